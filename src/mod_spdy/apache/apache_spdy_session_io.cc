@@ -14,7 +14,20 @@
 
 #include "mod_spdy/apache/apache_spdy_session_io.h"
 
+#if defined(__linux)
+#include <netinet/in.h>
+#include <netinet/tcp.h>  // for TCP_INFO
+#include <sys/socket.h>
+#endif
+
 #include "apr_buckets.h"
+#include "apr_portable.h"
+#include "http_config.h"
+// Temporarily define CORE_PRIVATE so we can see the declaration for
+// core_module (in http_core.h).
+#define CORE_PRIVATE
+#include "http_core.h"
+#undef CORE_PRIVATE
 #include "http_log.h"
 #include "util_filter.h"
 
@@ -22,7 +35,7 @@
 #include "base/logging.h"
 #include "mod_spdy/apache/pool_util.h"  // for AprStatusString
 #include "mod_spdy/common/protocol_util.h"  // for FrameData
-#include "net/spdy/buffered_spdy_framer.h"
+#include "mod_spdy/common/session_framer.h"
 #include "net/spdy/spdy_protocol.h"
 
 namespace mod_spdy {
@@ -50,7 +63,7 @@ bool ApacheSpdySessionIO::IsConnectionAborted() {
 }
 
 SpdySessionIO::ReadStatus ApacheSpdySessionIO::ProcessAvailableInput(
-    bool block, net::BufferedSpdyFramer* framer) {
+    bool block, SessionFramer* framer) {
   const apr_read_type_e read_type = block ? APR_BLOCK_READ : APR_NONBLOCK_READ;
 
   // Make sure the input brigade we're using is empty.
@@ -184,4 +197,28 @@ SpdySessionIO::WriteStatus ApacheSpdySessionIO::SendFrameRaw(
   }
 }
 
+bool ApacheSpdySessionIO::GetCongestionWindow(uint32* cwnd, uint32* mss) {
+#if defined(__linux) && defined(TCP_INFO)
+  // The core module keeps the connection's socket in its conn_config (this is
+  // the real TCP socket even when mod_ssl is in use).
+  apr_socket_t* socket = static_cast<apr_socket_t*>(
+      ap_get_module_config(connection_->conn_config, &core_module));
+  apr_os_sock_t fd;
+  if (socket == NULL || apr_os_sock_get(&fd, socket) != APR_SUCCESS) {
+    return false;
+  }
+  struct tcp_info info;
+  socklen_t length = sizeof(info);
+  if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) != 0) {
+    VLOG(2) << "getsockopt(TCP_INFO) failed";
+    return false;
+  }
+  *cwnd = info.tcpi_snd_cwnd;
+  *mss = info.tcpi_snd_mss;
+  return true;
+#else
+  return false;
+#endif
+}
+
 }  // namespace mod_spdy
@@ -21,12 +21,13 @@
 #include "mod_spdy/common/spdy_session_io.h"
 
 namespace net {
-class BufferedSpdyFramer;
 class SpdyFrame;
 }  // namespace net
 
 namespace mod_spdy {
 
+class SessionFramer;
+
 class ApacheSpdySessionIO : public SpdySessionIO {
  public:
   explicit ApacheSpdySessionIO(conn_rec* connection);
@@ -34,9 +35,9 @@ class ApacheSpdySessionIO : public SpdySessionIO {
 
   // SpdySessionIO methods:
   virtual bool IsConnectionAborted();
-  virtual ReadStatus ProcessAvailableInput(bool block,
-                                           net::BufferedSpdyFramer* framer);
+  virtual ReadStatus ProcessAvailableInput(bool block, SessionFramer* framer);
   virtual WriteStatus SendFrameRaw(const net::SpdySerializedFrame& frame);
+  virtual bool GetCongestionWindow(uint32* cwnd, uint32* mss);
 
  private:
   conn_rec* const connection_;
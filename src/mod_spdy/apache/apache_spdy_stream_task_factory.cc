@@ -14,6 +14,8 @@
 
 #include "mod_spdy/apache/apache_spdy_stream_task_factory.h"
 
+#include <new>
+
 #include "apr_buckets.h"
 #include "apr_network_io.h"
 #include "http_log.h"
@@ -41,6 +43,7 @@ namespace {
 // start-up (during which Apache is running single-threaded; see TAMB 2.2.1),
 // and are read-only thereafter.
 ap_filter_rec_t* gHttpToSpdyFilterHandle = NULL;
+ap_filter_rec_t* gSpdyHeaderFilterHandle = NULL;
 ap_filter_rec_t* gSpdyToHttpFilterHandle = NULL;
 
 // See TAMB 8.4.2
@@ -62,10 +65,20 @@ apr_status_t HttpToSpdyFilterFunc(ap_filter_t* filter,
   return http_to_spdy_filter->Write(filter, input_brigade);
 }
 
+// The filter function for our replacement for Apache's HTTP_HEADER filter.
+apr_status_t SpdyHeaderFilterFunc(ap_filter_t* filter,
+                                  apr_bucket_brigade* input_brigade) {
+  mod_spdy::HttpToSpdyFilter* http_to_spdy_filter =
+      static_cast<mod_spdy::HttpToSpdyFilter*>(filter->ctx);
+  return http_to_spdy_filter->WriteResponseHeaders(filter, input_brigade);
+}
+
 // A task to be returned by ApacheSpdyStreamTaskFactory::NewStreamTask().
 class ApacheStreamTask : public net_instaweb::Function {
  public:
-  // The task does not take ownership of the arguments.
+  // The task does not take ownership of the arguments.  When the task is
+  // deleted, it hands its slave connection back to the conn_factory to be
+  // recycled, so the conn_factory must outlive the task.
   ApacheStreamTask(SlaveConnectionFactory* conn_factory,
                    SpdyStream* stream);
   virtual ~ApacheStreamTask();
@@ -76,6 +89,7 @@ class ApacheStreamTask : public net_instaweb::Function {
   virtual void Cancel();
 
  private:
+  SlaveConnectionFactory* const conn_factory_;
   SpdyStream* const stream_;
   scoped_ptr<SlaveConnection> slave_connection_;
 
@@ -84,7 +98,8 @@ class ApacheStreamTask : public net_instaweb::Function {
 
 ApacheStreamTask::ApacheStreamTask(SlaveConnectionFactory* conn_factory,
                                    SpdyStream* stream)
-    : stream_(stream),
+    : conn_factory_(conn_factory),
+      stream_(stream),
       slave_connection_(conn_factory->Create()) {
   const SpdyServerConfig* config =
       GetServerConfig(slave_connection_->apache_connection());
@@ -94,19 +109,41 @@ ApacheStreamTask::ApacheStreamTask(SlaveConnectionFactory* conn_factory,
       slave_connection_->GetSlaveConnectionContext();
   slave_context->set_slave_stream(stream);
 
-  // Create our filters to hook us up to the slave connection.
-  SpdyToHttpFilter* spdy_to_http_filter = new SpdyToHttpFilter(stream);
-  PoolRegisterDelete(slave_connection_->apache_connection()->pool,
-                     spdy_to_http_filter);
+  // Create our filters to hook us up to the slave connection.  If configured
+  // to, and if the slave connection is able to make use of it, have the input
+  // filter build the request_rec directly from the SPDY headers.  The filters
+  // live in the slave connection's pool, which keeps its memory when the
+  // connection is recycled, so once a slave connection has been used, later
+  // streams on it don't need any heap allocations for them.
+  apr_pool_t* const pool = slave_connection_->apache_connection()->pool;
+  const bool build_request_directly =
+      config->build_requests_directly() &&
+      SlaveConnection::IsFastPathEnabled();
+  SpdyToHttpFilter* spdy_to_http_filter =
+      new (apr_palloc(pool, sizeof(SpdyToHttpFilter)))
+      SpdyToHttpFilter(stream, build_request_directly);
+  PoolRegisterDestroy(pool, spdy_to_http_filter);
   slave_context->SetInputFilter(gSpdyToHttpFilterHandle, spdy_to_http_filter);
+  if (build_request_directly) {
+    slave_context->set_direct_request_source(spdy_to_http_filter);
+  }
 
-  HttpToSpdyFilter* http_to_spdy_filter = new HttpToSpdyFilter(config, stream);
-  PoolRegisterDelete(slave_connection_->apache_connection()->pool,
-                     http_to_spdy_filter);
+  HttpToSpdyFilter* http_to_spdy_filter =
+      new (apr_palloc(pool, sizeof(HttpToSpdyFilter)))
+      HttpToSpdyFilter(config, stream);
+  PoolRegisterDestroy(pool, http_to_spdy_filter);
   slave_context->SetOutputFilter(gHttpToSpdyFilterHandle, http_to_spdy_filter);
+  if (config->build_responses_directly()) {
+    slave_context->SetResponseHeaderFilter(gSpdyHeaderFilterHandle,
+                                           http_to_spdy_filter);
+  }
 }
 
 ApacheStreamTask::~ApacheStreamTask() {
+  // Rather than deleting the slave connection, give it back to the factory so
+  // that a later stream can reuse it.  This also clears the connection's pool,
+  // destroying the filters we constructed in it above.
+  conn_factory_->Recycle(slave_connection_.release());
 }
 
 void ApacheStreamTask::Run() {
@@ -153,6 +190,16 @@ void ApacheSpdyStreamTaskFactory::InitFilters() {
       HttpToSpdyFilterFunc,       // filter function
       NULL,                       // init function (n/a in our case)
       AP_FTYPE_NETWORK);          // filter type
+
+  // Our replacement for HTTP_HEADER is a request-level filter, so like
+  // HTTP_HEADER it's a protocol filter.  It goes in the same place in the
+  // chain that HTTP_HEADER would have (see InsertRequestFilters in
+  // mod_spdy.cc).
+  gSpdyHeaderFilterHandle = ap_register_output_filter(
+      "SPDY_HEADER",              // name
+      SpdyHeaderFilterFunc,       // filter function
+      NULL,                       // init function (n/a in our case)
+      AP_FTYPE_PROTOCOL);         // filter type
 }
 
 net_instaweb::Function* ApacheSpdyStreamTaskFactory::NewStreamTask(
@@ -0,0 +1,155 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/apache/apache_spdy_stream_task_factory.h"
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <new>
+#include <vector>
+
+#include "apr_allocator.h"
+#include "apr_buckets.h"
+#include "apr_pools.h"
+#include "httpd.h"
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "base/stl_util.h"
+#include "mod_spdy/apache/filters/http_to_spdy_filter.h"
+#include "mod_spdy/apache/filters/spdy_to_http_filter.h"
+#include "mod_spdy/apache/pool_util.h"
+#include "mod_spdy/apache/slave_connection.h"
+#include "mod_spdy/common/protocol_util.h"
+#include "mod_spdy/common/spdy_frame_priority_queue.h"
+#include "mod_spdy/common/spdy_server_config.h"
+#include "mod_spdy/common/spdy_server_push_interface.h"
+#include "mod_spdy/common/spdy_session.h"
+#include "mod_spdy/common/spdy_stream.h"
+#include "net/instaweb/util/public/function.h"
+#include "net/spdy/spdy_protocol.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+#if defined(__GLIBC__)
+
+class NoPushInterface : public mod_spdy::SpdyServerPushInterface {
+ public:
+  NoPushInterface() {}
+  virtual ~NoPushInterface() {}
+  virtual PushStatus StartServerPush(
+      net::SpdyStreamId associated_stream_id,
+      int32 server_push_depth,
+      net::SpdyPriority priority,
+      const net::SpdyHeaderBlock& request_headers) {
+    return CANNOT_PUSH_EVER_AGAIN;
+  }
+ private:
+  DISALLOW_COPY_AND_ASSIGN(NoPushInterface);
+};
+
+// Return the number of bytes currently allocated with malloc (including by
+// APR, which gets the memory for its pools from malloc).
+size_t HeapBytesInUse() {
+  const struct mallinfo info = mallinfo();
+  return static_cast<size_t>(info.uordblks) +
+      static_cast<size_t>(info.hblkhd);
+}
+
+// Measure what each idle open stream costs, counting every allocation rather
+// than just the size of the SpdyStream.  For each stream, we build what
+// ApacheStreamTask and SlaveConnection build -- a long-lived pool holding the
+// conn_rec and a bucket allocator, a per-connection pool under it, and the
+// two filters, constructed in the per-connection pool -- and measure the heap
+// that all of that (and the SpdyStream) takes.  Slave connections are
+// recycled, and clearing a pool keeps its memory, so all of this stays
+// allocated between streams.  We can't create the ApacheStreamTask or the
+// SlaveConnection objects themselves (that takes a running httpd), nor the
+// session's wrapper task, so those are added in by size.
+TEST(ApacheSpdyStreamTaskFactoryTest, BytesPerIdleStream) {
+  const int kNumStreams = 100;
+  const mod_spdy::SpdyServerConfig config;
+  mod_spdy::SpdyFramePriorityQueue output_queue;
+  NoPushInterface pusher;
+
+  // Give the pools an allocator of their own, so that their memory comes
+  // fresh from malloc rather than from nodes that earlier tests freed.
+  apr_allocator_t* allocator = NULL;
+  ASSERT_EQ(APR_SUCCESS, apr_allocator_create(&allocator));
+  apr_pool_t* root_pool = NULL;
+  ASSERT_EQ(APR_SUCCESS,
+            apr_pool_create_ex(&root_pool, NULL, NULL, allocator));
+  apr_allocator_owner_set(allocator, root_pool);
+
+  std::vector<mod_spdy::SpdyStream*> streams;
+  streams.reserve(kNumStreams);
+  const size_t heap_bytes_before = HeapBytesInUse();
+  for (int i = 0; i < kNumStreams; ++i) {
+    mod_spdy::SpdyStream* stream = new mod_spdy::SpdyStream(
+        mod_spdy::spdy::SPDY_VERSION_3, 2 * i + 1, 0, 0, 0u,
+        net::kSpdyStreamInitialWindowSize, &output_queue, NULL, &pusher);
+    streams.push_back(stream);
+
+    apr_pool_t* pool = NULL;
+    ASSERT_EQ(APR_SUCCESS, apr_pool_create(&pool, root_pool));
+    apr_palloc(pool, sizeof(conn_rec));
+    apr_bucket_alloc_create(pool);
+    apr_pool_t* connection_pool = NULL;
+    ASSERT_EQ(APR_SUCCESS, apr_pool_create(&connection_pool, pool));
+
+    mod_spdy::SpdyToHttpFilter* spdy_to_http_filter =
+        new (apr_palloc(connection_pool, sizeof(mod_spdy::SpdyToHttpFilter)))
+        mod_spdy::SpdyToHttpFilter(stream, false);
+    mod_spdy::PoolRegisterDestroy(connection_pool, spdy_to_http_filter);
+    mod_spdy::HttpToSpdyFilter* http_to_spdy_filter =
+        new (apr_palloc(connection_pool, sizeof(mod_spdy::HttpToSpdyFilter)))
+        mod_spdy::HttpToSpdyFilter(&config, stream);
+    mod_spdy::PoolRegisterDestroy(connection_pool, http_to_spdy_filter);
+  }
+  const size_t measured_bytes =
+      (HeapBytesInUse() - heap_bytes_before) / kNumStreams;
+
+  // Destroying the pools destroys the filters, which refer to the streams.
+  apr_pool_destroy(root_pool);
+  STLDeleteElements(&streams);
+
+  // ApacheStreamTask is private to apache_spdy_stream_task_factory.cc; it is
+  // a Function holding three pointers.
+  const size_t unmeasured_bytes =
+      (mod_spdy::SpdySession::GetStreamTaskSizeForTest() -
+       sizeof(mod_spdy::SpdyStream)) +
+      sizeof(net_instaweb::Function) + 3 * sizeof(void*) +
+      sizeof(mod_spdy::SlaveConnection);
+  const size_t total_bytes = measured_bytes + unmeasured_bytes;
+
+  LOG(INFO) << "Bytes per idle open stream: " << total_bytes << " ("
+            << measured_bytes << " measured for the SpdyStream, filters and "
+            << "pools, of which the SpdyStream is "
+            << sizeof(mod_spdy::SpdyStream) << "; " << unmeasured_bytes
+            << " by size for the task objects and the SlaveConnection)";
+
+  // The APR pools dominate: each one takes a node of at least 8 KB when it is
+  // created, and so does the bucket allocator.  Make sure that nothing else
+  // adds much on top of that, and that none of it creeps up.
+  EXPECT_GE(total_bytes, 3 * 8192u);
+  EXPECT_LE(total_bytes, 32 * 1024u);
+  EXPECT_LE(sizeof(mod_spdy::SpdyStream), 400u);
+}
+
+#endif  // defined(__GLIBC__)
+
+}  // namespace
@@ -98,9 +98,11 @@ const char* SetUseSpdyForNonSslConnections(cmd_parms* cmd, void* dir,
     value = spdy::SPDY_VERSION_3;
   } else if (0 == apr_strnatcasecmp(arg, "3.1")) {
     value = spdy::SPDY_VERSION_3_1;
+  } else if (0 == apr_strnatcasecmp(arg, "h2")) {
+    value = spdy::SPDY_VERSION_HTTP2;
   } else {
     return apr_pstrcat(cmd->pool, cmd->cmd->name,
-                       " must be 2, 3, 3.1, or off", NULL);
+                       " must be 2, 3, 3.1, h2, or off", NULL);
   }
   GetServerConfig(cmd)->set_use_spdy_version_without_ssl(value);
   return NULL;
@@ -147,6 +149,23 @@ const command_rec kSpdyConfigCommands[] = {
       GlobalOnly<SetPositiveInt<
         &SpdyServerConfig::set_max_threads_per_process> >,
       "Maximum number of worker threads to spawn per child process"),
+  SPDY_CONFIG_COMMAND(
+      "SpdyMinThreadsPerVirtualHost",
+      SetPositiveInt<&SpdyServerConfig::set_min_threads_per_virtual_host>,
+      "Minimum number of worker threads to spawn per child process for this "
+      "virtual host's own thread pool"),
+  SPDY_CONFIG_COMMAND(
+      "SpdyMaxThreadsPerVirtualHost",
+      SetNonNegativeInt<&SpdyServerConfig::set_max_threads_per_virtual_host>,
+      "Maximum number of worker threads to spawn per child process for this "
+      "virtual host's own thread pool; 0 (the default) means use the shared "
+      "per-process thread pool"),
+  SPDY_CONFIG_COMMAND(
+      "SpdyMaxStreamsPerProcess",
+      GlobalOnly<SetNonNegativeInt<
+        &SpdyServerConfig::set_max_streams_per_process> >,
+      "Maximum number of simultaneous SPDY streams per child process, "
+      "across all connections; 0 (the default) means no limit"),
   SPDY_CONFIG_COMMAND(
       "SpdyMaxServerPushDepth",
       SetNonNegativeInt<
@@ -156,6 +175,20 @@ const command_rec kSpdyConfigCommands[] = {
       "SpdySendVersionHeader",
       SetBoolean<&SpdyServerConfig::set_send_version_header>,
       "Send an x-mod-spdy header with the module version number"),
+  SPDY_CONFIG_COMMAND(
+      "SpdyBuildRequestsDirectly",
+      SetBoolean<&SpdyServerConfig::set_build_requests_directly>,
+      "Fill in Apache's request record directly from the SPDY headers, "
+      "rather than having Apache parse them as HTTP/1.1 text"),
+  SPDY_CONFIG_COMMAND(
+      "SpdyBuildResponsesDirectly",
+      SetBoolean<&SpdyServerConfig::set_build_responses_directly>,
+      "Build SPDY replies directly from Apache's request record, rather than "
+      "parsing the HTTP/1.1 text that Apache would serialize"),
+  SPDY_CONFIG_COMMAND(
+      "SpdyEnableHttp2",
+      SetBoolean<&SpdyServerConfig::set_http2_enabled>,
+      "Offer HTTP/2 (h2) to clients during NPN, in preference to SPDY"),
   SPDY_CONFIG_COMMAND(
       "SpdyServerPushDiscoveryEnabled",
       SetBoolean<&SpdyServerConfig::set_server_push_discovery_enabled>,
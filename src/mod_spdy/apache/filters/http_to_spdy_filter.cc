@@ -46,10 +46,21 @@
 
 #include "mod_spdy/apache/filters/http_to_spdy_filter.h"
 
+#include <cstring>  // for strchr
+
 #include "apr_strings.h"
+#include "apr_tables.h"
+#include "apr_time.h"
+#include "httpd.h"
+#include "http_protocol.h"
+#include "http_request.h"
 
 #include "base/logging.h"
+#include "base/memory/ref_counted.h"
+#include "mod_spdy/apache/mapped_file_region.h"
 #include "mod_spdy/apache/pool_util.h"  // for AprStatusString
+#include "mod_spdy/common/header_block.h"
+#include "mod_spdy/common/http_response_visitor_interface.h"
 #include "mod_spdy/common/protocol_util.h"
 #include "mod_spdy/common/spdy_server_config.h"
 #include "mod_spdy/common/spdy_stream.h"
@@ -60,6 +71,34 @@ namespace {
 
 const char* kModSpdyVersion = MOD_SPDY_VERSION_STRING "-" LASTCHANGE_STRING;
 
+// FILE buckets smaller than this aren't worth mapping into memory; copying a
+// few KB is cheaper than the mmap/munmap calls.  We map at most
+// kMaxMappedBytes of a file at a time, so that a huge file doesn't tie up a
+// huge amount of address space while we wait on flow control.  (These match
+// APR_MMAP_THRESHOLD and APR_MMAP_LIMIT, which APR uses for the same purpose
+// when reading FILE buckets.)
+const apr_size_t kMinMappedBytes = 8 * 1024;
+const apr_size_t kMaxMappedBytes = 4 * 1024 * 1024;
+
+// Callback for apr_table_do, passing each response header to the converter.
+int AddResponseHeader(void* visitor, const char* key, const char* value) {
+  static_cast<mod_spdy::HttpResponseVisitorInterface*>(visitor)->
+      OnLeadingHeader(key, value);
+  return 1;  // keep going
+}
+
+// Set a header to the given value, unless this is a proxy request and the
+// header was already set by the origin server; this is what
+// ap_basic_http_header (in http_filters.c in Apache) does for Date and
+// Server.
+void SetBasicHeader(request_rec* request, const char* key,
+                    const char* value) {
+  if (request->proxyreq == PROXYREQ_NONE ||
+      apr_table_get(request->headers_out, key) == NULL) {
+    apr_table_setn(request->headers_out, key, value);
+  }
+}
+
 }  // namespace
 
 namespace mod_spdy {
@@ -68,7 +107,13 @@ HttpToSpdyFilter::HttpToSpdyFilter(const SpdyServerConfig* config,
                                    SpdyStream* stream)
     : receiver_(config, stream),
       converter_(stream->spdy_version(), &receiver_),
-      eos_bucket_received_(false) {}
+      eos_bucket_received_(false),
+      sent_headers_directly_(false),
+      sent_direct_fin_(false) {
+  if (stream->target_data_frame_size() != 0u) {
+    converter_.set_target_data_frame_size(stream->target_data_frame_size());
+  }
+}
 
 HttpToSpdyFilter::~HttpToSpdyFilter() {}
 
@@ -124,7 +169,16 @@ apr_status_t HttpToSpdyFilter::Write(ap_filter_t* filter,
         // EOS bucket -- there should be no more data buckets in this stream.
         eos_bucket_received_ = true;
         RETURN_IF_STREAM_ABORT(filter);
-        converter_.Flush();
+        if (sent_headers_directly_) {
+          // There's no chunked encoding or Content-Length for the parser to
+          // tell us where the response ends, so the EOS is our only cue.
+          if (!sent_direct_fin_) {
+            sent_direct_fin_ = true;
+            converter_.direct_visitor()->OnData(base::StringPiece(), true);
+          }
+        } else {
+          converter_.Flush();
+        }
       } else if (APR_BUCKET_IS_FLUSH(bucket)) {
         // FLUSH bucket -- call Send() immediately and flush the data buffer.
         RETURN_IF_STREAM_ABORT(filter);
@@ -139,6 +193,10 @@ apr_status_t HttpToSpdyFilter::Write(ap_filter_t* filter,
       // after the EOS).  If we do get them, ignore them.
       LOG(INFO) << "HttpToSpdyFilter received " << bucket->type->name
                 << " bucket after an EOS (and ignored it).";
+    } else if (SendFileBucketMapped(bucket)) {
+      // We sent this bucket's data straight out of a memory mapping of the
+      // file, so there's nothing to read.
+      RETURN_IF_STREAM_ABORT(filter);
     } else {
       // Data bucket -- get ready to read.
       const char* data = NULL;
@@ -149,7 +207,7 @@ apr_status_t HttpToSpdyFilter::Write(ap_filter_t* filter,
                                             APR_NONBLOCK_READ);
       if (status == APR_SUCCESS) {
         RETURN_IF_STREAM_ABORT(filter);
-        if (!converter_.ProcessInput(data, static_cast<size_t>(data_length))) {
+        if (!ProcessData(data, static_cast<size_t>(data_length))) {
           // Parse failure.  The parser will have already logged an error.
           return APR_EGENERAL;
         }
@@ -167,7 +225,7 @@ apr_status_t HttpToSpdyFilter::Write(ap_filter_t* filter,
           return status;  // failure
         }
         RETURN_IF_STREAM_ABORT(filter);
-        if (!converter_.ProcessInput(data, static_cast<size_t>(data_length))) {
+        if (!ProcessData(data, static_cast<size_t>(data_length))) {
           // Parse failure.  The parser will have already logged an error.
           return APR_EGENERAL;
         }
@@ -189,6 +247,147 @@ apr_status_t HttpToSpdyFilter::Write(ap_filter_t* filter,
   return APR_SUCCESS;
 }
 
+apr_status_t HttpToSpdyFilter::WriteResponseHeaders(
+    ap_filter_t* filter, apr_bucket_brigade* input_brigade) {
+  request_rec* const request = filter->r;
+  DCHECK(request != NULL);
+  DCHECK(!sent_headers_directly_);
+
+  // Like HTTP_HEADER, if the brigade has an error bucket in it, discard the
+  // output and have Apache generate an error response instead (which will
+  // pass back through this filter).
+  for (apr_bucket* bucket = APR_BRIGADE_FIRST(input_brigade);
+       bucket != APR_BRIGADE_SENTINEL(input_brigade);
+       bucket = APR_BUCKET_NEXT(bucket)) {
+    if (AP_BUCKET_IS_ERROR(bucket)) {
+      const int status = static_cast<ap_bucket_error*>(bucket->data)->status;
+      apr_brigade_cleanup(input_brigade);
+      ap_die(status, request);
+      return AP_FILTER_ERROR;
+    }
+  }
+
+  // Gather up the response headers the way HTTP_HEADER (see
+  // ap_http_header_filter in http_filters.c in Apache) would before
+  // serializing them.
+  apr_pool_t* const pool = request->pool;
+  if (!apr_is_empty_table(request->err_headers_out)) {
+    request->headers_out = apr_table_overlay(pool, request->err_headers_out,
+                                             request->headers_out);
+  }
+  if (request->content_type != NULL) {
+    apr_table_setn(request->headers_out, "Content-Type",
+                   ap_make_content_type(request, request->content_type));
+  }
+  if (request->content_encoding != NULL) {
+    apr_table_setn(request->headers_out, "Content-Encoding",
+                   request->content_encoding);
+  }
+  if (request->content_languages != NULL &&
+      request->content_languages->nelts > 0) {
+    apr_table_setn(request->headers_out, "Content-Language",
+                   apr_array_pstrcat(pool, request->content_languages, ','));
+  }
+  char* date = static_cast<char*>(apr_palloc(pool, APR_RFC822_DATE_LEN));
+  apr_rfc822_date(date, request->request_time);
+  SetBasicHeader(request, "Date", date);
+  SetBasicHeader(request, "Server", ap_get_server_banner());
+  if (request->no_cache &&
+      apr_table_get(request->headers_out, "Expires") == NULL) {
+    apr_table_addn(request->headers_out, "Expires", date);
+  }
+
+  RETURN_IF_STREAM_ABORT(filter);
+
+  // Send the SYN_REPLY.  If the response can't have a body, we can set
+  // FLAG_FIN on it, and Write() will drop whatever body the handler produces.
+  const char* status_line = ap_get_status_line(request->status);
+  const char* status_phrase = strchr(status_line, ' ');
+  HttpResponseVisitorInterface* visitor = converter_.direct_visitor();
+  visitor->OnStatusLine("HTTP/1.1", apr_itoa(pool, request->status),
+                        (status_phrase == NULL ? "" : status_phrase + 1));
+  if (request->status == HTTP_NOT_MODIFIED) {
+    // Like ap_http_header_filter, send only the headers that RFC 2616 allows
+    // (or that are harmless) on a 304, along with the Date and Server headers
+    // that ap_basic_http_header would have sent.
+    apr_table_do(AddResponseHeader, visitor, request->headers_out,
+                 "Connection", "Keep-Alive", "ETag", "Content-Location",
+                 "Expires", "Cache-Control", "Vary", "Warning",
+                 "WWW-Authenticate", "Proxy-Authenticate", "Set-Cookie",
+                 "Set-Cookie2", "Date", "Server", NULL);
+  } else {
+    apr_table_do(AddResponseHeader, visitor, request->headers_out, NULL);
+  }
+  const bool fin = (request->header_only ||
+                    request->status == HTTP_NO_CONTENT ||
+                    request->status == HTTP_NOT_MODIFIED);
+  visitor->OnLeadingHeadersComplete(fin);
+  sent_headers_directly_ = true;
+  sent_direct_fin_ = fin;
+  // Whatever follows is the real response body (this is what tells Apache
+  // that the headers have been sent).
+  request->sent_bodyct = 1;
+
+  // We don't need to look at the body, so get out of the way.
+  ap_remove_output_filter(filter);
+  return ap_pass_brigade(filter->next, input_brigade);
+}
+
+bool HttpToSpdyFilter::ProcessData(const char* data, size_t size) {
+  if (!sent_headers_directly_) {
+    return converter_.ProcessInput(data, size);
+  }
+  // If we already sent FLAG_FIN with the headers (e.g. for a HEAD request),
+  // the body is simply dropped.
+  if (!sent_direct_fin_) {
+    converter_.direct_visitor()->OnData(base::StringPiece(data, size), false);
+  }
+  return true;
+}
+
+bool HttpToSpdyFilter::SendFileBucketMapped(apr_bucket* bucket) {
+#if APR_HAS_MMAP
+  if (!APR_BUCKET_IS_FILE(bucket) || sent_direct_fin_ ||
+      bucket->length == static_cast<apr_size_t>(-1) ||
+      bucket->length < kMinMappedBytes) {
+    return false;
+  }
+  // The default handler turns off can_mmap if the EnableMMAP directive is off
+  // for this file (e.g. because it's on a network filesystem), in which case
+  // we must leave it alone.  Note that, as with EnableMMAP, if the file is
+  // truncated while we're sending it, reading the mapping will crash.
+  apr_bucket_file* file_data = static_cast<apr_bucket_file*>(bucket->data);
+  if (!file_data->can_mmap) {
+    return false;
+  }
+  if (bucket->length > kMaxMappedBytes) {
+    // The rest of the file becomes the next bucket in the brigade.
+    apr_bucket_split(bucket, kMaxMappedBytes);
+  }
+  // Unless we sent the headers directly, the converter is parsing HTTP, so we
+  // can only skip the parser if it knows this data is all response body (as
+  // it is for a static file, whether or not it's being chunked).
+  if (!sent_headers_directly_ &&
+      converter_.GetPendingBodyBytes() < bucket->length) {
+    return false;
+  }
+
+  scoped_refptr<MappedFileRegion> region(MappedFileRegion::Create(
+      file_data->fd, bucket->start, bucket->length));
+  if (region.get() == NULL) {
+    return false;
+  }
+  if (sent_headers_directly_) {
+    converter_.SendBackedBodyData(region->data(), region.get());
+  } else {
+    converter_.ProcessBackedBodyData(region->data(), region.get());
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
 HttpToSpdyFilter::ReceiverImpl::ReceiverImpl(const SpdyServerConfig* config,
                                              SpdyStream* stream)
     : config_(config), stream_(stream) {
@@ -199,10 +398,10 @@ HttpToSpdyFilter::ReceiverImpl::ReceiverImpl(const SpdyServerConfig* config,
 HttpToSpdyFilter::ReceiverImpl::~ReceiverImpl() {}
 
 void HttpToSpdyFilter::ReceiverImpl::ReceiveSynReply(
-    net::SpdyHeaderBlock* headers, bool flag_fin) {
+    HeaderBlock* headers, bool flag_fin) {
   DCHECK(headers);
   if (config_->send_version_header()) {
-    (*headers)[http::kXModSpdy] = kModSpdyVersion;
+    headers->Set(http::kXModSpdy, kModSpdyVersion);
   }
   // For client-requested streams, we should send a SYN_REPLY.  For
   // server-pushed streams, the SpdySession has already sent an initial
@@ -220,4 +419,9 @@ void HttpToSpdyFilter::ReceiverImpl::ReceiveData(
   stream_->SendOutputDataFrame(data, flag_fin);
 }
 
+void HttpToSpdyFilter::ReceiverImpl::ReceiveBackedData(
+    base::StringPiece data, bool flag_fin, DataFrameBacking* backing) {
+  stream_->SendOutputBackedDataFrame(data, flag_fin, backing);
+}
+
 }  // namespace mod_spdy
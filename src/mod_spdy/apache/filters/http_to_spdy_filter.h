@@ -53,13 +53,23 @@ class HttpToSpdyFilter {
   // process.
   apr_status_t Write(ap_filter_t* filter, apr_bucket_brigade* input_brigade);
 
+  // The filter function for an optional request-level filter that takes the
+  // place of Apache's HTTP_HEADER filter.  Rather than have Apache serialize
+  // the response status and headers to text (and chunk the body) only for us
+  // to parse them again, this sends the SYN_REPLY straight from the
+  // request_rec, and lets the body through to Write() unchunked.
+  apr_status_t WriteResponseHeaders(ap_filter_t* filter,
+                                    apr_bucket_brigade* input_brigade);
+
  private:
   class ReceiverImpl : public HttpToSpdyConverter::SpdyReceiver {
    public:
     ReceiverImpl(const SpdyServerConfig* config, SpdyStream* stream);
     virtual ~ReceiverImpl();
-    virtual void ReceiveSynReply(net::SpdyHeaderBlock* headers, bool flag_fin);
+    virtual void ReceiveSynReply(HeaderBlock* headers, bool flag_fin);
     virtual void ReceiveData(base::StringPiece data, bool flag_fin);
+    virtual void ReceiveBackedData(base::StringPiece data, bool flag_fin,
+                                   DataFrameBacking* backing);
 
    private:
     friend class HttpToSpdyFilter;
@@ -69,9 +79,27 @@ class HttpToSpdyFilter {
     DISALLOW_COPY_AND_ASSIGN(ReceiverImpl);
   };
 
+  // Pass response body data to the converter, either as HTTP text to be
+  // parsed or, if the headers were sent by WriteResponseHeaders, as raw body
+  // data.  Returns false if parsing fails.
+  bool ProcessData(const char* data, size_t size);
+
+  // If the given bucket is a FILE bucket holding response body data, map (the
+  // first part of) the file into memory and send DATA frames that point into
+  // the mapping, rather than reading the file onto the heap, and return true.
+  // Otherwise, do nothing and return false; the bucket should then be read as
+  // usual.  This may split the bucket if it is very large.
+  bool SendFileBucketMapped(apr_bucket* bucket);
+
   ReceiverImpl receiver_;
   HttpToSpdyConverter converter_;
   bool eos_bucket_received_;
+  // True if WriteResponseHeaders has sent the response headers, so the data
+  // we receive is just the response body.
+  bool sent_headers_directly_;
+  // True if we've sent FLAG_FIN for a response whose headers were sent by
+  // WriteResponseHeaders, so any further body data must be dropped.
+  bool sent_direct_fin_;
 
   DISALLOW_COPY_AND_ASSIGN(HttpToSpdyFilter);
 };
@@ -18,12 +18,17 @@
 
 #include "httpd.h"
 #include "apr_buckets.h"
+#include "apr_file_io.h"
+#include "apr_strings.h"
 #include "apr_tables.h"
+#include "http_protocol.h"
 #include "util_filter.h"
 
+#include "base/basictypes.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/string_piece.h"
 #include "mod_spdy/apache/pool_util.h"
+#include "mod_spdy/apache/testing/dummy_httpd.h"
 #include "mod_spdy/common/protocol_util.h"
 #include "mod_spdy/common/shared_flow_control_window.h"
 #include "mod_spdy/common/spdy_frame_priority_queue.h"
@@ -72,7 +77,68 @@ class HttpToSpdyFilterTest :
     ap_filter_->c = connection_;
   }
 
+  virtual ~HttpToSpdyFilterTest() {
+    mod_spdy::testing::ResetDummyHttpdForTest();
+  }
+
  protected:
+  // Make a bare request record with the given status, for
+  // WriteResponseHeaders to send the headers of.  The request time is the
+  // epoch, so that the Date header is predictable.
+  request_rec* MakeRequest(int status) {
+    request_rec* request = static_cast<request_rec*>(
+        apr_pcalloc(local_.pool(), sizeof(request_rec)));
+    request->pool = local_.pool();
+    request->connection = connection_;
+    request->status = status;
+    request->headers_out = apr_table_make(local_.pool(), 5);
+    request->err_headers_out = apr_table_make(local_.pool(), 5);
+    ap_filter_->r = request;
+    return request;
+  }
+
+  // The SPDY headers that WriteResponseHeaders should send for a request from
+  // MakeRequest, before any headers the test adds.
+  net::SpdyHeaderBlock DirectResponseHeaders(const char* status) {
+    net::SpdyHeaderBlock headers;
+    headers["date"] = "Thu, 01 Jan 1970 00:00:00 GMT";
+    headers["server"] = "Apache";
+    headers[status_header_name()] = status;
+    headers[version_header_name()] = "HTTP/1.1";
+    headers[mod_spdy::http::kXModSpdy] =
+        MOD_SPDY_VERSION_STRING "-" LASTCHANGE_STRING;
+    return headers;
+  }
+
+  // Create a temporary file (deleted when the pool is cleaned up) holding the
+  // given contents.
+  apr_file_t* MakeTempFile(const std::string& contents) {
+    const char* temp_dir = NULL;
+    apr_file_t* file = NULL;
+    EXPECT_EQ(APR_SUCCESS, apr_temp_dir_get(&temp_dir, local_.pool()));
+    char* path = apr_pstrcat(local_.pool(), temp_dir,
+                             "/http_to_spdy_filter_test.XXXXXX", NULL);
+    EXPECT_EQ(APR_SUCCESS, apr_file_mktemp(
+        &file, path, APR_FOPEN_CREATE | APR_FOPEN_READ | APR_FOPEN_WRITE |
+        APR_FOPEN_EXCL | APR_FOPEN_DELONCLOSE, local_.pool()));
+    OverwriteFile(file, 0, contents);
+    return file;
+  }
+
+  void OverwriteFile(apr_file_t* file, apr_off_t offset,
+                     const std::string& data) {
+    apr_size_t written = 0;
+    ASSERT_EQ(APR_SUCCESS, apr_file_seek(file, APR_SET, &offset));
+    ASSERT_EQ(APR_SUCCESS, apr_file_write_full(
+        file, data.data(), data.size(), &written));
+    ASSERT_EQ(APR_SUCCESS, apr_file_flush(file));
+  }
+
+  void AddFileBucket(apr_file_t* file, apr_off_t offset, apr_size_t length) {
+    APR_BRIGADE_INSERT_TAIL(brigade_, apr_bucket_file_create(
+        file, offset, length, local_.pool(), bucket_alloc_));
+  }
+
   void AddHeapBucket(base::StringPiece str) {
     APR_BRIGADE_INSERT_TAIL(brigade_, apr_bucket_heap_create(
         str.data(), str.size(), NULL, bucket_alloc_));
@@ -519,6 +585,256 @@ TEST_P(HttpToSpdyFilterTest, DoNotSendVersionHeaderWhenAskedNotTo) {
   ExpectOutputQueueEmpty();
 }
 
+TEST_P(HttpToSpdyFilterTest, DirectResponseEndsAtEos) {
+  mod_spdy::SpdyStream stream(
+      spdy_version_, 1, 0, 0, 0, net::kSpdyStreamInitialWindowSize,
+      &output_queue_, &shared_window_, &pusher_);
+  mod_spdy::SpdyServerConfig config;
+  mod_spdy::HttpToSpdyFilter http_to_spdy_filter(&config, &stream);
+
+  // Send the headers straight from the request record.  The response has no
+  // Content-Length, so the SYN_REPLY can't have FLAG_FIN.
+  request_rec* request = MakeRequest(HTTP_OK);
+  request->content_type = "text/plain";
+  ASSERT_EQ(APR_SUCCESS, http_to_spdy_filter.WriteResponseHeaders(
+      ap_filter_, brigade_));
+  net::SpdyHeaderBlock expected_headers = DirectResponseHeaders("200");
+  expected_headers[mod_spdy::http::kContentType] = "text/plain";
+  ExpectSynReply(1, expected_headers, false);
+  ExpectOutputQueueEmpty();
+
+  // The body passes through unparsed, so there's nothing to tell us it has
+  // ended until the EOS bucket, which should produce the FLAG_FIN.
+  AddImmortalBucket("Hello, world!\n");
+  ASSERT_EQ(APR_SUCCESS, WriteBrigade(&http_to_spdy_filter));
+  EXPECT_TRUE(APR_BRIGADE_EMPTY(brigade_));
+  ExpectOutputQueueEmpty();
+  AddEosBucket();
+  ASSERT_EQ(APR_SUCCESS, WriteBrigade(&http_to_spdy_filter));
+  EXPECT_TRUE(APR_BRIGADE_EMPTY(brigade_));
+  ExpectDataFrame(1, "Hello, world!\n", true);
+  ExpectOutputQueueEmpty();
+}
+
+TEST_P(HttpToSpdyFilterTest, DirectResponseWithErrorBucket) {
+  mod_spdy::SpdyStream stream(
+      spdy_version_, 1, 0, 0, 0, net::kSpdyStreamInitialWindowSize,
+      &output_queue_, &shared_window_, &pusher_);
+  mod_spdy::SpdyServerConfig config;
+  mod_spdy::HttpToSpdyFilter http_to_spdy_filter(&config, &stream);
+
+  // If the brigade has an error bucket in it, the output should be discarded
+  // and the error passed to ap_die, without anything being sent.
+  MakeRequest(HTTP_OK);
+  APR_BRIGADE_INSERT_TAIL(brigade_, ap_bucket_error_create(
+      HTTP_BAD_GATEWAY, NULL, local_.pool(), bucket_alloc_));
+  AddImmortalBucket("junk");
+  AddEosBucket();
+  EXPECT_EQ(AP_FILTER_ERROR, http_to_spdy_filter.WriteResponseHeaders(
+      ap_filter_, brigade_));
+  EXPECT_TRUE(APR_BRIGADE_EMPTY(brigade_));
+  EXPECT_EQ(HTTP_BAD_GATEWAY, mod_spdy::testing::GetLastApDieStatusForTest());
+  ExpectOutputQueueEmpty();
+}
+
+TEST_P(HttpToSpdyFilterTest, DirectResponseToHeadRequest) {
+  mod_spdy::SpdyStream stream(
+      spdy_version_, 1, 0, 0, 0, net::kSpdyStreamInitialWindowSize,
+      &output_queue_, &shared_window_, &pusher_);
+  mod_spdy::SpdyServerConfig config;
+  mod_spdy::HttpToSpdyFilter http_to_spdy_filter(&config, &stream);
+
+  // The SYN_REPLY should have FLAG_FIN set, and any body the handler
+  // produces anyway should be dropped.
+  request_rec* request = MakeRequest(HTTP_OK);
+  request->header_only = 1;
+  apr_table_setn(request->headers_out, "Content-Length", "14");
+  ASSERT_EQ(APR_SUCCESS, http_to_spdy_filter.WriteResponseHeaders(
+      ap_filter_, brigade_));
+  net::SpdyHeaderBlock expected_headers = DirectResponseHeaders("200");
+  expected_headers[mod_spdy::http::kContentLength] = "14";
+  ExpectSynReply(1, expected_headers, true);
+  ExpectOutputQueueEmpty();
+
+  AddImmortalBucket("Hello, world!\n");
+  AddEosBucket();
+  ASSERT_EQ(APR_SUCCESS, WriteBrigade(&http_to_spdy_filter));
+  EXPECT_TRUE(APR_BRIGADE_EMPTY(brigade_));
+  ExpectOutputQueueEmpty();
+}
+
+TEST_P(HttpToSpdyFilterTest, DirectNoContentResponse) {
+  mod_spdy::SpdyStream stream(
+      spdy_version_, 1, 0, 0, 0, net::kSpdyStreamInitialWindowSize,
+      &output_queue_, &shared_window_, &pusher_);
+  mod_spdy::SpdyServerConfig config;
+  mod_spdy::HttpToSpdyFilter http_to_spdy_filter(&config, &stream);
+
+  MakeRequest(HTTP_NO_CONTENT);
+  ASSERT_EQ(APR_SUCCESS, http_to_spdy_filter.WriteResponseHeaders(
+      ap_filter_, brigade_));
+  ExpectSynReply(1, DirectResponseHeaders("204"), true);
+  ExpectOutputQueueEmpty();
+
+  AddImmortalBucket("junk");
+  AddEosBucket();
+  ASSERT_EQ(APR_SUCCESS, WriteBrigade(&http_to_spdy_filter));
+  EXPECT_TRUE(APR_BRIGADE_EMPTY(brigade_));
+  ExpectOutputQueueEmpty();
+}
+
+TEST_P(HttpToSpdyFilterTest, DirectNotModifiedResponse) {
+  mod_spdy::SpdyStream stream(
+      spdy_version_, 1, 0, 0, 0, net::kSpdyStreamInitialWindowSize,
+      &output_queue_, &shared_window_, &pusher_);
+  mod_spdy::SpdyServerConfig config;
+  mod_spdy::HttpToSpdyFilter http_to_spdy_filter(&config, &stream);
+
+  // Only the headers that ap_http_header_filter allows on a 304 should be
+  // sent; in particular, the entity headers should not.
+  request_rec* request = MakeRequest(HTTP_NOT_MODIFIED);
+  request->content_type = "text/html";
+  apr_table_setn(request->headers_out, "Content-Length", "1234");
+  apr_table_setn(request->headers_out, "ETag", "\"abc\"");
+  apr_table_setn(request->headers_out, "X-Foo", "bar");
+  apr_table_setn(request->err_headers_out, "Cache-Control", "max-age=60");
+  ASSERT_EQ(APR_SUCCESS, http_to_spdy_filter.WriteResponseHeaders(
+      ap_filter_, brigade_));
+  net::SpdyHeaderBlock expected_headers = DirectResponseHeaders("304");
+  expected_headers["cache-control"] = "max-age=60";
+  expected_headers["etag"] = "\"abc\"";
+  ExpectSynReply(1, expected_headers, true);
+  ExpectOutputQueueEmpty();
+
+  AddImmortalBucket("junk");
+  AddEosBucket();
+  ASSERT_EQ(APR_SUCCESS, WriteBrigade(&http_to_spdy_filter));
+  EXPECT_TRUE(APR_BRIGADE_EMPTY(brigade_));
+  ExpectOutputQueueEmpty();
+}
+
+#if APR_HAS_MMAP
+
+// The file mappings are shared, so by overwriting the file after the filter
+// has returned, but before we look at the DATA frames, we can tell whether
+// the frames point into a mapping of the file, or hold a copy of its data.
+
+TEST_P(HttpToSpdyFilterTest, FileBucketSentMapped) {
+  mod_spdy::SpdyStream stream(
+      spdy_version_, 1, 0, 0, 0, net::kSpdyStreamInitialWindowSize,
+      &output_queue_, &shared_window_, &pusher_);
+  mod_spdy::SpdyServerConfig config;
+  mod_spdy::HttpToSpdyFilter http_to_spdy_filter(&config, &stream);
+
+  apr_file_t* file = MakeTempFile(std::string(10000, 'a'));
+  AddImmortalBucket("HTTP/1.1 200 OK\r\n"
+                    "Content-Length: 10000\r\n"
+                    "\r\n");
+  AddFileBucket(file, 0, 10000);
+  AddEosBucket();
+  ASSERT_EQ(APR_SUCCESS, WriteBrigade(&http_to_spdy_filter));
+  EXPECT_TRUE(APR_BRIGADE_EMPTY(brigade_));
+  OverwriteFile(file, 0, std::string(10000, 'b'));
+
+  net::SpdyHeaderBlock expected_headers;
+  expected_headers[mod_spdy::http::kContentLength] = "10000";
+  expected_headers[status_header_name()] = "200";
+  expected_headers[version_header_name()] = "HTTP/1.1";
+  expected_headers[mod_spdy::http::kXModSpdy] =
+      MOD_SPDY_VERSION_STRING "-" LASTCHANGE_STRING;
+  ExpectSynReply(1, expected_headers, false);
+  ExpectDataFrame(1, std::string(4096, 'b'), false);
+  ExpectDataFrame(1, std::string(4096, 'b'), false);
+  ExpectDataFrame(1, std::string(1808, 'b'), true);
+  ExpectOutputQueueEmpty();
+}
+
+TEST_P(HttpToSpdyFilterTest, LargeFileBucketSplitForMapping) {
+  // Use flow control windows big enough that we never block, and a frame
+  // size that doesn't divide 4 MB, so that the end of each mapping shows up
+  // as a short DATA frame.
+  mod_spdy::SharedFlowControlWindow shared_window(kint32max, kint32max);
+  mod_spdy::SpdyStream stream(
+      spdy_version_, 1, 0, 0, 0, kint32max, &output_queue_, &shared_window,
+      &pusher_);
+  stream.set_target_data_frame_size(3000);
+  mod_spdy::SpdyServerConfig config;
+  mod_spdy::HttpToSpdyFilter http_to_spdy_filter(&config, &stream);
+
+  const size_t kMappingSize = 4 * 1024 * 1024;
+  const size_t kFileSize = kMappingSize + 10000;
+  std::string contents;
+  contents.reserve(kFileSize);
+  for (size_t i = 0; i < kFileSize; ++i) {
+    contents.push_back(static_cast<char>('a' + i % 23));
+  }
+  apr_file_t* file = MakeTempFile(contents);
+  AddImmortalBucket("HTTP/1.1 200 OK\r\n"
+                    "Content-Length: 4204304\r\n"
+                    "\r\n");
+  AddFileBucket(file, 0, kFileSize);
+  AddEosBucket();
+  ASSERT_EQ(APR_SUCCESS, WriteBrigade(&http_to_spdy_filter));
+  EXPECT_TRUE(APR_BRIGADE_EMPTY(brigade_));
+
+  net::SpdyHeaderBlock expected_headers;
+  expected_headers[mod_spdy::http::kContentLength] = "4204304";
+  expected_headers[status_header_name()] = "200";
+  expected_headers[version_header_name()] = "HTTP/1.1";
+  expected_headers[mod_spdy::http::kXModSpdy] =
+      MOD_SPDY_VERSION_STRING "-" LASTCHANGE_STRING;
+  ExpectSynReply(1, expected_headers, false);
+
+  // The first 4 MB go out in 3000-byte frames, ending with a short one...
+  size_t offset = 0;
+  while (kMappingSize - offset > 3000) {
+    ExpectDataFrame(1, contents.substr(offset, 3000), false);
+    offset += 3000;
+  }
+  ExpectDataFrame(1, contents.substr(offset, kMappingSize - offset), false);
+  // ...and then the rest of the file does the same.
+  ExpectDataFrame(1, contents.substr(kMappingSize, 3000), false);
+  ExpectDataFrame(1, contents.substr(kMappingSize + 3000, 3000), false);
+  ExpectDataFrame(1, contents.substr(kMappingSize + 6000, 3000), false);
+  ExpectDataFrame(1, contents.substr(kMappingSize + 9000), true);
+  ExpectOutputQueueEmpty();
+}
+
+TEST_P(HttpToSpdyFilterTest, FileBucketWithHeadersIsCopied) {
+  mod_spdy::SpdyStream stream(
+      spdy_version_, 1, 0, 0, 0, net::kSpdyStreamInitialWindowSize,
+      &output_queue_, &shared_window_, &pusher_);
+  mod_spdy::SpdyServerConfig config;
+  mod_spdy::HttpToSpdyFilter http_to_spdy_filter(&config, &stream);
+
+  // The whole response, headers included, comes from the file, so when the
+  // filter sees the FILE bucket, GetPendingBodyBytes is still zero; the file
+  // must be read (and parsed) the ordinary way.
+  const std::string headers("HTTP/1.1 200 OK\r\n"
+                            "Content-Length: 10000\r\n"
+                            "\r\n");
+  apr_file_t* file = MakeTempFile(headers + std::string(10000, 'a'));
+  AddFileBucket(file, 0, headers.size() + 10000);
+  AddEosBucket();
+  ASSERT_EQ(APR_SUCCESS, WriteBrigade(&http_to_spdy_filter));
+  EXPECT_TRUE(APR_BRIGADE_EMPTY(brigade_));
+  OverwriteFile(file, headers.size(), std::string(10000, 'b'));
+
+  net::SpdyHeaderBlock expected_headers;
+  expected_headers[mod_spdy::http::kContentLength] = "10000";
+  expected_headers[status_header_name()] = "200";
+  expected_headers[version_header_name()] = "HTTP/1.1";
+  expected_headers[mod_spdy::http::kXModSpdy] =
+      MOD_SPDY_VERSION_STRING "-" LASTCHANGE_STRING;
+  ExpectSynReply(1, expected_headers, false);
+  ExpectDataFrame(1, std::string(4096, 'a'), false);
+  ExpectDataFrame(1, std::string(4096, 'a'), false);
+  ExpectDataFrame(1, std::string(1808, 'a'), true);
+  ExpectOutputQueueEmpty();
+}
+
+#endif  // APR_HAS_MMAP
+
 // Run each test over SPDY/2, SPDY/3, and SPDY/3.1.
 INSTANTIATE_TEST_CASE_P(Spdy2And3, HttpToSpdyFilterTest, testing::Values(
     mod_spdy::spdy::SPDY_VERSION_2, mod_spdy::spdy::SPDY_VERSION_3,
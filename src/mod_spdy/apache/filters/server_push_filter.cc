@@ -239,6 +239,7 @@ void ServerPushFilter::ParseXAssociatedContentHeader(base::StringPiece value) {
       case SpdyServerPushInterface::ASSOCIATED_STREAM_INACTIVE:
       case SpdyServerPushInterface::CANNOT_PUSH_EVER_AGAIN:
       case SpdyServerPushInterface::TOO_MANY_CONCURRENT_PUSHES:
+      case SpdyServerPushInterface::SERVER_OVERLOADED:
       case SpdyServerPushInterface::PUSH_INTERNAL_ERROR:
         // In any of these cases, any remaining pushes specified by the header
         // are unlikely to succeed, so just stop parsing and quit.
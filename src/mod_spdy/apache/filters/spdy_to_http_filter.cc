@@ -14,11 +14,26 @@
 
 #include "mod_spdy/apache/filters/spdy_to_http_filter.h"
 
+#include <algorithm>
+#include <cstdio>  // for sscanf
+#include <cstring>  // for memchr, strlen
+#include <deque>
 #include <map>
 #include <string>
+#include <vector>
+
+#include "apr_strings.h"
+#include "apr_tables.h"
+// Temporarily define CORE_PRIVATE so we can see the declaration for
+// ap_parse_uri (in http_protocol.h).
+#define CORE_PRIVATE
+#include "httpd.h"
+#include "http_core.h"
+#include "http_protocol.h"
+#undef CORE_PRIVATE
 
 #include "base/logging.h"
-#include "base/memory/scoped_ptr.h"
+#include "base/stl_util.h"
 #include "base/strings/string_piece.h"
 #include "base/strings/stringprintf.h"
 #include "mod_spdy/common/spdy_stream.h"
@@ -37,11 +52,23 @@ const size_t kGetlineThreshold = 4096;
 
 namespace mod_spdy {
 
-SpdyToHttpFilter::SpdyToHttpFilter(SpdyStream* stream)
+SpdyToHttpFilter::SpdyToHttpFilter(SpdyStream* stream,
+                                   bool build_request_directly)
     : stream_(stream),
-      visitor_(&data_buffer_),
-      converter_(stream_->spdy_version(), &visitor_),
-      next_read_start_(0) {
+      build_request_directly_(build_request_directly),
+      front_chunk_offset_(0),
+      buffered_size_(0),
+      visitor_(&frame_buffer_),
+      recorder_(&frame_buffer_),
+      converter_(stream_->spdy_version(),
+                 (build_request_directly_ ?
+                  static_cast<HttpRequestVisitorInterface*>(&recorder_) :
+                  static_cast<HttpRequestVisitorInterface*>(&visitor_))),
+      bytes_to_consume_(0),
+      request_(NULL),
+      added_trailing_headers_(false),
+      body_bytes_read_(0),
+      body_limit_exceeded_(false) {
   DCHECK(stream_ != NULL);
 }
 
@@ -85,9 +112,9 @@ apr_status_t SpdyToHttpFilter::Read(ap_filter_t *filter,
 
   // Clear any buffer data that was already returned on a previous invocation
   // of this filter.
-  if (next_read_start_ > 0) {
-    data_buffer_.erase(0, next_read_start_);
-    next_read_start_ = 0;
+  if (bytes_to_consume_ > 0) {
+    ConsumeBufferedData(bytes_to_consume_);
+    bytes_to_consume_ = 0;
   }
 
   // We don't need to do anything for AP_MODE_INIT.  (We check this case before
@@ -99,7 +126,7 @@ apr_status_t SpdyToHttpFilter::Read(ap_filter_t *filter,
 
   // If there will never be any more data on this stream, return EOF.  (That's
   // what ap_core_input_filter() in core_filters.c does.)
-  if (end_of_stream_reached() && data_buffer_.empty()) {
+  if (end_of_stream_reached() && buffered_size_ == 0) {
     return APR_EOF;
   }
 
@@ -118,7 +145,7 @@ apr_status_t SpdyToHttpFilter::Read(ap_filter_t *filter,
   if (mode == AP_MODE_READBYTES || mode == AP_MODE_SPECULATIVE ||
       mode == AP_MODE_EXHAUSTIVE) {
     // Try to get as much data as we were asked for.
-    while (max_bytes > data_buffer_.size() || mode == AP_MODE_EXHAUSTIVE) {
+    while (max_bytes > buffered_size_ || mode == AP_MODE_EXHAUSTIVE) {
       const bool got_frame = GetNextFrame(block);
       RETURN_IF_STREAM_ABORT(filter, brigade);
       if (!got_frame) {
@@ -127,7 +154,7 @@ apr_status_t SpdyToHttpFilter::Read(ap_filter_t *filter,
     }
 
     // Return however much data we read, but no more than they asked for.
-    bytes_read = data_buffer_.size();
+    bytes_read = buffered_size_;
     if (mode != AP_MODE_EXHAUSTIVE && max_bytes < bytes_read) {
       bytes_read = max_bytes;
     }
@@ -138,15 +165,15 @@ apr_status_t SpdyToHttpFilter::Read(ap_filter_t *filter,
     size_t linebreak = std::string::npos;
     size_t start = 0;
     while (true) {
-      linebreak = data_buffer_.find('\n', start);
+      linebreak = FindLinebreak(start);
       // Stop if we find a linebreak, or if we've pulled too much data already.
       if (linebreak != std::string::npos ||
-          data_buffer_.size() >= kGetlineThreshold) {
+          buffered_size_ >= kGetlineThreshold) {
         break;
       }
-      // Remember where we left off so we don't have to re-scan the whole
-      // buffer on the next iteration.
-      start = data_buffer_.size();
+      // Remember where we left off so we only have to scan the newly-arrived
+      // data on the next iteration.
+      start = buffered_size_;
       // We haven't seen a linebreak yet, so try to get more data.
       const bool got_frame = GetNextFrame(block);
       RETURN_IF_STREAM_ABORT(filter, brigade);
@@ -158,7 +185,7 @@ apr_status_t SpdyToHttpFilter::Read(ap_filter_t *filter,
     // If we found a linebreak, return data up to and including that linebreak.
     // Otherwise, just send whatever we were able to get.
     bytes_read = (linebreak == std::string::npos ?
-                  data_buffer_.size() : linebreak + 1);
+                  buffered_size_ : linebreak + 1);
   }
   // We don't support AP_MODE_EATCRLF.  Doing so would be tricky, and probably
   // totally pointless.  But if we ever decide to implement it, see
@@ -171,20 +198,30 @@ apr_status_t SpdyToHttpFilter::Read(ap_filter_t *filter,
     return APR_ENOTIMPL;
   }
 
+  // In direct mode, everything we return is request body, so this is where we
+  // enforce LimitRequestBody in place of the HTTP_IN filter.
+  if (build_request_directly_ &&
+      !CheckRequestBodyLimit(filter, mode == AP_MODE_SPECULATIVE ?
+                             0 : bytes_read)) {
+    return APR_ENOSPC;
+  }
+
   // Keep track of whether we were able to put any buckets into the brigade.
   bool success = false;
 
-  // If we managed to read any data, put it into the brigade.  We use a
-  // transient bucket (as opposed to a heap bucket) to avoid an extra string
-  // copy.
+  // If we managed to read any data, put it into the brigade.  We use
+  // transient buckets (as opposed to heap buckets) pointing into our buffered
+  // chunks to avoid an extra string copy.
   if (bytes_read > 0) {
-    APR_BRIGADE_INSERT_TAIL(brigade, apr_bucket_transient_create(
-        data_buffer_.data(), bytes_read, brigade->bucket_alloc));
+    AppendBufferedData(bytes_read, brigade);
     success = true;
   }
 
   // If this is the last bit of data from this stream, send an EOS bucket.
-  if (end_of_stream_reached() && bytes_read == data_buffer_.size()) {
+  if (end_of_stream_reached() && bytes_read == buffered_size_) {
+    if (build_request_directly_) {
+      AddTrailingHeadersToRequest();
+    }
     APR_BRIGADE_INSERT_TAIL(brigade, apr_bucket_eos_create(
         brigade->bucket_alloc));
     success = true;
@@ -197,16 +234,216 @@ apr_status_t SpdyToHttpFilter::Read(ap_filter_t *filter,
   }
 
   // Unless this is a speculative read, we should skip past the bytes we read
-  // next time this filter is invoked.  We don't want to erase those bytes
-  // yet, though, so that we can return them to the previous filter in a
-  // transient bucket.
+  // next time this filter is invoked.  We don't want to free those bytes
+  // yet, though, so that we can return them to the previous filter in
+  // transient buckets.
   if (mode != AP_MODE_SPECULATIVE) {
-    next_read_start_ = bytes_read;
+    bytes_to_consume_ = bytes_read;
   }
 
   return APR_SUCCESS;
 }
 
+void SpdyToHttpFilter::ConsumeBufferedData(size_t num_bytes) {
+  DCHECK_LE(num_bytes, buffered_size_);
+  buffered_size_ -= num_bytes;
+  while (num_bytes > 0) {
+    DCHECK(!input_chunks_.empty());
+    const size_t remaining = input_chunks_.front().size() - front_chunk_offset_;
+    if (num_bytes < remaining) {
+      front_chunk_offset_ += num_bytes;
+      return;
+    }
+    num_bytes -= remaining;
+    input_chunks_.pop_front();
+    front_chunk_offset_ = 0;
+  }
+}
+
+void SpdyToHttpFilter::AppendBufferedData(size_t num_bytes,
+                                          apr_bucket_brigade* brigade) {
+  DCHECK_LE(num_bytes, buffered_size_);
+  size_t offset = front_chunk_offset_;
+  for (std::deque<std::string>::const_iterator iter = input_chunks_.begin();
+       num_bytes > 0; ++iter) {
+    DCHECK(iter != input_chunks_.end());
+    const size_t size = std::min(num_bytes, iter->size() - offset);
+    APR_BRIGADE_INSERT_TAIL(brigade, apr_bucket_transient_create(
+        iter->data() + offset, size, brigade->bucket_alloc));
+    num_bytes -= size;
+    offset = 0;
+  }
+}
+
+size_t SpdyToHttpFilter::FindLinebreak(size_t start) const {
+  // Skip over whole chunks that lie before the start position (without
+  // looking at their contents), then scan the rest with memchr.
+  size_t chunk_start = 0;  // position of the current chunk's first byte
+  size_t offset = front_chunk_offset_;
+  for (std::deque<std::string>::const_iterator iter = input_chunks_.begin();
+       iter != input_chunks_.end(); ++iter) {
+    const size_t size = iter->size() - offset;
+    if (start < chunk_start + size) {
+      const size_t skip = (start > chunk_start ? start - chunk_start : 0);
+      const char* begin = iter->data() + offset + skip;
+      const void* found = memchr(begin, '\n', size - skip);
+      if (found != NULL) {
+        return chunk_start + skip +
+            (static_cast<const char*>(found) - begin);
+      }
+    }
+    chunk_start += size;
+    offset = 0;
+  }
+  return std::string::npos;
+}
+
+bool SpdyToHttpFilter::PopulateRequest(request_rec* request) {
+  DCHECK(build_request_directly_);
+  DCHECK(request_ == NULL);
+
+  // Block until we have the request line and all the leading headers.  If
+  // anything goes wrong, GetNextFrame will already have aborted the stream.
+  while (!recorder_.leading_headers_complete()) {
+    if (stream_->is_aborted() || !GetNextFrame(APR_BLOCK_READ)) {
+      return false;
+    }
+  }
+  if (stream_->is_aborted()) {
+    return false;
+  }
+  request_ = request;
+
+  // Fill in what read_request_line (in protocol.c in Apache) would have
+  // parsed out of the request line.
+  apr_pool_t* pool = request->pool;
+  const std::string& method = recorder_.method();
+  const std::string& path = recorder_.path();
+  const std::string& version = recorder_.version();
+  request->request_time = apr_time_now();
+  request->the_request = apr_pstrcat(pool, method.c_str(), " ", path.c_str(),
+                                     " ", version.c_str(), NULL);
+  request->method = apr_pstrdup(pool, method.c_str());
+  request->method_number = ap_method_number_of(request->method);
+  if (request->method_number == M_GET && method == "HEAD") {
+    request->header_only = 1;
+  }
+  ap_parse_uri(request, apr_pstrdup(pool, path.c_str()));
+  request->protocol = apr_pstrdup(pool, version.c_str());
+  unsigned int major = 0, minor = 0;
+  if (sscanf(request->protocol, "HTTP/%u.%u", &major, &minor) == 2 &&
+      minor < HTTP_VERSION(1, 0)) {
+    request->proto_num = HTTP_VERSION(major, minor);
+  } else {
+    request->proto_num = HTTP_VERSION(1, 0);
+  }
+
+  // Enforce LimitRequestLine as read_request_line would have.  Like
+  // ap_read_request, we report a violation by setting the request's status,
+  // and leave it to the caller to send the error response.
+  const server_rec* server = request->server;
+  if (server->limit_req_line > 0 &&
+      strlen(request->the_request) > static_cast<size_t>(
+          server->limit_req_line)) {
+    request->status = HTTP_REQUEST_URI_TOO_LARGE;
+    request->proto_num = HTTP_VERSION(1, 0);
+    request->protocol = apr_pstrdup(pool, "HTTP/1.0");
+    return true;
+  }
+
+  // Fill in the headers, merging repeated headers the way
+  // ap_get_mime_headers does, and enforcing LimitRequestFields and
+  // LimitRequestFieldSize as it would (counting each header's size as that of
+  // the "Name: value" line it would have been sent as).
+  const HttpRequestRecorder::HeaderList& headers = recorder_.leading_headers();
+  if (server->limit_req_fields > 0 &&
+      headers.size() > static_cast<size_t>(server->limit_req_fields)) {
+    request->status = HTTP_BAD_REQUEST;
+    apr_table_setn(request->notes, "error-notes",
+                   "The number of request header fields exceeds this "
+                   "server's limit.");
+    return true;
+  }
+  for (HttpRequestRecorder::HeaderList::const_iterator iter = headers.begin();
+       iter != headers.end(); ++iter) {
+    if (server->limit_req_fieldsize > 0 &&
+        iter->first.size() + 2 + iter->second.size() >
+        static_cast<size_t>(server->limit_req_fieldsize)) {
+      request->status = HTTP_BAD_REQUEST;
+      apr_table_setn(request->notes, "error-notes", apr_pstrcat(
+          pool, "Size of a request header field exceeds server limit.<br />\n"
+          "<pre>\n", ap_escape_html(pool, iter->first.c_str()), "</pre>\n",
+          NULL));
+      return true;
+    }
+    apr_table_add(request->headers_in, iter->first.c_str(),
+                  iter->second.c_str());
+  }
+  apr_table_compress(request->headers_in, APR_OVERLAP_TABLES_MERGE);
+  return true;
+}
+
+bool SpdyToHttpFilter::CheckRequestBodyLimit(ap_filter_t* filter,
+                                             size_t num_bytes) {
+  // If we haven't populated a request, there's no limit to apply.
+  if (request_ == NULL) {
+    return true;
+  }
+  if (body_limit_exceeded_) {
+    return false;
+  }
+  const apr_off_t limit = ap_get_limit_req_body(request_);
+  if (limit <= 0) {
+    return true;  // zero means no limit
+  }
+
+  // Like the HTTP_IN filter, refuse the body up front if the client has told
+  // us it will be too long, and otherwise as soon as it turns out to be.
+  apr_off_t declared_length = 0;
+  const char* content_length =
+      apr_table_get(request_->headers_in, "Content-Length");
+  if (content_length != NULL) {
+    char* end = NULL;
+    if (apr_strtoff(&declared_length, content_length, &end, 10) !=
+        APR_SUCCESS) {
+      declared_length = 0;
+    }
+  }
+  const apr_off_t total =
+      body_bytes_read_ + static_cast<apr_off_t>(num_bytes);
+  if (declared_length <= limit && total <= limit) {
+    body_bytes_read_ = total;
+    return true;
+  }
+
+  LOG(ERROR) << "Request body on stream " << stream_->stream_id()
+             << " is larger than the configured limit of " << limit;
+  body_limit_exceeded_ = true;
+  apr_bucket_brigade* error_brigade =
+      apr_brigade_create(request_->pool, filter->c->bucket_alloc);
+  APR_BRIGADE_INSERT_TAIL(error_brigade, ap_bucket_error_create(
+      HTTP_REQUEST_ENTITY_TOO_LARGE, NULL, request_->pool,
+      filter->c->bucket_alloc));
+  APR_BRIGADE_INSERT_TAIL(error_brigade, apr_bucket_eos_create(
+      filter->c->bucket_alloc));
+  ap_pass_brigade(request_->output_filters, error_brigade);
+  return false;
+}
+
+void SpdyToHttpFilter::AddTrailingHeadersToRequest() {
+  if (request_ == NULL || added_trailing_headers_) {
+    return;
+  }
+  added_trailing_headers_ = true;
+  const HttpRequestRecorder::HeaderList& headers =
+      recorder_.trailing_headers();
+  for (HttpRequestRecorder::HeaderList::const_iterator iter = headers.begin();
+       iter != headers.end(); ++iter) {
+    apr_table_add(request_->headers_in, iter->first.c_str(),
+                  iter->second.c_str());
+  }
+}
+
 SpdyToHttpFilter::DecodeFrameVisitor::DecodeFrameVisitor(
     SpdyToHttpFilter* filter)
     : filter_(filter), success_(false) {
@@ -257,22 +494,30 @@ bool SpdyToHttpFilter::GetNextFrame(apr_read_type_e block) {
     return false;
   }
 
-  // Try to get the next SPDY frame from the stream.
-  scoped_ptr<net::SpdyFrameIR> frame;
-  {
-    net::SpdyFrameIR* frame_ptr = NULL;
-    if (!stream_->GetInputFrame(block == APR_BLOCK_READ, &frame_ptr)) {
-      DCHECK(frame_ptr == NULL);
-      return false;
+  // Get all the SPDY frames that have arrived on the stream so far.
+  DCHECK(input_frames_.empty());
+  if (!stream_->GetInputFrames(block == APR_BLOCK_READ, &input_frames_)) {
+    DCHECK(input_frames_.empty());
+    return false;
+  }
+  DCHECK(!input_frames_.empty());
+
+  // Decode each frame into HTTP, and move the resulting data (if any) into a
+  // new chunk at the end of our buffered data.  If a frame fails to decode,
+  // the stream has been aborted, so we just drop the rest.
+  bool success = true;
+  for (size_t i = 0; i < input_frames_.size() && success; ++i) {
+    DecodeFrameVisitor visitor(this);
+    input_frames_[i]->Visit(&visitor);
+    if (!frame_buffer_.empty()) {
+      buffered_size_ += frame_buffer_.size();
+      input_chunks_.push_back(std::string());
+      input_chunks_.back().swap(frame_buffer_);
     }
-    frame.reset(frame_ptr);
+    success = visitor.success();
   }
-  DCHECK(frame.get() != NULL);
-
-  // Decode the frame into HTTP and append to the data buffer.
-  DecodeFrameVisitor visitor(this);
-  frame->Visit(&visitor);
-  return visitor.success();
+  STLDeleteElements(&input_frames_);
+  return success;
 }
 
 bool SpdyToHttpFilter::DecodeSynStreamFrame(
@@ -345,7 +590,7 @@ bool SpdyToHttpFilter::DecodeDataFrame(const net::SpdyDataIR& frame) {
       //   shouldn't send the WINDOW_UPDATE until we're about to return the
       //   data to the previous filter, so that we're aren't buffering an
       //   unbounded amount of data in this filter.  The trouble is that once
-      //   we convert the frames, everything goes into data_buffer_ and we
+      //   we convert the frames, everything goes into input_chunks_ and we
       //   forget which of it is leading/trailing headers and which of it is
       //   request data, so it'll take a little work to know when to send the
       //   WINDOW_UPDATE frames.  For now, just doing it here is good enough.
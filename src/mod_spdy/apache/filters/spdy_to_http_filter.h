@@ -15,12 +15,16 @@
 #ifndef MOD_SPDY_APACHE_FILTERS_SPDY_TO_HTTP_FILTER_H_
 #define MOD_SPDY_APACHE_FILTERS_SPDY_TO_HTTP_FILTER_H_
 
+#include <deque>
 #include <string>
+#include <vector>
 
 #include "apr_buckets.h"
 #include "util_filter.h"
 
 #include "base/basictypes.h"
+#include "mod_spdy/apache/slave_connection_context.h"
+#include "mod_spdy/common/http_request_recorder.h"
 #include "mod_spdy/common/http_string_builder.h"
 #include "mod_spdy/common/spdy_to_http_converter.h"
 #include "net/spdy/spdy_protocol.h"
@@ -34,10 +38,18 @@ class SpdyStream;
 // data to be processed by Apache.  This is intended to be the outermost filter
 // in the input chain of one of our slave connections, essentially taking the
 // place of the network socket.
-class SpdyToHttpFilter {
+//
+// If build_request_directly is true, the filter doesn't serialize the request
+// line and headers to HTTP/1.1 text at all.  Instead, it acts as the slave
+// connection's DirectRequestSource, filling them straight into the request_rec
+// from the SPDY header block, and Read() supplies only the raw request body,
+// with no chunked encoding.  Since Apache's HTTP_IN filter is not used in that
+// case, the filter enforces the server's request limits (LimitRequestLine,
+// LimitRequestFields, LimitRequestFieldSize and LimitRequestBody) itself.
+class SpdyToHttpFilter : public DirectRequestSource {
  public:
-  explicit SpdyToHttpFilter(SpdyStream* stream);
-  ~SpdyToHttpFilter();
+  SpdyToHttpFilter(SpdyStream* stream, bool build_request_directly);
+  virtual ~SpdyToHttpFilter();
 
   apr_status_t Read(ap_filter_t* filter,
                     apr_bucket_brigade* brigade,
@@ -45,6 +57,10 @@ class SpdyToHttpFilter {
                     apr_read_type_e block,
                     apr_off_t readbytes);
 
+  // DirectRequestSource method.  May only be called if build_request_directly
+  // was true, and only before the first call to Read().
+  virtual bool PopulateRequest(request_rec* request);
+
  private:
   friend class DecodeFrameVisitor;
   class DecodeFrameVisitor : public net::SpdyFrameVisitor {
@@ -77,14 +93,31 @@ class SpdyToHttpFilter {
   };
 
   // Return true if we've received a FLAG_FIN (i.e. EOS has been reached).
-  bool end_of_stream_reached() const { return visitor_.is_complete(); }
-
-  // Try to get the next SPDY frame on this stream, convert it into HTTP, and
-  // append the resulting data to data_buffer_.  If the block argument is
-  // APR_BLOCK_READ, this function will block until a frame comes in (or the
-  // stream is closed).
+  bool end_of_stream_reached() const {
+    return (build_request_directly_ ? recorder_.is_complete() :
+            visitor_.is_complete());
+  }
+
+  // Try to get the next SPDY frames on this stream (all of those that have
+  // arrived, taken from the stream's input queue in one go), convert them into
+  // HTTP, and append the resulting data to the end of input_chunks_.  If the
+  // block argument is APR_BLOCK_READ, this function will block until a frame
+  // comes in (or the stream is closed).
   bool GetNextFrame(apr_read_type_e block);
 
+  // Discard the first num_bytes bytes of buffered data, freeing any chunks
+  // that have been used up.
+  void ConsumeBufferedData(size_t num_bytes);
+
+  // Append TRANSIENT buckets (one per chunk) referring to the first num_bytes
+  // bytes of buffered data to the brigade.  The buckets stay valid until the
+  // data is consumed.
+  void AppendBufferedData(size_t num_bytes, apr_bucket_brigade* brigade);
+
+  // Return the offset (within the buffered data) of the first linebreak at or
+  // after offset start, or std::string::npos if there isn't one yet.
+  size_t FindLinebreak(size_t start) const;
+
   // Pass the given frame to the SpdyToHttpConverter, and deal with the return
   // code appropriately.
   bool DecodeSynStreamFrame(const net::SpdySynStreamIR& frame);
@@ -94,11 +127,38 @@ class SpdyToHttpFilter {
   // Send a RST_STREAM frame and abort the stream.
   void AbortStream(net::SpdyRstStreamStatus status);
 
+  // In direct mode, add any trailing headers the client sent to the request's
+  // headers_in (as the HTTP_IN filter would have done for us in text mode).
+  void AddTrailingHeadersToRequest();
+
+  // In direct mode, check that returning another num_bytes bytes of the
+  // request body won't take it over LimitRequestBody (nor will the declared
+  // Content-Length).  If it would, send a 413 error down the request's output
+  // filters, as the HTTP_IN filter does, and return false.
+  bool CheckRequestBodyLimit(ap_filter_t* filter, size_t num_bytes);
+
   SpdyStream* const stream_;
-  std::string data_buffer_;
-  HttpStringBuilder visitor_;
+  const bool build_request_directly_;
+  // The converter appends the data for each frame to frame_buffer_; once the
+  // frame is decoded, that data is moved (not copied) into a new chunk at the
+  // back of input_chunks_.  Buckets we return refer into those chunks, and a
+  // chunk is freed only once all of its data has been consumed, so we never
+  // have to shift data around within a buffer.
+  std::string frame_buffer_;
+  // Frames taken from the stream by GetNextFrame, which are decoded and
+  // deleted before it returns; kept as a member only to reuse its storage.
+  std::vector<net::SpdyFrameIR*> input_frames_;
+  std::deque<std::string> input_chunks_;
+  size_t front_chunk_offset_;  // bytes already consumed from the first chunk
+  size_t buffered_size_;  // total unconsumed bytes in input_chunks_
+  HttpStringBuilder visitor_;  // used unless build_request_directly_
+  HttpRequestRecorder recorder_;  // used if build_request_directly_
   SpdyToHttpConverter converter_;
-  size_t next_read_start_;
+  size_t bytes_to_consume_;  // bytes to discard at the start of next Read()
+  request_rec* request_;  // the request we populated, if any; not owned
+  bool added_trailing_headers_;
+  apr_off_t body_bytes_read_;  // request body bytes returned so far
+  bool body_limit_exceeded_;  // we've already sent a 413 for this request
 
   DISALLOW_COPY_AND_ASSIGN(SpdyToHttpFilter);
 };
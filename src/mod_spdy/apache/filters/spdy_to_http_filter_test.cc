@@ -21,9 +21,12 @@
 #include "apr_tables.h"
 #include "util_filter.h"
 
+#include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/string_piece.h"
+#include "base/time/time.h"
 #include "mod_spdy/apache/pool_util.h"
+#include "mod_spdy/apache/testing/dummy_httpd.h"
 #include "mod_spdy/common/protocol_util.h"
 #include "mod_spdy/common/shared_flow_control_window.h"
 #include "mod_spdy/common/spdy_frame_priority_queue.h"
@@ -57,7 +60,7 @@ class SpdyToHttpFilterTest :
         stream_(spdy_version_, stream_id_, 0, 0, priority_,
                 net::kSpdyStreamInitialWindowSize, &output_queue_,
                 &shared_window_, &pusher_),
-        spdy_to_http_filter_(&stream_) {
+        spdy_to_http_filter_(&stream_, false) {
     bucket_alloc_ = apr_bucket_alloc_create(local_.pool());
     connection_ = static_cast<conn_rec*>(
         apr_pcalloc(local_.pool(), sizeof(conn_rec)));
@@ -69,6 +72,11 @@ class SpdyToHttpFilterTest :
     brigade_ = apr_brigade_create(local_.pool(), bucket_alloc_);
   }
 
+  virtual ~SpdyToHttpFilterTest() {
+    // Don't let one test's LimitRequestBody leak into the next.
+    mod_spdy::testing::ResetDummyHttpdForTest();
+  }
+
  protected:
   void PostSynStreamFrame(bool fin, const net::SpdyNameValueBlock& headers) {
     scoped_ptr<net::SpdySynStreamIR> frame(
@@ -100,6 +108,9 @@ class SpdyToHttpFilterTest :
                                      mode, block, readbytes);
   }
 
+  // The filter returns one TRANSIENT bucket for each chunk of buffered data
+  // that a read touches, so check that the brigade starts with one or more
+  // TRANSIENT buckets whose data, put together, is the expected string.
   void ExpectTransientBucket(const std::string& expected) {
     ASSERT_FALSE(APR_BRIGADE_EMPTY(brigade_))
         << "Expected TRANSIENT bucket, but brigade is empty.";
@@ -107,12 +118,18 @@ class SpdyToHttpFilterTest :
     ASSERT_TRUE(APR_BUCKET_IS_TRANSIENT(bucket))
         << "Expected TRANSIENT bucket, but found " << bucket->type->name
         << " bucket.";
-    const char* data = NULL;
-    apr_size_t size = 0;
-    ASSERT_EQ(APR_SUCCESS, apr_bucket_read(
-        bucket, &data, &size, APR_NONBLOCK_READ));
-    EXPECT_EQ(expected, std::string(data, size));
-    apr_bucket_delete(bucket);
+    std::string actual;
+    do {
+      const char* data = NULL;
+      apr_size_t size = 0;
+      ASSERT_EQ(APR_SUCCESS, apr_bucket_read(
+          bucket, &data, &size, APR_NONBLOCK_READ));
+      EXPECT_GT(size, 0u);
+      actual.append(data, size);
+      apr_bucket_delete(bucket);
+      bucket = APR_BRIGADE_FIRST(brigade_);
+    } while (!APR_BRIGADE_EMPTY(brigade_) && APR_BUCKET_IS_TRANSIENT(bucket));
+    EXPECT_EQ(expected, actual);
   }
 
   void ExpectEosBucket() {
@@ -140,6 +157,14 @@ class SpdyToHttpFilterTest :
     EXPECT_THAT(*frame, mod_spdy::testing::IsRstStream(stream_id_, status));
   }
 
+  // Discard any frames (e.g. WINDOW_UPDATEs) in the output queue.
+  void DrainOutputFrames() {
+    net::SpdyFrameIR* raw_frame;
+    while (output_queue_.Pop(&raw_frame)) {
+      delete raw_frame;
+    }
+  }
+
   void ExpectNoMoreOutputFrames() {
     EXPECT_TRUE(output_queue_.IsEmpty());
   }
@@ -166,6 +191,39 @@ class SpdyToHttpFilterTest :
             mod_spdy::spdy::kSpdy3Version);
   }
 
+  // Make a bare request record for a direct-mode filter to populate, on a
+  // server with no request limits set.
+  request_rec* MakeRequest() {
+    apr_pool_t* pool = local_.pool();
+    server_rec* server = static_cast<server_rec*>(
+        apr_pcalloc(pool, sizeof(server_rec)));
+    request_rec* request = static_cast<request_rec*>(
+        apr_pcalloc(pool, sizeof(request_rec)));
+    request->pool = pool;
+    request->connection = connection_;
+    request->server = server;
+    request->headers_in = apr_table_make(pool, 5);
+    request->notes = apr_table_make(pool, 5);
+    request->status = HTTP_OK;
+    return request;
+  }
+
+  void PostDirectPostRequest(bool fin, const std::string& content_length) {
+    net::SpdyNameValueBlock headers;
+    headers[host_header_name()] = "www.example.com";
+    headers[method_header_name()] = "POST";
+    headers[scheme_header_name()] = "https";
+    headers[path_header_name()] = "/upload.cgi";
+    headers[version_header_name()] = "HTTP/1.1";
+    headers["accept-encoding"] = "gzip";
+    headers["x-foo"] = "foo";
+    headers["x-bar"] = "barbarbar";
+    if (!content_length.empty()) {
+      headers[mod_spdy::http::kContentLength] = content_length;
+    }
+    PostSynStreamFrame(fin, headers);
+  }
+
   const mod_spdy::spdy::SpdyVersion spdy_version_;
   const net::SpdyStreamId stream_id_;
   const net::SpdyPriority priority_;
@@ -322,6 +380,145 @@ TEST_P(SpdyToHttpFilterTest, SimplePostRequest) {
   ASSERT_TRUE(APR_STATUS_IS_EOF(Read(AP_MODE_GETLINE, APR_BLOCK_READ, 0)));
 }
 
+TEST_P(SpdyToHttpFilterTest, PostRequestBuiltDirectly) {
+  // Use a filter in build-request-directly mode in place of the usual one.
+  mod_spdy::SpdyToHttpFilter direct_filter(&stream_, true);
+
+  // Send a SYN_STREAM frame from the client, followed by some DATA frames.
+  net::SpdyNameValueBlock headers;
+  headers[host_header_name()] = "www.example.com";
+  headers[method_header_name()] = "POST";
+  headers[scheme_header_name()] = "https";
+  headers[path_header_name()] = "/erase/the/whole/database.cgi";
+  headers[version_header_name()] = "HTTP/1.1";
+  PostSynStreamFrame(false, headers);
+  PostDataFrame(false, "Hello, world!\nPlease erase ");
+  PostDataFrame(false, "the whole database ");
+
+  // The headers never get serialized to text, so all we should get back is
+  // the request body, with no chunked encoding.
+  ASSERT_EQ(APR_SUCCESS, direct_filter.Read(
+      ap_filter_, brigade_, AP_MODE_READBYTES, APR_NONBLOCK_READ, 4096));
+  ExpectTransientBucket("Hello, world!\nPlease erase the whole database ");
+  ExpectEndOfBrigade();
+  ASSERT_TRUE(APR_STATUS_IS_EAGAIN(direct_filter.Read(
+      ap_filter_, brigade_, AP_MODE_READBYTES, APR_NONBLOCK_READ, 4096)));
+  ExpectEndOfBrigade();
+
+  // The end of the body is marked only by the EOS bucket.
+  PostDataFrame(true, "immediately.\nThanks!\n");
+  ASSERT_EQ(APR_SUCCESS, direct_filter.Read(
+      ap_filter_, brigade_, AP_MODE_READBYTES, APR_NONBLOCK_READ, 4096));
+  ExpectTransientBucket("immediately.\nThanks!\n");
+  ExpectEosBucket();
+  ExpectEndOfBrigade();
+  ExpectNoMoreOutputFrames();
+  ASSERT_TRUE(APR_STATUS_IS_EOF(direct_filter.Read(
+      ap_filter_, brigade_, AP_MODE_READBYTES, APR_BLOCK_READ, 4096)));
+}
+
+TEST_P(SpdyToHttpFilterTest, DirectRequestWithinLimits) {
+  mod_spdy::SpdyToHttpFilter direct_filter(&stream_, true);
+  PostDirectPostRequest(false, "");
+  PostDataFrame(true, "0123456789");
+
+  request_rec* request = MakeRequest();
+  request->server->limit_req_line = 100;
+  request->server->limit_req_fields = 10;
+  request->server->limit_req_fieldsize = 100;
+  mod_spdy::testing::SetLimitRequestBodyForTest(10);
+  ASSERT_TRUE(direct_filter.PopulateRequest(request));
+  EXPECT_EQ(HTTP_OK, request->status);
+  EXPECT_EQ(M_POST, request->method_number);
+  EXPECT_STREQ("/upload.cgi", request->uri);
+  EXPECT_STREQ("barbarbar", apr_table_get(request->headers_in, "x-bar"));
+
+  ASSERT_EQ(APR_SUCCESS, direct_filter.Read(
+      ap_filter_, brigade_, AP_MODE_READBYTES, APR_NONBLOCK_READ, 4096));
+  ExpectTransientBucket("0123456789");
+  ExpectEosBucket();
+  ExpectEndOfBrigade();
+}
+
+TEST_P(SpdyToHttpFilterTest, DirectRequestLineTooLong) {
+  mod_spdy::SpdyToHttpFilter direct_filter(&stream_, true);
+  PostDirectPostRequest(true, "");
+
+  // "POST /upload.cgi HTTP/1.1" is 25 characters long.
+  request_rec* request = MakeRequest();
+  request->server->limit_req_line = 24;
+  ASSERT_TRUE(direct_filter.PopulateRequest(request));
+  EXPECT_EQ(HTTP_REQUEST_URI_TOO_LARGE, request->status);
+}
+
+TEST_P(SpdyToHttpFilterTest, DirectRequestHasTooManyHeaderFields) {
+  mod_spdy::SpdyToHttpFilter direct_filter(&stream_, true);
+  PostDirectPostRequest(true, "");
+
+  // The request has host, accept-encoding, x-foo and x-bar headers.
+  request_rec* request = MakeRequest();
+  request->server->limit_req_fields = 2;
+  ASSERT_TRUE(direct_filter.PopulateRequest(request));
+  EXPECT_EQ(HTTP_BAD_REQUEST, request->status);
+  EXPECT_TRUE(apr_table_get(request->notes, "error-notes") != NULL);
+}
+
+TEST_P(SpdyToHttpFilterTest, DirectRequestHeaderFieldTooLarge) {
+  mod_spdy::SpdyToHttpFilter direct_filter(&stream_, true);
+  PostDirectPostRequest(true, "");
+
+  // "host: www.example.com" and "accept-encoding: gzip" are 21 characters
+  // long; the other headers are shorter.
+  request_rec* request = MakeRequest();
+  request->server->limit_req_fieldsize = 20;
+  ASSERT_TRUE(direct_filter.PopulateRequest(request));
+  EXPECT_EQ(HTTP_BAD_REQUEST, request->status);
+  EXPECT_TRUE(apr_table_get(request->notes, "error-notes") != NULL);
+}
+
+TEST_P(SpdyToHttpFilterTest, DirectRequestBodyTooLarge) {
+  mod_spdy::SpdyToHttpFilter direct_filter(&stream_, true);
+  PostDirectPostRequest(false, "");
+  PostDataFrame(false, "0123456789");
+
+  request_rec* request = MakeRequest();
+  mod_spdy::testing::SetLimitRequestBodyForTest(15);
+  ASSERT_TRUE(direct_filter.PopulateRequest(request));
+  EXPECT_EQ(HTTP_OK, request->status);
+
+  // The first ten bytes are within the limit.
+  ASSERT_EQ(APR_SUCCESS, direct_filter.Read(
+      ap_filter_, brigade_, AP_MODE_READBYTES, APR_NONBLOCK_READ, 4096));
+  ExpectTransientBucket("0123456789");
+  ExpectEndOfBrigade();
+
+  // The next ten bytes would go over it, so the read should fail (and keep
+  // failing), without returning any of them.
+  PostDataFrame(true, "abcdefghij");
+  EXPECT_TRUE(APR_STATUS_IS_ENOSPC(direct_filter.Read(
+      ap_filter_, brigade_, AP_MODE_READBYTES, APR_NONBLOCK_READ, 4096)));
+  ExpectEndOfBrigade();
+  EXPECT_TRUE(APR_STATUS_IS_ENOSPC(direct_filter.Read(
+      ap_filter_, brigade_, AP_MODE_READBYTES, APR_NONBLOCK_READ, 4)));
+  ExpectEndOfBrigade();
+}
+
+TEST_P(SpdyToHttpFilterTest, DirectRequestContentLengthTooLarge) {
+  mod_spdy::SpdyToHttpFilter direct_filter(&stream_, true);
+  PostDirectPostRequest(false, "1000");
+  PostDataFrame(false, "0123456789");
+
+  // Even though the data so far is within the limit, the Content-Length
+  // header says that the body will go over it, so the request should fail at
+  // once.
+  request_rec* request = MakeRequest();
+  mod_spdy::testing::SetLimitRequestBodyForTest(100);
+  ASSERT_TRUE(direct_filter.PopulateRequest(request));
+  EXPECT_TRUE(APR_STATUS_IS_ENOSPC(direct_filter.Read(
+      ap_filter_, brigade_, AP_MODE_READBYTES, APR_NONBLOCK_READ, 4096)));
+  ExpectEndOfBrigade();
+}
+
 TEST_P(SpdyToHttpFilterTest, PostRequestWithHeadersFrames) {
   // Send a SYN_STREAM frame from the client.
   net::SpdyNameValueBlock headers;
@@ -655,6 +852,58 @@ TEST_P(SpdyToHttpFilterTest, ExtraSynStream) {
   EXPECT_TRUE(stream_.is_aborted());
 }
 
+// Uploads 100 MB through the filter, one DATA frame at a time, reading it
+// back out in 8 KB pieces the way the HTTP_IN filter would, and logs how long
+// that took.  This is a benchmark rather than a test, so it's disabled by
+// default; run it with --gtest_also_run_disabled_tests.
+TEST_P(SpdyToHttpFilterTest, DISABLED_LargeUploadBenchmark) {
+  const size_t kUploadSize = 100 * 1024 * 1024;
+  const size_t kFrameSize = 4096;
+  const apr_off_t kReadSize = 8192;
+
+  // Send a SYN_STREAM frame with a content-length (so that the body isn't
+  // chunked), and read past the request line and headers.
+  net::SpdyNameValueBlock headers;
+  headers["content-length"] = "104857600";
+  headers[host_header_name()] = "www.example.com";
+  headers[method_header_name()] = "POST";
+  headers[scheme_header_name()] = "https";
+  headers[path_header_name()] = "/upload.cgi";
+  headers[version_header_name()] = "HTTP/1.1";
+  PostSynStreamFrame(false, headers);
+  ASSERT_EQ(APR_SUCCESS, Read(AP_MODE_EXHAUSTIVE, APR_NONBLOCK_READ, 0));
+  ASSERT_EQ(APR_SUCCESS, apr_brigade_cleanup(brigade_));
+
+  const std::string payload(kFrameSize, 'x');
+  size_t bytes_posted = 0;
+  size_t bytes_read = 0;
+  const base::TimeTicks start = base::TimeTicks::Now();
+  while (bytes_posted < kUploadSize) {
+    bytes_posted += kFrameSize;
+    PostDataFrame(bytes_posted >= kUploadSize, payload);
+    while (true) {
+      const apr_status_t status =
+          Read(AP_MODE_READBYTES, APR_NONBLOCK_READ, kReadSize);
+      if (status != APR_SUCCESS) {
+        ASSERT_TRUE(APR_STATUS_IS_EAGAIN(status) || APR_STATUS_IS_EOF(status));
+        break;
+      }
+      apr_off_t length = 0;
+      ASSERT_EQ(APR_SUCCESS, apr_brigade_length(brigade_, 0, &length));
+      bytes_read += static_cast<size_t>(length);
+      ASSERT_EQ(APR_SUCCESS, apr_brigade_cleanup(brigade_));
+    }
+    // Throw away the WINDOW_UPDATE frames that the stream sends.
+    DrainOutputFrames();
+  }
+  const base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+
+  EXPECT_EQ(kUploadSize, bytes_read);
+  EXPECT_FALSE(stream_.is_aborted());
+  LOG(INFO) << "Uploaded " << (kUploadSize >> 20) << " MB through "
+            << "SpdyToHttpFilter in " << elapsed.InMillisecondsF() << " ms";
+}
+
 // Run each test over both SPDY v2 and SPDY v3.
 INSTANTIATE_TEST_CASE_P(Spdy2And3, SpdyToHttpFilterTest, testing::Values(
     mod_spdy::spdy::SPDY_VERSION_2, mod_spdy::spdy::SPDY_VERSION_3,
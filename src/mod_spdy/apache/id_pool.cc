@@ -12,23 +12,49 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-// Contains IdPool, a class for managing 16-bit process-global IDs.
+// Contains IdPool, a class for managing process-global IDs.
 
 #include "mod_spdy/apache/id_pool.h"
 
 #include <vector>
-#include <set>
 
+#include "base/atomicops.h"
 #include "base/basictypes.h"
 #include "base/logging.h"
 
 namespace mod_spdy {
 
+namespace {
+
+const int kBitsPerWord = 32;
+const size_t kNumWords = (static_cast<size_t>(1) << IdPool::kIdBits) /
+    kBitsPerWord;
+
+// Returns the index of the lowest clear bit in the given word, which must not
+// be all ones.
+int LowestClearBit(uint32 word) {
+  DCHECK_NE(0xFFFFFFFFu, word);
+  int bit = 0;
+  while (word & 1u) {
+    word >>= 1;
+    ++bit;
+  }
+  return bit;
+}
+
+}  // namespace
+
 IdPool* IdPool::g_instance = NULL;
-const uint16 IdPool::kOverFlowId;
+const int IdPool::kIdBits;
+const uint32 IdPool::kOverFlowId;
 
-IdPool::IdPool()
-    : next_never_used_(0) /* So it gets incremented to 1 in ::Alloc */ {
+IdPool::IdPool() : bitmap_(kNumWords, 0) {
+  COMPILE_ASSERT(sizeof(base::subtle::Atomic32) * 8 == kBitsPerWord,
+                 bitmap_words_must_be_32_bits);
+  COMPILE_ASSERT(IdPool::kIdBits >= 5, id_space_must_fill_a_bitmap_word);
+  COMPILE_ASSERT(IdPool::kIdBits < 32, ids_must_not_reach_overflow_id);
+  // ID zero is never handed out.
+  bitmap_[0] = 1;
 }
 
 IdPool::~IdPool() {
@@ -45,38 +71,68 @@ void IdPool::DestroyInstance() {
   g_instance = NULL;
 }
 
-uint16 IdPool::Alloc() {
-  base::AutoLock lock(mutex_);
-  if (!free_list_.empty()) {
-    uint16 id = free_list_.back();
-    free_list_.pop_back();
-    alloc_set_.insert(id);
-    return id;
+uint32 IdPool::Alloc() {
+  // Start where this thread last found a free ID (or at the beginning, if
+  // this thread has never allocated one), and go around the bitmap once.
+  base::subtle::Atomic32* hint = search_hint_.Get();
+  const size_t start = (hint == NULL ? 0 : hint - &bitmap_[0]);
+  for (size_t i = 0; i < kNumWords; ++i) {
+    const size_t word_index = (start + i) % kNumWords;
+    const uint32 id = TryAllocInWord(word_index);
+    if (id != 0) {
+      if (word_index != start) {
+        search_hint_.Set(&bitmap_[word_index]);
+      }
+      return id;
+    }
   }
 
-  // We do not use 0 or kOverFlowId normally..
-  if (alloc_set_.size() == (0x10000 - 2)) {
-    LOG(WARNING) << "Out of slave fetch IDs, things may break";
-    return kOverFlowId;
-  }
-
-  // Freelist is empty, but we haven't yet used some ID, so return it.
-  ++next_never_used_;
-  DCHECK(next_never_used_ != kOverFlowId);
-  DCHECK(alloc_set_.find(next_never_used_) == alloc_set_.end());
-  alloc_set_.insert(next_never_used_);
-  return next_never_used_;
+  LOG(WARNING) << "Out of slave fetch IDs, things may break";
+  return kOverFlowId;
 }
 
-void IdPool::Free(uint16 id) {
+void IdPool::Free(uint32 id) {
   if (id == kOverFlowId) {
     return;
   }
+  DCHECK_NE(0u, id);
+  DCHECK_LT(id, 1u << kIdBits);
+
+  base::subtle::Atomic32* word = &bitmap_[id / kBitsPerWord];
+  const uint32 mask = 1u << (id % kBitsPerWord);
+  base::subtle::Atomic32 old_value = base::subtle::NoBarrier_Load(word);
+  while (true) {
+    DCHECK(static_cast<uint32>(old_value) & mask) << "ID " << id
+                                                  << " is not in use";
+    const base::subtle::Atomic32 new_value =
+        static_cast<base::subtle::Atomic32>(
+            static_cast<uint32>(old_value) & ~mask);
+    const base::subtle::Atomic32 previous =
+        base::subtle::Release_CompareAndSwap(word, old_value, new_value);
+    if (previous == old_value) {
+      return;
+    }
+    old_value = previous;
+  }
+}
 
-  base::AutoLock lock(mutex_);
-  DCHECK(alloc_set_.find(id) != alloc_set_.end());
-  alloc_set_.erase(id);
-  free_list_.push_back(id);
+uint32 IdPool::TryAllocInWord(size_t word_index) {
+  base::subtle::Atomic32* word = &bitmap_[word_index];
+  base::subtle::Atomic32 old_value = base::subtle::NoBarrier_Load(word);
+  while (static_cast<uint32>(old_value) != 0xFFFFFFFFu) {
+    const int bit = LowestClearBit(static_cast<uint32>(old_value));
+    const base::subtle::Atomic32 new_value =
+        static_cast<base::subtle::Atomic32>(
+            static_cast<uint32>(old_value) | (1u << bit));
+    const base::subtle::Atomic32 previous =
+        base::subtle::Acquire_CompareAndSwap(word, old_value, new_value);
+    if (previous == old_value) {
+      return static_cast<uint32>(word_index * kBitsPerWord + bit);
+    }
+    // Someone else changed this word under us; try again with its new value.
+    old_value = previous;
+  }
+  return 0;
 }
 
 }  // namespace mod_spdy
@@ -17,17 +17,30 @@
 #define MOD_SPDY_APACHE_ID_POOL_H_
 
 #include <vector>
-#include <set>
 
+#include "base/atomicops.h"
 #include "base/basictypes.h"
-#include "base/synchronization/lock.h"
+#include "base/threading/thread_local.h"
 
 namespace mod_spdy {
 
-// A class for managing non-zero 16-bit process-global IDs.
+// A class for managing non-zero process-global IDs.  The IDs in use are
+// tracked in a bitmap of atomic words, so Alloc() and Free() never take a lock
+// or allocate memory.  Each thread remembers which word of the bitmap it last
+// allocated from and starts its next search there, so that concurrent threads
+// tend to stay out of each other's way.
 class IdPool {
  public:
-  static const uint16 kOverFlowId = 0xFFFF;
+  // The IDs returned by Alloc() fit in this many bits.  If long is 64 bits,
+  // we use 20 bits (so that over a million IDs may be in use at once);
+  // otherwise, we stick to 16 bits so that a slave connection ID, which
+  // combines one of these IDs with the master connection ID, still fits in a
+  // long (see SlaveConnection::Run).
+  static const int kIdBits = (sizeof(long) >= 8 ? 20 : 16);
+
+  // Returned by Alloc() if all other IDs are in use.  This is never a valid
+  // ID, since it doesn't fit in kIdBits bits.
+  static const uint32 kOverFlowId = 0xFFFFFFFF;
 
   // Returns the one and only instance of the IdPool. Note that one must
   // be created with CreateInstance().
@@ -39,26 +52,31 @@ class IdPool {
   // Call this once you're done with the pool object to delete it.
   static void DestroyInstance();
 
-  // Allocates a new, distinct, non-zero ID. 2^16-2 possible values may be
-  // returned; if more than that are needed simultaneously (without being
-  // Free()d) kOverFlowId will always be returned.
-  uint16 Alloc();
+  // Allocates a new, distinct, non-zero ID. 2^kIdBits-1 possible values may
+  // be returned; if more than that are needed simultaneously (without being
+  // Free()d) kOverFlowId will always be returned.  This is thread-safe.
+  uint32 Alloc();
 
   // Release an ID that's no longer in use, making it available for further
-  // calls to Alloc().
-  void Free(uint16 id);
+  // calls to Alloc().  This is thread-safe.
+  void Free(uint32 id);
 
  private:
   IdPool();
   ~IdPool();
 
+  // Try to claim a clear bit in the given word of the bitmap.  Returns the ID
+  // for that bit, or zero if the word is full.
+  uint32 TryAllocInWord(size_t word_index);
+
   static IdPool* g_instance;
 
-  base::Lock mutex_;
-  std::vector<uint16> free_list_;  // IDs known to be free
-  std::set<uint16> alloc_set_;  // IDs currently in use
-  uint16 next_never_used_;  // Next ID we have never returned from Alloc,
-                            // for use when the free list is empty.
+  // One bit per ID, set for IDs that are in use.  The bit for ID zero is
+  // always set, so that it is never returned.  This vector is never resized
+  // after construction.
+  std::vector<base::subtle::Atomic32> bitmap_;
+  // For each thread, the word of bitmap_ that it last allocated from.
+  base::ThreadLocalPointer<base::subtle::Atomic32> search_hint_;
 
   DISALLOW_COPY_AND_ASSIGN(IdPool);
 };
@@ -14,9 +14,11 @@
 
 #include "mod_spdy/apache/id_pool.h"
 
-#include <set>
+#include <vector>
 
+#include "base/atomicops.h"
 #include "base/basictypes.h"
+#include "base/threading/platform_thread.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
 namespace {
@@ -34,12 +36,12 @@ TEST(IdPoolTest, Lifetime) {
 TEST(IdPoolTest, BasicAllocation) {
   IdPool::CreateInstance();
   IdPool* instance = IdPool::Instance();
-  uint16 id_1 = instance->Alloc();
-  uint16 id_2 = instance->Alloc();
-  uint16 id_3 = instance->Alloc();
-  EXPECT_NE(0, id_1);
-  EXPECT_NE(0, id_2);
-  EXPECT_NE(0, id_3);
+  uint32 id_1 = instance->Alloc();
+  uint32 id_2 = instance->Alloc();
+  uint32 id_3 = instance->Alloc();
+  EXPECT_NE(0u, id_1);
+  EXPECT_NE(0u, id_2);
+  EXPECT_NE(0u, id_3);
   EXPECT_NE(id_1, id_2);
   EXPECT_NE(id_1, id_3);
   EXPECT_NE(id_2, id_3);
@@ -50,17 +52,21 @@ TEST(IdPoolTest, BasicAllocation) {
 }
 
 TEST(IdPoolTest, AllocatingMany) {
-  // We should be able to allocate 2^16-2 unique ids.
+  // We should be able to allocate 2^kIdBits-1 unique ids.
+  const uint32 kMaxIds = (1u << IdPool::kIdBits) - 1;
   IdPool::CreateInstance();
   IdPool* instance = IdPool::Instance();
 
-  std::set<uint16> in_use;
-  for (int run = 0; run < 0xFFFE; ++run) {
-    uint16 new_id = instance->Alloc();
-    EXPECT_NE(0, new_id);
-    EXPECT_NE(IdPool::kOverFlowId, new_id);
-    EXPECT_TRUE(in_use.find(new_id) == in_use.end());
-    in_use.insert(new_id);
+  std::vector<bool> in_use(kMaxIds + 1, false);
+  std::vector<uint32> allocated;
+  for (uint32 run = 0; run < kMaxIds; ++run) {
+    uint32 new_id = instance->Alloc();
+    ASSERT_NE(0u, new_id);
+    ASSERT_NE(IdPool::kOverFlowId, new_id);
+    ASSERT_LE(new_id, kMaxIds);
+    ASSERT_FALSE(in_use[new_id]);
+    in_use[new_id] = true;
+    allocated.push_back(new_id);
   }
 
   // All attempts after this point should return kOverFlowId.
@@ -72,26 +78,109 @@ TEST(IdPoolTest, AllocatingMany) {
   instance->Free(IdPool::kOverFlowId);
 
   // Now delete half of them.
-  int deleted = 0;
-  std::set<uint16>::iterator i = in_use.begin();
-  while (deleted != 0xFFFE / 2) {
-    ASSERT_TRUE(i != in_use.end());
-    instance->Free(*i);
-    ++deleted;
-    in_use.erase(i);
-    i = in_use.begin();
+  for (uint32 i = 0; i < kMaxIds / 2; ++i) {
+    const uint32 id = allocated.back();
+    allocated.pop_back();
+    instance->Free(id);
+    in_use[id] = false;
   }
 
   // Should now be able to allocate that many again.
-  for (int run = 0; run < 0xFFFE / 2; ++run) {
-    uint16 new_id = instance->Alloc();
-    EXPECT_NE(0, new_id);
-    EXPECT_NE(IdPool::kOverFlowId, new_id);
-    EXPECT_TRUE(in_use.find(new_id) == in_use.end());
-    in_use.insert(new_id);
+  for (uint32 run = 0; run < kMaxIds / 2; ++run) {
+    uint32 new_id = instance->Alloc();
+    ASSERT_NE(0u, new_id);
+    ASSERT_NE(IdPool::kOverFlowId, new_id);
+    ASSERT_FALSE(in_use[new_id]);
+    in_use[new_id] = true;
   }
+  EXPECT_EQ(IdPool::kOverFlowId, instance->Alloc());
 
   IdPool::DestroyInstance();
 }
 
+TEST(IdPoolTest, MoreThanSixteenBitsWhenLongIsWide) {
+  // On systems with an eight-byte long, the pool should hand out more than
+  // 2^16 simultaneous IDs, so that a busy server doesn't run out.
+  if (sizeof(long) < 8) {
+    EXPECT_EQ(16, IdPool::kIdBits);
+    return;
+  }
+  IdPool::CreateInstance();
+  IdPool* instance = IdPool::Instance();
+  const uint32 kNumIds = 0x10000 + 1000;
+  for (uint32 run = 0; run < kNumIds; ++run) {
+    ASSERT_NE(IdPool::kOverFlowId, instance->Alloc());
+  }
+  IdPool::DestroyInstance();
+}
+
+// Repeatedly allocates a batch of IDs, checks (using a table shared with the
+// other threads) that no one else holds them, and then frees them again.
+class AllocFreeDelegate : public base::PlatformThread::Delegate {
+ public:
+  AllocFreeDelegate(IdPool* pool, std::vector<base::subtle::Atomic32>* owners,
+                    base::subtle::Atomic32 thread_number)
+      : pool_(pool), owners_(owners), thread_number_(thread_number),
+        num_failures_(0) {}
+
+  virtual void ThreadMain() {
+    const int kNumRounds = 200;
+    const int kBatchSize = 100;
+    std::vector<uint32> ids;
+    for (int round = 0; round < kNumRounds; ++round) {
+      for (int i = 0; i < kBatchSize; ++i) {
+        const uint32 id = pool_->Alloc();
+        if (id == 0 || id == IdPool::kOverFlowId ||
+            base::subtle::NoBarrier_CompareAndSwap(
+                &(*owners_)[id], 0, thread_number_) != 0) {
+          ++num_failures_;
+          continue;
+        }
+        ids.push_back(id);
+      }
+      for (size_t i = 0; i < ids.size(); ++i) {
+        base::subtle::NoBarrier_Store(&(*owners_)[ids[i]], 0);
+        pool_->Free(ids[i]);
+      }
+      ids.clear();
+    }
+  }
+
+  int num_failures() const { return num_failures_; }
+
+ private:
+  IdPool* const pool_;
+  std::vector<base::subtle::Atomic32>* const owners_;
+  const base::subtle::Atomic32 thread_number_;
+  int num_failures_;
+
+  DISALLOW_COPY_AND_ASSIGN(AllocFreeDelegate);
+};
+
+TEST(IdPoolTest, ConcurrentAllocAndFree) {
+  IdPool::CreateInstance();
+  IdPool* instance = IdPool::Instance();
+  std::vector<base::subtle::Atomic32> owners(1u << IdPool::kIdBits, 0);
+
+  const int kNumThreads = 8;
+  std::vector<AllocFreeDelegate*> delegates;
+  std::vector<base::PlatformThreadHandle> handles(kNumThreads);
+  for (int i = 0; i < kNumThreads; ++i) {
+    delegates.push_back(new AllocFreeDelegate(instance, &owners, i + 1));
+    ASSERT_TRUE(base::PlatformThread::Create(0, delegates[i], &handles[i]));
+  }
+  for (int i = 0; i < kNumThreads; ++i) {
+    base::PlatformThread::Join(handles[i]);
+    EXPECT_EQ(0, delegates[i]->num_failures());
+    delete delegates[i];
+  }
+
+  // Every ID should have been freed, so we should be able to get them all
+  // again.
+  for (uint32 run = 0; run < (1u << IdPool::kIdBits) - 1; ++run) {
+    ASSERT_NE(IdPool::kOverFlowId, instance->Alloc());
+  }
+  IdPool::DestroyInstance();
+}
+
 }  // namespace
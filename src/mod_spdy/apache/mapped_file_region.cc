@@ -0,0 +1,74 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/apache/mapped_file_region.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "apr_file_io.h"
+#include "apr_portable.h"
+
+#include "base/logging.h"
+#include "base/strings/string_piece.h"
+#include "mod_spdy/apache/pool_util.h"  // for AprStatusString
+
+namespace mod_spdy {
+
+// static
+MappedFileRegion* MappedFileRegion::Create(apr_file_t* file, apr_off_t offset,
+                                           apr_size_t length) {
+  DCHECK(file != NULL);
+  if (offset < 0 || length == 0) {
+    return NULL;
+  }
+
+  apr_os_file_t fd;
+  const apr_status_t status = apr_os_file_get(&fd, file);
+  if (status != APR_SUCCESS) {
+    VLOG(1) << "Can't get descriptor for file bucket: "
+            << AprStatusString(status);
+    return NULL;
+  }
+
+  // mmap requires the offset to be a multiple of the page size, so map from
+  // the start of the page containing the region.
+  static const long page_size = sysconf(_SC_PAGESIZE);
+  const size_t page_offset = static_cast<size_t>(offset % page_size);
+  const size_t mapped_length = length + page_offset;
+  void* address = mmap(NULL, mapped_length, PROT_READ, MAP_SHARED, fd,
+                       offset - page_offset);
+  if (address == MAP_FAILED) {
+    VLOG(1) << "Can't mmap " << length << " bytes of file at offset "
+            << offset << ": errno " << errno;
+    return NULL;
+  }
+  return new MappedFileRegion(
+      address, mapped_length,
+      base::StringPiece(static_cast<const char*>(address) + page_offset,
+                        length));
+}
+
+MappedFileRegion::MappedFileRegion(void* address, size_t mapped_length,
+                                   base::StringPiece data)
+    : address_(address), mapped_length_(mapped_length), data_(data) {}
+
+MappedFileRegion::~MappedFileRegion() {
+  if (munmap(address_, mapped_length_) != 0) {
+    LOG(DFATAL) << "munmap failed: errno " << errno;
+  }
+}
+
+}  // namespace mod_spdy
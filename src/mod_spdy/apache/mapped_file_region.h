@@ -0,0 +1,55 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_APACHE_MAPPED_FILE_REGION_H_
+#define MOD_SPDY_APACHE_MAPPED_FILE_REGION_H_
+
+#include "apr_file_io.h"
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+#include "mod_spdy/common/backed_data_frame.h"
+
+namespace mod_spdy {
+
+// A read-only memory mapping of part of a file, which DATA frames can refer to
+// directly (see BackedSpdyDataIR).  Unlike an apr_mmap_t, the mapping does not
+// belong to any APR pool, so it may safely outlive the slave connection that
+// created it and be released from the master connection thread.
+class MappedFileRegion : public DataFrameBacking {
+ public:
+  // Map length bytes of the given file, starting at offset, into memory.
+  // Returns NULL (and logs why) if the region can't be mapped, in which case
+  // the caller should read the file the ordinary way.
+  static MappedFileRegion* Create(apr_file_t* file, apr_off_t offset,
+                                  apr_size_t length);
+
+  // The contents of the requested region of the file.
+  base::StringPiece data() const { return data_; }
+
+ private:
+  MappedFileRegion(void* address, size_t mapped_length,
+                   base::StringPiece data);
+  virtual ~MappedFileRegion();
+
+  void* const address_;  // page-aligned start of the mapping
+  const size_t mapped_length_;
+  const base::StringPiece data_;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedFileRegion);
+};
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_APACHE_MAPPED_FILE_REGION_H_
@@ -0,0 +1,80 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/apache/mapped_file_region.h"
+
+#include <string>
+
+#include "apr_file_io.h"
+#include "apr_strings.h"
+
+#include "base/memory/ref_counted.h"
+#include "mod_spdy/apache/pool_util.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+class MappedFileRegionTest : public testing::Test {
+ public:
+  MappedFileRegionTest() : file_(NULL) {}
+
+  virtual void SetUp() {
+    const char* temp_dir = NULL;
+    ASSERT_EQ(APR_SUCCESS, apr_temp_dir_get(&temp_dir, local_.pool()));
+    char* path = apr_pstrcat(local_.pool(), temp_dir,
+                             "/mapped_file_region_test.XXXXXX", NULL);
+    ASSERT_EQ(APR_SUCCESS, apr_file_mktemp(
+        &file_, path, APR_FOPEN_CREATE | APR_FOPEN_READ | APR_FOPEN_WRITE |
+        APR_FOPEN_EXCL | APR_FOPEN_DELONCLOSE, local_.pool()));
+  }
+
+ protected:
+  void WriteToFile(const std::string& data) {
+    apr_size_t written = 0;
+    ASSERT_EQ(APR_SUCCESS, apr_file_write_full(
+        file_, data.data(), data.size(), &written));
+    ASSERT_EQ(APR_SUCCESS, apr_file_flush(file_));
+  }
+
+  mod_spdy::LocalPool local_;
+  apr_file_t* file_;
+};
+
+TEST_F(MappedFileRegionTest, MapUnalignedRegion) {
+  // Write a file spanning a few pages, with distinct contents on each.
+  std::string contents;
+  for (int i = 0; i < 20000; ++i) {
+    contents.push_back(static_cast<char>('a' + i % 23));
+  }
+  WriteToFile(contents);
+
+  // Map a region that starts and ends partway through a page.
+  scoped_refptr<mod_spdy::MappedFileRegion> region(
+      mod_spdy::MappedFileRegion::Create(file_, 5000, 12345));
+  ASSERT_TRUE(region.get() != NULL);
+  EXPECT_EQ(contents.substr(5000, 12345), region->data().as_string());
+
+  // The mapping stays valid as long as something holds a reference to it,
+  // even after the file is closed.
+  ASSERT_EQ(APR_SUCCESS, apr_file_close(file_));
+  EXPECT_EQ(contents.substr(5000, 12345), region->data().as_string());
+}
+
+TEST_F(MappedFileRegionTest, EmptyRegion) {
+  WriteToFile("Hello, world!\n");
+  EXPECT_TRUE(mod_spdy::MappedFileRegion::Create(file_, 0, 0) == NULL);
+  EXPECT_TRUE(mod_spdy::MappedFileRegion::Create(file_, -1, 5) == NULL);
+}
+
+}  // namespace
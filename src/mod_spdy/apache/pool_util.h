@@ -83,6 +83,29 @@ void PoolUnregisterDelete(apr_pool_t* pool, T* object) {
   apr_pool_cleanup_kill(pool, object, DeletionFunction<T>);
 }
 
+// Helper function for PoolRegisterDestroy.
+template <class T>
+apr_status_t DestructionFunction(void* object) {
+  static_cast<T*>(object)->~T();
+  return APR_SUCCESS;
+}
+
+// Register a C++ object that was constructed (with placement new) in memory
+// allocated from a pool to be destroyed with that pool.  The pool frees the
+// memory itself, so an object that lives exactly as long as a pool that gets
+// cleared and reused costs no heap allocation at all.
+//
+// Example usage:
+//
+//   Foo* foo = new (apr_palloc(pool, sizeof(Foo))) Foo(arg);
+//   PoolRegisterDestroy(pool, foo);
+template <class T>
+void PoolRegisterDestroy(apr_pool_t* pool, T* object) {
+  apr_pool_cleanup_register(pool, object,
+                            DestructionFunction<T>,  // cleanup function
+                            apr_pool_cleanup_null);  // child cleanup
+}
+
 // Return a string describing the given APR status code.
 std::string AprStatusString(apr_status_t status);
 
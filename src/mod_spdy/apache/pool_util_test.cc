@@ -14,6 +14,10 @@
 
 #include "mod_spdy/apache/pool_util.h"
 
+#include <new>
+
+#include "apr_pools.h"
+
 #include "base/basictypes.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
@@ -56,4 +60,24 @@ TEST(PoolUtilTest, LocalPoolUnregisterDelete) {
   ASSERT_EQ(7, value);
 }
 
+TEST(PoolUtilTest, LocalPoolRegisterDestroy) {
+  int value = 4;
+  {
+    mod_spdy::LocalPool local;
+    SetOnDelete* setter = new (apr_palloc(local.pool(), sizeof(SetOnDelete)))
+        SetOnDelete(9, &value);
+    mod_spdy::PoolRegisterDestroy(local.pool(), setter);
+    ASSERT_EQ(4, value);
+    apr_pool_clear(local.pool());
+    ASSERT_EQ(9, value);
+
+    // The pool can be reused after clearing it.
+    setter = new (apr_palloc(local.pool(), sizeof(SetOnDelete)))
+        SetOnDelete(11, &value);
+    mod_spdy::PoolRegisterDestroy(local.pool(), setter);
+    ASSERT_EQ(9, value);
+  }
+  ASSERT_EQ(11, value);
+}
+
 }  // namespace
@@ -14,29 +14,81 @@
 
 #include "mod_spdy/apache/slave_connection.h"
 
+#include <cstring>  // for memset and strcmp
+#include <vector>
+
+#include "apr_buckets.h"
+#include "apr_portable.h"
 #include "apr_strings.h"
 // Temporarily define CORE_PRIVATE so we can see the declarations for
-// ap_create_conn_config (in http_config.h), ap_process_connection (in
-// http_connection.h), and core_module (in http_core.h).
+// ap_create_conn_config and ap_create_request_config (in http_config.h),
+// ap_process_connection (in http_connection.h), core_module (in http_core.h),
+// ap_read_request (in http_protocol.h), and ap_update_vhost_from_headers (in
+// http_vhost.h).
 #define CORE_PRIVATE
 #include "httpd.h"
 #include "http_config.h"
 #include "http_connection.h"
 #include "http_core.h"
+#include "http_protocol.h"
+#include "http_request.h"
+#include "http_vhost.h"
 #undef CORE_PRIVATE
 
 #include "base/basictypes.h"
 #include "base/logging.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string_util.h"
+#include "base/synchronization/lock.h"
 #include "mod_spdy/apache/config_util.h"
 #include "mod_spdy/apache/id_pool.h"
 #include "mod_spdy/apache/log_message_handler.h"
 #include "mod_spdy/apache/master_connection_context.h"
+#include "mod_spdy/apache/pool_util.h"
 #include "mod_spdy/apache/slave_connection_context.h"
 #include "mod_spdy/apache/sockaddr_util.h"
 #include "mod_spdy/apache/ssl_util.h"
 
+extern "C" {
+  extern module AP_MODULE_DECLARE_DATA spdy_module;
+}
+
 namespace mod_spdy {
 
+namespace {
+
+// The maximum number of recycled slave connections that each factory will
+// keep around for reuse.  Connections recycled beyond this are just deleted.
+const size_t kMaxFreeSlaveConnections = 16;
+
+typedef std::vector<ap_HOOK_pre_connection_t*> PreConnectionHookList;
+
+// The pre-connection hooks that actually need to be run for a slave
+// connection, in order, or NULL if slave connections can't use the fast path.
+// This is set at most once, by SlaveConnection::InitFastPath, while the child
+// process is still single-threaded, and is read-only after that.
+PreConnectionHookList* gSlavePreConnectionHooks = NULL;
+
+// Returns true if the named module's pre-connection hook is known to do
+// nothing for a slave connection.  The core hook never runs for slaves (our
+// own pre-connection hook returns DONE before it gets the chance), and mod_ssl
+// just declines once our other hook has disabled SSL on the connection.
+bool IsNoOpPreConnectionHookForSlaves(const char* module_name) {
+  return (strcmp(module_name, "core.c") == 0 ||
+          strcmp(module_name, "mod_ssl.c") == 0);
+}
+
+// Returns true if the named module's process-connection hook is one we know
+// how to replace with a direct call to ap_read_request/ap_process_request:
+// our own hook declines for slave connections, and the HTTP module's hook
+// just reads and processes requests.
+bool IsKnownProcessConnectionHook(const char* module_name) {
+  return (strcmp(module_name, spdy_module.name) == 0 ||
+          strcmp(module_name, "http_core.c") == 0);
+}
+
+}  // namespace
+
 SlaveConnectionFactory::SlaveConnectionFactory(conn_rec* master_connection) {
   // If the parent connection is using mod_spdy, we can extract relevant info
   // on whether we're using it there.
@@ -61,30 +113,108 @@ SlaveConnectionFactory::SlaveConnectionFactory(conn_rec* master_connection) {
 }
 
 SlaveConnectionFactory::~SlaveConnectionFactory() {
-  // Nothing to do --- pool_ dtor will clean everything up.
+  // Any connections still out there must be deleted rather than recycled, as
+  // we won't be around to take them back.  The pool_ dtor will clean up
+  // everything else.
+  base::AutoLock autolock(free_connections_lock_);
+  for (std::vector<SlaveConnection*>::const_iterator iter =
+           free_connections_.begin();
+       iter != free_connections_.end(); ++iter) {
+    delete *iter;
+  }
+  free_connections_.clear();
 }
 
 SlaveConnection* SlaveConnectionFactory::Create() {
-  return new SlaveConnection(this);
+  SlaveConnection* connection = NULL;
+  {
+    base::AutoLock autolock(free_connections_lock_);
+    if (!free_connections_.empty()) {
+      connection = free_connections_.back();
+      free_connections_.pop_back();
+    }
+  }
+  if (connection == NULL) {
+    return new SlaveConnection(this);
+  }
+  connection->Init(this);
+  return connection;
+}
+
+void SlaveConnectionFactory::Recycle(SlaveConnection* connection) {
+  // Clear the connection's pool before taking the lock, since running the
+  // pool cleanups may take a while.
+  connection->Reset();
+  {
+    base::AutoLock autolock(free_connections_lock_);
+    if (free_connections_.size() < kMaxFreeSlaveConnections) {
+      free_connections_.push_back(connection);
+      return;
+    }
+  }
+  delete connection;
 }
 
 SlaveConnection::SlaveConnection(SlaveConnectionFactory* factory) {
   apr_pool_t* pool = pool_.pool();
 
+  // The conn_rec object itself, and its bucket allocator, live in the
+  // long-lived pool so that they can be reused each time this connection is
+  // recycled.  Everything else lives in the connection's own pool, which is
+  // cleared when the connection is recycled.
   slave_connection_ =
-      static_cast<conn_rec*>(apr_pcalloc(pool, sizeof(conn_rec)));
+      static_cast<conn_rec*>(apr_palloc(pool, sizeof(conn_rec)));
+  bucket_alloc_ = apr_bucket_alloc_create(pool);
+  connection_pool_ = NULL;
+  const apr_status_t pool_status = apr_pool_create(&connection_pool_, pool);
+  CHECK(pool_status == APR_SUCCESS);
+  CHECK(connection_pool_ != NULL);
+
+  // We're supposed to pass a socket object to ap_process_connection below, but
+  // there's no meaningful object to pass for this slave connection, because
+  // we're not really talking to the network.  Our pre-connection hook will
+  // prevent the core filters, which talk to the socket, from being inserted,
+  // so they won't notice anyway; nonetheless, we can't pass NULL to
+  // ap_process_connection because that can cause some other modules to
+  // segfault if they try to muck with the socket's settings.  So, we'll just
+  // allocate our own socket object for those modules to mess with.
+  //
+  // We don't want to open a real kernel socket just for that (it would cost
+  // us syscalls and a file descriptor per stream), so instead we wrap an
+  // invalid descriptor in an apr_socket_t.  apr_os_sock_put doesn't make any
+  // syscalls or register any cleanup that would try to close the descriptor.
+  // Modules that try to change the socket's settings will simply get an error
+  // (EBADF) back, which they already have to be prepared to handle.
+  slave_socket_ = NULL;
+  apr_os_sock_t no_descriptor = -1;
+  const apr_status_t status =
+      apr_os_sock_put(&slave_socket_, &no_descriptor, pool);
+  DCHECK(status == APR_SUCCESS);
+  DCHECK(slave_socket_ != NULL);
+
+  Init(factory);
+}
+
+SlaveConnection::~SlaveConnection() {
+  // pool_ destructor will take care of everything.
+}
+
+void SlaveConnection::Init(SlaveConnectionFactory* factory) {
+  apr_pool_t* pool = connection_pool_;
+
+  memset(slave_connection_, 0, sizeof(conn_rec));
 
   // Initialize what fields of the connection object we can (the rest are
-  // zeroed out by apr_pcalloc).  In particular, we should set at least those
-  // fields set by core_create_conn() in core.c in Apache.
+  // zeroed out by the memset above).  In particular, we should set at least
+  // those fields set by core_create_conn() in core.c in Apache.
   // -> id will be set once we are actually running the connection, in
   // ::Run().
   slave_connection_->clogging_input_filters = 0;
   slave_connection_->sbh = NULL;
   // We will manage this connection and all the associated resources with the
-  // pool we just created.
+  // connection pool, except for the bucket allocator, which we reuse.
   slave_connection_->pool = pool;
-  slave_connection_->bucket_alloc = apr_bucket_alloc_create(pool);
+  slave_connection_->bucket_alloc = bucket_alloc_;
   slave_connection_->conn_config = ap_create_conn_config(pool);
   slave_connection_->notes = apr_table_make(pool, 5);
   // Use the same server settings and client address for the slave connection
@@ -100,21 +230,6 @@ SlaveConnection::SlaveConnection(SlaveConnectionFactory* factory) {
   // id of the master connection. We save it here, and use it inside ::Run().
   master_connection_id_ = factory->master_connection_id_;
 
-  // We're supposed to pass a socket object to ap_process_connection below, but
-  // there's no meaningful object to pass for this slave connection, because
-  // we're not really talking to the network.  Our pre-connection hook will
-  // prevent the core filters, which talk to the socket, from being inserted,
-  // so they won't notice anyway; nonetheless, we can't pass NULL to
-  // ap_process_connection because that can cause some other modules to
-  // segfault if they try to muck with the socket's settings.  So, we'll just
-  // allocate our own socket object for those modules to mess with.  This is a
-  // kludge, but it seems to work.
-  slave_socket_ = NULL;
-  apr_status_t status = apr_socket_create(
-      &slave_socket_, APR_INET, SOCK_STREAM, APR_PROTO_TCP, pool);
-  DCHECK(status == APR_SUCCESS);
-  DCHECK(slave_socket_ != NULL);
-
   // In our context object for this connection, mark this connection as being
   // a slave.  Our pre-connection and process-connection hooks will notice
   // this, and act accordingly, when they are called for the slave
@@ -127,8 +242,12 @@ SlaveConnection::SlaveConnection(SlaveConnectionFactory* factory) {
   slave_context->set_spdy_version(factory->spdy_version_);
 }
 
-SlaveConnection::~SlaveConnection() {
-  // pool_ destructor will take care of everything.
+void SlaveConnection::Reset() {
+  // Clearing the pool runs all cleanups registered on it (deleting our slave
+  // context, and destroying the stream's filter objects, which live in the
+  // pool), but keeps its memory around, so that re-initializing the connection
+  // and setting up the next stream's filters is cheap.
+  apr_pool_clear(connection_pool_);
 }
 
 SlaveConnectionContext* SlaveConnection::GetSlaveConnectionContext() {
@@ -151,22 +270,29 @@ void SlaveConnection::Run() {
   // connection ID for the master connection with a small integer from IDPool
   // that's unique within the process, and, to avoid conflicts with
   // MPM-assigned connection IDs, we make our slave connection ID negative.
-  // We only have so many bits to work with
-  // (especially if long is only four bytes instead of eight), so we could
-  // potentially run into trouble if the master connection ID gets very large
-  // or we have too many active tasks simultaneously (i.e. more than 2^16).
-  // So, this approach definitely isn't any kind of robust; but it will
-  // probably usually work. It would, of course, be great to replace this
-  // with a better strategy, if we find one.
-  //
-  // TODO(mdsteele): We could also consider using an #if here to widen the
-  //   masks and the shift distance on systems where sizeof(long)==8.
-  //   We might as well use those extra bits if we have them.
+  // The in-process ID takes the low IdPool::kIdBits bits, and the master
+  // connection ID gets all the remaining bits but the sign bit.  Since the
+  // in-process ID is unique within the process, and the master connection ID
+  // is unique across processes, no two slave connections can share an ID so
+  // long as the master connection ID fits in its bits.  With an eight-byte
+  // long, that leaves 43 bits for the master connection ID, which no MPM will
+  // come anywhere near; with a four-byte long, there are only 15 bits (and
+  // the pool is limited to 2^16 IDs), so a very large server could still run
+  // into trouble.
   COMPILE_ASSERT(sizeof(long) >= 4, long_is_at_least_32_bits);
-  const uint16 in_process_id = IdPool::Instance()->Alloc();
-  const long slave_connectionid =
-      -(((master_connection_id_ & 0x7fffL) << 16) | in_process_id);
-  slave_connection_->id = slave_connectionid;
+  const int kMasterIdBits = sizeof(long) * 8 - 1 - IdPool::kIdBits;
+  const long kMasterIdMask = (1L << kMasterIdBits) - 1;
+  const uint32 in_process_id = IdPool::Instance()->Alloc();
+  if ((master_connection_id_ & ~kMasterIdMask) != 0) {
+    VLOG(1) << "Master connection ID " << master_connection_id_
+            << " is too large; slave connection IDs may collide";
+  }
+  // If the pool ran out of IDs, all the connections that got kOverFlowId
+  // will share the (otherwise unused) in-process ID zero.
+  const long slave_connection_id =
+      -(((master_connection_id_ & kMasterIdMask) << IdPool::kIdBits) |
+        (in_process_id == IdPool::kOverFlowId ? 0 : in_process_id));
+  slave_connection_->id = slave_connection_id;
 
   // Normally, the core pre-connection hook sets the core module's connection
   // context to the socket passed to ap_process_connection; certain other
@@ -180,11 +306,180 @@ void SlaveConnection::Run() {
   ap_set_module_config(slave_connection_->conn_config,
                        &core_module, slave_socket_);
 
-  // Invoke Apache's usual processing pipeline.  This will block until the
-  // connection is complete.
-  ap_process_connection(slave_connection_, slave_socket_);
+  // Invoke Apache's usual processing pipeline (or our shortcut through it, if
+  // the hooks allow it).  This will block until the connection is complete.
+  if (gSlavePreConnectionHooks != NULL) {
+    RunFastPath();
+  } else {
+    ap_process_connection(slave_connection_, slave_socket_);
+  }
 
   IdPool::Instance()->Free(in_process_id);
 }
 
+void SlaveConnection::RunFastPath() {
+  DCHECK(gSlavePreConnectionHooks != NULL);
+
+  // This mirrors what ap_process_connection would do for us, minus the work
+  // that we know is pointless for a slave connection.  We skip
+  // ap_update_vhost_given_ip, since base_server was copied from the master
+  // connection, which has already been through it.  Then we run the
+  // pre-connection hooks, with the same semantics as ap_run_pre_connection
+  // (DONE stops the hooks but still processes the connection; any other
+  // error aborts it).
+  for (PreConnectionHookList::const_iterator iter =
+           gSlavePreConnectionHooks->begin();
+       iter != gSlavePreConnectionHooks->end(); ++iter) {
+    const int status = (*iter)(slave_connection_, slave_socket_);
+    if (status == DONE) {
+      break;
+    } else if (status != OK && status != DECLINED) {
+      slave_connection_->aborted = 1;
+      break;
+    }
+  }
+  if (slave_connection_->aborted) {
+    return;
+  }
+
+  // A slave connection carries exactly one request, so rather than run the
+  // process-connection hooks (which would loop looking for keep-alive
+  // requests), we read and process the one request directly.  If the
+  // request couldn't be read properly, an error response will already have
+  // been sent.
+  DirectRequestSource* source =
+      GetSlaveConnectionContext()->direct_request_source();
+  request_rec* request = (source != NULL ? ReadDirectRequest(source) :
+                          ap_read_request(slave_connection_));
+  if (request == NULL) {
+    return;
+  }
+  slave_connection_->keepalive = AP_CONN_UNKNOWN;
+  if (request->status == HTTP_OK) {
+    ap_process_request(request);
+  }
+  // The request's pool is a subpool of the connection pool, so it will be
+  // cleaned up when the connection is recycled or deleted.
+}
+
+request_rec* SlaveConnection::ReadDirectRequest(DirectRequestSource* source) {
+  // Set up the request object the same way that ap_read_request (in
+  // protocol.c in Apache) does, up to the point where it would start reading
+  // the request line.
+  apr_pool_t* pool = NULL;
+  const apr_status_t status = apr_pool_create(&pool, slave_connection_->pool);
+  CHECK(status == APR_SUCCESS);
+  apr_pool_tag(pool, "request");
+  request_rec* request =
+      static_cast<request_rec*>(apr_pcalloc(pool, sizeof(request_rec)));
+  request->pool = pool;
+  request->connection = slave_connection_;
+  request->server = slave_connection_->base_server;
+  request->allowed_methods = ap_make_method_list(pool, 2);
+  request->headers_in = apr_table_make(pool, 25);
+  request->subprocess_env = apr_table_make(pool, 25);
+  request->headers_out = apr_table_make(pool, 12);
+  request->err_headers_out = apr_table_make(pool, 5);
+  request->notes = apr_table_make(pool, 5);
+  request->request_config = ap_create_request_config(pool);
+  request->proto_output_filters = slave_connection_->output_filters;
+  request->output_filters = request->proto_output_filters;
+  request->proto_input_filters = slave_connection_->input_filters;
+  request->input_filters = request->proto_input_filters;
+  ap_run_create_request(request);
+  request->per_dir_config = request->server->lookup_defaults;
+  request->read_body = REQUEST_NO_BODY;
+  request->status = HTTP_OK;
+  request->used_path_info = AP_REQ_DEFAULT_PATH_INFO;
+
+  // This is where ap_read_request would parse the request line and headers.
+  if (!source->PopulateRequest(request)) {
+    // Like ap_read_request, we leave the request pool to be cleaned up along
+    // with the connection pool.
+    return NULL;
+  }
+
+  // Now do the rest of what ap_read_request does, except that we don't insert
+  // the HTTP_IN filter: the body from our input filter is already unchunked,
+  // and ends where the stream ends.
+  ap_update_vhost_from_headers(request);
+  request->per_dir_config = request->server->lookup_defaults;
+  if (request->status == HTTP_OK && request->hostname == NULL &&
+      request->proto_num >= HTTP_VERSION(1, 1)) {
+    request->status = HTTP_BAD_REQUEST;
+  }
+  if (request->status != HTTP_OK) {
+    ap_send_error_response(request, 0);
+    ap_run_log_transaction(request);
+    return request;
+  }
+  const int access_status = ap_run_post_read_request(request);
+  if (access_status != OK) {
+    ap_die(access_status, request);
+    ap_run_log_transaction(request);
+    return NULL;
+  }
+
+  // Handle any Expect header as ap_read_request does.  The HTTP_IN filter
+  // would normally be the one to act on expecting_100, but we set it anyway
+  // so that the rest of Apache sees the request as it would have otherwise.
+  const char* expect = apr_table_get(request->headers_in, "Expect");
+  if (expect != NULL && expect[0] != '\0') {
+    if (LowerCaseEqualsASCII(expect, "100-continue")) {
+      request->expecting_100 = 1;
+    } else {
+      LOG(INFO) << "Client sent an unrecognized expectation value of "
+                << "Expect: " << expect;
+      request->status = HTTP_EXPECTATION_FAILED;
+      ap_send_error_response(request, 0);
+      ap_run_log_transaction(request);
+      return request;
+    }
+  }
+  return request;
+}
+
+// static
+void SlaveConnection::InitFastPath(apr_pool_t* pool) {
+  DCHECK(gSlavePreConnectionHooks == NULL);
+
+  // If any other module wants to take over processing of connections, we
+  // can't know whether it would do so for our slaves, so we have to go the
+  // slow way and let it decide.
+  const apr_array_header_t* process_hooks = ap_hook_get_process_connection();
+  if (process_hooks != NULL) {
+    const ap_LINK_process_connection_t* links =
+        reinterpret_cast<const ap_LINK_process_connection_t*>(
+            process_hooks->elts);
+    for (int i = 0; i < process_hooks->nelts; ++i) {
+      if (!IsKnownProcessConnectionHook(links[i].szName)) {
+        LOG(INFO) << "Not using fast path for slave connections, due to "
+                  << "process-connection hook from " << links[i].szName;
+        return;
+      }
+    }
+  }
+
+  scoped_ptr<PreConnectionHookList> hooks(new PreConnectionHookList);
+  const apr_array_header_t* pre_hooks = ap_hook_get_pre_connection();
+  if (pre_hooks != NULL) {
+    const ap_LINK_pre_connection_t* links =
+        reinterpret_cast<const ap_LINK_pre_connection_t*>(pre_hooks->elts);
+    for (int i = 0; i < pre_hooks->nelts; ++i) {
+      if (!IsNoOpPreConnectionHookForSlaves(links[i].szName)) {
+        hooks->push_back(links[i].pFunc);
+      }
+    }
+  }
+  VLOG(1) << "Using fast path for slave connections, with " << hooks->size()
+          << " pre-connection hooks";
+  gSlavePreConnectionHooks = hooks.release();
+  PoolRegisterDelete(pool, gSlavePreConnectionHooks);
+}
+
+// static
+bool SlaveConnection::IsFastPathEnabled() {
+  return gSlavePreConnectionHooks != NULL;
+}
+
 }  // namespace mod_spdy
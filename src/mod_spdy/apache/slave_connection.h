@@ -16,17 +16,24 @@
 #ifndef MOD_SPDY_APACHE_SLAVE_CONNECTION_H_
 #define MOD_SPDY_APACHE_SLAVE_CONNECTION_H_
 
+#include <vector>
+
 #include "base/basictypes.h"
+#include "base/synchronization/lock.h"
 #include "mod_spdy/apache/pool_util.h"
 #include "mod_spdy/common/protocol_util.h"
 
+struct apr_bucket_alloc_t;
+struct apr_pool_t;
 struct apr_sockaddr_t;
 struct apr_socket_t;
 struct conn_rec;
+struct request_rec;
 struct server_rec;
 
 namespace mod_spdy {
 
+class DirectRequestSource;
 class SlaveConnection;
 class SlaveConnectionContext;
 
@@ -55,12 +62,26 @@ class SlaveConnectionFactory {
   // You should attach I/O filters on its GetSlaveConnectionContext() before
   // calling Run().
   //
-  // The resulted object lives on the C++ heap, and must be deleted.
+  // The resulted object lives on the C++ heap, and must either be deleted or
+  // handed back to this factory with Recycle().  It may be a previously used
+  // connection that was recycled, rather than a brand new one.
   SlaveConnection* Create();
 
+  // Take back a slave connection, previously returned by Create(), that is
+  // done running.  Its pool is cleared (running any cleanups registered on it)
+  // right away, and the connection may be reused by a later call to Create().
+  // This is cheaper than deleting it and creating a new one.  This method is
+  // thread-safe with respect to Create(), so connections may be recycled from
+  // any thread.
+  void Recycle(SlaveConnection* connection);
+
  private:
   friend class SlaveConnection;
 
+  // Recycled connections, ready to be reused.
+  base::Lock free_connections_lock_;
+  std::vector<SlaveConnection*> free_connections_;
+
   // Saved information from master_connection
   bool is_using_ssl_;
   spdy::SpdyVersion spdy_version_;
@@ -95,13 +116,52 @@ class SlaveConnection {
   // the response to the output filter. Note that this is a blocking operation.
   void Run();
 
+  // Examines the pre-connection and process-connection hooks that modules
+  // have registered, and decides whether slave connections can skip
+  // ap_process_connection and run the HTTP request directly (see Run()).  This
+  // should be called once per child process, after all hooks have been
+  // registered and sorted (e.g. from a child-init hook), and before any slave
+  // connections are run.  If it is never called, slave connections always use
+  // ap_process_connection.  The cached hook list is deleted when the given
+  // pool is cleaned up.
+  static void InitFastPath(apr_pool_t* pool);
+
+  // Returns true if InitFastPath() decided that slave connections can use the
+  // fast path.  Only then will a DirectRequestSource set on the connection's
+  // SlaveConnectionContext be used.
+  static bool IsFastPathEnabled();
+
  private:
   SlaveConnection(SlaveConnectionFactory* factory);
   friend class SlaveConnectionFactory;
 
+  // (Re)initialize the conn_rec, along with everything hanging off of it that
+  // lives in connection_pool_, to be a fresh slave connection matching the
+  // factory's settings.  connection_pool_ must be newly created or cleared.
+  void Init(SlaveConnectionFactory* factory);
+
+  // Clear connection_pool_ (deleting everything that was allocated in it or
+  // registered for cleanup with it), so that the connection can be reused.
+  void Reset();
+
+  // Run the connection without going through ap_process_connection, using the
+  // pre-connection hooks cached by InitFastPath().
+  void RunFastPath();
+
+  // Create a new request on this connection, the way ap_read_request would,
+  // but with the request line and headers supplied by the given source rather
+  // than parsed from the input filters.  Returns NULL if there is no request
+  // to process.
+  request_rec* ReadDirectRequest(DirectRequestSource* source);
+
+  // The long-lived pool_ holds the objects that we reuse when the connection
+  // is recycled; connection_pool_, a subpool of pool_, is the conn_rec's own
+  // pool, and is cleared each time the connection is recycled.
   LocalPool pool_;
+  apr_pool_t* connection_pool_;  // owned by pool_
   conn_rec* slave_connection_;  // owned by pool_
-  apr_socket_t* slave_socket_;  // owned by pool_
+  apr_bucket_alloc_t* bucket_alloc_;  // owned by pool_
+  apr_socket_t* slave_socket_;  // owned by pool_; has no file descriptor
   long master_connection_id_;
 
   DISALLOW_COPY_AND_ASSIGN(SlaveConnection);
@@ -26,7 +26,10 @@ SlaveConnectionContext::SlaveConnectionContext()
       output_filter_handle_(NULL),
       output_filter_context_(NULL),
       input_filter_handle_(NULL),
-      input_filter_context_(NULL) {
+      input_filter_context_(NULL),
+      response_header_filter_handle_(NULL),
+      response_header_filter_context_(NULL),
+      direct_request_source_(NULL) {
 }
 
 SlaveConnectionContext::~SlaveConnectionContext() {}
@@ -43,4 +46,10 @@ void SlaveConnectionContext::SetInputFilter(
   input_filter_context_ = context;
 }
 
+void SlaveConnectionContext::SetResponseHeaderFilter(
+    ap_filter_rec_t* handle, void* context) {
+  response_header_filter_handle_ = handle;
+  response_header_filter_context_ = context;
+}
+
 }  // namespace mod_spdy
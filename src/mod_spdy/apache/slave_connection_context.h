@@ -22,11 +22,31 @@
 #include "mod_spdy/common/protocol_util.h"
 
 struct ap_filter_rec_t;
+struct request_rec;
 
 namespace mod_spdy {
 
 class SpdyStream;
 
+// Interface for an input source that can supply a slave connection's request
+// as structured data, so that Apache doesn't need to parse it out of HTTP/1.1
+// text coming from the input filter.
+class DirectRequestSource {
+ public:
+  DirectRequestSource() {}
+  virtual ~DirectRequestSource() {}
+
+  // Fill in the request line fields (method, URI, protocol, etc.) and the
+  // headers_in table of a freshly created request, blocking until they are
+  // available if necessary.  Once this succeeds, the input filter will supply
+  // only the raw request body, with no chunked encoding.  Returns false if no
+  // request could be read (e.g. because the stream was aborted).
+  virtual bool PopulateRequest(request_rec* request) = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(DirectRequestSource);
+};
+
 // Context for a 'slave' connection in mod_spdy, used to represent a fetch
 // of a given URL from within Apache (as opposed to outgoing SPDY session to
 // the client, which has a ConnectionContext).
@@ -73,6 +93,31 @@ class SlaveConnectionContext {
     return input_filter_context_;
   }
 
+  // An optional request-level output filter that, for each request on this
+  // connection, mod_spdy's insert-filter hook puts in place of Apache's
+  // HTTP_HEADER filter.  The handle is NULL if HTTP_HEADER should be left
+  // alone.
+  void SetResponseHeaderFilter(ap_filter_rec_t* handle, void* context);
+
+  ap_filter_rec_t* response_header_filter_handle() const {
+    return response_header_filter_handle_;
+  }
+
+  void* response_header_filter_context() const {
+    return response_header_filter_context_;
+  }
+
+  // If set (to non-NULL), the slave connection's request is built from this
+  // source rather than parsed from the input filter.  This is only honored
+  // when SlaveConnection::IsFastPathEnabled() is true, so it should not be set
+  // otherwise.  Not owned.
+  DirectRequestSource* direct_request_source() const {
+    return direct_request_source_;
+  }
+  void set_direct_request_source(DirectRequestSource* source) {
+    direct_request_source_ = source;
+  }
+
  private:
   // These are used to properly inform modules running on slave connections
   // on whether the connection should be treated as using SPDY and SSL.
@@ -91,6 +136,11 @@ class SlaveConnectionContext {
   ap_filter_rec_t* input_filter_handle_;
   void* input_filter_context_;
 
+  ap_filter_rec_t* response_header_filter_handle_;
+  void* response_header_filter_context_;
+
+  DirectRequestSource* direct_request_source_;
+
   DISALLOW_COPY_AND_ASSIGN(SlaveConnectionContext);
 };
 
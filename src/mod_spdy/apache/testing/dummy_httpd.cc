@@ -0,0 +1,172 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/apache/testing/dummy_httpd.h"
+
+#include <cstring>  // for strchr and strcmp
+
+#include "apr_buckets.h"
+#include "apr_strings.h"
+// Temporarily define CORE_PRIVATE so we can see the declaration for
+// ap_parse_uri (in http_protocol.h).
+#define CORE_PRIVATE
+#include "httpd.h"
+#include "http_core.h"
+#include "http_protocol.h"
+#include "http_request.h"
+#undef CORE_PRIVATE
+
+// For unit tests, we don't link in Apache's server code, which defines the
+// below functions.  We define simplified versions of them here, just good
+// enough for the tests that exercise the code calling them.
+
+namespace {
+
+apr_off_t gLimitRequestBody = 0;
+int gLastApDieStatus = 0;
+
+}  // namespace
+
+namespace mod_spdy {
+
+namespace testing {
+
+void SetLimitRequestBodyForTest(apr_off_t limit) {
+  gLimitRequestBody = limit;
+}
+
+int GetLastApDieStatusForTest() {
+  return gLastApDieStatus;
+}
+
+void ResetDummyHttpdForTest() {
+  gLimitRequestBody = 0;
+  gLastApDieStatus = 0;
+}
+
+}  // namespace testing
+
+}  // namespace mod_spdy
+
+extern "C" {
+
+// Unlike the real thing, this doesn't parse absolute URIs; it just splits the
+// path from the query string.
+AP_CORE_DECLARE(void) ap_parse_uri(request_rec* r, const char* uri) {
+  r->unparsed_uri = apr_pstrdup(r->pool, uri);
+  r->uri = apr_pstrdup(r->pool, uri);
+  char* query = strchr(r->uri, '?');
+  if (query != NULL) {
+    *query = '\0';
+    r->args = query + 1;
+  }
+}
+
+AP_DECLARE(int) ap_method_number_of(const char* method) {
+  static const struct { const char* name; int number; } kMethods[] = {
+    {"GET", M_GET}, {"HEAD", M_GET}, {"PUT", M_PUT}, {"POST", M_POST},
+    {"DELETE", M_DELETE}, {"OPTIONS", M_OPTIONS}
+  };
+  for (size_t i = 0; i < sizeof(kMethods) / sizeof(kMethods[0]); ++i) {
+    if (strcmp(method, kMethods[i].name) == 0) {
+      return kMethods[i].number;
+    }
+  }
+  return M_INVALID;
+}
+
+AP_DECLARE(apr_off_t) ap_get_limit_req_body(const request_rec* r) {
+  return gLimitRequestBody;
+}
+
+AP_DECLARE(char*) ap_escape_html(apr_pool_t* p, const char* s) {
+  return apr_pstrdup(p, s);
+}
+
+// Rather than generate an error response, just record the status.
+AP_DECLARE(void) ap_die(int type, request_rec* r) {
+  gLastApDieStatus = type;
+}
+
+AP_DECLARE(const char*) ap_get_status_line(int status) {
+  switch (status) {
+    case HTTP_OK:                 return "200 OK";
+    case HTTP_NO_CONTENT:         return "204 No Content";
+    case HTTP_MOVED_PERMANENTLY:  return "301 Moved Permanently";
+    case HTTP_NOT_MODIFIED:       return "304 Not Modified";
+    case HTTP_NOT_FOUND:          return "404 Not Found";
+    default:                      return "500 Internal Server Error";
+  }
+}
+
+// The real thing adds the AddDefaultCharset charset, if any.
+AP_DECLARE(const char*) ap_make_content_type(request_rec* r,
+                                             const char* type) {
+  return type;
+}
+
+AP_DECLARE(const char*) ap_get_server_banner(void) {
+  return "Apache";
+}
+
+// The error bucket type, as defined in Apache's error_bucket.c.
+
+static apr_status_t error_bucket_read(apr_bucket* b, const char** str,
+                                      apr_size_t* len,
+                                      apr_read_type_e block) {
+  *str = NULL;
+  *len = 0;
+  return APR_SUCCESS;
+}
+
+static void error_bucket_destroy(void* data) {
+  ap_bucket_error* h = static_cast<ap_bucket_error*>(data);
+  if (apr_bucket_shared_destroy(h)) {
+    apr_bucket_free(h);
+  }
+}
+
+AP_DECLARE_DATA const apr_bucket_type_t ap_bucket_type_error = {
+  "ERROR", 5, apr_bucket_type_t::APR_BUCKET_METADATA,
+  error_bucket_destroy,
+  error_bucket_read,
+  apr_bucket_setaside_notimpl,
+  apr_bucket_split_notimpl,
+  apr_bucket_shared_copy
+};
+
+AP_DECLARE(apr_bucket*) ap_bucket_error_make(apr_bucket* b, int error,
+                                             const char* buf,
+                                             apr_pool_t* p) {
+  ap_bucket_error* h = static_cast<ap_bucket_error*>(
+      apr_bucket_alloc(sizeof(*h), b->list));
+  h->status = error;
+  h->data = (buf == NULL ? NULL : apr_pstrdup(p, buf));
+  b = apr_bucket_shared_make(b, h, 0, 0);
+  b->type = &ap_bucket_type_error;
+  return b;
+}
+
+AP_DECLARE(apr_bucket*) ap_bucket_error_create(int error, const char* buf,
+                                               apr_pool_t* p,
+                                               apr_bucket_alloc_t* list) {
+  apr_bucket* b = static_cast<apr_bucket*>(
+      apr_bucket_alloc(sizeof(*b), list));
+  APR_BUCKET_INIT(b);
+  b->free = apr_bucket_free;
+  b->list = list;
+  return ap_bucket_error_make(b, error, buf, p);
+}
+
+}  // extern "C"
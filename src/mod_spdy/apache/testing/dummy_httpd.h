@@ -0,0 +1,44 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_APACHE_TESTING_DUMMY_HTTPD_H_
+#define MOD_SPDY_APACHE_TESTING_DUMMY_HTTPD_H_
+
+#include "apr.h"
+
+namespace mod_spdy {
+
+namespace testing {
+
+// For unit tests, we don't link in Apache itself, so dummy_httpd.cc defines
+// simple versions of the few httpd functions that our filters call.  These
+// functions let a test control what those dummies return.
+
+// Set the value that ap_get_limit_req_body will return for any request (zero,
+// the default, means no limit).
+void SetLimitRequestBodyForTest(apr_off_t limit);
+
+// Return the status passed to the most recent call to ap_die, or zero if it
+// hasn't been called since the last reset.
+int GetLastApDieStatusForTest();
+
+// Put the dummies back in their initial state; tests that change them should
+// call this when they're done.
+void ResetDummyHttpdForTest();
+
+}  // namespace testing
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_APACHE_TESTING_DUMMY_HTTPD_H_
@@ -0,0 +1,37 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/backed_data_frame.h"
+
+#include "base/logging.h"
+#include "base/strings/string_piece.h"
+#include "net/spdy/spdy_protocol.h"
+
+namespace mod_spdy {
+
+DataFrameBacking::DataFrameBacking() {}
+
+DataFrameBacking::~DataFrameBacking() {}
+
+BackedSpdyDataIR::BackedSpdyDataIR(net::SpdyStreamId stream_id,
+                                   base::StringPiece data,
+                                   DataFrameBacking* backing)
+    : PooledSpdyDataIR(stream_id), backing_(backing) {
+  DCHECK(backing_.get() != NULL);
+  SetDataShallow(data);
+}
+
+BackedSpdyDataIR::~BackedSpdyDataIR() {}
+
+}  // namespace mod_spdy
@@ -0,0 +1,60 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_COMMON_BACKED_DATA_FRAME_H_
+#define MOD_SPDY_COMMON_BACKED_DATA_FRAME_H_
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+#include "base/strings/string_piece.h"
+#include "mod_spdy/common/spdy_frame_pool.h"
+#include "net/spdy/spdy_protocol.h"
+
+namespace mod_spdy {
+
+// A reference-counted owner of some memory (such as a region of a file mapped
+// into memory) that DATA frames can point into rather than copying it.  The
+// memory must stay valid until the object is destroyed, which will happen on
+// whichever thread drops the last reference -- usually the master connection
+// thread, once it has written the last frame referring to it.
+class DataFrameBacking : public base::RefCountedThreadSafe<DataFrameBacking> {
+ public:
+  DataFrameBacking();
+
+ protected:
+  friend class base::RefCountedThreadSafe<DataFrameBacking>;
+  virtual ~DataFrameBacking();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(DataFrameBacking);
+};
+
+// A DATA frame whose payload is not copied, but instead points into memory
+// owned by a DataFrameBacking; the frame holds a reference to the backing
+// object for as long as the frame exists.
+class BackedSpdyDataIR : public PooledSpdyDataIR {
+ public:
+  BackedSpdyDataIR(net::SpdyStreamId stream_id, base::StringPiece data,
+                   DataFrameBacking* backing);
+  virtual ~BackedSpdyDataIR();
+
+ private:
+  const scoped_refptr<DataFrameBacking> backing_;
+
+  DISALLOW_COPY_AND_ASSIGN(BackedSpdyDataIR);
+};
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_BACKED_DATA_FRAME_H_
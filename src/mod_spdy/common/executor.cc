@@ -14,10 +14,28 @@
 
 #include "mod_spdy/common/executor.h"
 
+#include "net/instaweb/util/public/function.h"
+
 namespace mod_spdy {
 
 Executor::Executor() {}
 
 Executor::~Executor() {}
 
+void Executor::AddTasks(const TaskList& tasks) {
+  for (TaskList::const_iterator iter = tasks.begin();
+       iter != tasks.end(); ++iter) {
+    AddTask(iter->first, iter->second);
+  }
+}
+
+void Executor::StopAsync(net_instaweb::Function* callback) {
+  Stop();
+  callback->CallRun();
+}
+
+bool Executor::ShouldShed(SheddableWork work, net::SpdyPriority priority) {
+  return false;
+}
+
 }  // namespace mod_spdy
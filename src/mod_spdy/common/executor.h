@@ -15,6 +15,9 @@
 #ifndef MOD_SPDY_COMMON_EXECUTOR_H_
 #define MOD_SPDY_COMMON_EXECUTOR_H_
 
+#include <utility>
+#include <vector>
+
 #include "base/basictypes.h"
 #include "net/spdy/spdy_protocol.h"
 
@@ -28,6 +31,19 @@ namespace mod_spdy {
 // in an event-driven environment (e.g. Nginx).
 class Executor {
  public:
+  // A list of tasks to be added all at once, each paired with its priority.
+  typedef std::vector<std::pair<net_instaweb::Function*, net::SpdyPriority> >
+      TaskList;
+
+  // Kinds of new work that an overloaded executor may ask its callers to shed
+  // (see ShouldShed).
+  enum SheddableWork {
+    // SERVER_PUSH: A speculative server push stream.
+    SERVER_PUSH,
+    // LOW_PRIORITY_STREAM: A new client stream at the lowest priority.
+    LOW_PRIORITY_STREAM
+  };
+
   Executor();
   virtual ~Executor();
 
@@ -38,12 +54,34 @@ class Executor {
   virtual void AddTask(net_instaweb::Function* task,
                        net::SpdyPriority priority) = 0;
 
+  // Add several new tasks at once; the executor takes ownership of all of
+  // them.  This is equivalent to calling AddTask for each task in order, but
+  // gives the executor a chance to do so more cheaply (e.g. by taking its
+  // locks only once).  The default implementation simply calls AddTask
+  // repeatedly.
+  virtual void AddTasks(const TaskList& tasks);
+
+  // Return true if the caller should decline to start the given kind of new
+  // work at the given priority (rather than adding a task for it), because
+  // tasks at that priority are currently waiting too long before they get to
+  // run.  The default implementation always returns false.
+  virtual bool ShouldShed(SheddableWork work, net::SpdyPriority priority);
+
   // Stop the executor.  Cancel all tasks that were pushed onto this executor
   // but that have not yet begun to run.  Tasks that were already running will
   // continue to run, and this function must block until they have completed.
   // It must be safe to call this method more than once.
   virtual void Stop() = 0;
 
+  // Stop the executor, as with Stop, but without blocking until running tasks
+  // have completed.  Instead, once none of this executor's tasks are running
+  // anymore, run the given callback (which may happen on another thread, or
+  // before this method returns); the executor takes ownership of the
+  // callback.  The callback may delete the executor, but the executor must
+  // not otherwise be deleted until the callback has run.  The default
+  // implementation simply calls Stop and then runs the callback.
+  virtual void StopAsync(net_instaweb::Function* callback);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(Executor);
 };
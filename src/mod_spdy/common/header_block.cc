@@ -0,0 +1,245 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/header_block.h"
+
+#include <cstring>
+#include <string>
+#include <utility>  // for make_pair
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "base/strings/string_piece.h"
+
+namespace {
+
+// Header names that appear in most requests or responses, in sorted order.
+// Names of the form ":foo" are SPDY v3 special headers; "method", "status",
+// "url", and "version" are their SPDY v2 equivalents.
+const char* const kInternedNames[] = {
+  ":host",
+  ":method",
+  ":path",
+  ":scheme",
+  ":status",
+  ":version",
+  "accept-ranges",
+  "age",
+  "cache-control",
+  "content-encoding",
+  "content-language",
+  "content-length",
+  "content-location",
+  "content-type",
+  "date",
+  "etag",
+  "expires",
+  "last-modified",
+  "link",
+  "location",
+  "method",
+  "pragma",
+  "server",
+  "set-cookie",
+  "status",
+  "url",
+  "vary",
+  "version",
+  "x-associated-content",
+  "x-mod-spdy",
+  "x-powered-by",
+};
+
+// Compare two header names in the same order as std::string does (and hence
+// net::SpdyHeaderBlock).
+int CompareNames(const base::StringPiece& a, const base::StringPiece& b) {
+  const size_t min_size = a.size() < b.size() ? a.size() : b.size();
+  const int result = memcmp(a.data(), b.data(), min_size);
+  if (result != 0) {
+    return result;
+  }
+  return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+}
+
+char ToLowerASCII(char c) {
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+}  // namespace
+
+namespace mod_spdy {
+
+HeaderBlock::HeaderBlock() {}
+
+HeaderBlock::~HeaderBlock() {}
+
+base::StringPiece HeaderBlock::name(size_t index) const {
+  DCHECK_LT(index, entries_.size());
+  return EntryName(entries_[index]);
+}
+
+base::StringPiece HeaderBlock::value(size_t index) const {
+  DCHECK_LT(index, entries_.size());
+  const Entry& entry = entries_[index];
+  return base::StringPiece(buffer_.data() + entry.value_offset,
+                           entry.value_length);
+}
+
+bool HeaderBlock::Lookup(base::StringPiece name,
+                         base::StringPiece* value) const {
+  bool found = false;
+  const size_t index = FindEntry(name, &found);
+  if (found) {
+    *value = this->value(index);
+  }
+  return found;
+}
+
+void HeaderBlock::Set(base::StringPiece name, base::StringPiece value) {
+  const char* interned_name = FindInternedName(name);
+  if (interned_name != NULL) {
+    Insert(interned_name, buffer_.size(), name, value,
+           false);  // false = replace
+    return;
+  }
+  const size_t name_offset = buffer_.size();
+  name.AppendToString(&buffer_);
+  Insert(NULL, name_offset,
+         base::StringPiece(buffer_.data() + name_offset, name.size()),
+         value, false);  // false = replace
+}
+
+void HeaderBlock::MergeIn(base::StringPiece name, base::StringPiece value) {
+  // The SPDY spec requires that header names be lowercase.  Lowercase the name
+  // straight into the end of the buffer; if it turns out to be interned, or
+  // we already have it, Insert will chop it off again.
+  const size_t name_offset = buffer_.size();
+  for (size_t i = 0; i < name.size(); ++i) {
+    buffer_.push_back(ToLowerASCII(name[i]));
+  }
+  const base::StringPiece lower_name(buffer_.data() + name_offset,
+                                     name.size());
+  Insert(FindInternedName(lower_name), name_offset, lower_name, value,
+         true);  // true = merge
+}
+
+void HeaderBlock::Clear() {
+  buffer_.clear();
+  entries_.clear();
+}
+
+void HeaderBlock::CopyTo(net::SpdyHeaderBlock* headers) const {
+  DCHECK(headers);
+  // Since our entries are already in order, each one can be inserted at the
+  // end of the map in constant time.
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    headers->insert(headers->end(), std::make_pair(name(i).as_string(),
+                                                   value(i).as_string()));
+  }
+}
+
+// static
+const char* HeaderBlock::FindInternedName(base::StringPiece name) {
+  size_t low = 0;
+  size_t high = arraysize(kInternedNames);
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    const int cmp = CompareNames(kInternedNames[mid], name);
+    if (cmp == 0) {
+      return kInternedNames[mid];
+    } else if (cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return NULL;
+}
+
+base::StringPiece HeaderBlock::EntryName(const Entry& entry) const {
+  if (entry.interned_name != NULL) {
+    return base::StringPiece(entry.interned_name, entry.name_length);
+  }
+  return base::StringPiece(buffer_.data() + entry.name_offset,
+                           entry.name_length);
+}
+
+size_t HeaderBlock::FindEntry(base::StringPiece name, bool* found) const {
+  size_t low = 0;
+  size_t high = entries_.size();
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    const int cmp = CompareNames(EntryName(entries_[mid]), name);
+    if (cmp == 0) {
+      *found = true;
+      return mid;
+    } else if (cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  *found = false;
+  return low;
+}
+
+void HeaderBlock::Insert(const char* interned_name, size_t name_offset,
+                         base::StringPiece name, base::StringPiece value,
+                         bool merge) {
+  bool found = false;
+  const size_t index = FindEntry(name, &found);
+
+  // Anything from name_offset on is a copy of the name, which we only need to
+  // keep if this is a new, non-interned header.
+  if (found || interned_name != NULL) {
+    buffer_.resize(name_offset);
+  }
+
+  if (!found) {
+    Entry entry;
+    entry.interned_name = interned_name;
+    entry.name_offset = static_cast<uint32>(name_offset);
+    entry.name_length = static_cast<uint32>(name.size());
+    entry.value_offset = static_cast<uint32>(buffer_.size());
+    entry.value_length = static_cast<uint32>(value.size());
+    value.AppendToString(&buffer_);
+    entries_.insert(entries_.begin() + index, entry);
+    return;
+  }
+
+  Entry* entry = &entries_[index];
+  if (!merge) {
+    // Leave the old value behind in the buffer; it'll be reclaimed by Clear.
+    entry->value_offset = static_cast<uint32>(buffer_.size());
+    entry->value_length = static_cast<uint32>(value.size());
+    value.AppendToString(&buffer_);
+    return;
+  }
+
+  // To merge, we need the old value, a NUL, and the new value contiguous at
+  // the end of the buffer.  If the old value is already at the end (as it will
+  // be for repeated headers that arrive together, such as Set-Cookie), we can
+  // just extend it; otherwise copy it to the end first.
+  if (entry->value_offset + entry->value_length != buffer_.size()) {
+    const size_t old_offset = entry->value_offset;
+    entry->value_offset = static_cast<uint32>(buffer_.size());
+    buffer_.append(buffer_, old_offset, entry->value_length);
+  }
+  buffer_.push_back('\0');
+  value.AppendToString(&buffer_);
+  entry->value_length = static_cast<uint32>(buffer_.size() -
+                                            entry->value_offset);
+}
+
+}  // namespace mod_spdy
@@ -0,0 +1,105 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_COMMON_HEADER_BLOCK_H_
+#define MOD_SPDY_COMMON_HEADER_BLOCK_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+#include "net/spdy/spdy_framer.h"  // for SpdyHeaderBlock
+
+namespace mod_spdy {
+
+// A compact set of SPDY header name/value pairs, which we use instead of
+// net::SpdyHeaderBlock (a std::map<std::string, std::string>) while building
+// up the headers for a frame.  All names and values are stored in a single
+// buffer, and the names of common headers (":status", "content-type", and so
+// on) aren't stored at all, but refer to a static table.  Thus adding a header
+// doesn't usually allocate any memory, and a HeaderBlock that is cleared and
+// reused (as for each response on a stream) allocates hardly at all.
+//
+// Entries are kept sorted by name, in the same order as net::SpdyHeaderBlock,
+// so that converting to one at the framer boundary (CopyTo) is a single pass.
+class HeaderBlock {
+ public:
+  HeaderBlock();
+  ~HeaderBlock();
+
+  bool empty() const { return entries_.empty(); }
+  size_t size() const { return entries_.size(); }
+
+  // Get the name or value of the header at the given index, which must be
+  // less than size().  Headers are in order of name.  The returned pieces
+  // remain valid until the block is next modified.
+  base::StringPiece name(size_t index) const;
+  base::StringPiece value(size_t index) const;
+
+  // If there is a header with the given name (which must be lowercase), set
+  // *value to its value and return true; otherwise return false.
+  bool Lookup(base::StringPiece name, base::StringPiece* value) const;
+
+  // Set the value of a header, replacing any existing value.  The name must
+  // already be lowercase.
+  void Set(base::StringPiece name, base::StringPiece value);
+
+  // Add a header, lower-casing the name and, if there's already a header with
+  // that name, appending the value to the existing one (separated by a NUL
+  // byte, as SPDY requires).  This is the equivalent of MergeInHeader.
+  void MergeIn(base::StringPiece name, base::StringPiece value);
+
+  // Remove all headers.  The memory used is kept for reuse.
+  void Clear();
+
+  // Add all of these headers to *headers, for passing to the SPDY framer.
+  void CopyTo(net::SpdyHeaderBlock* headers) const;
+
+  // Return the interned copy of the given (lowercase) header name, or NULL if
+  // it isn't one of the common names that we intern.  Exposed for testing.
+  static const char* FindInternedName(base::StringPiece name);
+
+ private:
+  struct Entry {
+    // If the name is interned, this points to it, and name_offset is unused;
+    // otherwise this is NULL and the name is in buffer_.
+    const char* interned_name;
+    uint32 name_offset;
+    uint32 name_length;
+    uint32 value_offset;
+    uint32 value_length;
+  };
+
+  base::StringPiece EntryName(const Entry& entry) const;
+
+  // Return the index of the entry with the given name, or the index at which
+  // it should be inserted if there isn't one, and set *found accordingly.
+  size_t FindEntry(base::StringPiece name, bool* found) const;
+
+  // Add or update the entry for the name.  Anything in buffer_ from
+  // name_offset on is a copy of the name that was just appended, which is
+  // truncated away again if it turns out not to be needed.
+  void Insert(const char* interned_name, size_t name_offset,
+              base::StringPiece name, base::StringPiece value, bool merge);
+
+  std::string buffer_;
+  std::vector<Entry> entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(HeaderBlock);
+};
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_HEADER_BLOCK_H_
@@ -0,0 +1,155 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/header_block.h"
+
+#include <string>
+
+#include "base/strings/string_piece.h"
+#include "mod_spdy/common/protocol_util.h"
+#include "net/spdy/spdy_framer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+using mod_spdy::HeaderBlock;
+
+// Check that the block holds exactly the expected headers, in order.
+void ExpectHeaders(const net::SpdyHeaderBlock& expected,
+                   const HeaderBlock& block) {
+  ASSERT_EQ(expected.size(), block.size());
+  size_t index = 0;
+  for (net::SpdyHeaderBlock::const_iterator iter = expected.begin();
+       iter != expected.end(); ++iter, ++index) {
+    EXPECT_EQ(iter->first, block.name(index).as_string());
+    EXPECT_EQ(iter->second, block.value(index).as_string());
+  }
+  net::SpdyHeaderBlock copy;
+  block.CopyTo(&copy);
+  EXPECT_TRUE(expected == copy);
+}
+
+TEST(HeaderBlockTest, Empty) {
+  HeaderBlock block;
+  EXPECT_TRUE(block.empty());
+  EXPECT_EQ(0u, block.size());
+  base::StringPiece value;
+  EXPECT_FALSE(block.Lookup("content-type", &value));
+  ExpectHeaders(net::SpdyHeaderBlock(), block);
+}
+
+TEST(HeaderBlockTest, InternedNames) {
+  EXPECT_TRUE(HeaderBlock::FindInternedName(":status") != NULL);
+  EXPECT_TRUE(HeaderBlock::FindInternedName("content-type") != NULL);
+  EXPECT_TRUE(HeaderBlock::FindInternedName("x-mod-spdy") != NULL);
+  EXPECT_TRUE(HeaderBlock::FindInternedName("Content-Type") == NULL);
+  EXPECT_TRUE(HeaderBlock::FindInternedName("content-typ") == NULL);
+  EXPECT_TRUE(HeaderBlock::FindInternedName("x-whatever") == NULL);
+  EXPECT_STREQ("content-type", HeaderBlock::FindInternedName("content-type"));
+  // The same name should always give the same pointer.
+  EXPECT_EQ(HeaderBlock::FindInternedName("date"),
+            HeaderBlock::FindInternedName(std::string("date")));
+}
+
+TEST(HeaderBlockTest, SetKeepsHeadersInOrder) {
+  HeaderBlock block;
+  net::SpdyHeaderBlock expected;
+  const char* const kNames[] = {
+    "x-foo", ":status", "content-type", "a", "zzz", ":version", "x-bar",
+    "content-length", "x-foo-bar", "date",
+  };
+  for (size_t i = 0; i < arraysize(kNames); ++i) {
+    const std::string value = std::string("value of ") + kNames[i];
+    block.Set(kNames[i], value);
+    expected[kNames[i]] = value;
+    ExpectHeaders(expected, block);
+  }
+
+  base::StringPiece value;
+  ASSERT_TRUE(block.Lookup("x-foo-bar", &value));
+  EXPECT_EQ("value of x-foo-bar", value.as_string());
+  ASSERT_TRUE(block.Lookup(":status", &value));
+  EXPECT_EQ("value of :status", value.as_string());
+  EXPECT_FALSE(block.Lookup("x-baz", &value));
+}
+
+TEST(HeaderBlockTest, SetReplacesValue) {
+  HeaderBlock block;
+  block.Set("x-foo", "bar");
+  block.Set(":status", "200");
+  block.Set("x-foo", "baz");
+  block.Set(":status", "404");
+  net::SpdyHeaderBlock expected;
+  expected["x-foo"] = "baz";
+  expected[":status"] = "404";
+  ExpectHeaders(expected, block);
+}
+
+// MergeIn should behave just like MergeInHeader.
+TEST(HeaderBlockTest, MergeInMatchesMergeInHeader) {
+  const char* const kHeaders[][2] = {
+    {"Content-Type", "text/plain"},
+    {"X-Foo", "bar"},
+    {"Set-Cookie", "a=1"},
+    {"Set-Cookie", "b=2"},
+    {"X-Baz", "quux"},
+    {"x-foo", "baz"},
+    {"SET-COOKIE", "c=3"},
+    {"Date", "today"},
+    {"X-Empty", ""},
+    {"x-empty", ""},
+  };
+  HeaderBlock block;
+  net::SpdyHeaderBlock expected;
+  for (size_t i = 0; i < arraysize(kHeaders); ++i) {
+    block.MergeIn(kHeaders[i][0], kHeaders[i][1]);
+    mod_spdy::MergeInHeader(kHeaders[i][0], kHeaders[i][1], &expected);
+    ExpectHeaders(expected, block);
+  }
+  base::StringPiece value;
+  ASSERT_TRUE(block.Lookup("set-cookie", &value));
+  EXPECT_EQ(std::string("a=1\0b=2\0c=3", 11), value.as_string());
+}
+
+TEST(HeaderBlockTest, ClearAndReuse) {
+  HeaderBlock block;
+  block.MergeIn("X-Foo", "bar");
+  block.Set(":status", "200");
+  block.Clear();
+  EXPECT_TRUE(block.empty());
+  base::StringPiece value;
+  EXPECT_FALSE(block.Lookup("x-foo", &value));
+
+  block.MergeIn("X-Baz", "quux");
+  net::SpdyHeaderBlock expected;
+  expected["x-baz"] = "quux";
+  ExpectHeaders(expected, block);
+}
+
+TEST(HeaderBlockTest, CopyToAddsToExistingHeaders) {
+  HeaderBlock block;
+  block.Set("x-foo", "bar");
+  block.Set(":status", "200");
+  net::SpdyHeaderBlock headers;
+  headers["x-aaa"] = "1";
+  headers["x-zzz"] = "2";
+  block.CopyTo(&headers);
+  ASSERT_EQ(4u, headers.size());
+  EXPECT_EQ("1", headers["x-aaa"]);
+  EXPECT_EQ("bar", headers["x-foo"]);
+  EXPECT_EQ("200", headers[":status"]);
+  EXPECT_EQ("2", headers["x-zzz"]);
+}
+
+}  // namespace
@@ -0,0 +1,149 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/header_name.h"
+
+#include <cstring>
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "base/strings/string_piece.h"
+
+namespace mod_spdy {
+
+namespace {
+
+struct KnownName {
+  const char* name;
+  size_t length;
+  HeaderName header;
+};
+
+// The names we recognize, in HeaderName order.  (We can't use the constants
+// from protocol_util.h here, since they aren't compile-time constants; the
+// unit test checks that these match.)
+const KnownName kKnownNames[] = {
+  {"accept-encoding", 15, HEADER_ACCEPT_ENCODING},
+  {"connection", 10, HEADER_CONNECTION},
+  {"content-length", 14, HEADER_CONTENT_LENGTH},
+  {"content-type", 12, HEADER_CONTENT_TYPE},
+  {"host", 4, HEADER_HOST},
+  {"keep-alive", 10, HEADER_KEEP_ALIVE},
+  {"proxy-connection", 16, HEADER_PROXY_CONNECTION},
+  {"referer", 7, HEADER_REFERER},
+  {"transfer-encoding", 17, HEADER_TRANSFER_ENCODING},
+  {"x-associated-content", 20, HEADER_X_ASSOCIATED_CONTENT},
+  {"x-mod-spdy", 10, HEADER_X_MOD_SPDY},
+  {"method", 6, HEADER_SPDY2_METHOD},
+  {"scheme", 6, HEADER_SPDY2_SCHEME},
+  {"status", 6, HEADER_SPDY2_STATUS},
+  {"url", 3, HEADER_SPDY2_URL},
+  {"version", 7, HEADER_SPDY2_VERSION},
+  {":host", 5, HEADER_SPDY3_HOST},
+  {":method", 7, HEADER_SPDY3_METHOD},
+  {":path", 5, HEADER_SPDY3_PATH},
+  {":scheme", 7, HEADER_SPDY3_SCHEME},
+  {":status", 7, HEADER_SPDY3_STATUS},
+  {":version", 8, HEADER_SPDY3_VERSION},
+};
+COMPILE_ASSERT(arraysize(kKnownNames) == NUM_HEADER_NAMES - 1,
+               known_names_must_match_header_name_enum);
+
+const size_t kMinNameLength = 3;   // "url"
+const size_t kMaxNameLength = 20;  // "x-associated-content"
+
+// A perfect hash of the names above: for each one, HashName gives a distinct
+// slot, which holds its index in kKnownNames.  The multipliers in HashName
+// were found by searching for the smallest ones that give no collisions in a
+// 64-entry table; if you add a name, search again and regenerate this table
+// (the unit test checks that every name maps to itself).
+const int8 kSlots[64] = {
+  -1, -1, -1,  1,  3, 14,  8, -1,  6, -1, 12, -1, -1, -1, -1, -1,
+  17,  2, -1, -1, 21, 16, -1, -1, -1, -1, -1, -1, -1, -1, -1, 19,
+  -1,  9, -1, 11, -1, -1, -1, -1, -1, -1, -1,  4, -1, 20, -1, -1,
+  -1, 18, 15, -1, 10, 13,  7, -1,  5,  0, -1, -1, -1, -1, -1, -1,
+};
+
+inline unsigned char FoldChar(char c) {
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// The name must be at least two characters long.
+inline size_t HashName(const base::StringPiece& name) {
+  return (name.size() * 5 + FoldChar(name[1]) * 13 +
+          FoldChar(name[name.size() - 1])) & (arraysize(kSlots) - 1);
+}
+
+// Lowercase all eight bytes of the word at once.  For each byte, we compute
+// whether it is in the range 'A'..'Z' using additions that can't carry into
+// the next byte (having first masked off the high bits), and then set the 0x20
+// bit of those bytes.  Bytes with the high bit set are left alone.
+inline uint64 FoldWord(uint64 word) {
+  const uint64 kOnes = GG_UINT64_C(0x0101010101010101);
+  const uint64 low_bits = word & (0x7f * kOnes);
+  const uint64 at_least_a = low_bits + (0x80 - 'A') * kOnes;
+  const uint64 above_z = low_bits + (0x80 - 'Z' - 1) * kOnes;
+  const uint64 is_upper = (at_least_a ^ above_z) & ~word & (0x80 * kOnes);
+  return word | (is_upper >> 2);
+}
+
+// Load up to eight bytes into a word, zero-filling the rest.
+inline uint64 LoadWord(const char* data, size_t size) {
+  uint64 word = 0;
+  memcpy(&word, data, size);
+  return word;
+}
+
+// Return true if the data, when lowercased, equals the given lowercase string
+// of the same length.  This compares eight bytes at a time.
+bool EqualsFolded(const char* data, const char* lower, size_t length) {
+  while (length >= sizeof(uint64)) {
+    if (FoldWord(LoadWord(data, sizeof(uint64))) !=
+        LoadWord(lower, sizeof(uint64))) {
+      return false;
+    }
+    data += sizeof(uint64);
+    lower += sizeof(uint64);
+    length -= sizeof(uint64);
+  }
+  return FoldWord(LoadWord(data, length)) == LoadWord(lower, length);
+}
+
+}  // namespace
+
+HeaderName ClassifyHeaderName(base::StringPiece name) {
+  if (name.size() < kMinNameLength || name.size() > kMaxNameLength) {
+    return HEADER_OTHER;
+  }
+  const int index = kSlots[HashName(name)];
+  if (index < 0) {
+    return HEADER_OTHER;
+  }
+  const KnownName& known = kKnownNames[index];
+  if (known.length != name.size() ||
+      !EqualsFolded(name.data(), known.name, known.length)) {
+    return HEADER_OTHER;
+  }
+  return known.header;
+}
+
+const char* HeaderNameToString(HeaderName header) {
+  if (header <= HEADER_OTHER || header >= NUM_HEADER_NAMES) {
+    return NULL;
+  }
+  DCHECK_EQ(header, kKnownNames[header - 1].header);
+  return kKnownNames[header - 1].name;
+}
+
+}  // namespace mod_spdy
@@ -0,0 +1,68 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_COMMON_HEADER_NAME_H_
+#define MOD_SPDY_COMMON_HEADER_NAME_H_
+
+#include "base/strings/string_piece.h"
+
+namespace mod_spdy {
+
+// The header names that mod_spdy needs to recognize when converting between
+// HTTP and SPDY.  Each corresponds to one of the name constants declared in
+// protocol_util.h.
+enum HeaderName {
+  HEADER_OTHER,  // any header not listed below
+
+  // HTTP headers:
+  HEADER_ACCEPT_ENCODING,
+  HEADER_CONNECTION,
+  HEADER_CONTENT_LENGTH,
+  HEADER_CONTENT_TYPE,
+  HEADER_HOST,
+  HEADER_KEEP_ALIVE,
+  HEADER_PROXY_CONNECTION,
+  HEADER_REFERER,
+  HEADER_TRANSFER_ENCODING,
+  HEADER_X_ASSOCIATED_CONTENT,
+  HEADER_X_MOD_SPDY,
+
+  // Magic headers for SPDY v2:
+  HEADER_SPDY2_METHOD,
+  HEADER_SPDY2_SCHEME,
+  HEADER_SPDY2_STATUS,
+  HEADER_SPDY2_URL,
+  HEADER_SPDY2_VERSION,
+
+  // Magic headers for SPDY v3:
+  HEADER_SPDY3_HOST,
+  HEADER_SPDY3_METHOD,
+  HEADER_SPDY3_PATH,
+  HEADER_SPDY3_SCHEME,
+  HEADER_SPDY3_STATUS,
+  HEADER_SPDY3_VERSION,
+
+  NUM_HEADER_NAMES
+};
+
+// Identify the given header name, ignoring case.  This costs one hash-table
+// probe and one string comparison, no matter how many names we recognize.
+HeaderName ClassifyHeaderName(base::StringPiece name);
+
+// Return the (lowercase) name of the given header, or NULL for HEADER_OTHER.
+const char* HeaderNameToString(HeaderName header);
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_HEADER_NAME_H_
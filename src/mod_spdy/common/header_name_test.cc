@@ -0,0 +1,143 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/header_name.h"
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "base/strings/string_piece.h"
+#include "base/strings/string_util.h"
+#include "base/time/time.h"
+#include "mod_spdy/common/protocol_util.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+using mod_spdy::ClassifyHeaderName;
+using mod_spdy::HeaderName;
+using mod_spdy::HeaderNameToString;
+
+// Every HeaderName should round-trip through its string, and should match the
+// corresponding constant in protocol_util.
+TEST(HeaderNameTest, AllNames) {
+  namespace http = mod_spdy::http;
+  namespace spdy = mod_spdy::spdy;
+  const char* const kExpected[] = {
+    http::kAcceptEncoding, http::kConnection, http::kContentLength,
+    http::kContentType, http::kHost, http::kKeepAlive, http::kProxyConnection,
+    http::kReferer, http::kTransferEncoding, http::kXAssociatedContent,
+    http::kXModSpdy, spdy::kSpdy2Method, spdy::kSpdy2Scheme,
+    spdy::kSpdy2Status, spdy::kSpdy2Url, spdy::kSpdy2Version,
+    spdy::kSpdy3Host, spdy::kSpdy3Method, spdy::kSpdy3Path,
+    spdy::kSpdy3Scheme, spdy::kSpdy3Status, spdy::kSpdy3Version,
+  };
+  ASSERT_EQ(static_cast<size_t>(mod_spdy::NUM_HEADER_NAMES - 1),
+            arraysize(kExpected));
+  EXPECT_TRUE(HeaderNameToString(mod_spdy::HEADER_OTHER) == NULL);
+  for (int i = mod_spdy::HEADER_OTHER + 1; i < mod_spdy::NUM_HEADER_NAMES;
+       ++i) {
+    const HeaderName header = static_cast<HeaderName>(i);
+    ASSERT_STREQ(kExpected[i - 1], HeaderNameToString(header));
+    EXPECT_EQ(header, ClassifyHeaderName(kExpected[i - 1]));
+  }
+}
+
+TEST(HeaderNameTest, IgnoresCase) {
+  EXPECT_EQ(mod_spdy::HEADER_CONTENT_LENGTH,
+            ClassifyHeaderName("Content-Length"));
+  EXPECT_EQ(mod_spdy::HEADER_TRANSFER_ENCODING,
+            ClassifyHeaderName("TRANSFER-ENCODING"));
+  EXPECT_EQ(mod_spdy::HEADER_X_ASSOCIATED_CONTENT,
+            ClassifyHeaderName("X-Associated-Content"));
+  EXPECT_EQ(mod_spdy::HEADER_SPDY3_HOST, ClassifyHeaderName(":HoSt"));
+  EXPECT_EQ(mod_spdy::HEADER_SPDY2_URL, ClassifyHeaderName("URL"));
+}
+
+TEST(HeaderNameTest, OtherNames) {
+  EXPECT_EQ(mod_spdy::HEADER_OTHER, ClassifyHeaderName(""));
+  EXPECT_EQ(mod_spdy::HEADER_OTHER, ClassifyHeaderName("x"));
+  EXPECT_EQ(mod_spdy::HEADER_OTHER, ClassifyHeaderName("date"));
+  EXPECT_EQ(mod_spdy::HEADER_OTHER, ClassifyHeaderName("content-lengths"));
+  EXPECT_EQ(mod_spdy::HEADER_OTHER, ClassifyHeaderName("content-lengtH "));
+  EXPECT_EQ(mod_spdy::HEADER_OTHER, ClassifyHeaderName("connectioN\xC1"));
+  EXPECT_EQ(mod_spdy::HEADER_OTHER,
+            ClassifyHeaderName("x-associated-contents"));
+  // These differ from real names only in characters that a naive case fold
+  // (OR-ing in 0x20) would confuse.
+  EXPECT_EQ(mod_spdy::HEADER_OTHER, ClassifyHeaderName("keep\ralive"));
+  EXPECT_EQ(mod_spdy::HEADER_OTHER, ClassifyHeaderName("\x1ahost"));
+  EXPECT_EQ(mod_spdy::HEADER_OTHER, ClassifyHeaderName("X-MOD\rSPDY"));
+  EXPECT_EQ(mod_spdy::HEADER_OTHER,
+            ClassifyHeaderName(std::string("url\0", 4)));
+}
+
+// Time classifying a typical mix of header names, compared with the chain of
+// LowerCaseEqualsASCII calls this replaced.  This is disabled by default; run
+// it with --gtest_also_run_disabled_tests.
+TEST(HeaderNameBenchmark, DISABLED_Classify) {
+  const char* const kNames[] = {
+    ":method", ":path", ":version", ":host", ":scheme", "accept",
+    "accept-encoding", "accept-language", "cookie", "user-agent",
+    "Date", "Server", "Last-Modified", "ETag", "Accept-Ranges",
+    "Content-Length", "Cache-Control", "Content-Type", "Connection",
+    "Keep-Alive", "Vary", "Transfer-Encoding",
+  };
+  const int kIterations = 2000000;
+
+  int num_known = 0;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < kIterations; ++i) {
+    for (size_t j = 0; j < arraysize(kNames); ++j) {
+      const base::StringPiece name(kNames[j]);
+      if (ClassifyHeaderName(name) != mod_spdy::HEADER_OTHER) {
+        ++num_known;
+      }
+    }
+  }
+  const base::TimeDelta hash_time = base::TimeTicks::Now() - start;
+
+  // The old way: compare against each name in turn.
+  const char* const kCandidates[] = {
+    mod_spdy::http::kAcceptEncoding, mod_spdy::http::kConnection,
+    mod_spdy::http::kContentLength, mod_spdy::http::kContentType,
+    mod_spdy::http::kHost,
+    mod_spdy::http::kKeepAlive, mod_spdy::http::kProxyConnection,
+    mod_spdy::http::kTransferEncoding, mod_spdy::spdy::kSpdy3Host,
+    mod_spdy::spdy::kSpdy3Method, mod_spdy::spdy::kSpdy3Path,
+    mod_spdy::spdy::kSpdy3Scheme, mod_spdy::spdy::kSpdy3Version,
+  };
+  int num_compared = 0;
+  start = base::TimeTicks::Now();
+  for (int i = 0; i < kIterations; ++i) {
+    for (size_t j = 0; j < arraysize(kNames); ++j) {
+      const base::StringPiece name(kNames[j]);
+      for (size_t k = 0; k < arraysize(kCandidates); ++k) {
+        if (LowerCaseEqualsASCII(name.begin(), name.end(), kCandidates[k])) {
+          ++num_compared;
+          break;
+        }
+      }
+    }
+  }
+  const base::TimeDelta compare_time = base::TimeTicks::Now() - start;
+
+  EXPECT_EQ(num_known, num_compared);
+  LOG(INFO) << kIterations * arraysize(kNames) << " names: "
+            << hash_time.InMillisecondsF() << " ms with ClassifyHeaderName, "
+            << compare_time.InMillisecondsF() << " ms comparing each name";
+}
+
+}  // namespace
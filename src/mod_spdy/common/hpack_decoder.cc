@@ -0,0 +1,178 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/hpack_decoder.h"
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "base/strings/string_piece.h"
+#include "mod_spdy/common/hpack_header_table.h"
+#include "mod_spdy/common/hpack_huffman.h"
+#include "net/spdy/spdy_framer.h"
+
+namespace {
+
+// Read an integer with an N-bit prefix (RFC 7541 section 5.1) from the front
+// of *input, removing it from *input, and return true.  Return false if the
+// input is truncated or the value doesn't fit comfortably in 32 bits.
+bool DecodeInteger(int prefix_bits, base::StringPiece* input, uint32* value) {
+  if (input->empty()) {
+    return false;
+  }
+  const uint32 prefix_max = (1u << prefix_bits) - 1;
+  uint32 result = static_cast<uint8>((*input)[0]) & prefix_max;
+  input->remove_prefix(1);
+  if (result < prefix_max) {
+    *value = result;
+    return true;
+  }
+  // No legitimate value we care about (lengths, indices, table sizes) needs
+  // more than 28 bits, so stop there rather than worrying about overflow.
+  for (int shift = 0; shift <= 21; shift += 7) {
+    if (input->empty()) {
+      return false;
+    }
+    const uint8 byte = static_cast<uint8>((*input)[0]);
+    input->remove_prefix(1);
+    result += static_cast<uint32>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Read a string literal (RFC 7541 section 5.2) from the front of *input,
+// removing it from *input, and set *value to the decoded string and return
+// true.  The result points either into the original input or into *buffer.
+// Return false if the input is truncated or badly Huffman-encoded.
+bool DecodeString(base::StringPiece* input, std::string* buffer,
+                  base::StringPiece* value) {
+  if (input->empty()) {
+    return false;
+  }
+  const bool huffman = ((*input)[0] & 0x80) != 0;
+  uint32 length = 0;
+  if (!DecodeInteger(7, input, &length) || length > input->size()) {
+    return false;
+  }
+  const base::StringPiece encoded(input->data(), length);
+  input->remove_prefix(length);
+  if (!huffman) {
+    *value = encoded;
+    return true;
+  }
+  buffer->clear();
+  if (!mod_spdy::HpackHuffmanDecode(encoded, buffer)) {
+    return false;
+  }
+  *value = *buffer;
+  return true;
+}
+
+// Add a decoded header to the block, merging it with any previous header of
+// the same name.
+void AddHeader(base::StringPiece name, base::StringPiece value,
+               net::SpdyHeaderBlock* headers) {
+  const std::string key = name.as_string();
+  net::SpdyHeaderBlock::iterator iter = headers->find(key);
+  if (iter == headers->end()) {
+    (*headers)[key] = value.as_string();
+    return;
+  }
+  if (name == "cookie") {
+    iter->second.append("; ");
+  } else {
+    iter->second.push_back('\0');
+  }
+  value.AppendToString(&iter->second);
+}
+
+}  // namespace
+
+namespace mod_spdy {
+
+// static
+const size_t HpackDecoder::kMaxHeaderListSize;
+
+HpackDecoder::HpackDecoder() {}
+
+HpackDecoder::~HpackDecoder() {}
+
+bool HpackDecoder::DecodeHeaderBlock(base::StringPiece block,
+                                     net::SpdyHeaderBlock* headers) {
+  size_t header_list_size = 0;
+  bool seen_header = false;
+  while (!block.empty()) {
+    const uint8 first = static_cast<uint8>(block[0]);
+    base::StringPiece name, value;
+    bool add_to_table = false;
+
+    if (first & 0x80) {
+      // Indexed header field (section 6.1).
+      uint32 index = 0;
+      if (!DecodeInteger(7, &block, &index) ||
+          !table_.GetEntry(index, &name, &value)) {
+        VLOG(1) << "HPACK: bad indexed header field";
+        return false;
+      }
+    } else if ((first & 0xe0) == 0x20) {
+      // Dynamic table size update (section 6.3).  These may only come at the
+      // start of a block, and may not exceed the limit we allow.
+      uint32 max_size = 0;
+      if (seen_header || !DecodeInteger(5, &block, &max_size) ||
+          max_size > HpackHeaderTable::kDefaultMaxSize) {
+        VLOG(1) << "HPACK: bad dynamic table size update";
+        return false;
+      }
+      table_.SetMaxSize(max_size);
+      continue;
+    } else {
+      // Literal header field, either with incremental indexing (01xxxxxx,
+      // section 6.2.1; 6-bit index), or without indexing (0000xxxx) or never
+      // indexed (0001xxxx) (sections 6.2.2 and 6.2.3; 4-bit index).  A zero
+      // index means the name follows as a literal.
+      add_to_table = (first & 0xc0) == 0x40;
+      uint32 name_index = 0;
+      base::StringPiece unused_value;
+      if (!DecodeInteger(add_to_table ? 6 : 4, &block, &name_index) ||
+          (name_index == 0 ?
+           !DecodeString(&block, &name_buffer_, &name) :
+           !table_.GetEntry(name_index, &name, &unused_value)) ||
+          !DecodeString(&block, &value_buffer_, &value)) {
+        VLOG(1) << "HPACK: bad literal header field";
+        return false;
+      }
+    }
+
+    seen_header = true;
+    header_list_size += HpackHeaderTable::EntrySize(name, value);
+    if (header_list_size > kMaxHeaderListSize) {
+      VLOG(1) << "HPACK: header list too large";
+      return false;
+    }
+    // The name and value may point into the table, so add the header to the
+    // block before changing the table.
+    AddHeader(name, value, headers);
+    if (add_to_table) {
+      table_.AddEntry(name, value);
+    }
+  }
+  return true;
+}
+
+}  // namespace mod_spdy
@@ -0,0 +1,65 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_COMMON_HPACK_DECODER_H_
+#define MOD_SPDY_COMMON_HPACK_DECODER_H_
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+#include "mod_spdy/common/hpack_header_table.h"
+#include "net/spdy/spdy_framer.h"
+
+namespace mod_spdy {
+
+// Decodes HPACK-compressed header blocks (RFC 7541) received on one HTTP/2
+// connection.  The dynamic table is limited to the default 4096 bytes, which
+// is the most we ever allow the client to use.  This class is not
+// thread-safe.
+class HpackDecoder {
+ public:
+  // The largest header list we'll accept in one block, counting each header
+  // the way SETTINGS_MAX_HEADER_LIST_SIZE does (name and value length plus 32
+  // bytes).
+  static const size_t kMaxHeaderListSize = 256 * 1024;
+
+  HpackDecoder();
+  ~HpackDecoder();
+
+  // Decode a complete header block (the payload of a HEADERS frame and any
+  // CONTINUATION frames after it) and add the headers to *headers, then
+  // return true.  Repeated headers are merged into one NUL-separated value,
+  // as in a SPDY header block, except that cookie crumbs are rejoined with
+  // "; " (RFC 7540 section 8.1.2.5).  Return false if the block is malformed
+  // or too large; in that case the decoder's table may no longer match the
+  // client's, so the connection must be closed with a COMPRESSION_ERROR.
+  bool DecodeHeaderBlock(base::StringPiece block,
+                         net::SpdyHeaderBlock* headers);
+
+  // The decoder's header table, for testing.
+  const HpackHeaderTable& header_table() const { return table_; }
+
+ private:
+  HpackHeaderTable table_;
+  // Scratch space for Huffman-decoding names and values.
+  std::string name_buffer_;
+  std::string value_buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(HpackDecoder);
+};
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_HPACK_DECODER_H_
@@ -0,0 +1,157 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mod_spdy/common/hpack_decoder.h"
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+#include "net/spdy/spdy_framer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+using mod_spdy::HpackDecoder;
+
+// Convert a hex string to bytes, to keep the test vectors readable.
+std::string FromHex(const char* hex) {
+  std::string output;
+  for (; hex[0] != '\0' && hex[1] != '\0'; hex += 2) {
+    int byte = 0;
+    for (int i = 0; i < 2; ++i) {
+      const char ch = hex[i];
+      byte = byte * 16 + (ch <= '9' ? ch - '0' : ch - 'a' + 10);
+    }
+    output.push_back(static_cast<char>(byte));
+  }
+  return output;
+}
+
+// RFC 7541 appendix C.4: three requests with Huffman coding.
+TEST(HpackDecoderTest, RequestExamples) {
+  HpackDecoder decoder;
+  net::SpdyHeaderBlock headers;
+  ASSERT_TRUE(decoder.DecodeHeaderBlock(
+      FromHex("828684418cf1e3c2e5f23a6ba0ab90f4ff"), &headers));
+  EXPECT_EQ(4u, headers.size());
+  EXPECT_EQ("GET", headers[":method"]);
+  EXPECT_EQ("http", headers[":scheme"]);
+  EXPECT_EQ("/", headers[":path"]);
+  EXPECT_EQ("www.example.com", headers[":authority"]);
+  EXPECT_EQ(57u, decoder.header_table().size());
+
+  headers.clear();
+  ASSERT_TRUE(decoder.DecodeHeaderBlock(
+      FromHex("828684be5886a8eb10649cbf"), &headers));
+  EXPECT_EQ(5u, headers.size());
+  EXPECT_EQ("www.example.com", headers[":authority"]);
+  EXPECT_EQ("no-cache", headers["cache-control"]);
+  EXPECT_EQ(110u, decoder.header_table().size());
+
+  headers.clear();
+  ASSERT_TRUE(decoder.DecodeHeaderBlock(
+      FromHex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"), &headers));
+  EXPECT_EQ(5u, headers.size());
+  EXPECT_EQ("https", headers[":scheme"]);
+  EXPECT_EQ("/index.html", headers[":path"]);
+  EXPECT_EQ("www.example.com", headers[":authority"]);
+  EXPECT_EQ("custom-value", headers["custom-key"]);
+  EXPECT_EQ(3u, decoder.header_table().num_dynamic_entries());
+  EXPECT_EQ(164u, decoder.header_table().size());
+}
+
+// RFC 7541 appendix C.6: three responses with a 256-byte table, which forces
+// evictions.
+TEST(HpackDecoderTest, ResponseExamplesWithEviction) {
+  HpackDecoder decoder;
+  net::SpdyHeaderBlock headers;
+  ASSERT_TRUE(decoder.DecodeHeaderBlock(FromHex(
+      "3fe101"
+      "488264025885aec3771a4b6196d07abe941054d444a8200595040b8166e082a62d1b"
+      "ff6e919d29ad171863c78f0b97c8e9ae82ae43d3"), &headers));
+  EXPECT_EQ(256u, decoder.header_table().max_size());
+  EXPECT_EQ("302", headers[":status"]);
+  EXPECT_EQ("private", headers["cache-control"]);
+  EXPECT_EQ("Mon, 21 Oct 2013 20:13:21 GMT", headers["date"]);
+  EXPECT_EQ("https://www.example.com", headers["location"]);
+  EXPECT_EQ(222u, decoder.header_table().size());
+
+  headers.clear();
+  ASSERT_TRUE(decoder.DecodeHeaderBlock(FromHex("4883640effc1c0bf"),
+                                        &headers));
+  EXPECT_EQ("307", headers[":status"]);
+  EXPECT_EQ("https://www.example.com", headers["location"]);
+  EXPECT_EQ(222u, decoder.header_table().size());
+
+  headers.clear();
+  ASSERT_TRUE(decoder.DecodeHeaderBlock(FromHex(
+      "88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a839bd9ab77ad"
+      "94e7821dd7f2e6c7b335dfdfcd5b3960d5af27087f3672c1ab270fb5291f9587316065"
+      "c003ed4ee5b1063d5007"), &headers));
+  EXPECT_EQ("200", headers[":status"]);
+  EXPECT_EQ("gzip", headers["content-encoding"]);
+  EXPECT_EQ("foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1",
+            headers["set-cookie"]);
+  EXPECT_EQ(3u, decoder.header_table().num_dynamic_entries());
+  EXPECT_EQ(215u, decoder.header_table().size());
+}
+
+TEST(HpackDecoderTest, MergeRepeatedHeaders) {
+  HpackDecoder decoder;
+  net::SpdyHeaderBlock headers;
+  // Two literal "cookie" headers (static index 32) without indexing, and two
+  // literal "x-foo" headers with literal names.
+  ASSERT_TRUE(decoder.DecodeHeaderBlock(
+      std::string("\x0f\x11\x03""a=1"
+                  "\x0f\x11\x03""b=2"
+                  "\x00\x05x-foo\x01""1"
+                  "\x00\x05x-foo\x01""2", 30), &headers));
+  EXPECT_EQ(2u, headers.size());
+  EXPECT_EQ("a=1; b=2", headers["cookie"]);
+  EXPECT_EQ(std::string("1\0" "2", 3), headers["x-foo"]);
+  EXPECT_EQ(0u, decoder.header_table().num_dynamic_entries());
+}
+
+TEST(HpackDecoderTest, InvalidBlocks) {
+  const char* const kBadBlocks[] = {
+    "be",          // index 62 with an empty dynamic table
+    "80",          // index 0
+    "ff",          // truncated integer
+    "ffffffffff0f",  // integer too large
+    "4005",        // truncated literal name
+    "40",          // missing literal name
+    "41",          // missing value
+    "3fe21f",      // table size update larger than 4096
+    "823fe101",    // table size update after a header
+    "418118",      // invalid Huffman padding in the value
+  };
+  for (size_t i = 0; i < arraysize(kBadBlocks); ++i) {
+    HpackDecoder decoder;
+    net::SpdyHeaderBlock headers;
+    EXPECT_FALSE(decoder.DecodeHeaderBlock(FromHex(kBadBlocks[i]), &headers))
+        << kBadBlocks[i];
+  }
+}
+
+TEST(HpackDecoderTest, HeaderListTooLarge) {
+  HpackDecoder decoder;
+  net::SpdyHeaderBlock headers;
+  // Repeat an indexed header until the list exceeds the limit.
+  const std::string block(HpackDecoder::kMaxHeaderListSize / 32, '\x82');
+  EXPECT_FALSE(decoder.DecodeHeaderBlock(block, &headers));
+}
+
+}  // namespace
@@ -0,0 +1,148 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/hpack_encoder.h"
+
+#include <algorithm>
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "base/strings/string_piece.h"
+#include "mod_spdy/common/hpack_header_table.h"
+#include "mod_spdy/common/hpack_huffman.h"
+#include "net/spdy/spdy_framer.h"
+
+namespace {
+
+// Append an integer with an N-bit prefix (RFC 7541 section 5.1), with the
+// given bits set in the first byte above the prefix.
+void EncodeInteger(uint8 high_bits, int prefix_bits, uint32 value,
+                   std::string* output) {
+  const uint32 prefix_max = (1u << prefix_bits) - 1;
+  if (value < prefix_max) {
+    output->push_back(static_cast<char>(high_bits | value));
+    return;
+  }
+  output->push_back(static_cast<char>(high_bits | prefix_max));
+  value -= prefix_max;
+  while (value >= 0x80) {
+    output->push_back(static_cast<char>(0x80 | (value & 0x7f)));
+    value >>= 7;
+  }
+  output->push_back(static_cast<char>(value));
+}
+
+// Append a string literal (RFC 7541 section 5.2), Huffman-encoding it if that
+// makes it shorter.
+void EncodeString(base::StringPiece str, std::string* output) {
+  const size_t huffman_length = mod_spdy::HpackHuffmanEncodedLength(str);
+  if (huffman_length < str.size()) {
+    EncodeInteger(0x80, 7, huffman_length, output);
+    mod_spdy::HpackHuffmanEncode(str, output);
+  } else {
+    EncodeInteger(0x00, 7, str.size(), output);
+    str.AppendToString(output);
+  }
+}
+
+// Return true if the header's value is likely to differ from one response to
+// the next, so that it isn't worth adding to the dynamic table.
+bool IsVolatileHeader(base::StringPiece name) {
+  return (name == "content-length" || name == "date" || name == "etag" ||
+          name == "expires" || name == "last-modified");
+}
+
+}  // namespace
+
+namespace mod_spdy {
+
+HpackEncoder::HpackEncoder()
+    : table_size_changed_(false),
+      smallest_table_size_(HpackHeaderTable::kDefaultMaxSize) {}
+
+HpackEncoder::~HpackEncoder() {}
+
+void HpackEncoder::ApplyHeaderTableSizeSetting(uint32 size) {
+  // The client's setting is only an upper bound; we never use a bigger table
+  // than the default, to bound our memory use.
+  const size_t new_size =
+      std::min(static_cast<size_t>(size), HpackHeaderTable::kDefaultMaxSize);
+  if (new_size == table_.max_size()) {
+    return;
+  }
+  smallest_table_size_ = table_size_changed_ ?
+      std::min(smallest_table_size_, new_size) : new_size;
+  table_size_changed_ = true;
+  table_.SetMaxSize(new_size);
+}
+
+void HpackEncoder::EncodeHeaderBlock(const net::SpdyHeaderBlock& headers,
+                                     std::string* output) {
+  if (table_size_changed_) {
+    if (smallest_table_size_ < table_.max_size()) {
+      EncodeInteger(0x20, 5, smallest_table_size_, output);
+    }
+    EncodeInteger(0x20, 5, table_.max_size(), output);
+    table_size_changed_ = false;
+  }
+
+  // Pseudo-headers must come before regular headers; since ':' sorts before
+  // any lowercase letter, the block's ordering takes care of that for us.
+  for (net::SpdyHeaderBlock::const_iterator it = headers.begin();
+       it != headers.end(); ++it) {
+    const base::StringPiece name = it->first;
+    const base::StringPiece value = it->second;
+    for (size_t start = 0; start <= value.size();) {
+      size_t end = value.find('\0', start);
+      if (end == base::StringPiece::npos) {
+        end = value.size();
+      }
+      EncodeHeader(name, value.substr(start, end - start), output);
+      start = end + 1;
+    }
+  }
+}
+
+void HpackEncoder::EncodeHeader(base::StringPiece name,
+                                base::StringPiece value,
+                                std::string* output) {
+  size_t name_index = 0;
+  const size_t index = table_.FindEntry(name, value, &name_index);
+  if (index != 0) {
+    // Indexed header field.
+    EncodeInteger(0x80, 7, index, output);
+    return;
+  }
+
+  if (name == "set-cookie") {
+    // Cookies may be sensitive, so ask intermediaries never to index them
+    // (RFC 7541 section 7.1.3), and don't index them ourselves.
+    EncodeInteger(0x10, 4, name_index, output);
+  } else if (IsVolatileHeader(name) ||
+             HpackHeaderTable::EntrySize(name, value) > table_.max_size()) {
+    // Literal without indexing.
+    EncodeInteger(0x00, 4, name_index, output);
+  } else {
+    // Literal with incremental indexing.
+    EncodeInteger(0x40, 6, name_index, output);
+    table_.AddEntry(name, value);
+  }
+  if (name_index == 0) {
+    EncodeString(name, output);
+  }
+  EncodeString(value, output);
+}
+
+}  // namespace mod_spdy
@@ -0,0 +1,65 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_COMMON_HPACK_ENCODER_H_
+#define MOD_SPDY_COMMON_HPACK_ENCODER_H_
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+#include "mod_spdy/common/hpack_header_table.h"
+#include "net/spdy/spdy_framer.h"
+
+namespace mod_spdy {
+
+// Encodes header blocks with HPACK (RFC 7541) for sending on one HTTP/2
+// connection.  Headers are added to the dynamic table (which is limited to
+// the smaller of 4096 bytes and whatever the client allows) unless they're
+// unlikely to be repeated.  This class is not thread-safe.
+class HpackEncoder {
+ public:
+  HpackEncoder();
+  ~HpackEncoder();
+
+  // Apply a SETTINGS_HEADER_TABLE_SIZE value from the client.  The encoder
+  // signals the resulting change of table size at the start of the next
+  // header block, as the spec requires.
+  void ApplyHeaderTableSizeSetting(uint32 size);
+
+  // Append the encoding of the given headers to *output.  A value containing
+  // NULs (i.e. a SPDY-style merged header) is sent as separate headers.
+  void EncodeHeaderBlock(const net::SpdyHeaderBlock& headers,
+                         std::string* output);
+
+  // The encoder's header table, for testing.
+  const HpackHeaderTable& header_table() const { return table_; }
+
+ private:
+  void EncodeHeader(base::StringPiece name, base::StringPiece value,
+                    std::string* output);
+
+  HpackHeaderTable table_;
+  // True if the table size has changed since the last header block, in which
+  // case smallest_table_size_ is the smallest size it had in between; we must
+  // signal that as well as the final size (RFC 7541 section 4.2).
+  bool table_size_changed_;
+  size_t smallest_table_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(HpackEncoder);
+};
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_HPACK_ENCODER_H_
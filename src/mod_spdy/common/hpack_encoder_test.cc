@@ -0,0 +1,117 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mod_spdy/common/hpack_encoder.h"
+
+#include <string>
+
+#include "mod_spdy/common/hpack_decoder.h"
+#include "net/spdy/spdy_framer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+using mod_spdy::HpackDecoder;
+using mod_spdy::HpackEncoder;
+
+class HpackEncoderTest : public testing::Test {
+ protected:
+  // Encode the headers, check that the decoder gets the same headers back,
+  // and return the size of the encoding.
+  size_t EncodeAndDecode(const net::SpdyHeaderBlock& headers) {
+    std::string encoded;
+    encoder_.EncodeHeaderBlock(headers, &encoded);
+    net::SpdyHeaderBlock decoded;
+    EXPECT_TRUE(decoder_.DecodeHeaderBlock(encoded, &decoded));
+    EXPECT_EQ(headers, decoded);
+    EXPECT_EQ(encoder_.header_table().size(),
+              decoder_.header_table().size());
+    return encoded.size();
+  }
+
+  HpackEncoder encoder_;
+  HpackDecoder decoder_;
+};
+
+TEST_F(HpackEncoderTest, RepeatedHeadersGetSmaller) {
+  net::SpdyHeaderBlock headers;
+  headers[":status"] = "200";
+  headers["content-type"] = "text/html; charset=utf-8";
+  headers["server"] = "Apache/2.2.22";
+  headers["x-custom"] = "some custom value";
+  const size_t first_size = EncodeAndDecode(headers);
+  // Everything but :status 200 (which is in the static table) was indexed, so
+  // the second time each header takes one byte.
+  EXPECT_EQ(3u, encoder_.header_table().num_dynamic_entries());
+  EXPECT_EQ(4u, EncodeAndDecode(headers));
+  EXPECT_LT(4u, first_size);
+}
+
+TEST_F(HpackEncoderTest, HeadersNotIndexed) {
+  net::SpdyHeaderBlock headers;
+  headers[":status"] = "200";
+  headers["content-length"] = "1234";
+  headers["date"] = "Mon, 21 Oct 2013 20:13:21 GMT";
+  headers["set-cookie"] = "secret=1";
+  headers["x-big"] = std::string(5000, 'x');
+  EncodeAndDecode(headers);
+  EXPECT_EQ(0u, encoder_.header_table().num_dynamic_entries());
+
+  std::string encoded;
+  net::SpdyHeaderBlock cookie;
+  cookie["set-cookie"] = "secret=1";
+  encoder_.EncodeHeaderBlock(cookie, &encoded);
+  // Never-indexed literal with the static name index 55.
+  EXPECT_EQ(0x1f, encoded[0]);
+  EXPECT_EQ(55 - 15, encoded[1]);
+}
+
+TEST_F(HpackEncoderTest, MergedValues) {
+  net::SpdyHeaderBlock headers;
+  headers[":status"] = "200";
+  headers["set-cookie"] = std::string("a=1\0b=2", 7);
+  headers["vary"] = std::string("accept\0accept-encoding", 22);
+  EncodeAndDecode(headers);
+  EncodeAndDecode(headers);
+}
+
+TEST_F(HpackEncoderTest, TableSizeSetting) {
+  net::SpdyHeaderBlock headers;
+  headers[":status"] = "200";
+  headers["x-custom"] = "value";
+  EncodeAndDecode(headers);
+  EXPECT_EQ(1u, encoder_.header_table().num_dynamic_entries());
+
+  // Shrinking the table to nothing and back must be signalled to the decoder
+  // so that it drops its entries too.
+  encoder_.ApplyHeaderTableSizeSetting(0);
+  encoder_.ApplyHeaderTableSizeSetting(1000);
+  std::string encoded;
+  encoder_.EncodeHeaderBlock(headers, &encoded);
+  EXPECT_EQ(std::string("\x20\x3f\xc9\x07", 4), encoded.substr(0, 4));
+  net::SpdyHeaderBlock decoded;
+  ASSERT_TRUE(decoder_.DecodeHeaderBlock(encoded, &decoded));
+  EXPECT_EQ(headers, decoded);
+  EXPECT_EQ(1000u, decoder_.header_table().max_size());
+  EXPECT_EQ(1u, decoder_.header_table().num_dynamic_entries());
+
+  // We never use more than the default size, whatever the client allows.
+  encoder_.ApplyHeaderTableSizeSetting(1 << 20);
+  EXPECT_EQ(4096u, encoder_.header_table().max_size());
+  EncodeAndDecode(headers);
+  EXPECT_EQ(4096u, decoder_.header_table().max_size());
+}
+
+}  // namespace
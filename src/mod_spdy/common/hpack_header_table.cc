@@ -0,0 +1,198 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/hpack_header_table.h"
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "base/strings/string_piece.h"
+
+namespace {
+
+struct StaticEntry {
+  const char* name;
+  const char* value;
+};
+
+// The HPACK static table (RFC 7541 appendix A); entry i has index i + 1.
+const StaticEntry kStaticTable[] = {
+  {":authority", ""},
+  {":method", "GET"},
+  {":method", "POST"},
+  {":path", "/"},
+  {":path", "/index.html"},
+  {":scheme", "http"},
+  {":scheme", "https"},
+  {":status", "200"},
+  {":status", "204"},
+  {":status", "206"},
+  {":status", "304"},
+  {":status", "400"},
+  {":status", "404"},
+  {":status", "500"},
+  {"accept-charset", ""},
+  {"accept-encoding", "gzip, deflate"},
+  {"accept-language", ""},
+  {"accept-ranges", ""},
+  {"accept", ""},
+  {"access-control-allow-origin", ""},
+  {"age", ""},
+  {"allow", ""},
+  {"authorization", ""},
+  {"cache-control", ""},
+  {"content-disposition", ""},
+  {"content-encoding", ""},
+  {"content-language", ""},
+  {"content-length", ""},
+  {"content-location", ""},
+  {"content-range", ""},
+  {"content-type", ""},
+  {"cookie", ""},
+  {"date", ""},
+  {"etag", ""},
+  {"expect", ""},
+  {"expires", ""},
+  {"from", ""},
+  {"host", ""},
+  {"if-match", ""},
+  {"if-modified-since", ""},
+  {"if-none-match", ""},
+  {"if-range", ""},
+  {"if-unmodified-since", ""},
+  {"last-modified", ""},
+  {"link", ""},
+  {"location", ""},
+  {"max-forwards", ""},
+  {"proxy-authenticate", ""},
+  {"proxy-authorization", ""},
+  {"range", ""},
+  {"referer", ""},
+  {"refresh", ""},
+  {"retry-after", ""},
+  {"server", ""},
+  {"set-cookie", ""},
+  {"strict-transport-security", ""},
+  {"transfer-encoding", ""},
+  {"user-agent", ""},
+  {"vary", ""},
+  {"via", ""},
+  {"www-authenticate", ""},
+};
+
+const size_t kEntryOverhead = 32;
+
+}  // namespace
+
+namespace mod_spdy {
+
+// static
+const size_t HpackHeaderTable::kDefaultMaxSize;
+// static
+const size_t HpackHeaderTable::kStaticTableSize;
+
+HpackHeaderTable::HpackHeaderTable()
+    : size_(0), max_size_(kDefaultMaxSize) {
+  COMPILE_ASSERT(arraysize(kStaticTable) == kStaticTableSize,
+                 static_table_has_wrong_number_of_entries);
+}
+
+HpackHeaderTable::~HpackHeaderTable() {}
+
+// static
+size_t HpackHeaderTable::EntrySize(base::StringPiece name,
+                                   base::StringPiece value) {
+  return name.size() + value.size() + kEntryOverhead;
+}
+
+bool HpackHeaderTable::GetEntry(size_t index, base::StringPiece* name,
+                                base::StringPiece* value) const {
+  if (index == 0) {
+    return false;
+  }
+  if (index <= kStaticTableSize) {
+    *name = kStaticTable[index - 1].name;
+    *value = kStaticTable[index - 1].value;
+    return true;
+  }
+  index -= kStaticTableSize + 1;
+  if (index >= dynamic_entries_.size()) {
+    return false;
+  }
+  const Entry& entry = dynamic_entries_[index];
+  *name = entry.first;
+  *value = entry.second;
+  return true;
+}
+
+size_t HpackHeaderTable::FindEntry(base::StringPiece name,
+                                   base::StringPiece value,
+                                   size_t* name_index) const {
+  *name_index = 0;
+  for (size_t i = 0; i < kStaticTableSize; ++i) {
+    if (name == kStaticTable[i].name) {
+      if (value == kStaticTable[i].value) {
+        return i + 1;
+      }
+      if (*name_index == 0) {
+        *name_index = i + 1;
+      }
+    }
+  }
+  for (size_t i = 0; i < dynamic_entries_.size(); ++i) {
+    const Entry& entry = dynamic_entries_[i];
+    if (name == entry.first) {
+      if (value == entry.second) {
+        return kStaticTableSize + 1 + i;
+      }
+      if (*name_index == 0) {
+        *name_index = kStaticTableSize + 1 + i;
+      }
+    }
+  }
+  return 0;
+}
+
+void HpackHeaderTable::AddEntry(base::StringPiece name,
+                                base::StringPiece value) {
+  const size_t entry_size = EntrySize(name, value);
+  if (entry_size > max_size_) {
+    EvictDownTo(0);
+    return;
+  }
+  // Copy the new entry before evicting anything, since the name or value
+  // might point into an entry that's about to be evicted.
+  dynamic_entries_.push_front(Entry(name.as_string(), value.as_string()));
+  EvictDownTo(max_size_ - entry_size);
+  size_ += entry_size;
+}
+
+void HpackHeaderTable::SetMaxSize(size_t max_size) {
+  max_size_ = max_size;
+  EvictDownTo(max_size_);
+}
+
+void HpackHeaderTable::EvictDownTo(size_t size) {
+  // AddEntry pushes its new entry before calling this, but doesn't count it
+  // in size_ until afterwards, so that entry is never evicted here.
+  while (size_ > size) {
+    DCHECK(!dynamic_entries_.empty());
+    const Entry& oldest = dynamic_entries_.back();
+    size_ -= EntrySize(oldest.first, oldest.second);
+    dynamic_entries_.pop_back();
+  }
+}
+
+}  // namespace mod_spdy
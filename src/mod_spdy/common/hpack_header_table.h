@@ -0,0 +1,93 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_COMMON_HPACK_HEADER_TABLE_H_
+#define MOD_SPDY_COMMON_HPACK_HEADER_TABLE_H_
+
+#include <deque>
+#include <string>
+#include <utility>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+
+namespace mod_spdy {
+
+// The HPACK header table (RFC 7541 section 2.3): the fixed static table,
+// followed by a dynamic table of recently-sent headers whose total size is
+// bounded.  Each HPACK encoder or decoder keeps one of these per connection.
+// This class is not thread-safe.
+class HpackHeaderTable {
+ public:
+  // The initial maximum size of the dynamic table, and the largest we will
+  // ever use, in HPACK size units (see EntrySize).  HTTP/2 endpoints start
+  // with this size until told otherwise.
+  static const size_t kDefaultMaxSize = 4096;
+  // Indices 1 through kStaticTableSize refer to the static table; higher
+  // indices refer to the dynamic table, newest entry first.
+  static const size_t kStaticTableSize = 61;
+
+  HpackHeaderTable();
+  ~HpackHeaderTable();
+
+  // The size HPACK charges for an entry: the length of the name and value
+  // plus 32 bytes of overhead (RFC 7541 section 4.1).
+  static size_t EntrySize(base::StringPiece name, base::StringPiece value);
+
+  // The current total size of the dynamic table's entries.
+  size_t size() const { return size_; }
+  // The maximum size of the dynamic table.
+  size_t max_size() const { return max_size_; }
+  // The number of entries in the dynamic table.
+  size_t num_dynamic_entries() const { return dynamic_entries_.size(); }
+
+  // Get the entry with the given index and return true, or return false if
+  // there is no such entry.  The pieces remain valid until the table is next
+  // modified.
+  bool GetEntry(size_t index, base::StringPiece* name,
+                base::StringPiece* value) const;
+
+  // Return the index of an entry with the given name and value, or zero if
+  // there isn't one.  In the latter case, also set *name_index to the index of
+  // an entry with the given name, or to zero if there isn't one of those
+  // either.
+  size_t FindEntry(base::StringPiece name, base::StringPiece value,
+                   size_t* name_index) const;
+
+  // Add an entry to the front of the dynamic table, evicting the oldest
+  // entries as necessary to stay within the maximum size.  An entry larger
+  // than the maximum size just empties the table.  It's okay for the name and
+  // value to point into an entry of this table.
+  void AddEntry(base::StringPiece name, base::StringPiece value);
+
+  // Change the maximum size of the dynamic table, evicting the oldest entries
+  // as necessary.
+  void SetMaxSize(size_t max_size);
+
+ private:
+  typedef std::pair<std::string, std::string> Entry;
+
+  // Evict entries until the table's size is at most the given size.
+  void EvictDownTo(size_t size);
+
+  std::deque<Entry> dynamic_entries_;  // newest first
+  size_t size_;
+  size_t max_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(HpackHeaderTable);
+};
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_HPACK_HEADER_TABLE_H_
@@ -0,0 +1,108 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mod_spdy/common/hpack_header_table.h"
+
+#include <string>
+
+#include "base/strings/string_piece.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+using mod_spdy::HpackHeaderTable;
+
+TEST(HpackHeaderTableTest, StaticTable) {
+  HpackHeaderTable table;
+  base::StringPiece name, value;
+  EXPECT_FALSE(table.GetEntry(0, &name, &value));
+  ASSERT_TRUE(table.GetEntry(1, &name, &value));
+  EXPECT_EQ(":authority", name);
+  EXPECT_EQ("", value);
+  ASSERT_TRUE(table.GetEntry(8, &name, &value));
+  EXPECT_EQ(":status", name);
+  EXPECT_EQ("200", value);
+  ASSERT_TRUE(table.GetEntry(61, &name, &value));
+  EXPECT_EQ("www-authenticate", name);
+  EXPECT_FALSE(table.GetEntry(62, &name, &value));
+
+  size_t name_index = 99;
+  EXPECT_EQ(2u, table.FindEntry(":method", "GET", &name_index));
+  EXPECT_EQ(0u, table.FindEntry(":status", "302", &name_index));
+  EXPECT_EQ(8u, name_index);
+  EXPECT_EQ(0u, table.FindEntry("x-foo", "bar", &name_index));
+  EXPECT_EQ(0u, name_index);
+}
+
+TEST(HpackHeaderTableTest, DynamicTable) {
+  HpackHeaderTable table;
+  EXPECT_EQ(4096u, table.max_size());
+  table.AddEntry("x-foo", "bar");
+  table.AddEntry(":status", "302");
+  EXPECT_EQ(2u, table.num_dynamic_entries());
+  EXPECT_EQ(2 * 32u + 8u + 10u, table.size());
+
+  // The newest entry comes first.
+  base::StringPiece name, value;
+  ASSERT_TRUE(table.GetEntry(62, &name, &value));
+  EXPECT_EQ(":status", name);
+  EXPECT_EQ("302", value);
+  ASSERT_TRUE(table.GetEntry(63, &name, &value));
+  EXPECT_EQ("x-foo", name);
+  EXPECT_FALSE(table.GetEntry(64, &name, &value));
+
+  size_t name_index = 0;
+  EXPECT_EQ(63u, table.FindEntry("x-foo", "bar", &name_index));
+  EXPECT_EQ(62u, table.FindEntry(":status", "302", &name_index));
+  // Static table matches are preferred.
+  EXPECT_EQ(0u, table.FindEntry(":status", "307", &name_index));
+  EXPECT_EQ(8u, name_index);
+  EXPECT_EQ(0u, table.FindEntry("x-foo", "baz", &name_index));
+  EXPECT_EQ(63u, name_index);
+}
+
+TEST(HpackHeaderTableTest, Eviction) {
+  HpackHeaderTable table;
+  table.SetMaxSize(100);
+  table.AddEntry("aaaa", "1111");  // size 40
+  table.AddEntry("bbbb", "2222");  // size 40
+  EXPECT_EQ(80u, table.size());
+  // Adding a third entry evicts the oldest.
+  table.AddEntry("cccc", "3333");
+  EXPECT_EQ(2u, table.num_dynamic_entries());
+  EXPECT_EQ(80u, table.size());
+  size_t name_index = 0;
+  EXPECT_EQ(0u, table.FindEntry("aaaa", "1111", &name_index));
+  EXPECT_EQ(63u, table.FindEntry("bbbb", "2222", &name_index));
+
+  // Adding an entry that refers to one being evicted is fine.
+  base::StringPiece name, value;
+  ASSERT_TRUE(table.GetEntry(63, &name, &value));
+  table.AddEntry(name, value);
+  EXPECT_EQ(62u, table.FindEntry("bbbb", "2222", &name_index));
+  EXPECT_EQ(63u, table.FindEntry("cccc", "3333", &name_index));
+
+  // Shrinking the table evicts entries.
+  table.SetMaxSize(50);
+  EXPECT_EQ(1u, table.num_dynamic_entries());
+  EXPECT_EQ(40u, table.size());
+
+  // An entry too big for the table empties it.
+  table.AddEntry("name", std::string(20, 'x'));
+  EXPECT_EQ(0u, table.num_dynamic_entries());
+  EXPECT_EQ(0u, table.size());
+}
+
+}  // namespace
@@ -0,0 +1,40 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_COMMON_HPACK_HUFFMAN_H_
+#define MOD_SPDY_COMMON_HPACK_HUFFMAN_H_
+
+#include <string>
+
+#include "base/strings/string_piece.h"
+
+namespace mod_spdy {
+
+// Return the number of bytes that HpackHuffmanEncode would produce for the
+// given input.
+size_t HpackHuffmanEncodedLength(base::StringPiece input);
+
+// Append the HPACK Huffman encoding (RFC 7541 section 5.2) of the input to
+// *output, padding the last byte with ones.
+void HpackHuffmanEncode(base::StringPiece input, std::string* output);
+
+// Decode a Huffman-encoded HPACK string, appending the result to *output, and
+// return true.  Return false if the input is invalid (contains the EOS symbol,
+// or has more than seven bits of padding, or padding that isn't all ones);
+// *output may then contain a partial result.
+bool HpackHuffmanDecode(base::StringPiece input, std::string* output);
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_HPACK_HUFFMAN_H_
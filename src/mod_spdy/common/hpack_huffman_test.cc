@@ -0,0 +1,87 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/hpack_huffman.h"
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+using mod_spdy::HpackHuffmanDecode;
+using mod_spdy::HpackHuffmanEncode;
+using mod_spdy::HpackHuffmanEncodedLength;
+
+// Examples from RFC 7541 appendix C.4.
+TEST(HpackHuffmanTest, Examples) {
+  const struct {
+    const char* plain;
+    const char* encoded;
+    size_t encoded_length;
+  } kExamples[] = {
+    {"www.example.com",
+     "\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff", 12},
+    {"no-cache", "\xa8\xeb\x10\x64\x9c\xbf", 6},
+    {"custom-key", "\x25\xa8\x49\xe9\x5b\xa9\x7d\x7f", 8},
+    {"custom-value", "\x25\xa8\x49\xe9\x5b\xb8\xe8\xb4\xbf", 9},
+  };
+  for (size_t i = 0; i < arraysize(kExamples); ++i) {
+    const base::StringPiece encoded(kExamples[i].encoded,
+                                    kExamples[i].encoded_length);
+    EXPECT_EQ(encoded.size(), HpackHuffmanEncodedLength(kExamples[i].plain));
+    std::string output;
+    HpackHuffmanEncode(kExamples[i].plain, &output);
+    EXPECT_EQ(encoded.as_string(), output);
+    output.clear();
+    ASSERT_TRUE(HpackHuffmanDecode(encoded, &output));
+    EXPECT_EQ(kExamples[i].plain, output);
+  }
+}
+
+TEST(HpackHuffmanTest, AllBytesRoundTrip) {
+  std::string input;
+  for (int i = 0; i < 256; ++i) {
+    input.push_back(static_cast<char>(i));
+    input.push_back(static_cast<char>(255 - i));
+  }
+  std::string encoded;
+  HpackHuffmanEncode(input, &encoded);
+  EXPECT_EQ(encoded.size(), HpackHuffmanEncodedLength(input));
+  std::string decoded;
+  ASSERT_TRUE(HpackHuffmanDecode(encoded, &decoded));
+  EXPECT_EQ(input, decoded);
+
+  std::string empty;
+  HpackHuffmanEncode("", &empty);
+  EXPECT_EQ("", empty);
+  EXPECT_TRUE(HpackHuffmanDecode("", &empty));
+  EXPECT_EQ("", empty);
+}
+
+TEST(HpackHuffmanTest, InvalidInput) {
+  std::string output;
+  // 'a' is 00011, so it must be padded with 111.
+  EXPECT_TRUE(HpackHuffmanDecode("\x1f", &output));
+  EXPECT_EQ("a", output);
+  EXPECT_FALSE(HpackHuffmanDecode("\x18", &output));
+  // A whole byte of padding is too much.
+  EXPECT_FALSE(HpackHuffmanDecode("\x1f\xff", &output));
+  // EOS (thirty ones) may not appear explicitly.
+  EXPECT_FALSE(HpackHuffmanDecode("\xff\xff\xff\xfc", &output));
+}
+
+}  // namespace
@@ -0,0 +1,937 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mod_spdy/common/http2_framer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "base/strings/string_piece.h"
+#include "mod_spdy/common/protocol_util.h"
+#include "net/spdy/buffered_spdy_framer.h"
+#include "net/spdy/spdy_framer.h"
+#include "net/spdy/spdy_protocol.h"
+
+namespace {
+
+// Every HTTP/2 client connection starts with this (RFC 7540 section 3.5).
+const char kConnectionPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const size_t kConnectionPrefaceLength = arraysize(kConnectionPreface) - 1;
+
+const size_t kFrameHeaderSize = 9;
+
+// Frame types (RFC 7540 section 6).
+const uint8 kDataFrame = 0x0;
+const uint8 kHeadersFrame = 0x1;
+const uint8 kPriorityFrame = 0x2;
+const uint8 kRstStreamFrame = 0x3;
+const uint8 kSettingsFrame = 0x4;
+const uint8 kPushPromiseFrame = 0x5;
+const uint8 kPingFrame = 0x6;
+const uint8 kGoAwayFrame = 0x7;
+const uint8 kWindowUpdateFrame = 0x8;
+const uint8 kContinuationFrame = 0x9;
+
+// Frame flags.
+const uint8 kFlagEndStream = 0x1;
+const uint8 kFlagAck = 0x1;
+const uint8 kFlagEndHeaders = 0x4;
+const uint8 kFlagPadded = 0x8;
+const uint8 kFlagPriority = 0x20;
+
+// Settings identifiers (RFC 7540 section 6.5.2).
+const uint16 kSettingsHeaderTableSize = 0x1;
+const uint16 kSettingsEnablePush = 0x2;
+const uint16 kSettingsMaxConcurrentStreams = 0x3;
+const uint16 kSettingsInitialWindowSize = 0x4;
+const uint16 kSettingsMaxFrameSize = 0x5;
+
+const size_t kLargestMaxFrameSize = (1u << 24) - 1;
+const uint32 kMaxWindowSize = 0x7fffffffu;
+const uint32 kStreamIdMask = 0x7fffffffu;
+
+// The priority we give streams whose HEADERS frame carries no priority block.
+// RFC 7540 gives such streams the default weight of 16, which WeightToPriority
+// maps to 6, and that is what a stream with an explicit weight of 16 gets.
+// But weights only rank a client's streams against each other, while our
+// priorities also rank them against every other client's in the shared thread
+// pool.  A client that sends no priority information at all has expressed no
+// preference, so we put its streams in the middle of the SPDY/3 range, rather
+// than queueing them behind nearly everything that other clients send.
+const net::SpdyPriority kDefaultPriority = 3;
+
+uint16 ReadUint16(const char* data) {
+  const uint8* bytes = reinterpret_cast<const uint8*>(data);
+  return static_cast<uint16>((bytes[0] << 8) | bytes[1]);
+}
+
+uint32 ReadUint24(const char* data) {
+  const uint8* bytes = reinterpret_cast<const uint8*>(data);
+  return (static_cast<uint32>(bytes[0]) << 16) |
+      (static_cast<uint32>(bytes[1]) << 8) | bytes[2];
+}
+
+uint32 ReadUint32(const char* data) {
+  const uint8* bytes = reinterpret_cast<const uint8*>(data);
+  return (static_cast<uint32>(bytes[0]) << 24) |
+      (static_cast<uint32>(bytes[1]) << 16) |
+      (static_cast<uint32>(bytes[2]) << 8) | bytes[3];
+}
+
+void AppendUint16(uint16 value, std::string* output) {
+  output->push_back(static_cast<char>(value >> 8));
+  output->push_back(static_cast<char>(value));
+}
+
+void AppendUint32(uint32 value, std::string* output) {
+  output->push_back(static_cast<char>(value >> 24));
+  output->push_back(static_cast<char>(value >> 16));
+  output->push_back(static_cast<char>(value >> 8));
+  output->push_back(static_cast<char>(value));
+}
+
+void AppendFrameHeader(size_t length, uint8 type, uint8 flags,
+                       net::SpdyStreamId stream_id, std::string* output) {
+  DCHECK_LE(length, kLargestMaxFrameSize);
+  output->push_back(static_cast<char>(length >> 16));
+  output->push_back(static_cast<char>(length >> 8));
+  output->push_back(static_cast<char>(length));
+  output->push_back(static_cast<char>(type));
+  output->push_back(static_cast<char>(flags));
+  AppendUint32(stream_id & kStreamIdMask, output);
+}
+
+// Map an HTTP/2 weight (1 to 256) to a SPDY/3 priority (0 to 7).  This is the
+// inverse of the mapping Chrome uses to send SPDY/3 priorities as weights
+// (weight = (7 - priority) * 255.9 / 7 + 1), in integer arithmetic.
+net::SpdyPriority WeightToPriority(int weight) {
+  DCHECK_GE(weight, 1);
+  DCHECK_LE(weight, 256);
+  return static_cast<net::SpdyPriority>(
+      (7 * 2559 - (weight - 1) * 70) / 2559);
+}
+
+// Return true if the given header name is allowed in a request: it must be
+// non-empty and lowercase (RFC 7540 section 8.1.2).
+bool IsValidRequestHeaderName(const std::string& name) {
+  if (name.empty()) {
+    return false;
+  }
+  for (std::string::const_iterator ch = name.begin(); ch != name.end(); ++ch) {
+    if (*ch >= 'A' && *ch <= 'Z') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Return true if the given trailer block is well-formed: as well as the usual
+// rules for names, trailers must not contain pseudo-headers (RFC 7540 section
+// 8.1.2.1).
+bool IsValidTrailerBlock(const net::SpdyHeaderBlock& headers) {
+  for (net::SpdyHeaderBlock::const_iterator iter = headers.begin();
+       iter != headers.end(); ++iter) {
+    if (!IsValidRequestHeaderName(iter->first) || iter->first[0] == ':') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Convert a decoded request header block to the SPDY/3 form that the rest of
+// mod_spdy expects, and return true; return false if the block is malformed
+// (RFC 7540 section 8.1.2).
+bool ConvertRequestHeaders(net::SpdyHeaderBlock* headers) {
+  for (net::SpdyHeaderBlock::const_iterator iter = headers->begin();
+       iter != headers->end(); ++iter) {
+    const std::string& name = iter->first;
+    if (!IsValidRequestHeaderName(name)) {
+      return false;
+    }
+    if (name[0] == ':' && name != mod_spdy::spdy::kSpdy3Method &&
+        name != mod_spdy::spdy::kSpdy3Path &&
+        name != mod_spdy::spdy::kSpdy3Scheme && name != ":authority") {
+      return false;
+    }
+  }
+  // HTTP/2 uses :authority rather than :host, but a client may send a Host
+  // header instead (RFC 7540 section 8.1.2.3).
+  net::SpdyHeaderBlock::iterator authority = headers->find(":authority");
+  if (authority == headers->end()) {
+    authority = headers->find(mod_spdy::http::kHost);
+  }
+  if (authority != headers->end()) {
+    const std::string host = authority->second;
+    headers->erase(":authority");
+    headers->erase(mod_spdy::http::kHost);
+    (*headers)[mod_spdy::spdy::kSpdy3Host] = host;
+  }
+  (*headers)[mod_spdy::spdy::kSpdy3Version] = "HTTP/1.1";
+  return true;
+}
+
+net::SpdyRstStreamStatus RstStreamStatusFromErrorCode(uint32 error_code) {
+  switch (error_code) {
+    case mod_spdy::Http2Framer::HTTP2_NO_ERROR:
+    case mod_spdy::Http2Framer::HTTP2_CANCEL:
+      return net::RST_STREAM_CANCEL;
+    case mod_spdy::Http2Framer::HTTP2_REFUSED_STREAM:
+      return net::RST_STREAM_REFUSED_STREAM;
+    case mod_spdy::Http2Framer::HTTP2_INTERNAL_ERROR:
+      return net::RST_STREAM_INTERNAL_ERROR;
+    case mod_spdy::Http2Framer::HTTP2_FLOW_CONTROL_ERROR:
+      return net::RST_STREAM_FLOW_CONTROL_ERROR;
+    case mod_spdy::Http2Framer::HTTP2_STREAM_CLOSED:
+      return net::RST_STREAM_STREAM_ALREADY_CLOSED;
+    case mod_spdy::Http2Framer::HTTP2_FRAME_SIZE_ERROR:
+      return net::RST_STREAM_FRAME_TOO_LARGE;
+    default:
+      return net::RST_STREAM_PROTOCOL_ERROR;
+  }
+}
+
+mod_spdy::Http2Framer::ErrorCode ErrorCodeFromRstStreamStatus(
+    net::SpdyRstStreamStatus status) {
+  switch (status) {
+    case net::RST_STREAM_REFUSED_STREAM:
+      return mod_spdy::Http2Framer::HTTP2_REFUSED_STREAM;
+    case net::RST_STREAM_CANCEL:
+      return mod_spdy::Http2Framer::HTTP2_CANCEL;
+    case net::RST_STREAM_INTERNAL_ERROR:
+      return mod_spdy::Http2Framer::HTTP2_INTERNAL_ERROR;
+    case net::RST_STREAM_FLOW_CONTROL_ERROR:
+      return mod_spdy::Http2Framer::HTTP2_FLOW_CONTROL_ERROR;
+    case net::RST_STREAM_INVALID_STREAM:
+    case net::RST_STREAM_STREAM_ALREADY_CLOSED:
+      return mod_spdy::Http2Framer::HTTP2_STREAM_CLOSED;
+    case net::RST_STREAM_FRAME_TOO_LARGE:
+      return mod_spdy::Http2Framer::HTTP2_FRAME_SIZE_ERROR;
+    default:
+      return mod_spdy::Http2Framer::HTTP2_PROTOCOL_ERROR;
+  }
+}
+
+net::SpdyGoAwayStatus GoAwayStatusFromErrorCode(uint32 error_code) {
+  switch (error_code) {
+    case mod_spdy::Http2Framer::HTTP2_NO_ERROR:
+      return net::GOAWAY_OK;
+    case mod_spdy::Http2Framer::HTTP2_PROTOCOL_ERROR:
+      return net::GOAWAY_PROTOCOL_ERROR;
+    default:
+      return net::GOAWAY_INTERNAL_ERROR;
+  }
+}
+
+mod_spdy::Http2Framer::ErrorCode ErrorCodeFromGoAwayStatus(
+    net::SpdyGoAwayStatus status) {
+  switch (status) {
+    case net::GOAWAY_OK:
+      return mod_spdy::Http2Framer::HTTP2_NO_ERROR;
+    case net::GOAWAY_PROTOCOL_ERROR:
+      return mod_spdy::Http2Framer::HTTP2_PROTOCOL_ERROR;
+    default:
+      return mod_spdy::Http2Framer::HTTP2_INTERNAL_ERROR;
+  }
+}
+
+// Copy the bytes into a new frame object.
+net::SpdySerializedFrame* NewSerializedFrame(const std::string& bytes) {
+  char* buffer = new char[bytes.size()];
+  std::memcpy(buffer, bytes.data(), bytes.size());
+  return new net::SpdySerializedFrame(buffer, bytes.size(), true);
+}
+
+}  // namespace
+
+namespace mod_spdy {
+
+class Http2Framer::FrameWriter : public net::SpdyFrameVisitor {
+ public:
+  FrameWriter(Http2Framer* framer, std::string* output)
+      : framer_(framer), output_(output), success_(true) {}
+  virtual ~FrameWriter() {}
+
+  bool success() const { return success_; }
+
+  virtual void VisitSynStream(const net::SpdySynStreamIR& frame) {
+    // Pushing would need PUSH_PROMISE, which we don't implement; SpdySession
+    // never starts pushes on HTTP/2 sessions.
+    Unsupported("SYN_STREAM");
+  }
+  virtual void VisitSynReply(const net::SpdySynReplyIR& frame) {
+    framer_->WriteHeaders(frame.stream_id(), frame.fin(),
+                          frame.name_value_block(), output_);
+  }
+  virtual void VisitRstStream(const net::SpdyRstStreamIR& frame) {
+    framer_->WriteRstStream(frame.stream_id(),
+                            ErrorCodeFromRstStreamStatus(frame.status()),
+                            output_);
+  }
+  virtual void VisitSettings(const net::SpdySettingsIR& frame) {
+    framer_->WriteSettings(frame, output_);
+  }
+  virtual void VisitPing(const net::SpdyPingIR& frame) {
+    framer_->WritePing(frame.id(), output_);
+  }
+  virtual void VisitGoAway(const net::SpdyGoAwayIR& frame) {
+    // If we're going away because the client broke the protocol, say how.
+    framer_->WriteGoAway(
+        frame.last_good_stream_id(),
+        (framer_->error_code_ != HTTP2_NO_ERROR ? framer_->error_code_ :
+         ErrorCodeFromGoAwayStatus(frame.status())),
+        output_);
+  }
+  virtual void VisitHeaders(const net::SpdyHeadersIR& frame) {
+    framer_->WriteHeaders(frame.stream_id(), frame.fin(),
+                          frame.name_value_block(), output_);
+  }
+  virtual void VisitWindowUpdate(const net::SpdyWindowUpdateIR& frame) {
+    framer_->WriteWindowUpdate(frame.stream_id(), frame.delta(), output_);
+  }
+  virtual void VisitCredential(const net::SpdyCredentialIR& frame) {
+    Unsupported("CREDENTIAL");
+  }
+  virtual void VisitBlocked(const net::SpdyBlockedIR& frame) {
+    Unsupported("BLOCKED");
+  }
+  virtual void VisitPushPromise(const net::SpdyPushPromiseIR& frame) {
+    Unsupported("PUSH_PROMISE");
+  }
+  virtual void VisitData(const net::SpdyDataIR& frame) {
+    framer_->WriteData(frame.stream_id(), frame.fin(), frame.data(), output_);
+  }
+
+ private:
+  void Unsupported(const char* frame_type) {
+    LOG(DFATAL) << "Can't send " << frame_type << " over HTTP/2";
+    success_ = false;
+  }
+
+  Http2Framer* const framer_;
+  std::string* const output_;
+  bool success_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrameWriter);
+};
+
+// static
+const size_t Http2Framer::kMaxFramePayloadSize;
+// static
+const size_t Http2Framer::kMaxHeaderBlockSize;
+
+Http2Framer::Http2Framer()
+    : visitor_(NULL),
+      error_code_(HTTP2_NO_ERROR),
+      preface_received_(false),
+      settings_received_(false),
+      header_block_stream_id_(0),
+      header_block_fin_(false),
+      header_block_priority_(kDefaultPriority),
+      last_client_stream_id_(0),
+      peer_max_frame_size_(kMaxFramePayloadSize) {}
+
+Http2Framer::~Http2Framer() {}
+
+void Http2Framer::set_visitor(
+    net::BufferedSpdyFramerVisitorInterface* visitor) {
+  visitor_ = visitor;
+}
+
+size_t Http2Framer::ProcessInput(const char* data, size_t length) {
+  DCHECK(visitor_);
+  if (HasError()) {
+    return 0;
+  }
+  // Parse whole frames straight out of the caller's data where we can, and
+  // only copy the incomplete tail.
+  base::StringPiece input(data, length);
+  if (!input_buffer_.empty()) {
+    input_buffer_.append(data, length);
+    input = input_buffer_;
+  }
+  const size_t consumed = ProcessFrames(input);
+  if (HasError()) {
+    input_buffer_.clear();
+    return 0;
+  }
+  if (input.data() == input_buffer_.data()) {
+    input_buffer_.erase(0, consumed);
+  } else {
+    input_buffer_.assign(data + consumed, length - consumed);
+  }
+  return length;
+}
+
+bool Http2Framer::HasError() {
+  return error_code_ != HTTP2_NO_ERROR;
+}
+
+net::SpdySerializedFrame* Http2Framer::SerializeFrame(
+    const net::SpdyFrameIR& frame) {
+  std::string output;
+  FrameWriter writer(this, &output);
+  frame.Visit(&writer);
+  if (!writer.success()) {
+    return NULL;
+  }
+  return NewSerializedFrame(output);
+}
+
+net::SpdySerializedFrame* Http2Framer::ReleasePendingOutput() {
+  if (pending_output_.empty()) {
+    return NULL;
+  }
+  net::SpdySerializedFrame* frame = NewSerializedFrame(pending_output_);
+  pending_output_.clear();
+  return frame;
+}
+
+size_t Http2Framer::ProcessFrames(base::StringPiece input) {
+  size_t consumed = 0;
+  if (!preface_received_) {
+    const size_t length = std::min(input.size(), kConnectionPrefaceLength);
+    if (std::memcmp(input.data(), kConnectionPreface, length) != 0) {
+      ConnectionError(HTTP2_PROTOCOL_ERROR, "invalid connection preface");
+      return 0;
+    }
+    if (length < kConnectionPrefaceLength) {
+      return 0;
+    }
+    preface_received_ = true;
+    consumed = kConnectionPrefaceLength;
+  }
+
+  while (!HasError() && input.size() - consumed >= kFrameHeaderSize) {
+    const char* header = input.data() + consumed;
+    const size_t length = ReadUint24(header);
+    // Check the length before waiting for the payload, so that we don't
+    // buffer an oversized frame.
+    if (length > kMaxFramePayloadSize) {
+      ConnectionError(HTTP2_FRAME_SIZE_ERROR, "frame too large");
+      break;
+    }
+    if (input.size() - consumed - kFrameHeaderSize < length) {
+      break;
+    }
+    ProcessFrame(static_cast<uint8>(header[3]), static_cast<uint8>(header[4]),
+                 ReadUint32(header + 5) & kStreamIdMask,
+                 base::StringPiece(header + kFrameHeaderSize, length));
+    consumed += kFrameHeaderSize + length;
+  }
+  return consumed;
+}
+
+void Http2Framer::ProcessFrame(uint8 type, uint8 flags,
+                               net::SpdyStreamId stream_id,
+                               base::StringPiece payload) {
+  // The client's first frame must be a SETTINGS frame (RFC 7540 section 3.5).
+  if (!settings_received_ &&
+      (type != kSettingsFrame || (flags & kFlagAck) != 0)) {
+    ConnectionError(HTTP2_PROTOCOL_ERROR, "first frame must be SETTINGS");
+    return;
+  }
+  // A header block must be sent as a contiguous sequence of frames (RFC 7540
+  // section 4.3).
+  if (header_block_stream_id_ != 0 ?
+      (type != kContinuationFrame || stream_id != header_block_stream_id_) :
+      type == kContinuationFrame) {
+    ConnectionError(HTTP2_PROTOCOL_ERROR, "unexpected CONTINUATION state");
+    return;
+  }
+
+  switch (type) {
+    case kDataFrame:
+      ProcessDataFrame(flags, stream_id, payload);
+      break;
+    case kHeadersFrame:
+      ProcessHeadersFrame(flags, stream_id, payload);
+      break;
+    case kPriorityFrame:
+      // We don't support stream dependencies, so only check that the frame
+      // is valid (RFC 7540 section 6.3).
+      if (stream_id == 0) {
+        ConnectionError(HTTP2_PROTOCOL_ERROR, "PRIORITY for stream 0");
+      } else if (payload.size() != 5) {
+        ConnectionError(HTTP2_FRAME_SIZE_ERROR, "bad PRIORITY length");
+      }
+      break;
+    case kRstStreamFrame:
+      ProcessRstStreamFrame(stream_id, payload);
+      break;
+    case kSettingsFrame:
+      ProcessSettingsFrame(flags, stream_id, payload);
+      break;
+    case kPushPromiseFrame:
+      ConnectionError(HTTP2_PROTOCOL_ERROR, "client sent PUSH_PROMISE");
+      break;
+    case kPingFrame:
+      ProcessPingFrame(flags, stream_id, payload);
+      break;
+    case kGoAwayFrame:
+      ProcessGoAwayFrame(stream_id, payload);
+      break;
+    case kWindowUpdateFrame:
+      ProcessWindowUpdateFrame(stream_id, payload);
+      break;
+    case kContinuationFrame:
+      ProcessContinuationFrame(flags, payload);
+      break;
+    default:
+      // Unknown frame types must be ignored (RFC 7540 section 4.1).
+      VLOG(3) << "Ignoring HTTP/2 frame of unknown type " << int(type);
+      break;
+  }
+}
+
+void Http2Framer::ProcessDataFrame(uint8 flags, net::SpdyStreamId stream_id,
+                                   base::StringPiece payload) {
+  if (stream_id == 0 || IsIdleStream(stream_id)) {
+    ConnectionError(HTTP2_PROTOCOL_ERROR, "DATA for idle stream");
+    return;
+  }
+  const size_t flow_controlled_length = payload.size();
+  if (!RemovePadding(flags, &payload)) {
+    return;
+  }
+  StreamStateMap::const_iterator iter = stream_states_.find(stream_id);
+  if (iter == stream_states_.end() ||
+      iter->second == STREAM_HALF_CLOSED_REMOTE) {
+    // The session never sees this data, so give the client back the
+    // connection window it used here.
+    if (flow_controlled_length > 0) {
+      WriteWindowUpdate(0, flow_controlled_length, &pending_output_);
+    }
+    // If the stream is closed, most likely we reset it while this data was in
+    // flight, so just drop the data.  But if the client has already ended the
+    // stream, it has broken the protocol (RFC 7540 section 5.1).
+    if (iter != stream_states_.end()) {
+      visitor_->OnStreamError(stream_id, "DATA for half-closed stream");
+    }
+    return;
+  }
+
+  const bool fin = (flags & kFlagEndStream) != 0;
+  // Padding counts against flow control, but the session only sees (and
+  // eventually sends WINDOW_UPDATEs for) the data itself, so give the client
+  // back the padding's share of its windows right away.
+  const size_t padding = flow_controlled_length - payload.size();
+  if (padding > 0) {
+    WriteWindowUpdate(0, padding, &pending_output_);
+    if (!fin) {
+      WriteWindowUpdate(stream_id, padding, &pending_output_);
+    }
+  }
+  if (fin) {
+    OnRemoteEndStream(stream_id);
+  }
+  visitor_->OnStreamFrameData(stream_id, payload.data(), payload.size(), fin);
+}
+
+void Http2Framer::ProcessHeadersFrame(uint8 flags,
+                                      net::SpdyStreamId stream_id,
+                                      base::StringPiece payload) {
+  if (stream_id == 0) {
+    ConnectionError(HTTP2_PROTOCOL_ERROR, "HEADERS for stream 0");
+    return;
+  }
+  if (!RemovePadding(flags, &payload)) {
+    return;
+  }
+  net::SpdyPriority priority = kDefaultPriority;
+  if ((flags & kFlagPriority) != 0) {
+    // Skip the stream dependency, and use only the weight.
+    if (payload.size() < 5) {
+      ConnectionError(HTTP2_FRAME_SIZE_ERROR, "HEADERS too short");
+      return;
+    }
+    priority = WeightToPriority(static_cast<uint8>(payload[4]) + 1);
+    payload.remove_prefix(5);
+  }
+
+  header_block_stream_id_ = stream_id;
+  header_block_fin_ = (flags & kFlagEndStream) != 0;
+  header_block_priority_ = priority;
+  if ((flags & kFlagEndHeaders) != 0) {
+    ProcessHeaderBlock(payload);
+  } else {
+    payload.CopyToString(&header_block_);
+  }
+}
+
+void Http2Framer::ProcessContinuationFrame(uint8 flags,
+                                           base::StringPiece payload) {
+  if (header_block_.size() + payload.size() > kMaxHeaderBlockSize) {
+    ConnectionError(HTTP2_ENHANCE_YOUR_CALM, "header block too large");
+    return;
+  }
+  payload.AppendToString(&header_block_);
+  if ((flags & kFlagEndHeaders) != 0) {
+    ProcessHeaderBlock(header_block_);
+    header_block_.clear();
+  }
+}
+
+void Http2Framer::ProcessHeaderBlock(base::StringPiece block) {
+  const net::SpdyStreamId stream_id = header_block_stream_id_;
+  const bool fin = header_block_fin_;
+  header_block_stream_id_ = 0;
+
+  // Decode the block even if we're going to reject the stream, to keep our
+  // HPACK table in step with the client's.
+  net::SpdyHeaderBlock headers;
+  if (!decoder_.DecodeHeaderBlock(block, &headers)) {
+    ConnectionError(HTTP2_COMPRESSION_ERROR, "bad header block");
+    return;
+  }
+
+  if (stream_id % 2 == 0) {
+    ConnectionError(HTTP2_PROTOCOL_ERROR, "HEADERS for even stream ID");
+    return;
+  }
+
+  if (IsIdleStream(stream_id)) {
+    // This opens a new stream.
+    last_client_stream_id_ = stream_id;
+    stream_states_[stream_id] =
+        fin ? STREAM_HALF_CLOSED_REMOTE : STREAM_OPEN;
+    if (!ConvertRequestHeaders(&headers)) {
+      // A malformed request is a stream error (RFC 7540 section 8.1.2.6); the
+      // session will reset the stream.
+      visitor_->OnStreamError(stream_id, "malformed request headers");
+      return;
+    }
+    visitor_->OnSynStream(stream_id, 0, header_block_priority_, 0, fin, false,
+                          headers);
+    return;
+  }
+
+  // Otherwise, these are trailers for an open stream.
+  StreamStateMap::const_iterator iter = stream_states_.find(stream_id);
+  if (iter == stream_states_.end() ||
+      iter->second == STREAM_HALF_CLOSED_REMOTE) {
+    visitor_->OnStreamError(stream_id, "HEADERS for closed stream");
+    return;
+  }
+  if (!IsValidTrailerBlock(headers)) {
+    // As for the leading headers, this is a stream error (RFC 7540 section
+    // 8.1.2.6).
+    visitor_->OnStreamError(stream_id, "malformed trailers");
+    return;
+  }
+  if (fin) {
+    OnRemoteEndStream(stream_id);
+  }
+  visitor_->OnHeaders(stream_id, fin, headers);
+}
+
+void Http2Framer::ProcessRstStreamFrame(net::SpdyStreamId stream_id,
+                                        base::StringPiece payload) {
+  if (payload.size() != 4) {
+    ConnectionError(HTTP2_FRAME_SIZE_ERROR, "bad RST_STREAM length");
+    return;
+  }
+  if (stream_id == 0 || IsIdleStream(stream_id)) {
+    ConnectionError(HTTP2_PROTOCOL_ERROR, "RST_STREAM for idle stream");
+    return;
+  }
+  stream_states_.erase(stream_id);
+  visitor_->OnRstStream(
+      stream_id, RstStreamStatusFromErrorCode(ReadUint32(payload.data())));
+}
+
+void Http2Framer::ProcessSettingsFrame(uint8 flags,
+                                       net::SpdyStreamId stream_id,
+                                       base::StringPiece payload) {
+  if (stream_id != 0) {
+    ConnectionError(HTTP2_PROTOCOL_ERROR, "SETTINGS for nonzero stream");
+    return;
+  }
+  if ((flags & kFlagAck) != 0) {
+    // The client has applied our settings; there's nothing for us to do.
+    if (!payload.empty()) {
+      ConnectionError(HTTP2_FRAME_SIZE_ERROR, "SETTINGS ack with payload");
+    }
+    return;
+  }
+  if (payload.size() % 6 != 0) {
+    ConnectionError(HTTP2_FRAME_SIZE_ERROR, "bad SETTINGS length");
+    return;
+  }
+
+  settings_received_ = true;
+  visitor_->OnSettings(false);
+  for (size_t offset = 0; offset < payload.size(); offset += 6) {
+    const uint16 id = ReadUint16(payload.data() + offset);
+    const uint32 value = ReadUint32(payload.data() + offset + 2);
+    switch (id) {
+      case kSettingsHeaderTableSize:
+        encoder_.ApplyHeaderTableSizeSetting(value);
+        break;
+      case kSettingsEnablePush:
+        // We never push, so the value doesn't matter, but it must be valid.
+        if (value > 1) {
+          ConnectionError(HTTP2_PROTOCOL_ERROR, "bad SETTINGS_ENABLE_PUSH");
+          return;
+        }
+        break;
+      case kSettingsMaxConcurrentStreams:
+        visitor_->OnSetting(net::SETTINGS_MAX_CONCURRENT_STREAMS, 0, value);
+        break;
+      case kSettingsInitialWindowSize:
+        if (value > kMaxWindowSize) {
+          ConnectionError(HTTP2_FLOW_CONTROL_ERROR,
+                          "bad SETTINGS_INITIAL_WINDOW_SIZE");
+          return;
+        }
+        visitor_->OnSetting(net::SETTINGS_INITIAL_WINDOW_SIZE, 0, value);
+        break;
+      case kSettingsMaxFrameSize:
+        if (value < kMaxFramePayloadSize || value > kLargestMaxFrameSize) {
+          ConnectionError(HTTP2_PROTOCOL_ERROR, "bad SETTINGS_MAX_FRAME_SIZE");
+          return;
+        }
+        peer_max_frame_size_ = value;
+        break;
+      default:
+        // SETTINGS_MAX_HEADER_LIST_SIZE is advisory, and unknown settings
+        // must be ignored (RFC 7540 section 6.5.2).
+        break;
+    }
+  }
+  // Acknowledge the settings now that we've applied them (RFC 7540 section
+  // 6.5.3).
+  AppendFrameHeader(0, kSettingsFrame, kFlagAck, 0, &pending_output_);
+}
+
+void Http2Framer::ProcessPingFrame(uint8 flags, net::SpdyStreamId stream_id,
+                                   base::StringPiece payload) {
+  if (stream_id != 0) {
+    ConnectionError(HTTP2_PROTOCOL_ERROR, "PING for nonzero stream");
+    return;
+  }
+  if (payload.size() != 8) {
+    ConnectionError(HTTP2_FRAME_SIZE_ERROR, "bad PING length");
+    return;
+  }
+  // Echo the client's PINGs; we never send any of our own that would need
+  // their acks reporting to the session.
+  if ((flags & kFlagAck) == 0) {
+    AppendFrameHeader(8, kPingFrame, kFlagAck, 0, &pending_output_);
+    payload.AppendToString(&pending_output_);
+  }
+}
+
+void Http2Framer::ProcessGoAwayFrame(net::SpdyStreamId stream_id,
+                                     base::StringPiece payload) {
+  if (stream_id != 0) {
+    ConnectionError(HTTP2_PROTOCOL_ERROR, "GOAWAY for nonzero stream");
+    return;
+  }
+  if (payload.size() < 8) {
+    ConnectionError(HTTP2_FRAME_SIZE_ERROR, "GOAWAY too short");
+    return;
+  }
+  visitor_->OnGoAway(
+      ReadUint32(payload.data()) & kStreamIdMask,
+      GoAwayStatusFromErrorCode(ReadUint32(payload.data() + 4)));
+}
+
+void Http2Framer::ProcessWindowUpdateFrame(net::SpdyStreamId stream_id,
+                                           base::StringPiece payload) {
+  if (payload.size() != 4) {
+    ConnectionError(HTTP2_FRAME_SIZE_ERROR, "bad WINDOW_UPDATE length");
+    return;
+  }
+  const uint32 delta = ReadUint32(payload.data()) & kMaxWindowSize;
+  if (delta == 0) {
+    if (stream_id == 0) {
+      ConnectionError(HTTP2_PROTOCOL_ERROR, "zero WINDOW_UPDATE");
+    } else {
+      visitor_->OnStreamError(stream_id, "zero WINDOW_UPDATE");
+    }
+    return;
+  }
+  visitor_->OnWindowUpdate(stream_id, delta);
+}
+
+bool Http2Framer::RemovePadding(uint8 flags, base::StringPiece* payload) {
+  if ((flags & kFlagPadded) == 0) {
+    return true;
+  }
+  if (payload->empty() ||
+      static_cast<uint8>((*payload)[0]) >= payload->size()) {
+    ConnectionError(HTTP2_PROTOCOL_ERROR, "bad padding");
+    return false;
+  }
+  const size_t padding = static_cast<uint8>((*payload)[0]);
+  payload->remove_prefix(1);
+  payload->remove_suffix(padding);
+  return true;
+}
+
+bool Http2Framer::IsIdleStream(net::SpdyStreamId stream_id) const {
+  // We never open streams ourselves, so even IDs are always idle.
+  return stream_id % 2 == 0 || stream_id > last_client_stream_id_;
+}
+
+void Http2Framer::OnRemoteEndStream(net::SpdyStreamId stream_id) {
+  StreamStateMap::iterator iter = stream_states_.find(stream_id);
+  DCHECK(iter != stream_states_.end());
+  if (iter->second == STREAM_HALF_CLOSED_LOCAL) {
+    stream_states_.erase(iter);
+  } else {
+    iter->second = STREAM_HALF_CLOSED_REMOTE;
+  }
+}
+
+void Http2Framer::OnLocalEndStream(net::SpdyStreamId stream_id) {
+  StreamStateMap::iterator iter = stream_states_.find(stream_id);
+  if (iter == stream_states_.end()) {
+    return;
+  }
+  if (iter->second == STREAM_HALF_CLOSED_REMOTE) {
+    stream_states_.erase(iter);
+  } else {
+    iter->second = STREAM_HALF_CLOSED_LOCAL;
+  }
+}
+
+void Http2Framer::ConnectionError(ErrorCode error_code,
+                                  const char* description) {
+  DCHECK_NE(HTTP2_NO_ERROR, error_code);
+  VLOG(1) << "HTTP/2 connection error " << error_code << ": " << description;
+  error_code_ = error_code;
+  visitor_->OnError(
+      error_code == HTTP2_COMPRESSION_ERROR ?
+      net::SpdyFramer::SPDY_DECOMPRESS_FAILURE :
+      error_code == HTTP2_FRAME_SIZE_ERROR ?
+      net::SpdyFramer::SPDY_CONTROL_PAYLOAD_TOO_LARGE :
+      net::SpdyFramer::SPDY_INVALID_CONTROL_FRAME);
+}
+
+void Http2Framer::WriteHeaders(net::SpdyStreamId stream_id, bool fin,
+                               const net::SpdyHeaderBlock& block,
+                               std::string* output) {
+  // Convert the SPDY/3 response headers to HTTP/2 form.
+  net::SpdyHeaderBlock headers;
+  for (net::SpdyHeaderBlock::const_iterator iter = block.begin();
+       iter != block.end(); ++iter) {
+    if (iter->first == spdy::kSpdy3Status) {
+      // Keep only the status code (e.g. "200" from "200 OK").
+      headers[iter->first] = iter->second.substr(0, 3);
+    } else if (iter->first != spdy::kSpdy3Version &&
+               !IsInvalidSpdyResponseHeader(iter->first)) {
+      headers.insert(*iter);
+    }
+  }
+  std::string header_block;
+  encoder_.EncodeHeaderBlock(headers, &header_block);
+
+  // Split the block into a HEADERS frame and as many CONTINUATION frames as
+  // the client's maximum frame size requires.
+  base::StringPiece remaining(header_block);
+  uint8 type = kHeadersFrame;
+  uint8 flags = fin ? kFlagEndStream : 0;
+  while (true) {
+    const size_t length = std::min(remaining.size(), peer_max_frame_size_);
+    const bool last = length == remaining.size();
+    AppendFrameHeader(length, type, last ? flags | kFlagEndHeaders : flags,
+                      stream_id, output);
+    output->append(remaining.data(), length);
+    if (last) {
+      break;
+    }
+    remaining.remove_prefix(length);
+    type = kContinuationFrame;
+    flags = 0;
+  }
+  if (fin) {
+    OnLocalEndStream(stream_id);
+  }
+}
+
+void Http2Framer::WriteData(net::SpdyStreamId stream_id, bool fin,
+                            base::StringPiece data, std::string* output) {
+  const size_t num_frames = std::max<size_t>(
+      1, (data.size() + peer_max_frame_size_ - 1) / peer_max_frame_size_);
+  output->reserve(output->size() + data.size() +
+                  num_frames * kFrameHeaderSize);
+  while (true) {
+    const size_t length = std::min(data.size(), peer_max_frame_size_);
+    const bool last = length == data.size();
+    AppendFrameHeader(length, kDataFrame, (last && fin) ? kFlagEndStream : 0,
+                      stream_id, output);
+    output->append(data.data(), length);
+    if (last) {
+      break;
+    }
+    data.remove_prefix(length);
+  }
+  if (fin) {
+    OnLocalEndStream(stream_id);
+  }
+}
+
+void Http2Framer::WriteRstStream(net::SpdyStreamId stream_id,
+                                 ErrorCode error_code, std::string* output) {
+  AppendFrameHeader(4, kRstStreamFrame, 0, stream_id, output);
+  AppendUint32(error_code, output);
+  stream_states_.erase(stream_id);
+}
+
+void Http2Framer::WriteSettings(const net::SpdySettingsIR& frame,
+                                std::string* output) {
+  // Only some SPDY settings have HTTP/2 equivalents; the others (which are
+  // all advisory) are dropped.
+  std::string payload;
+  const net::SpdySettingsIR::ValueMap& values = frame.values();
+  for (net::SpdySettingsIR::ValueMap::const_iterator iter = values.begin();
+       iter != values.end(); ++iter) {
+    if (iter->first == net::SETTINGS_MAX_CONCURRENT_STREAMS) {
+      AppendUint16(kSettingsMaxConcurrentStreams, &payload);
+    } else if (iter->first == net::SETTINGS_INITIAL_WINDOW_SIZE) {
+      AppendUint16(kSettingsInitialWindowSize, &payload);
+    } else {
+      continue;
+    }
+    AppendUint32(iter->second.value, &payload);
+  }
+  AppendFrameHeader(payload.size(), kSettingsFrame, 0, 0, output);
+  output->append(payload);
+}
+
+void Http2Framer::WritePing(net::SpdyPingId id, std::string* output) {
+  AppendFrameHeader(8, kPingFrame, 0, 0, output);
+  AppendUint32(0, output);
+  AppendUint32(id, output);
+}
+
+void Http2Framer::WriteGoAway(net::SpdyStreamId last_stream_id,
+                              ErrorCode error_code, std::string* output) {
+  AppendFrameHeader(8, kGoAwayFrame, 0, 0, output);
+  AppendUint32(last_stream_id & kStreamIdMask, output);
+  AppendUint32(error_code, output);
+}
+
+void Http2Framer::WriteWindowUpdate(net::SpdyStreamId stream_id,
+                                    uint32 delta, std::string* output) {
+  AppendFrameHeader(4, kWindowUpdateFrame, 0, stream_id, output);
+  AppendUint32(delta & kMaxWindowSize, output);
+}
+
+}  // namespace mod_spdy
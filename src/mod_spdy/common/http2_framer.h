@@ -0,0 +1,183 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOD_SPDY_COMMON_HTTP2_FRAMER_H_
+#define MOD_SPDY_COMMON_HTTP2_FRAMER_H_
+
+#include <map>
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+#include "mod_spdy/common/hpack_decoder.h"
+#include "mod_spdy/common/hpack_encoder.h"
+#include "mod_spdy/common/session_framer.h"
+#include "net/spdy/buffered_spdy_framer.h"
+#include "net/spdy/spdy_framer.h"
+#include "net/spdy/spdy_protocol.h"
+
+namespace mod_spdy {
+
+// A SessionFramer that speaks HTTP/2 (RFC 7540) to the client, with HPACK
+// header compression (RFC 7541), while presenting the same SPDY/3-style
+// frames to the SpdySession as BufferedSpdyFramer does.  Request headers are
+// converted to SPDY/3 form (":authority" becomes ":host", and ":version" is
+// added) so that SpdyToHttpConverter can handle them as usual; response
+// headers are converted back (":status" loses its reason phrase, and
+// ":version" and connection-specific headers are dropped).
+//
+// The framer keeps track of stream states (RFC 7540 section 5.1), so that it
+// can tell new streams from trailers and reject frames for idle streams, and
+// answers SETTINGS and PING frames itself (see ReleasePendingOutput).  It
+// does not support server push (PUSH_PROMISE) or stream dependencies; the
+// weight in a HEADERS frame's priority block is mapped to a SPDY/3 priority,
+// and PRIORITY frames are ignored.  Like all SessionFramers, this class is not
+// thread-safe.
+class Http2Framer : public SessionFramer {
+ public:
+  // HTTP/2 error codes (RFC 7540 section 7).
+  enum ErrorCode {
+    HTTP2_NO_ERROR = 0x0,
+    HTTP2_PROTOCOL_ERROR = 0x1,
+    HTTP2_INTERNAL_ERROR = 0x2,
+    HTTP2_FLOW_CONTROL_ERROR = 0x3,
+    HTTP2_SETTINGS_TIMEOUT = 0x4,
+    HTTP2_STREAM_CLOSED = 0x5,
+    HTTP2_FRAME_SIZE_ERROR = 0x6,
+    HTTP2_REFUSED_STREAM = 0x7,
+    HTTP2_CANCEL = 0x8,
+    HTTP2_COMPRESSION_ERROR = 0x9,
+    HTTP2_CONNECT_ERROR = 0xa,
+    HTTP2_ENHANCE_YOUR_CALM = 0xb,
+    HTTP2_INADEQUATE_SECURITY = 0xc,
+    HTTP2_HTTP_1_1_REQUIRED = 0xd
+  };
+
+  // The largest frame payload we accept.  We never advertise a
+  // SETTINGS_MAX_FRAME_SIZE, so this is the protocol's default.
+  static const size_t kMaxFramePayloadSize = 16384;
+
+  // The largest header block (HEADERS plus CONTINUATION payloads, still
+  // compressed) we're willing to buffer.
+  static const size_t kMaxHeaderBlockSize = HpackDecoder::kMaxHeaderListSize;
+
+  Http2Framer();
+  virtual ~Http2Framer();
+
+  // SessionFramer methods:
+  virtual void set_visitor(net::BufferedSpdyFramerVisitorInterface* visitor);
+  virtual size_t ProcessInput(const char* data, size_t length);
+  virtual bool HasError();
+  virtual net::SpdySerializedFrame* SerializeFrame(
+      const net::SpdyFrameIR& frame);
+  virtual net::SpdySerializedFrame* ReleasePendingOutput();
+
+  // If the client's input caused a connection error, return its error code
+  // (which is also sent in our GOAWAY frame); otherwise, HTTP2_NO_ERROR.
+  ErrorCode error_code() const { return error_code_; }
+
+ private:
+  // A SpdyFrameVisitor that serializes each kind of SPDY frame as HTTP/2.
+  class FrameWriter;
+
+  // Streams that are neither idle nor closed.  Closed streams are removed
+  // from the map.
+  enum StreamState {
+    STREAM_OPEN,
+    STREAM_HALF_CLOSED_REMOTE,  // the client has sent END_STREAM
+    STREAM_HALF_CLOSED_LOCAL    // we have sent END_STREAM
+  };
+  typedef std::map<net::SpdyStreamId, StreamState> StreamStateMap;
+
+  // Process as many complete frames (and the connection preface, if it's
+  // still expected) from the front of the input as possible, and return the
+  // number of bytes used.
+  size_t ProcessFrames(base::StringPiece input);
+  void ProcessFrame(uint8 type, uint8 flags, net::SpdyStreamId stream_id,
+                    base::StringPiece payload);
+  void ProcessDataFrame(uint8 flags, net::SpdyStreamId stream_id,
+                        base::StringPiece payload);
+  void ProcessHeadersFrame(uint8 flags, net::SpdyStreamId stream_id,
+                           base::StringPiece payload);
+  void ProcessContinuationFrame(uint8 flags, base::StringPiece payload);
+  void ProcessHeaderBlock(base::StringPiece block);
+  void ProcessRstStreamFrame(net::SpdyStreamId stream_id,
+                             base::StringPiece payload);
+  void ProcessSettingsFrame(uint8 flags, net::SpdyStreamId stream_id,
+                            base::StringPiece payload);
+  void ProcessPingFrame(uint8 flags, net::SpdyStreamId stream_id,
+                        base::StringPiece payload);
+  void ProcessGoAwayFrame(net::SpdyStreamId stream_id,
+                          base::StringPiece payload);
+  void ProcessWindowUpdateFrame(net::SpdyStreamId stream_id,
+                                base::StringPiece payload);
+
+  // If the PADDED flag is set, strip the padding from the payload.  Return
+  // false (after reporting a connection error) if the padding is invalid.
+  bool RemovePadding(uint8 flags, base::StringPiece* payload);
+
+  // Return true if the given client stream ID hasn't been used yet.
+  bool IsIdleStream(net::SpdyStreamId stream_id) const;
+
+  // Record that the client or we, respectively, have sent END_STREAM.
+  void OnRemoteEndStream(net::SpdyStreamId stream_id);
+  void OnLocalEndStream(net::SpdyStreamId stream_id);
+
+  // Stop processing input, and tell the visitor that the connection is
+  // broken; the session will then send a GOAWAY with the given code.
+  void ConnectionError(ErrorCode error_code, const char* description);
+
+  // Append frames to the output.
+  void WriteHeaders(net::SpdyStreamId stream_id, bool fin,
+                    const net::SpdyHeaderBlock& block, std::string* output);
+  void WriteData(net::SpdyStreamId stream_id, bool fin,
+                 base::StringPiece data, std::string* output);
+  void WriteRstStream(net::SpdyStreamId stream_id, ErrorCode error_code,
+                      std::string* output);
+  void WriteSettings(const net::SpdySettingsIR& frame, std::string* output);
+  void WritePing(net::SpdyPingId id, std::string* output);
+  void WriteGoAway(net::SpdyStreamId last_stream_id, ErrorCode error_code,
+                   std::string* output);
+  void WriteWindowUpdate(net::SpdyStreamId stream_id, uint32 delta,
+                         std::string* output);
+
+  net::BufferedSpdyFramerVisitorInterface* visitor_;
+  HpackDecoder decoder_;
+  HpackEncoder encoder_;
+  ErrorCode error_code_;
+  bool preface_received_;
+  bool settings_received_;
+  // The tail of the input that doesn't yet make a whole frame.
+  std::string input_buffer_;
+  // The header block being assembled from a HEADERS frame and CONTINUATION
+  // frames, if header_block_stream_id_ is nonzero.
+  std::string header_block_;
+  net::SpdyStreamId header_block_stream_id_;
+  bool header_block_fin_;
+  net::SpdyPriority header_block_priority_;
+  // The highest stream ID the client has opened.
+  net::SpdyStreamId last_client_stream_id_;
+  StreamStateMap stream_states_;
+  // The client's SETTINGS_MAX_FRAME_SIZE.
+  size_t peer_max_frame_size_;
+  // Frames the framer has generated itself, waiting to be sent.
+  std::string pending_output_;
+
+  DISALLOW_COPY_AND_ASSIGN(Http2Framer);
+};
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_HTTP2_FRAMER_H_
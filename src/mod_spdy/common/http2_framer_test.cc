@@ -0,0 +1,389 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mod_spdy/common/http2_framer.h"
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+#include "mod_spdy/common/hpack_decoder.h"
+#include "mod_spdy/common/protocol_util.h"
+#include "net/spdy/buffered_spdy_framer.h"
+#include "net/spdy/spdy_framer.h"
+#include "net/spdy/spdy_protocol.h"
+#include "testing/gmock/include/gmock/gmock.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using mod_spdy::Http2Framer;
+using testing::_;
+using testing::AtLeast;
+using testing::Eq;
+using testing::InSequence;
+using testing::StrictMock;
+
+namespace {
+
+const char kPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+// RFC 7541 appendix C.4.1: GET http://www.example.com/
+const char kGetRequestBlock[] =
+    "\x82\x86\x84\x41\x8c\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff";
+
+class MockVisitor : public net::BufferedSpdyFramerVisitorInterface {
+ public:
+  MOCK_METHOD1(OnError, void(net::SpdyFramer::SpdyError));
+  MOCK_METHOD2(OnStreamError, void(net::SpdyStreamId, const std::string&));
+  MOCK_METHOD7(OnSynStream, void(net::SpdyStreamId, net::SpdyStreamId,
+                                 net::SpdyPriority, uint8, bool, bool,
+                                 const net::SpdyHeaderBlock&));
+  MOCK_METHOD3(OnSynReply, void(net::SpdyStreamId, bool,
+                                const net::SpdyHeaderBlock&));
+  MOCK_METHOD3(OnHeaders, void(net::SpdyStreamId, bool,
+                               const net::SpdyHeaderBlock&));
+  MOCK_METHOD4(OnStreamFrameData, void(net::SpdyStreamId, const char*,
+                                       size_t, bool));
+  MOCK_METHOD1(OnSettings, void(bool));
+  MOCK_METHOD3(OnSetting, void(net::SpdySettingsIds, uint8, uint32));
+  MOCK_METHOD1(OnPing, void(uint32));
+  MOCK_METHOD2(OnRstStream, void(net::SpdyStreamId,
+                                 net::SpdyRstStreamStatus));
+  MOCK_METHOD2(OnGoAway, void(net::SpdyStreamId, net::SpdyGoAwayStatus));
+  MOCK_METHOD2(OnWindowUpdate, void(net::SpdyStreamId, uint32));
+  MOCK_METHOD2(OnPushPromise, void(net::SpdyStreamId, net::SpdyStreamId));
+};
+
+std::string Uint32(uint32 value) {
+  std::string output;
+  output.push_back(static_cast<char>(value >> 24));
+  output.push_back(static_cast<char>(value >> 16));
+  output.push_back(static_cast<char>(value >> 8));
+  output.push_back(static_cast<char>(value));
+  return output;
+}
+
+std::string Frame(uint8 type, uint8 flags, net::SpdyStreamId stream_id,
+                  const std::string& payload) {
+  std::string output;
+  output.push_back(static_cast<char>(payload.size() >> 16));
+  output.push_back(static_cast<char>(payload.size() >> 8));
+  output.push_back(static_cast<char>(payload.size()));
+  output.push_back(static_cast<char>(type));
+  output.push_back(static_cast<char>(flags));
+  output.append(Uint32(stream_id));
+  output.append(payload);
+  return output;
+}
+
+std::string Setting(uint16 id, uint32 value) {
+  std::string output;
+  output.push_back(static_cast<char>(id >> 8));
+  output.push_back(static_cast<char>(id));
+  output.append(Uint32(value));
+  return output;
+}
+
+class Http2FramerTest : public testing::Test {
+ protected:
+  Http2FramerTest() {
+    framer_.set_visitor(&visitor_);
+  }
+
+  void Input(const std::string& data) {
+    EXPECT_EQ(data.size(), framer_.ProcessInput(data.data(), data.size()));
+  }
+
+  // Send the connection preface and an empty SETTINGS frame.
+  void StartConnection() {
+    EXPECT_CALL(visitor_, OnSettings(false));
+    Input(std::string(kPreface) + Frame(0x4, 0, 0, ""));
+    EXPECT_EQ(Frame(0x4, 0x1, 0, ""), TakePendingOutput());
+  }
+
+  // Open stream 1 with a GET request, without END_STREAM.
+  void OpenStream() {
+    EXPECT_CALL(visitor_, OnSynStream(1u, 0u, 3u, 0u, false, false, _));
+    Input(Frame(0x1, 0x4, 1, kGetRequestBlock));
+  }
+
+  std::string TakePendingOutput() {
+    scoped_ptr<net::SpdySerializedFrame> frame(
+        framer_.ReleasePendingOutput());
+    return frame == NULL ? "" : std::string(frame->data(), frame->size());
+  }
+
+  std::string Serialize(const net::SpdyFrameIR& frame_ir) {
+    scoped_ptr<net::SpdySerializedFrame> frame(
+        framer_.SerializeFrame(frame_ir));
+    EXPECT_TRUE(frame != NULL);
+    return frame == NULL ? "" : std::string(frame->data(), frame->size());
+  }
+
+  StrictMock<MockVisitor> visitor_;
+  Http2Framer framer_;
+};
+
+TEST_F(Http2FramerTest, Settings) {
+  {
+    InSequence seq;
+    EXPECT_CALL(visitor_, OnSettings(false));
+    EXPECT_CALL(visitor_, OnSetting(net::SETTINGS_MAX_CONCURRENT_STREAMS,
+                                    0, 100u));
+    EXPECT_CALL(visitor_, OnSetting(net::SETTINGS_INITIAL_WINDOW_SIZE,
+                                    0, 1000u));
+  }
+  // Send the input one byte at a time, to check that partial frames are
+  // buffered properly.
+  const std::string input = std::string(kPreface) + Frame(
+      0x4, 0, 0, Setting(0x1, 0) + Setting(0x2, 0) + Setting(0x3, 100) +
+      Setting(0x4, 1000) + Setting(0x5, 20000) + Setting(0x6, 8000) +
+      Setting(0x99, 1));
+  for (size_t i = 0; i < input.size(); ++i) {
+    Input(input.substr(i, 1));
+  }
+  EXPECT_FALSE(framer_.HasError());
+  EXPECT_EQ(Frame(0x4, 0x1, 0, ""), TakePendingOutput());
+  EXPECT_EQ("", TakePendingOutput());
+
+  // The client's SETTINGS_HEADER_TABLE_SIZE of zero is announced at the
+  // start of our next header block.
+  net::SpdySynReplyIR reply(1);
+  reply.SetHeader(mod_spdy::spdy::kSpdy3Status, "200 OK");
+  EXPECT_EQ(Frame(0x1, 0x4, 1, "\x20\x88"), Serialize(reply));
+
+  // Only the settings HTTP/2 knows about are sent.
+  net::SpdySettingsIR settings;
+  settings.AddSetting(net::SETTINGS_MAX_CONCURRENT_STREAMS, false, false, 50);
+  settings.AddSetting(net::SETTINGS_ROUND_TRIP_TIME, false, false, 10);
+  settings.AddSetting(net::SETTINGS_INITIAL_WINDOW_SIZE, false, false, 9999);
+  EXPECT_EQ(Frame(0x4, 0, 0, Setting(0x3, 50) + Setting(0x4, 9999)),
+            Serialize(settings));
+}
+
+TEST_F(Http2FramerTest, RequestHeaders) {
+  StartConnection();
+  net::SpdyHeaderBlock expected;
+  expected[":host"] = "www.example.com";
+  expected[":method"] = "GET";
+  expected[":path"] = "/";
+  expected[":scheme"] = "http";
+  expected[":version"] = "HTTP/1.1";
+  EXPECT_CALL(visitor_, OnSynStream(1u, 0u, 3u, 0u, true, false,
+                                    Eq(expected)));
+  Input(Frame(0x1, 0x5, 1, kGetRequestBlock));
+
+  // The same request again, split over a padded HEADERS frame with a
+  // priority block (weight 256) and a CONTINUATION frame.
+  const std::string block(kGetRequestBlock);
+  EXPECT_CALL(visitor_, OnSynStream(3u, 0u, 0u, 0u, true, false,
+                                    Eq(expected)));
+  Input(Frame(0x1, 0x29, 3, std::string("\x02", 1) +
+              std::string("\x00\x00\x00\x00\xff", 5) + block.substr(0, 5) +
+              std::string(2, '\0')) +
+        Frame(0x9, 0x4, 3, block.substr(5)));
+  EXPECT_FALSE(framer_.HasError());
+}
+
+TEST_F(Http2FramerTest, MalformedRequest) {
+  StartConnection();
+  // A literal "Foo: bar" header, with an uppercase name.
+  EXPECT_CALL(visitor_, OnStreamError(1u, _));
+  Input(Frame(0x1, 0x5, 1, std::string(kGetRequestBlock) +
+              std::string("\x00\x03" "Foo\x03" "bar", 9)));
+  EXPECT_FALSE(framer_.HasError());
+}
+
+TEST_F(Http2FramerTest, DataAndTrailers) {
+  StartConnection();
+  OpenStream();
+
+  EXPECT_CALL(visitor_, OnStreamFrameData(1u, _, 5u, false));
+  Input(Frame(0x0, 0, 1, "hello"));
+  EXPECT_EQ("", TakePendingOutput());
+
+  // Padding (four bytes, plus the pad length byte) is credited back to the
+  // client straight away.
+  EXPECT_CALL(visitor_, OnStreamFrameData(1u, _, 5u, false));
+  Input(Frame(0x0, 0x8, 1, std::string("\x04", 1) + "world" +
+              std::string(4, '\0')));
+  EXPECT_EQ(Frame(0x8, 0, 0, Uint32(5)) + Frame(0x8, 0, 1, Uint32(5)),
+            TakePendingOutput());
+
+  // A literal "x-foo: bar" trailer, with a new (never-indexed) name.
+  net::SpdyHeaderBlock trailers;
+  trailers["x-foo"] = "bar";
+  EXPECT_CALL(visitor_, OnHeaders(1u, true, Eq(trailers)));
+  Input(Frame(0x1, 0x5, 1, std::string("\x10\x05" "x-foo\x03" "bar", 11)));
+
+  // The client has now ended the stream, so more data is a stream error.  The
+  // session never sees the data, so the connection window is credited here.
+  EXPECT_CALL(visitor_, OnStreamError(1u, _));
+  Input(Frame(0x0, 0, 1, "late"));
+  EXPECT_EQ(Frame(0x8, 0, 0, Uint32(4)), TakePendingOutput());
+  EXPECT_FALSE(framer_.HasError());
+}
+
+// Trailers may not contain pseudo-headers, or uppercase names.
+TEST_F(Http2FramerTest, MalformedTrailers) {
+  StartConnection();
+  OpenStream();
+  EXPECT_CALL(visitor_, OnStreamError(1u, _));
+  Input(Frame(0x1, 0x5, 1, "\x82"));  // :method: GET
+  EXPECT_FALSE(framer_.HasError());
+
+  EXPECT_CALL(visitor_, OnSynStream(3u, 0u, 3u, 0u, false, false, _));
+  Input(Frame(0x1, 0x4, 3, kGetRequestBlock));
+  EXPECT_CALL(visitor_, OnStreamError(3u, _));
+  Input(Frame(0x1, 0x5, 3, std::string("\x00\x03" "Foo\x03" "bar", 9)));
+  EXPECT_FALSE(framer_.HasError());
+}
+
+TEST_F(Http2FramerTest, ControlFrames) {
+  StartConnection();
+  OpenStream();
+
+  // PINGs are answered by the framer.
+  Input(Frame(0x6, 0, 0, "12345678"));
+  EXPECT_EQ(Frame(0x6, 0x1, 0, "12345678"), TakePendingOutput());
+
+  EXPECT_CALL(visitor_, OnWindowUpdate(0u, 1000u));
+  Input(Frame(0x8, 0, 0, Uint32(1000)));
+  EXPECT_CALL(visitor_, OnWindowUpdate(1u, 2000u));
+  Input(Frame(0x8, 0, 1, Uint32(2000)));
+  EXPECT_CALL(visitor_, OnStreamError(1u, _));
+  Input(Frame(0x8, 0, 1, Uint32(0)));
+
+  // PRIORITY frames and unknown frame types are ignored.
+  Input(Frame(0x2, 0, 1, std::string("\x00\x00\x00\x00\x10", 5)));
+  Input(Frame(0x42, 0, 1, "whatever"));
+
+  EXPECT_CALL(visitor_, OnRstStream(1u, net::RST_STREAM_CANCEL));
+  Input(Frame(0x3, 0, 1, Uint32(0x8)));
+  // Data for the reset stream is dropped.
+  Input(Frame(0x0, 0, 1, "x"));
+  EXPECT_EQ(Frame(0x8, 0, 0, Uint32(1)), TakePendingOutput());
+
+  EXPECT_CALL(visitor_, OnGoAway(1u, net::GOAWAY_OK));
+  Input(Frame(0x7, 0, 0, Uint32(1) + Uint32(0)));
+  EXPECT_FALSE(framer_.HasError());
+}
+
+TEST_F(Http2FramerTest, SerializeResponse) {
+  StartConnection();
+  OpenStream();
+
+  net::SpdySynReplyIR reply(1);
+  reply.SetHeader(mod_spdy::spdy::kSpdy3Status, "200 OK");
+  reply.SetHeader(mod_spdy::spdy::kSpdy3Version, "HTTP/1.1");
+  reply.SetHeader(mod_spdy::http::kContentType, "text/html");
+  reply.SetHeader(mod_spdy::http::kConnection, "close");
+  const std::string headers_frame = Serialize(reply);
+  ASSERT_LT(9u, headers_frame.size());
+  EXPECT_EQ(Frame(0x1, 0x4, 1, "").substr(3), headers_frame.substr(3, 6));
+  mod_spdy::HpackDecoder decoder;
+  net::SpdyHeaderBlock decoded;
+  ASSERT_TRUE(decoder.DecodeHeaderBlock(headers_frame.substr(9), &decoded));
+  net::SpdyHeaderBlock expected;
+  expected[":status"] = "200";
+  expected["content-type"] = "text/html";
+  EXPECT_EQ(expected, decoded);
+
+  // Data bigger than the maximum frame size is split.
+  net::SpdyDataIR data(1, std::string(20000, 'x'));
+  data.set_fin(true);
+  EXPECT_EQ(Frame(0x0, 0, 1, std::string(16384, 'x')) +
+            Frame(0x0, 0x1, 1, std::string(3616, 'x')),
+            Serialize(data));
+
+  EXPECT_EQ(Frame(0x3, 0, 1, Uint32(0x7)),
+            Serialize(net::SpdyRstStreamIR(1, net::RST_STREAM_REFUSED_STREAM)));
+  EXPECT_EQ(Frame(0x8, 0, 1, Uint32(100)),
+            Serialize(net::SpdyWindowUpdateIR(1, 100)));
+  EXPECT_EQ(Frame(0x6, 0, 0, Uint32(0) + Uint32(7)),
+            Serialize(net::SpdyPingIR(7)));
+  EXPECT_EQ(Frame(0x7, 0, 0, Uint32(1) + Uint32(0)),
+            Serialize(net::SpdyGoAwayIR(1, net::GOAWAY_OK)));
+}
+
+TEST_F(Http2FramerTest, BadPreface) {
+  EXPECT_CALL(visitor_, OnError(_));
+  framer_.ProcessInput("GET / HTTP/1.1\r\n", 16);
+  EXPECT_TRUE(framer_.HasError());
+  EXPECT_EQ(Http2Framer::HTTP2_PROTOCOL_ERROR, framer_.error_code());
+}
+
+TEST_F(Http2FramerTest, FirstFrameMustBeSettings) {
+  EXPECT_CALL(visitor_, OnError(_));
+  const std::string input = std::string(kPreface) +
+      Frame(0x6, 0, 0, "12345678");
+  framer_.ProcessInput(input.data(), input.size());
+  EXPECT_TRUE(framer_.HasError());
+}
+
+TEST_F(Http2FramerTest, ConnectionErrors) {
+  const struct {
+    const char* description;
+    std::string input;
+    Http2Framer::ErrorCode error_code;
+  } kCases[] = {
+    {"DATA for idle stream", Frame(0x0, 0, 5, "x"),
+     Http2Framer::HTTP2_PROTOCOL_ERROR},
+    {"frame too large", Frame(0x0, 0, 1, std::string(16385, 'x')),
+     Http2Framer::HTTP2_FRAME_SIZE_ERROR},
+    {"interrupted header block",
+     Frame(0x1, 0x1, 3, "\x82") + Frame(0x0, 0, 1, "x"),
+     Http2Framer::HTTP2_PROTOCOL_ERROR},
+    {"stray CONTINUATION", Frame(0x9, 0x4, 1, "\x82"),
+     Http2Framer::HTTP2_PROTOCOL_ERROR},
+    {"bad HPACK", Frame(0x1, 0x5, 3, "\xbf"),
+     Http2Framer::HTTP2_COMPRESSION_ERROR},
+    {"HEADERS for even stream", Frame(0x1, 0x5, 2, "\x82"),
+     Http2Framer::HTTP2_PROTOCOL_ERROR},
+    {"PUSH_PROMISE", Frame(0x5, 0x4, 1, Uint32(2)),
+     Http2Framer::HTTP2_PROTOCOL_ERROR},
+    {"bad padding", Frame(0x0, 0x8, 1, "\x05" "abc"),
+     Http2Framer::HTTP2_PROTOCOL_ERROR},
+    {"bad window size", Frame(0x4, 0, 0, Setting(0x4, 0x80000000u)),
+     Http2Framer::HTTP2_FLOW_CONTROL_ERROR},
+    {"bad PING", Frame(0x6, 0, 0, "1234"),
+     Http2Framer::HTTP2_FRAME_SIZE_ERROR},
+  };
+  for (size_t i = 0; i < arraysize(kCases); ++i) {
+    SCOPED_TRACE(kCases[i].description);
+    StrictMock<MockVisitor> visitor;
+    Http2Framer framer;
+    framer.set_visitor(&visitor);
+    EXPECT_CALL(visitor, OnSettings(false)).Times(AtLeast(1));
+    EXPECT_CALL(visitor, OnSynStream(1u, _, _, _, _, _, _));
+    const std::string start = std::string(kPreface) + Frame(0x4, 0, 0, "") +
+        Frame(0x1, 0x4, 1, kGetRequestBlock);
+    framer.ProcessInput(start.data(), start.size());
+    ASSERT_FALSE(framer.HasError());
+
+    EXPECT_CALL(visitor, OnError(_));
+    framer.ProcessInput(kCases[i].input.data(), kCases[i].input.size());
+    EXPECT_TRUE(framer.HasError());
+    EXPECT_EQ(kCases[i].error_code, framer.error_code());
+
+    // Our GOAWAY reports the error.
+    scoped_ptr<net::SpdySerializedFrame> goaway(framer.SerializeFrame(
+        net::SpdyGoAwayIR(1, net::GOAWAY_PROTOCOL_ERROR)));
+    ASSERT_TRUE(goaway != NULL);
+    EXPECT_EQ(Frame(0x7, 0, 0, Uint32(1) + Uint32(kCases[i].error_code)),
+              std::string(goaway->data(), goaway->size()));
+  }
+}
+
+}  // namespace
@@ -0,0 +1,137 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/http_line_scanner.h"
+
+#include <cstring>  // for memchr
+
+#include "base/strings/string_piece.h"
+#include "build/build_config.h"
+
+// SSE2 is part of the baseline instruction set on x86-64 (and is enabled on
+// 32-bit x86 whenever the compiler is told it may use it), so there's no need
+// to check for it at runtime.
+#if defined(ARCH_CPU_X86_FAMILY) && defined(COMPILER_GCC) && defined(__SSE2__)
+#define MOD_SPDY_USE_SSE2_LINE_SCANNER 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const size_t kNpos = base::StringPiece::npos;
+
+// Finish up once we've found a CRLF at crlf: discard the colon if it comes
+// after the CRLF.
+size_t FoundLineEnd(size_t crlf, size_t* colon) {
+  if (colon != NULL && *colon != kNpos && *colon > crlf) {
+    *colon = kNpos;
+  }
+  return crlf;
+}
+
+size_t FindLineEndPortable(const char* data, size_t size, size_t start,
+                           size_t* colon) {
+  // Look for each '\n' in turn, and check if there's a '\r' before it.
+  size_t pos = start;
+  while (pos < size) {
+    const void* found = memchr(data + pos, '\n', size - pos);
+    if (found == NULL) {
+      break;
+    }
+    const size_t newline = static_cast<const char*>(found) - data;
+    if (newline > 0 && data[newline - 1] == '\r') {
+      const size_t crlf = newline - 1;
+      if (colon != NULL && *colon == kNpos) {
+        const void* found_colon = memchr(data, ':', crlf);
+        if (found_colon != NULL) {
+          *colon = static_cast<const char*>(found_colon) - data;
+        }
+      }
+      return FoundLineEnd(crlf, colon);
+    }
+    pos = newline + 1;
+  }
+  if (colon != NULL) {
+    *colon = kNpos;
+  }
+  return kNpos;
+}
+
+#if defined(MOD_SPDY_USE_SSE2_LINE_SCANNER)
+
+size_t FindLineEndSse2(const char* data, size_t size, size_t* colon) {
+  const __m128i newlines = _mm_set1_epi8('\n');
+  const __m128i colons = _mm_set1_epi8(':');
+  size_t pos = 0;
+  for (; pos + 16 <= size; pos += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+    // Find the colons and newlines in this block with one comparison each.
+    if (colon != NULL && *colon == kNpos) {
+      const int colon_mask =
+          _mm_movemask_epi8(_mm_cmpeq_epi8(block, colons));
+      if (colon_mask != 0) {
+        *colon = pos + __builtin_ctz(colon_mask);
+      }
+    }
+    int newline_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newlines));
+    while (newline_mask != 0) {
+      const size_t newline = pos + __builtin_ctz(newline_mask);
+      if (newline > 0 && data[newline - 1] == '\r') {
+        return FoundLineEnd(newline - 1, colon);
+      }
+      newline_mask &= newline_mask - 1;  // clear the lowest set bit
+    }
+  }
+  // Finish off the last few bytes the portable way.  We've already looked for
+  // a colon in everything up to pos, so only keep looking if we haven't found
+  // one yet.
+  if (colon != NULL && *colon != kNpos) {
+    const size_t found_colon = *colon;
+    const size_t crlf = FindLineEndPortable(data, size, pos, NULL);
+    if (crlf == kNpos) {
+      *colon = kNpos;
+      return kNpos;
+    }
+    *colon = found_colon;
+    return FoundLineEnd(crlf, colon);
+  }
+  return FindLineEndPortable(data, size, pos, colon);
+}
+
+#endif  // MOD_SPDY_USE_SSE2_LINE_SCANNER
+
+}  // namespace
+
+namespace mod_spdy {
+
+size_t FindLineEnd(const base::StringPiece& data, size_t* colon) {
+  if (colon != NULL) {
+    *colon = kNpos;
+  }
+#if defined(MOD_SPDY_USE_SSE2_LINE_SCANNER)
+  return FindLineEndSse2(data.data(), data.size(), colon);
+#else
+  return FindLineEndPortable(data.data(), data.size(), 0, colon);
+#endif
+}
+
+size_t FindLineEndForTest(const base::StringPiece& data, size_t* colon) {
+  if (colon != NULL) {
+    *colon = kNpos;
+  }
+  return FindLineEndPortable(data.data(), data.size(), 0, colon);
+}
+
+}  // namespace mod_spdy
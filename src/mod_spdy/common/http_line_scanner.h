@@ -0,0 +1,39 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_COMMON_HTTP_LINE_SCANNER_H_
+#define MOD_SPDY_COMMON_HTTP_LINE_SCANNER_H_
+
+#include <cstddef>
+
+#include "base/strings/string_piece.h"
+
+namespace mod_spdy {
+
+// Return the offset of the first CRLF in data, or base::StringPiece::npos if
+// there isn't one.  If colon is non-NULL, also set *colon to the offset of the
+// first ':' before that CRLF (or to npos if there isn't one), which is found
+// in the same pass over the data; if there is no CRLF, *colon is set to npos.
+//
+// Where the CPU supports it (i.e. SSE2 on x86), this examines sixteen bytes at
+// a time; otherwise it falls back to memchr.
+size_t FindLineEnd(const base::StringPiece& data, size_t* colon);
+
+// The same, but always using the portable implementation.  This is exposed
+// only so that tests can check the two implementations against each other.
+size_t FindLineEndForTest(const base::StringPiece& data, size_t* colon);
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_HTTP_LINE_SCANNER_H_
@@ -0,0 +1,89 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/http_line_scanner.h"
+
+#include <cstdlib>
+#include <string>
+
+#include "base/strings/string_piece.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+using mod_spdy::FindLineEnd;
+using mod_spdy::FindLineEndForTest;
+
+const size_t kNpos = base::StringPiece::npos;
+
+TEST(HttpLineScannerTest, Basics) {
+  size_t colon = 0;
+  EXPECT_EQ(kNpos, FindLineEnd("", &colon));
+  EXPECT_EQ(kNpos, colon);
+  EXPECT_EQ(kNpos, FindLineEnd("Content-Type: text/plain", &colon));
+  EXPECT_EQ(kNpos, colon);
+  EXPECT_EQ(24u, FindLineEnd("Content-Type: text/plain\r\nX-Foo: bar\r\n",
+                             &colon));
+  EXPECT_EQ(12u, colon);
+  EXPECT_EQ(0u, FindLineEnd("\r\n", &colon));
+  EXPECT_EQ(kNpos, colon);
+  EXPECT_EQ(kNpos, FindLineEnd("\n\r", NULL));
+}
+
+TEST(HttpLineScannerTest, ColonAfterLineEndIsIgnored) {
+  size_t colon = 0;
+  EXPECT_EQ(15u, FindLineEnd("HTTP/1.1 200 OK\r\nDate: today\r\n", &colon));
+  EXPECT_EQ(kNpos, colon);
+  // Same thing, but with the colon in the same sixteen-byte block as the CRLF.
+  EXPECT_EQ(3u, FindLineEnd("abc\r\nd:e\r\n", &colon));
+  EXPECT_EQ(kNpos, colon);
+}
+
+TEST(HttpLineScannerTest, LineEndsAcrossBlockBoundaries) {
+  // Put the CR and LF, and a lone LF before them, at every offset around the
+  // boundaries between sixteen-byte blocks.
+  for (size_t crlf = 0; crlf < 50; ++crlf) {
+    std::string line(crlf, 'x');
+    if (crlf > 3) {
+      line[crlf / 2] = ':';
+      line[1] = '\n';
+    }
+    const std::string text = line + "\r\n" + std::string(20, 'y');
+    size_t colon = 0;
+    EXPECT_EQ(crlf, FindLineEnd(text, &colon)) << crlf;
+    EXPECT_EQ(crlf > 3 ? crlf / 2 : kNpos, colon) << crlf;
+  }
+}
+
+// Check the fast implementation against the portable one on lots of random
+// strings made up mostly of the characters the scanner cares about.
+TEST(HttpLineScannerTest, MatchesPortableImplementation) {
+  const char kChars[] = "\r\n:ab";
+  srand(12345);
+  for (int trial = 0; trial < 20000; ++trial) {
+    std::string text(rand() % 80, 'a');
+    for (size_t i = 0; i < text.size(); ++i) {
+      text[i] = kChars[rand() % 5];
+    }
+    size_t colon = 0;
+    size_t expected_colon = 0;
+    ASSERT_EQ(FindLineEndForTest(text, &expected_colon),
+              FindLineEnd(text, &colon)) << text;
+    ASSERT_EQ(expected_colon, colon) << text;
+    ASSERT_EQ(FindLineEndForTest(text, NULL), FindLineEnd(text, NULL));
+    ASSERT_EQ(base::StringPiece(text).find("\r\n"), FindLineEnd(text, NULL));
+  }
+}
+
+}  // namespace
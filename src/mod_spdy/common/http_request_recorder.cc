@@ -0,0 +1,89 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mod_spdy/common/http_request_recorder.h"
+
+#include <string>
+
+#include "base/logging.h"
+#include "base/strings/string_piece.h"
+
+namespace mod_spdy {
+
+HttpRequestRecorder::HttpRequestRecorder(std::string* body)
+    : body_(body), state_(REQUEST_LINE) {
+  CHECK(body_);
+}
+
+HttpRequestRecorder::~HttpRequestRecorder() {}
+
+void HttpRequestRecorder::OnRequestLine(const base::StringPiece& method,
+                                        const base::StringPiece& path,
+                                        const base::StringPiece& version) {
+  DCHECK(state_ == REQUEST_LINE);
+  state_ = LEADING_HEADERS;
+  method.CopyToString(&method_);
+  path.CopyToString(&path_);
+  version.CopyToString(&version_);
+}
+
+void HttpRequestRecorder::OnLeadingHeader(const base::StringPiece& key,
+                                          const base::StringPiece& value) {
+  DCHECK(state_ == LEADING_HEADERS);
+  leading_headers_.push_back(std::make_pair(key.as_string(),
+                                            value.as_string()));
+}
+
+void HttpRequestRecorder::OnLeadingHeadersComplete() {
+  DCHECK(state_ == LEADING_HEADERS);
+  state_ = LEADING_HEADERS_COMPLETE;
+}
+
+void HttpRequestRecorder::OnRawData(const base::StringPiece& data) {
+  DCHECK(state_ == LEADING_HEADERS_COMPLETE || state_ == DATA);
+  state_ = DATA;
+  data.AppendToString(body_);
+}
+
+void HttpRequestRecorder::OnDataChunk(const base::StringPiece& data) {
+  // We don't need the chunk boundaries; the data goes in the body as-is.
+  OnRawData(data);
+}
+
+void HttpRequestRecorder::OnDataChunksComplete() {
+  // The body may be chunked and yet empty (e.g. if the client sent only empty
+  // DATA frames), in which case we never saw a data chunk.
+  DCHECK(state_ == LEADING_HEADERS_COMPLETE || state_ == DATA);
+  state_ = DATA;
+}
+
+void HttpRequestRecorder::OnTrailingHeader(const base::StringPiece& key,
+                                           const base::StringPiece& value) {
+  DCHECK(state_ == DATA || state_ == TRAILING_HEADERS);
+  state_ = TRAILING_HEADERS;
+  trailing_headers_.push_back(std::make_pair(key.as_string(),
+                                             value.as_string()));
+}
+
+void HttpRequestRecorder::OnTrailingHeadersComplete() {
+  DCHECK(state_ == TRAILING_HEADERS);
+}
+
+void HttpRequestRecorder::OnComplete() {
+  DCHECK(state_ != REQUEST_LINE && state_ != LEADING_HEADERS);
+  state_ = COMPLETE;
+}
+
+}  // namespace mod_spdy
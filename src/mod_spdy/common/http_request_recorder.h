@@ -0,0 +1,91 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOD_SPDY_COMMON_HTTP_REQUEST_RECORDER_H_
+#define MOD_SPDY_COMMON_HTTP_REQUEST_RECORDER_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "mod_spdy/common/http_request_visitor_interface.h"
+
+namespace mod_spdy {
+
+// An HttpRequestVisitorInterface class that records the request line and
+// headers as structured data, rather than serializing them to HTTP/1.1 text
+// the way HttpStringBuilder does.  The request body is appended to a
+// std::string as raw bytes, with no chunked encoding, whether it arrives as
+// raw data or as data chunks.
+class HttpRequestRecorder : public HttpRequestVisitorInterface {
+ public:
+  typedef std::vector<std::pair<std::string, std::string> > HeaderList;
+
+  explicit HttpRequestRecorder(std::string* body);
+  virtual ~HttpRequestRecorder();
+
+  // True once OnLeadingHeadersComplete has been called; until then, the
+  // request line and leading headers may still be incomplete.
+  bool leading_headers_complete() const {
+    return state_ != REQUEST_LINE && state_ != LEADING_HEADERS;
+  }
+  bool is_complete() const { return state_ == COMPLETE; }
+
+  const std::string& method() const { return method_; }
+  const std::string& path() const { return path_; }
+  const std::string& version() const { return version_; }
+  const HeaderList& leading_headers() const { return leading_headers_; }
+  const HeaderList& trailing_headers() const { return trailing_headers_; }
+
+  // HttpRequestVisitorInterface methods:
+  virtual void OnRequestLine(const base::StringPiece& method,
+                             const base::StringPiece& path,
+                             const base::StringPiece& version);
+  virtual void OnLeadingHeader(const base::StringPiece& key,
+                               const base::StringPiece& value);
+  virtual void OnLeadingHeadersComplete();
+  virtual void OnRawData(const base::StringPiece& data);
+  virtual void OnDataChunk(const base::StringPiece& data);
+  virtual void OnDataChunksComplete();
+  virtual void OnTrailingHeader(const base::StringPiece& key,
+                                const base::StringPiece& value);
+  virtual void OnTrailingHeadersComplete();
+  virtual void OnComplete();
+
+ private:
+  enum State {
+    REQUEST_LINE,
+    LEADING_HEADERS,
+    LEADING_HEADERS_COMPLETE,
+    DATA,
+    TRAILING_HEADERS,
+    COMPLETE
+  };
+
+  std::string* const body_;
+  State state_;
+  std::string method_;
+  std::string path_;
+  std::string version_;
+  HeaderList leading_headers_;
+  HeaderList trailing_headers_;
+
+  DISALLOW_COPY_AND_ASSIGN(HttpRequestRecorder);
+};
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_HTTP_REQUEST_RECORDER_H_
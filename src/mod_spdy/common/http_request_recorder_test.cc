@@ -0,0 +1,169 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/http_request_recorder.h"
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+using mod_spdy::HttpRequestRecorder;
+
+typedef HttpRequestRecorder::HeaderList HeaderList;
+
+class HttpRequestRecorderTest : public testing::Test {
+ public:
+  HttpRequestRecorderTest() : recorder_(&body_) {}
+
+ protected:
+  // Send the request line and the given leading headers, and close the
+  // leading headers section.
+  void SendLeadingHeaders() {
+    EXPECT_FALSE(recorder_.leading_headers_complete());
+    recorder_.OnRequestLine("POST", "/foo/bar.php?a=b", "HTTP/1.1");
+    EXPECT_FALSE(recorder_.leading_headers_complete());
+    recorder_.OnLeadingHeader("host", "www.example.com");
+    recorder_.OnLeadingHeader("accept", "text/html");
+    recorder_.OnLeadingHeader("accept", "text/plain");
+    EXPECT_FALSE(recorder_.leading_headers_complete());
+    recorder_.OnLeadingHeadersComplete();
+    EXPECT_TRUE(recorder_.leading_headers_complete());
+    EXPECT_FALSE(recorder_.is_complete());
+  }
+
+  void ExpectLeadingHeaders() {
+    EXPECT_EQ("POST", recorder_.method());
+    EXPECT_EQ("/foo/bar.php?a=b", recorder_.path());
+    EXPECT_EQ("HTTP/1.1", recorder_.version());
+    const HeaderList& headers = recorder_.leading_headers();
+    ASSERT_EQ(3u, headers.size());
+    EXPECT_EQ("host", headers[0].first);
+    EXPECT_EQ("www.example.com", headers[0].second);
+    // Repeated headers should be kept separate and in order.
+    EXPECT_EQ("accept", headers[1].first);
+    EXPECT_EQ("text/html", headers[1].second);
+    EXPECT_EQ("accept", headers[2].first);
+    EXPECT_EQ("text/plain", headers[2].second);
+  }
+
+  std::string body_;
+  HttpRequestRecorder recorder_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HttpRequestRecorderTest);
+};
+
+TEST_F(HttpRequestRecorderTest, NoBody) {
+  SendLeadingHeaders();
+  recorder_.OnComplete();
+  EXPECT_TRUE(recorder_.is_complete());
+  EXPECT_TRUE(recorder_.leading_headers_complete());
+  ExpectLeadingHeaders();
+  EXPECT_TRUE(recorder_.trailing_headers().empty());
+  EXPECT_EQ("", body_);
+}
+
+TEST_F(HttpRequestRecorderTest, RawBody) {
+  SendLeadingHeaders();
+  recorder_.OnRawData("foo=bar");
+  recorder_.OnRawData("");
+  recorder_.OnRawData("&baz=quux");
+  EXPECT_FALSE(recorder_.is_complete());
+  recorder_.OnComplete();
+  EXPECT_TRUE(recorder_.is_complete());
+  ExpectLeadingHeaders();
+  EXPECT_TRUE(recorder_.trailing_headers().empty());
+  EXPECT_EQ("foo=bar&baz=quux", body_);
+}
+
+TEST_F(HttpRequestRecorderTest, ChunkedBody) {
+  SendLeadingHeaders();
+  recorder_.OnDataChunk("foo=bar");
+  recorder_.OnDataChunk("&baz=quux");
+  recorder_.OnDataChunksComplete();
+  EXPECT_FALSE(recorder_.is_complete());
+  recorder_.OnComplete();
+  EXPECT_TRUE(recorder_.is_complete());
+  ExpectLeadingHeaders();
+  EXPECT_TRUE(recorder_.trailing_headers().empty());
+  // The chunk boundaries shouldn't appear in the body.
+  EXPECT_EQ("foo=bar&baz=quux", body_);
+}
+
+TEST_F(HttpRequestRecorderTest, ChunkedBodyWithTrailingHeaders) {
+  SendLeadingHeaders();
+  recorder_.OnDataChunk("foo=bar");
+  recorder_.OnDataChunksComplete();
+  recorder_.OnTrailingHeader("content-md5", "abcdef");
+  recorder_.OnTrailingHeader("x-foo", "bar");
+  recorder_.OnTrailingHeadersComplete();
+  EXPECT_FALSE(recorder_.is_complete());
+  recorder_.OnComplete();
+  EXPECT_TRUE(recorder_.is_complete());
+  ExpectLeadingHeaders();
+  const HeaderList& trailers = recorder_.trailing_headers();
+  ASSERT_EQ(2u, trailers.size());
+  EXPECT_EQ("content-md5", trailers[0].first);
+  EXPECT_EQ("abcdef", trailers[0].second);
+  EXPECT_EQ("x-foo", trailers[1].first);
+  EXPECT_EQ("bar", trailers[1].second);
+  EXPECT_EQ("foo=bar", body_);
+}
+
+// If the client sends only empty DATA frames, the body is chunked but has no
+// chunks in it; the recorder should cope with the data chunks being completed
+// (and trailers following) without any data chunk having been seen.
+TEST_F(HttpRequestRecorderTest, ChunkedBodyWithNoData) {
+  SendLeadingHeaders();
+  recorder_.OnDataChunksComplete();
+  EXPECT_FALSE(recorder_.is_complete());
+  recorder_.OnComplete();
+  EXPECT_TRUE(recorder_.is_complete());
+  ExpectLeadingHeaders();
+  EXPECT_TRUE(recorder_.trailing_headers().empty());
+  EXPECT_EQ("", body_);
+}
+
+TEST_F(HttpRequestRecorderTest, TrailingHeadersWithNoData) {
+  SendLeadingHeaders();
+  recorder_.OnDataChunksComplete();
+  recorder_.OnTrailingHeader("x-foo", "bar");
+  recorder_.OnTrailingHeadersComplete();
+  recorder_.OnComplete();
+  EXPECT_TRUE(recorder_.is_complete());
+  ExpectLeadingHeaders();
+  const HeaderList& trailers = recorder_.trailing_headers();
+  ASSERT_EQ(1u, trailers.size());
+  EXPECT_EQ("x-foo", trailers[0].first);
+  EXPECT_EQ("bar", trailers[0].second);
+  EXPECT_EQ("", body_);
+}
+
+// The body should be appended to whatever the string already held, rather
+// than replacing it, so that the caller can keep consuming from the front.
+TEST_F(HttpRequestRecorderTest, AppendsToBody) {
+  body_ = "abc";
+  SendLeadingHeaders();
+  recorder_.OnRawData("def");
+  EXPECT_EQ("abcdef", body_);
+  body_.clear();
+  recorder_.OnRawData("ghi");
+  recorder_.OnComplete();
+  EXPECT_EQ("ghi", body_);
+}
+
+}  // namespace
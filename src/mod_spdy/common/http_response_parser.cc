@@ -19,7 +19,8 @@
 #include "base/logging.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/string_piece.h"
-#include "base/strings/string_util.h"
+#include "mod_spdy/common/header_name.h"
+#include "mod_spdy/common/http_line_scanner.h"
 #include "mod_spdy/common/http_response_visitor_interface.h"
 #include "mod_spdy/common/protocol_util.h"
 
@@ -106,7 +107,7 @@ bool HttpResponseParser::ProcessInput(const base::StringPiece& input_data) {
 
 bool HttpResponseParser::ProcessStatusLine(base::StringPiece* data) {
   DCHECK(state_ == STATUS_LINE);
-  const size_t linebreak = data->find("\r\n");
+  const size_t linebreak = FindLineEnd(*data, NULL);
 
   // If we haven't reached the end of the line yet, buffer the data and quit.
   if (linebreak == base::StringPiece::npos) {
@@ -116,12 +117,19 @@ bool HttpResponseParser::ProcessStatusLine(base::StringPiece* data) {
   }
 
   // Combine the data up to the linebreak with what we've buffered, and parse
-  // the status line out of it.
-  data->substr(0, linebreak).AppendToString(&buffer_);
-  if (!ParseStatusLine(buffer_)) {
-    return false;
+  // the status line out of it.  If nothing is buffered (the usual case, since
+  // the whole status line generally arrives at once), parse it in place.
+  if (buffer_.empty()) {
+    if (!ParseStatusLine(data->substr(0, linebreak))) {
+      return false;
+    }
+  } else {
+    data->substr(0, linebreak).AppendToString(&buffer_);
+    if (!ParseStatusLine(buffer_)) {
+      return false;
+    }
+    buffer_.clear();
   }
-  buffer_.clear();
 
   // Chop off the linebreak and all data before it, and move on to parsing the
   // leading headers.
@@ -143,7 +151,7 @@ bool HttpResponseParser::CheckStartOfHeaderLine(const base::StringPiece& data){
   // buffer more data.
   const char first = data[0];
   if (first != ' ' && first != '\t') {
-    if (!ParseLeadingHeader(buffer_)) {
+    if (!ParseLeadingHeader(buffer_, buffer_.find(':'))) {
       return false;
     }
     buffer_.clear();
@@ -156,7 +164,8 @@ bool HttpResponseParser::CheckStartOfHeaderLine(const base::StringPiece& data){
 
 bool HttpResponseParser::ProcessLeadingHeaders(base::StringPiece* data) {
   DCHECK(state_ == LEADING_HEADERS);
-  const size_t linebreak = data->find("\r\n");
+  size_t colon = base::StringPiece::npos;
+  const size_t linebreak = FindLineEnd(*data, &colon);
 
   // If we haven't reached the end of the line yet, buffer the data and quit.
   if (linebreak == base::StringPiece::npos) {
@@ -190,6 +199,21 @@ bool HttpResponseParser::ProcessLeadingHeaders(base::StringPiece* data) {
     return true;
   }
 
+  // If we're not in the middle of a header line, and we can already see that
+  // the next line isn't a continuation of this one, then this is a complete
+  // header line, and we can parse it in place without copying it into the
+  // buffer.  This is the common case, since most header blocks arrive whole.
+  if (buffer_.empty() && linebreak + 2 < data->size()) {
+    const char next = (*data)[linebreak + 2];
+    if (next != ' ' && next != '\t') {
+      if (!ParseLeadingHeader(data->substr(0, linebreak), colon)) {
+        return false;
+      }
+      *data = data->substr(linebreak + 2);
+      return true;
+    }
+  }
+
   // We've reached the end of the line, but we need to check the next line to
   // see if it's a continuation of this header.  Buffer up to the linebreak,
   // skip the linebreak itself, and set our state to check the next line.
@@ -201,7 +225,7 @@ bool HttpResponseParser::ProcessLeadingHeaders(base::StringPiece* data) {
 
 bool HttpResponseParser::ProcessChunkStart(base::StringPiece* data) {
   DCHECK(state_ == CHUNK_START);
-  const size_t linebreak = data->find("\r\n");
+  const size_t linebreak = FindLineEnd(*data, NULL);
 
   // If we haven't reached the end of the line yet, buffer the data and quit.
   if (linebreak == base::StringPiece::npos) {
@@ -211,12 +235,18 @@ bool HttpResponseParser::ProcessChunkStart(base::StringPiece* data) {
   }
 
   // Combine the data up to the linebreak with what we've buffered, and parse
-  // the chunk length out of it.
-  data->substr(0, linebreak).AppendToString(&buffer_);
-  if (!ParseChunkStart(buffer_)) {
-    return false;
+  // the chunk length out of it (in place, if nothing is buffered).
+  if (buffer_.empty()) {
+    if (!ParseChunkStart(data->substr(0, linebreak))) {
+      return false;
+    }
+  } else {
+    data->substr(0, linebreak).AppendToString(&buffer_);
+    if (!ParseChunkStart(buffer_)) {
+      return false;
+    }
+    buffer_.clear();
   }
-  buffer_.clear();
 
   // Skip the linebreak.
   *data = data->substr(linebreak + 2);
@@ -266,6 +296,26 @@ bool HttpResponseParser::ProcessBodyData(base::StringPiece* data) {
   return true;
 }
 
+bool HttpResponseParser::SkipBodyData(size_t size) {
+  DCHECK(state_ == BODY_DATA);
+  DCHECK(buffer_.empty());
+  DCHECK_GT(size, 0u);
+  DCHECK_LE(size, remaining_bytes_);
+  // This mirrors what ProcessBodyData does, except that the caller has
+  // already taken care of passing the data along.
+  remaining_bytes_ -= size;
+  if (remaining_bytes_ > 0) {
+    return false;
+  }
+  if (body_type_ == CHUNKED_BODY) {
+    state_ = CHUNK_ENDING;
+  } else {
+    DCHECK(body_type_ == UNCHUNKED_BODY);
+    state_ = COMPLETE;
+  }
+  return state_ == COMPLETE;
+}
+
 bool HttpResponseParser::ProcessChunkEnding(base::StringPiece* data) {
   DCHECK(state_ == CHUNK_ENDING);
   // For whatever reason, HTTP requires each chunk to end with a CRLF.  So,
@@ -307,14 +357,15 @@ bool HttpResponseParser::ParseStatusLine(const base::StringPiece& text) {
   return true;
 }
 
-bool HttpResponseParser::ParseLeadingHeader(const base::StringPiece& text) {
+bool HttpResponseParser::ParseLeadingHeader(const base::StringPiece& text,
+                                            size_t colon) {
   // Even for multiline headers, we strip out the CRLFs, so there shouldn't be
   // any left in the text that we're parsing.
   DCHECK(text.find("\r\n") == base::StringPiece::npos);
+  DCHECK_EQ(text.find(':'), colon);
 
-  // Find the colon separating the key from the value, and skip any leading
-  // whitespace between the colon and the value.
-  const size_t colon = text.find(':');
+  // The colon separates the key from the value; skip any leading whitespace
+  // between the colon and the value.
   if (colon == base::StringPiece::npos) {
     VLOG(1) << "Bad header line: " << text;
     return false;
@@ -327,20 +378,25 @@ bool HttpResponseParser::ParseLeadingHeader(const base::StringPiece& text) {
 
   // We need to check the Content-Length and Transfer-Encoding headers to know
   // if we're using chunking, and if not, how long the body is.
-  if (LowerCaseEqualsASCII(key.begin(), key.end(), http::kTransferEncoding)) {
-    if (value == http::kChunked) {
-      body_type_ = CHUNKED_BODY;
-    }
-  } else if (body_type_ != CHUNKED_BODY &&
-             LowerCaseEqualsASCII(key.begin(), key.end(),
-                                  http::kContentLength)) {
-    uint64 uint_value = 0u;
-    if (base::StringToUint64(value, &uint_value) && uint_value > 0u) {
-      remaining_bytes_ = uint_value;
-      body_type_ = UNCHUNKED_BODY;
-    } else {
-      VLOG(1) << "Bad content-length: " << value;
-    }
+  switch (ClassifyHeaderName(key)) {
+    case HEADER_TRANSFER_ENCODING:
+      if (value == http::kChunked) {
+        body_type_ = CHUNKED_BODY;
+      }
+      break;
+    case HEADER_CONTENT_LENGTH:
+      if (body_type_ != CHUNKED_BODY) {
+        uint64 uint_value = 0u;
+        if (base::StringToUint64(value, &uint_value) && uint_value > 0u) {
+          remaining_bytes_ = uint_value;
+          body_type_ = UNCHUNKED_BODY;
+        } else {
+          VLOG(1) << "Bad content-length: " << value;
+        }
+      }
+      break;
+    default:
+      break;
   }
 
   visitor_->OnLeadingHeader(key, value);
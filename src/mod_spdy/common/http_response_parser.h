@@ -42,6 +42,20 @@ class HttpResponseParser {
     return ProcessInput(base::StringPiece(data, size));
   }
 
+  // If the parser is in the middle of the response body, return how many more
+  // bytes of body data it expects before the next chunk boundary (if the
+  // response is chunked) or the end of the response; otherwise, return zero.
+  // Any input of at most this many bytes is known to be pure body data.
+  uint64 GetPendingBodyBytes() const {
+    return (state_ == BODY_DATA ? remaining_bytes_ : 0);
+  }
+
+  // Account for size bytes of body data that the caller has dealt with itself
+  // rather than passing to ProcessInput (so the visitor's OnData will not be
+  // called for it).  The size must be nonzero and at most
+  // GetPendingBodyBytes().  Returns true if this was the end of the response.
+  bool SkipBodyData(size_t size);
+
   // For unit testing only: Get the remaining number of bytes expected (in the
   // whole response, if we used Content-Length, or just in the current chunk,
   // if we used Transfer-Encoding: chunked).
@@ -72,7 +86,9 @@ class HttpResponseParser {
   bool ProcessChunkEnding(base::StringPiece* data);
 
   bool ParseStatusLine(const base::StringPiece& text);
-  bool ParseLeadingHeader(const base::StringPiece& text);
+  // The colon argument is the offset of the first ':' in text (or npos), as
+  // found by FindLineEnd, so that we don't need to scan the line twice.
+  bool ParseLeadingHeader(const base::StringPiece& text, size_t colon);
   bool ParseChunkStart(const base::StringPiece& text);
 
   HttpResponseVisitorInterface* const visitor_;
@@ -14,7 +14,12 @@
 
 #include "mod_spdy/common/http_response_parser.h"
 
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/logging.h"
 #include "base/strings/string_piece.h"
+#include "base/time/time.h"
 #include "mod_spdy/common/http_response_visitor_interface.h"
 #include "testing/gmock/include/gmock/gmock.h"
 #include "testing/gtest/include/gtest/gtest.h"
@@ -36,6 +41,34 @@ class MockHttpResponseVisitor: public mod_spdy::HttpResponseVisitorInterface {
   MOCK_METHOD2(OnData, void(const base::StringPiece&, bool));
 };
 
+// A visitor that just counts what it sees, for benchmarking the parser
+// without the overhead of gMock.
+class CountingHttpResponseVisitor
+    : public mod_spdy::HttpResponseVisitorInterface {
+ public:
+  CountingHttpResponseVisitor() : num_headers_(0), num_bytes_(0) {}
+  virtual void OnStatusLine(const base::StringPiece& version,
+                            const base::StringPiece& status_code,
+                            const base::StringPiece& status_phrase) {}
+  virtual void OnLeadingHeader(const base::StringPiece& key,
+                               const base::StringPiece& value) {
+    ++num_headers_;
+  }
+  virtual void OnLeadingHeadersComplete(bool fin) {}
+  virtual void OnData(const base::StringPiece& data, bool fin) {
+    num_bytes_ += data.size();
+  }
+
+  size_t num_headers() const { return num_headers_; }
+  size_t num_bytes() const { return num_bytes_; }
+
+ private:
+  size_t num_headers_;
+  size_t num_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(CountingHttpResponseVisitor);
+};
+
 class HttpResponseParserTest : public testing::Test {
  public:
   HttpResponseParserTest() : parser_(&visitor_) {}
@@ -270,4 +303,116 @@ TEST_F(HttpResponseParserTest, LargeContentLength) {
   ASSERT_EQ(5497558138843uLL, parser_.GetRemainingBytesForTest());
 }
 
+// A caller can skip over body data that it handles itself, as long as it stays
+// within the current chunk.
+TEST_F(HttpResponseParserTest, SkipBodyDataInChunks) {
+  InSequence seq;
+  EXPECT_CALL(visitor_, OnStatusLine(Eq("HTTP/1.1"), Eq("200"), Eq("OK")));
+  EXPECT_CALL(visitor_, OnLeadingHeader(
+      Eq("Transfer-Encoding"), Eq("chunked")));
+  EXPECT_CALL(visitor_, OnLeadingHeadersComplete(Eq(false)));
+
+  ASSERT_TRUE(parser_.ProcessInput(
+      "HTTP/1.1 200 OK\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "\r\n"));
+  EXPECT_EQ(0u, parser_.GetPendingBodyBytes());
+  ASSERT_TRUE(parser_.ProcessInput("1A\r\n"));
+  EXPECT_EQ(26u, parser_.GetPendingBodyBytes());
+  EXPECT_FALSE(parser_.SkipBodyData(20));
+  EXPECT_EQ(6u, parser_.GetPendingBodyBytes());
+  EXPECT_FALSE(parser_.SkipBodyData(6));
+  EXPECT_EQ(0u, parser_.GetPendingBodyBytes());
+
+  EXPECT_CALL(visitor_, OnData(Eq("abc"), Eq(false)));
+  EXPECT_CALL(visitor_, OnData(Eq(""), Eq(true)));
+  ASSERT_TRUE(parser_.ProcessInput("\r\n3\r\nabc\r\n0\r\n\r\n"));
+}
+
+// Skipping the end of an unchunked body completes the response.
+TEST_F(HttpResponseParserTest, SkipBodyDataToEnd) {
+  InSequence seq;
+  EXPECT_CALL(visitor_, OnStatusLine(Eq("HTTP/1.1"), Eq("200"), Eq("OK")));
+  EXPECT_CALL(visitor_, OnLeadingHeader(Eq("Content-Length"), Eq("14")));
+  EXPECT_CALL(visitor_, OnLeadingHeadersComplete(Eq(false)));
+  EXPECT_CALL(visitor_, OnData(Eq("Hello"), Eq(false)));
+
+  ASSERT_TRUE(parser_.ProcessInput(
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Length: 14\r\n"
+      "\r\n"
+      "Hello"));
+  EXPECT_EQ(9u, parser_.GetPendingBodyBytes());
+  EXPECT_TRUE(parser_.SkipBodyData(9));
+  EXPECT_EQ(0u, parser_.GetPendingBodyBytes());
+  // Anything after the end of the response is ignored.
+  ASSERT_TRUE(parser_.ProcessInput("garbage"));
+}
+
+// A header line that is complete but is the last thing in the input can't be
+// parsed until we see whether the next line continues it.
+TEST_F(HttpResponseParserTest, HeaderLineAtEndOfInput) {
+  InSequence seq;
+  EXPECT_CALL(visitor_, OnStatusLine(Eq("HTTP/1.1"), Eq("200"), Eq("OK")));
+  EXPECT_CALL(visitor_, OnLeadingHeader(Eq("Content-Type"),
+                                        Eq("text/plain")));
+  EXPECT_CALL(visitor_, OnLeadingHeader(Eq("X-Long-Header-Name"),
+                                        Eq("a:b  c")));
+  EXPECT_CALL(visitor_, OnLeadingHeadersComplete(Eq(true)));
+
+  ASSERT_TRUE(parser_.ProcessInput(
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Type: text/plain\r\n"
+      "X-Long-Header-Name: a:b\r\n"));
+  ASSERT_TRUE(parser_.ProcessInput(
+      "  c\r\n"
+      "\r\n"));
+}
+
+// Time how long it takes to parse a typical set of response headers, fed to
+// the parser either all at once or in small pieces.  This is disabled by
+// default; run it with --gtest_also_run_disabled_tests.
+TEST(HttpResponseParserBenchmark, DISABLED_ParseHeaders) {
+  const std::string response(
+      "HTTP/1.1 200 OK\r\n"
+      "Date: Tue, 01 Oct 2013 17:02:11 GMT\r\n"
+      "Server: Apache/2.2.22 (Ubuntu)\r\n"
+      "Last-Modified: Mon, 30 Sep 2013 21:45:19 GMT\r\n"
+      "ETag: \"2c1a37-5e4b-4e79f5fba8e4c\"\r\n"
+      "Accept-Ranges: bytes\r\n"
+      "Cache-Control: public, max-age=31536000\r\n"
+      "Expires: Wed, 01 Oct 2014 17:02:11 GMT\r\n"
+      "Vary: Accept-Encoding\r\n"
+      "Content-Encoding: gzip\r\n"
+      "Content-Length: 7\r\n"
+      "Keep-Alive: timeout=5, max=100\r\n"
+      "Content-Type: text/html; charset=UTF-8\r\n"
+      "Set-Cookie: session=4f2e9a1c8b7d6e5f; path=/; HttpOnly\r\n"
+      "X-Frame-Options: SAMEORIGIN\r\n"
+      "\r\n"
+      "<html/>");
+  const int kIterations = 500000;
+  // The parser expects each CRLF to arrive in one piece, so these piece sizes
+  // are chosen not to split any of the above CRLFs.
+  const size_t kPieceSizes[] = {response.size(), 256, 64};
+  for (size_t i = 0; i < arraysize(kPieceSizes); ++i) {
+    const size_t piece_size = kPieceSizes[i];
+    CountingHttpResponseVisitor visitor;
+    const base::TimeTicks start = base::TimeTicks::Now();
+    for (int j = 0; j < kIterations; ++j) {
+      HttpResponseParser parser(&visitor);
+      for (size_t offset = 0; offset < response.size(); offset += piece_size) {
+        ASSERT_TRUE(parser.ProcessInput(
+            base::StringPiece(response).substr(offset, piece_size)));
+      }
+    }
+    const base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+
+    EXPECT_EQ(14u * kIterations, visitor.num_headers());
+    EXPECT_EQ(7u * kIterations, visitor.num_bytes());
+    LOG(INFO) << "Pieces of " << piece_size << " bytes: " << kIterations
+              << " responses in " << elapsed.InMillisecondsF() << " ms";
+  }
+}
+
 }  // namespace
@@ -21,16 +21,26 @@
 #include "base/strings/string_piece.h"
 #include "mod_spdy/common/http_response_visitor_interface.h"
 #include "mod_spdy/common/protocol_util.h"
+#include "mod_spdy/common/spdy_version_traits.h"
 #include "net/spdy/spdy_protocol.h"
 
 namespace {
 
-// This is the number of bytes we want to send per data frame.  We never send
-// data frames larger than this, but we might send smaller ones if we have to
+// This is the number of bytes we want to send per data frame, unless the
+// session has chosen a different size for the stream.  We never send data
+// frames larger than the target, but we might send smaller ones if we have to
 // flush early.
 // TODO The SPDY folks say that smallish (~4kB) data frames are good; however,
 //      we should experiment later on to see what value here performs the best.
-const size_t kTargetDataFrameBytes = 4096;
+const size_t kDefaultTargetDataFrameBytes = 4096;
+
+// Add the magic version and status headers for the given SpdyVersionTraits.
+template <typename Traits>
+void AddStatusHeaders(base::StringPiece version, base::StringPiece status_code,
+                      mod_spdy::HeaderBlock* headers) {
+  headers->Set(Traits::VersionHeaderName(), version);
+  headers->Set(Traits::StatusHeaderName(), status_code);
+}
 
 }  // namespace
 
@@ -43,6 +53,11 @@ class HttpToSpdyConverter::ConverterImpl : public HttpResponseVisitorInterface{
 
   void Flush();
 
+  void set_target_data_frame_bytes(size_t size) {
+    DCHECK(data_buffer_.empty());
+    target_data_frame_bytes_ = size;
+  }
+
   // HttpResponseVisitorInterface methods:
   virtual void OnStatusLine(const base::StringPiece& version,
                             const base::StringPiece& status_code,
@@ -52,14 +67,20 @@ class HttpToSpdyConverter::ConverterImpl : public HttpResponseVisitorInterface{
   virtual void OnLeadingHeadersComplete(bool fin);
   virtual void OnData(const base::StringPiece& data, bool fin);
 
+  // Like OnData, but for data owned by the given backing object, which we
+  // send on to the receiver without copying.
+  void OnBackedData(base::StringPiece data, bool fin,
+                    DataFrameBacking* backing);
+
  private:
   void SendDataIfNecessary(bool flush, bool fin);
   void SendDataFrame(const char* data, size_t size, bool flag_fin);
 
   const spdy::SpdyVersion spdy_version_;
   SpdyReceiver* const receiver_;
-  net::SpdyHeaderBlock headers_;
+  HeaderBlock headers_;
   std::string data_buffer_;
+  size_t target_data_frame_bytes_;
   bool sent_flag_fin_;
 
   DISALLOW_COPY_AND_ASSIGN(ConverterImpl);
@@ -69,6 +90,11 @@ HttpToSpdyConverter::SpdyReceiver::SpdyReceiver() {}
 
 HttpToSpdyConverter::SpdyReceiver::~SpdyReceiver() {}
 
+void HttpToSpdyConverter::SpdyReceiver::ReceiveBackedData(
+    base::StringPiece data, bool flag_fin, DataFrameBacking* backing) {
+  ReceiveData(data, flag_fin);
+}
+
 HttpToSpdyConverter::HttpToSpdyConverter(spdy::SpdyVersion spdy_version,
                                          SpdyReceiver* receiver)
     : impl_(new ConverterImpl(spdy_version, receiver)),
@@ -84,10 +110,32 @@ void HttpToSpdyConverter::Flush() {
   impl_->Flush();
 }
 
+void HttpToSpdyConverter::set_target_data_frame_size(size_t size) {
+  DCHECK_GT(size, 0u);
+  impl_->set_target_data_frame_bytes(size);
+}
+
+void HttpToSpdyConverter::ProcessBackedBodyData(base::StringPiece input_data,
+                                                DataFrameBacking* backing) {
+  DCHECK_LE(input_data.size(), parser_.GetPendingBodyBytes());
+  const bool fin = parser_.SkipBodyData(input_data.size());
+  impl_->OnBackedData(input_data, fin, backing);
+}
+
+void HttpToSpdyConverter::SendBackedBodyData(base::StringPiece data,
+                                             DataFrameBacking* backing) {
+  impl_->OnBackedData(data, false, backing);
+}
+
+HttpResponseVisitorInterface* HttpToSpdyConverter::direct_visitor() {
+  return impl_.get();
+}
+
 HttpToSpdyConverter::ConverterImpl::ConverterImpl(
     spdy::SpdyVersion spdy_version, SpdyReceiver* receiver)
     : spdy_version_(spdy_version),
       receiver_(receiver),
+      target_data_frame_bytes_(kDefaultTargetDataFrameBytes),
       sent_flag_fin_(false) {
   DCHECK_NE(spdy::SPDY_VERSION_NONE, spdy_version);
   CHECK(receiver_);
@@ -105,11 +153,14 @@ void HttpToSpdyConverter::ConverterImpl::OnStatusLine(
     const base::StringPiece& status_code,
     const base::StringPiece& status_phrase) {
   DCHECK(headers_.empty());
-  const bool spdy2 = spdy_version_ < spdy::SPDY_VERSION_3;
-  headers_[spdy2 ? spdy::kSpdy2Version : spdy::kSpdy3Version] =
-      version.as_string();
-  headers_[spdy2 ? spdy::kSpdy2Status : spdy::kSpdy3Status] =
-      status_code.as_string();
+  // SPDY/3.1 uses the same headers as SPDY/3.
+  if (spdy_version_ < spdy::SPDY_VERSION_3) {
+    AddStatusHeaders<SpdyVersionTraits<spdy::SPDY_VERSION_2> >(
+        version, status_code, &headers_);
+  } else {
+    AddStatusHeaders<SpdyVersionTraits<spdy::SPDY_VERSION_3> >(
+        version, status_code, &headers_);
+  }
 }
 
 void HttpToSpdyConverter::ConverterImpl::OnLeadingHeader(
@@ -119,7 +170,7 @@ void HttpToSpdyConverter::ConverterImpl::OnLeadingHeader(
   if (IsInvalidSpdyResponseHeader(key)) {
     return;
   }
-  MergeInHeader(key, value, &headers_);
+  headers_.MergeIn(key, value);
 }
 
 void HttpToSpdyConverter::ConverterImpl::OnLeadingHeadersComplete(bool fin) {
@@ -131,47 +182,114 @@ void HttpToSpdyConverter::ConverterImpl::OnLeadingHeadersComplete(bool fin) {
     sent_flag_fin_ = true;
   }
   receiver_->ReceiveSynReply(&headers_, fin);
-  headers_.clear();
+  headers_.Clear();
 }
 
 void HttpToSpdyConverter::ConverterImpl::OnData(const base::StringPiece& data,
                                                 bool fin) {
-  data.AppendToString(&data_buffer_);
+  // Between calls, data_buffer_ always holds less than a full frame.  We only
+  // buffer data when we have to (to make up a full frame); whenever the input
+  // contains whole frames, we send them straight from the caller's data.  The
+  // frames we send are the same as if we'd buffered everything.
+  DCHECK_LT(data_buffer_.size(), target_data_frame_bytes_);
+
+  // In the common case of a small write that doesn't complete a frame, all we
+  // can do is buffer it.
+  if (!fin && data_buffer_.size() + data.size() < target_data_frame_bytes_) {
+    data.AppendToString(&data_buffer_);
+    return;
+  }
+
+  base::StringPiece rest = data;
+
+  // If we have a partial frame buffered, top it up first.  If that uses up
+  // the input, we're done; otherwise, the buffer now holds a full frame, with
+  // more data after it, so it can go out (without FLAG_FIN).
+  if (!data_buffer_.empty()) {
+    const size_t needed = target_data_frame_bytes_ - data_buffer_.size();
+    if (rest.size() <= needed) {
+      rest.AppendToString(&data_buffer_);
+      SendDataIfNecessary(false, fin);  // false = don't flush
+      return;
+    }
+    rest.substr(0, needed).AppendToString(&data_buffer_);
+    rest = rest.substr(needed);
+    SendDataFrame(data_buffer_.data(), data_buffer_.size(), false);
+    data_buffer_.clear();
+  }
+
+  // Pass whole frames through without copying them.
+  while (rest.size() >= target_data_frame_bytes_) {
+    const bool last_frame = fin && rest.size() == target_data_frame_bytes_;
+    SendDataFrame(rest.data(), target_data_frame_bytes_, last_frame);
+    rest = rest.substr(target_data_frame_bytes_);
+    if (last_frame) {
+      return;
+    }
+  }
+
+  // Buffer whatever is left over (less than a frame), unless this is the end
+  // of the response, in which case it goes out now.
+  rest.AppendToString(&data_buffer_);
   SendDataIfNecessary(false, fin);  // false = don't flush
 }
 
+void HttpToSpdyConverter::ConverterImpl::OnBackedData(
+    base::StringPiece data, bool fin, DataFrameBacking* backing) {
+  // Anything we've already buffered has to go out first, to keep the data in
+  // order.
+  SendDataIfNecessary(true, false);  // true = flush, false = not fin yet
+  if (sent_flag_fin_) {
+    LOG(DFATAL) << "Trying to send data after sending FLAG_FIN";
+    return;
+  }
+  // Send the data in frames of (at most) the usual size, all referring to the
+  // same backing object.
+  while (data.size() > target_data_frame_bytes_) {
+    receiver_->ReceiveBackedData(data.substr(0, target_data_frame_bytes_),
+                                 false, backing);
+    data = data.substr(target_data_frame_bytes_);
+  }
+  if (!data.empty() || fin) {
+    if (fin) {
+      sent_flag_fin_ = true;
+    }
+    receiver_->ReceiveBackedData(data, fin, backing);
+  }
+}
+
 void HttpToSpdyConverter::ConverterImpl::SendDataIfNecessary(bool flush,
                                                              bool fin) {
   // If we have (strictly) more than one frame's worth of data waiting, send it
-  // down the filter chain, kTargetDataFrameBytes bytes at a time.  If we are
-  // left with _exactly_ kTargetDataFrameBytes bytes of data, we'll deal with
-  // that in the next code block (see the comment there to explain why).
-  if (data_buffer_.size() > kTargetDataFrameBytes) {
+  // down the filter chain, target_data_frame_bytes_ bytes at a time.  If we
+  // are left with _exactly_ one frame's worth of data, we'll deal with that in
+  // the next code block (see the comment there to explain why).
+  if (data_buffer_.size() > target_data_frame_bytes_) {
     const char* start = data_buffer_.data();
     size_t size = data_buffer_.size();
-    while (size > kTargetDataFrameBytes) {
-      SendDataFrame(start, kTargetDataFrameBytes, false);
-      start += kTargetDataFrameBytes;
-      size -= kTargetDataFrameBytes;
+    while (size > target_data_frame_bytes_) {
+      SendDataFrame(start, target_data_frame_bytes_, false);
+      start += target_data_frame_bytes_;
+      size -= target_data_frame_bytes_;
     }
     data_buffer_.erase(0, data_buffer_.size() - size);
   }
-  DCHECK(data_buffer_.size() <= kTargetDataFrameBytes);
+  DCHECK(data_buffer_.size() <= target_data_frame_bytes_);
 
   // We may still have some leftover data.  We need to send another data frame
-  // now (rather than waiting for a full kTargetDataFrameBytes) if:
+  // now (rather than waiting for a full frame's worth) if:
   //   1) This is the end of the response,
   //   2) we're supposed to flush and the buffer is nonempty, or
   //   3) we still have a full data frame's worth in the buffer.
   //
   // Note that because of the previous code block, condition (3) will only be
-  // true if we have exactly kTargetDataFrameBytes of data.  However, dealing
-  // with that case here instead of in the above block makes it easier to make
+  // true if we have exactly one frame's worth of data.  However, dealing with
+  // that case here instead of in the above block makes it easier to make
   // sure we correctly set FLAG_FIN on the final data frame, which is why the
   // above block uses a strict, > comparison rather than a non-strict, >=
   // comparison.
   if (fin || (flush && !data_buffer_.empty()) ||
-      data_buffer_.size() >= kTargetDataFrameBytes) {
+      data_buffer_.size() >= target_data_frame_bytes_) {
     SendDataFrame(data_buffer_.data(), data_buffer_.size(), fin);
     data_buffer_.clear();
   }
@@ -20,12 +20,15 @@
 #include "base/basictypes.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/string_piece.h"
+#include "mod_spdy/common/header_block.h"
 #include "mod_spdy/common/http_response_parser.h"
 #include "mod_spdy/common/protocol_util.h"
-#include "net/spdy/spdy_framer.h"  // for SpdyHeaderBlock
 
 namespace mod_spdy {
 
+class DataFrameBacking;
+class HttpResponseVisitorInterface;
+
 // Parses incoming HTTP response data and converts it into equivalent SPDY
 // frame data.
 class HttpToSpdyConverter {
@@ -37,15 +40,21 @@ class HttpToSpdyConverter {
     virtual ~SpdyReceiver();
 
     // Receive a SYN_REPLY frame with the given headers.  The callee is free to
-    // mutate the headers map (e.g. to add an extra header) before forwarding
+    // mutate the header block (e.g. to add an extra header) before forwarding
     // it on, but the pointer will not remain valid after this method returns.
-    virtual void ReceiveSynReply(net::SpdyHeaderBlock* headers,
-                                 bool flag_fin) = 0;
+    virtual void ReceiveSynReply(HeaderBlock* headers, bool flag_fin) = 0;
 
     // Receive a DATA frame with the given payload.  The data pointer will not
     // remain valid after this method returns.
     virtual void ReceiveData(base::StringPiece data, bool flag_fin) = 0;
 
+    // Receive a DATA frame whose payload is owned by the given backing object.
+    // The callee may keep a reference to the backing object (and so use the
+    // data without copying it) rather than treating the data pointer as
+    // temporary.  The default implementation just calls ReceiveData.
+    virtual void ReceiveBackedData(base::StringPiece data, bool flag_fin,
+                                   DataFrameBacking* backing);
+
    private:
     DISALLOW_COPY_AND_ASSIGN(SpdyReceiver);
   };
@@ -65,6 +74,31 @@ class HttpToSpdyConverter {
   // Flush out any buffered data.
   void Flush();
 
+  // Change the largest payload size for the DATA frames we send (by default,
+  // 4096 bytes).  This must be called before any body data is processed.
+  void set_target_data_frame_size(size_t size);
+
+  // Return how much input the parser currently knows to be pure response body
+  // data (see HttpResponseParser::GetPendingBodyBytes).
+  uint64 GetPendingBodyBytes() const { return parser_.GetPendingBodyBytes(); }
+
+  // Like ProcessInput, but for input that is owned by the given backing
+  // object, so that the data can be passed on to the receiver without being
+  // copied into our buffer.  The input must be nonempty and at most
+  // GetPendingBodyBytes() bytes.
+  void ProcessBackedBodyData(base::StringPiece input_data,
+                             DataFrameBacking* backing);
+
+  // The equivalent of ProcessBackedBodyData for responses that are being fed
+  // in through direct_visitor().
+  void SendBackedBodyData(base::StringPiece data, DataFrameBacking* backing);
+
+  // Callers that already have the response in structured form (rather than as
+  // HTTP text) can skip the HTTP parser and feed the response straight to the
+  // converter through this visitor.  A given response must be fed to the
+  // converter either entirely through ProcessInput or entirely through this.
+  HttpResponseVisitorInterface* direct_visitor();
+
  private:
   class ConverterImpl;
   scoped_ptr<ConverterImpl> impl_;
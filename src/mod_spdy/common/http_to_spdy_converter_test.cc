@@ -14,8 +14,15 @@
 
 #include "mod_spdy/common/http_to_spdy_converter.h"
 
+#include "base/logging.h"
+#include "base/memory/ref_counted.h"
 #include "base/strings/string_piece.h"
+#include "base/time/time.h"
+#include "mod_spdy/common/backed_data_frame.h"
+#include "mod_spdy/common/header_block.h"
+#include "mod_spdy/common/http_response_visitor_interface.h"
 #include "mod_spdy/common/protocol_util.h"
+#include "net/spdy/spdy_framer.h"
 #include "net/spdy/spdy_protocol.h"
 #include "testing/gmock/include/gmock/gmock.h"
 #include "testing/gtest/include/gtest/gtest.h"
@@ -24,15 +31,41 @@ using testing::_;
 using testing::DeleteArg;
 using testing::Eq;
 using testing::InSequence;
-using testing::Pointee;
 
 namespace {
 
+// Match a HeaderBlock* holding the same headers as the given SpdyHeaderBlock.
+MATCHER_P(HeadersAre, expected, "") {
+  net::SpdyHeaderBlock actual;
+  arg->CopyTo(&actual);
+  return actual == expected;
+}
+
 class MockSpdyReceiver : public mod_spdy::HttpToSpdyConverter::SpdyReceiver {
  public:
-  MOCK_METHOD2(ReceiveSynReply, void(net::SpdyHeaderBlock* headers,
+  MOCK_METHOD2(ReceiveSynReply, void(mod_spdy::HeaderBlock* headers,
                                      bool flag_fin));
   MOCK_METHOD2(ReceiveData, void(base::StringPiece data, bool flag_fin));
+  MOCK_METHOD3(ReceiveBackedData, void(base::StringPiece data, bool flag_fin,
+                                       mod_spdy::DataFrameBacking* backing));
+};
+
+// A receiver that just counts the data it gets, for benchmarking.
+class CountingSpdyReceiver
+    : public mod_spdy::HttpToSpdyConverter::SpdyReceiver {
+ public:
+  CountingSpdyReceiver() : num_frames_(0), num_bytes_(0) {}
+  virtual void ReceiveSynReply(mod_spdy::HeaderBlock* headers, bool flag_fin) {}
+  virtual void ReceiveData(base::StringPiece data, bool flag_fin) {
+    ++num_frames_;
+    num_bytes_ += data.size();
+  }
+  size_t num_frames() const { return num_frames_; }
+  size_t num_bytes() const { return num_bytes_; }
+
+ private:
+  size_t num_frames_;
+  size_t num_bytes_;
 };
 
 class HttpToSpdyConverterTest :
@@ -67,7 +100,7 @@ TEST_P(HttpToSpdyConverterTest, SimpleWithContentLength) {
   expected_headers_["x-whatever"] = "foobar";
 
   InSequence seq;
-  EXPECT_CALL(receiver_, ReceiveSynReply(Pointee(Eq(expected_headers_)),
+  EXPECT_CALL(receiver_, ReceiveSynReply(HeadersAre(expected_headers_),
                                          Eq(false)));
   EXPECT_CALL(receiver_, ReceiveData(Eq("Hello, world!\n"), Eq(true)));
 
@@ -89,7 +122,7 @@ TEST_P(HttpToSpdyConverterTest, SimpleWithChunking) {
   expected_headers_[mod_spdy::http::kContentType] = "text/plain";
 
   InSequence seq;
-  EXPECT_CALL(receiver_, ReceiveSynReply(Pointee(Eq(expected_headers_)),
+  EXPECT_CALL(receiver_, ReceiveSynReply(HeadersAre(expected_headers_),
                                          Eq(false)));
   EXPECT_CALL(receiver_, ReceiveData(Eq("Hello, world!\n"), Eq(true)));
 
@@ -116,7 +149,7 @@ TEST_P(HttpToSpdyConverterTest, ChunkedEncodingWithTrailingGarbage) {
   expected_headers_[mod_spdy::http::kContentType] = "text/plain";
 
   InSequence seq;
-  EXPECT_CALL(receiver_, ReceiveSynReply(Pointee(Eq(expected_headers_)),
+  EXPECT_CALL(receiver_, ReceiveSynReply(HeadersAre(expected_headers_),
                                          Eq(false)));
   EXPECT_CALL(receiver_, ReceiveData(Eq("Hello, world!\n"), Eq(true)));
 
@@ -140,7 +173,7 @@ TEST_P(HttpToSpdyConverterTest, NoResponseBody) {
   expected_headers_["location"] = "https://www.example.com/";
 
   InSequence seq;
-  EXPECT_CALL(receiver_, ReceiveSynReply(Pointee(Eq(expected_headers_)),
+  EXPECT_CALL(receiver_, ReceiveSynReply(HeadersAre(expected_headers_),
                                          Eq(true)));
 
   ASSERT_TRUE(converter_.ProcessInput(
@@ -158,7 +191,7 @@ TEST_P(HttpToSpdyConverterTest, BreakUpLargeDataIntoMultipleFrames) {
   expected_headers_[mod_spdy::http::kContentType] = "text/plain";
 
   InSequence seq;
-  EXPECT_CALL(receiver_, ReceiveSynReply(Pointee(Eq(expected_headers_)),
+  EXPECT_CALL(receiver_, ReceiveSynReply(HeadersAre(expected_headers_),
                                          Eq(false)));
   EXPECT_CALL(receiver_, ReceiveData(Eq(std::string(4096, 'x')), Eq(false)));
   EXPECT_CALL(receiver_, ReceiveData(Eq(std::string(4096, 'x')), Eq(false)));
@@ -173,6 +206,23 @@ TEST_P(HttpToSpdyConverterTest, BreakUpLargeDataIntoMultipleFrames) {
       "\r\n"));
 }
 
+// With a bigger target frame size (as chosen by the session for a client with
+// a large congestion window), large payloads should use fewer DATA frames.
+TEST_P(HttpToSpdyConverterTest, LargerTargetDataFrameSize) {
+  converter_.set_target_data_frame_size(8192);
+
+  InSequence seq;
+  EXPECT_CALL(receiver_, ReceiveSynReply(_, Eq(false)));
+  EXPECT_CALL(receiver_, ReceiveData(Eq(std::string(8192, 'x')), Eq(false)));
+  EXPECT_CALL(receiver_, ReceiveData(Eq(std::string(1808, 'x')), Eq(true)));
+
+  ASSERT_TRUE(converter_.ProcessInput(
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Length: 10000\r\n"
+      "\r\n" +
+      std::string(10000, 'x')));
+}
+
 // Test that we buffer data until we get the full frame.
 TEST_P(HttpToSpdyConverterTest, BufferUntilWeHaveACompleteFrame) {
   expected_headers_[status_header_name()] = "200";
@@ -187,7 +237,7 @@ TEST_P(HttpToSpdyConverterTest, BufferUntilWeHaveACompleteFrame) {
       "Content-Length: 4096\r\n"));
   // Send the rest of the headers, and some of the data.  We should get the
   // SYN_REPLY now, but no data yet.
-  EXPECT_CALL(receiver_, ReceiveSynReply(Pointee(Eq(expected_headers_)),
+  EXPECT_CALL(receiver_, ReceiveSynReply(HeadersAre(expected_headers_),
                                          Eq(false)));
   ASSERT_TRUE(converter_.ProcessInput(
       "Content-Type: text/plain\r\n"
@@ -210,7 +260,7 @@ TEST_P(HttpToSpdyConverterTest, RespectFlushes) {
   InSequence seq;
   // Send the headers and some of the data (not enough for a full frame).  We
   // should get the headers out, but no data yet.
-  EXPECT_CALL(receiver_, ReceiveSynReply(Pointee(Eq(expected_headers_)),
+  EXPECT_CALL(receiver_, ReceiveSynReply(HeadersAre(expected_headers_),
                                          Eq(false)));
   ASSERT_TRUE(converter_.ProcessInput(
       "HTTP/1.1 200 OK\r\n"
@@ -235,7 +285,7 @@ TEST_P(HttpToSpdyConverterTest, FlushAfterEndDoesNothing) {
   expected_headers_[mod_spdy::http::kContentType] = "text/plain";
 
   InSequence seq;
-  EXPECT_CALL(receiver_, ReceiveSynReply(Pointee(Eq(expected_headers_)),
+  EXPECT_CALL(receiver_, ReceiveSynReply(HeadersAre(expected_headers_),
                                          Eq(false)));
   EXPECT_CALL(receiver_, ReceiveData(Eq("foobar"), Eq(true)));
   ASSERT_TRUE(converter_.ProcessInput(
@@ -251,6 +301,129 @@ TEST_P(HttpToSpdyConverterTest, FlushAfterEndDoesNothing) {
   converter_.Flush();
 }
 
+// A response fed in through the direct visitor, rather than parsed from HTTP
+// text, should produce the same frames.
+TEST_P(HttpToSpdyConverterTest, DirectVisitor) {
+  expected_headers_[status_header_name()] = "200";
+  expected_headers_[version_header_name()] = "HTTP/1.1";
+  expected_headers_[mod_spdy::http::kContentType] = "text/plain";
+
+  InSequence seq;
+  EXPECT_CALL(receiver_, ReceiveSynReply(HeadersAre(expected_headers_),
+                                         Eq(false)));
+  EXPECT_CALL(receiver_, ReceiveData(Eq("Hello, world!\n"), Eq(true)));
+
+  mod_spdy::HttpResponseVisitorInterface* visitor =
+      converter_.direct_visitor();
+  visitor->OnStatusLine("HTTP/1.1", "200", "OK");
+  visitor->OnLeadingHeader("Content-Type", "text/plain");
+  // Headers that are invalid in SPDY should still be filtered out.
+  visitor->OnLeadingHeader("Transfer-Encoding", "chunked");
+  visitor->OnLeadingHeadersComplete(false);
+  visitor->OnData("Hello, ", false);
+  visitor->OnData("world!\n", false);
+  visitor->OnData("", true);
+}
+
+// Large writes are sent straight from the caller's data rather than being
+// buffered, but the frames should come out the same as if they had been
+// buffered: full-size frames, with any partial frame topped up first.
+TEST_P(HttpToSpdyConverterTest, LargeWritesKeepFrameBoundaries) {
+  InSequence seq;
+  EXPECT_CALL(receiver_, ReceiveSynReply(_, Eq(false)));
+  mod_spdy::HttpResponseVisitorInterface* visitor =
+      converter_.direct_visitor();
+  visitor->OnStatusLine("HTTP/1.1", "200", "OK");
+  visitor->OnLeadingHeadersComplete(false);
+
+  // A small write gets buffered.
+  visitor->OnData(std::string(1000, 'a'), false);
+  // A big write completes the buffered frame, sends two full frames from the
+  // input, and buffers the last 1000 bytes.
+  const std::string big(2 * 4096 + 3096 + 1000, 'b');
+  EXPECT_CALL(receiver_, ReceiveData(
+      Eq(std::string(1000, 'a') + std::string(3096, 'b')), Eq(false)));
+  EXPECT_CALL(receiver_, ReceiveData(
+      Eq(base::StringPiece(big.data() + 3096, 4096)), Eq(false)));
+  EXPECT_CALL(receiver_, ReceiveData(
+      Eq(base::StringPiece(big.data() + 3096 + 4096, 4096)), Eq(false)));
+  visitor->OnData(big, false);
+  // A write that ends exactly on a frame boundary, with FLAG_FIN, sends the
+  // buffered data and then the last frame straight from the input.
+  const std::string last(3096 + 4096, 'c');
+  EXPECT_CALL(receiver_, ReceiveData(
+      Eq(std::string(1000, 'b') + std::string(3096, 'c')), Eq(false)));
+  EXPECT_CALL(receiver_, ReceiveData(Eq(std::string(4096, 'c')), Eq(true)));
+  visitor->OnData(last, true);
+}
+
+// Body data given to ProcessBackedBodyData should be passed along with its
+// backing object rather than copied, after flushing any buffered data.
+TEST_P(HttpToSpdyConverterTest, BackedBodyData) {
+  expected_headers_[status_header_name()] = "200";
+  expected_headers_[version_header_name()] = "HTTP/1.1";
+  expected_headers_[mod_spdy::http::kContentLength] = "10000";
+
+  scoped_refptr<mod_spdy::DataFrameBacking> backing(
+      new mod_spdy::DataFrameBacking);
+  const std::string body(9000, 'x');
+
+  InSequence seq;
+  EXPECT_CALL(receiver_, ReceiveSynReply(HeadersAre(expected_headers_),
+                                         Eq(false)));
+  ASSERT_TRUE(converter_.ProcessInput(
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Length: 10000\r\n"
+      "\r\n" +
+      std::string(1000, 'w')));
+  EXPECT_EQ(9000u, converter_.GetPendingBodyBytes());
+
+  EXPECT_CALL(receiver_, ReceiveData(Eq(std::string(1000, 'w')), Eq(false)));
+  EXPECT_CALL(receiver_, ReceiveBackedData(
+      Eq(base::StringPiece(body.data(), 4096)), Eq(false), backing.get()));
+  EXPECT_CALL(receiver_, ReceiveBackedData(
+      Eq(base::StringPiece(body.data() + 4096, 4096)), Eq(false),
+      backing.get()));
+  EXPECT_CALL(receiver_, ReceiveBackedData(
+      Eq(base::StringPiece(body.data() + 8192, 808)), Eq(true),
+      backing.get()));
+  converter_.ProcessBackedBodyData(body, backing.get());
+  EXPECT_EQ(0u, converter_.GetPendingBodyBytes());
+}
+
+// Feeds 256 MB of response body through the converter in fragments of various
+// sizes, and logs how long each size took.  This is a benchmark rather than a
+// test, so it's disabled by default; run it with
+// --gtest_also_run_disabled_tests.
+TEST_P(HttpToSpdyConverterTest, DISABLED_OnDataBenchmark) {
+  const size_t kTotalBytes = 256 * 1024 * 1024;
+  const size_t kFragmentSizes[] = {64, 512, 1460, 4096, 8192, 65536, 262144};
+  for (size_t i = 0; i < arraysize(kFragmentSizes); ++i) {
+    const size_t fragment_size = kFragmentSizes[i];
+    const std::string fragment(fragment_size, 'x');
+    CountingSpdyReceiver receiver;
+    mod_spdy::HttpToSpdyConverter converter(GetParam(), &receiver);
+    mod_spdy::HttpResponseVisitorInterface* visitor =
+        converter.direct_visitor();
+    visitor->OnStatusLine("HTTP/1.1", "200", "OK");
+    visitor->OnLeadingHeadersComplete(false);
+
+    const base::TimeTicks start = base::TimeTicks::Now();
+    size_t bytes_sent = 0;
+    while (bytes_sent < kTotalBytes) {
+      visitor->OnData(fragment, false);
+      bytes_sent += fragment_size;
+    }
+    visitor->OnData(base::StringPiece(), true);
+    const base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+
+    EXPECT_EQ(bytes_sent, receiver.num_bytes());
+    LOG(INFO) << "Fragments of " << fragment_size << " bytes: "
+              << receiver.num_frames() << " frames in "
+              << elapsed.InMillisecondsF() << " ms";
+  }
+}
+
 // Run each test over both SPDY v2 and SPDY v3.
 INSTANTIATE_TEST_CASE_P(Spdy2And3, HttpToSpdyConverterTest, testing::Values(
     mod_spdy::spdy::SPDY_VERSION_2, mod_spdy::spdy::SPDY_VERSION_3,
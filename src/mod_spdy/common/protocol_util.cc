@@ -16,6 +16,7 @@
 
 #include "base/strings/string_piece.h"
 #include "base/strings/string_util.h"
+#include "mod_spdy/common/header_name.h"
 #include "net/spdy/spdy_frame_builder.h"
 #include "net/spdy/spdy_framer.h"
 #include "net/spdy/spdy_protocol.h"
@@ -65,6 +66,8 @@ net::SpdyMajorVersion SpdyVersionToFramerVersion(spdy::SpdyVersion version) {
     case spdy::SPDY_VERSION_3:
     case spdy::SPDY_VERSION_3_1:
       return net::SPDY3;
+    case spdy::SPDY_VERSION_HTTP2:
+      return net::SPDY4;
     default:
       LOG(DFATAL) << "Invalid SpdyVersion value: " << version;
       return static_cast<net::SpdyMajorVersion>(0);
@@ -76,12 +79,19 @@ const char* SpdyVersionNumberString(spdy::SpdyVersion version) {
     case spdy::SPDY_VERSION_2:   return "2";
     case spdy::SPDY_VERSION_3:   return "3";
     case spdy::SPDY_VERSION_3_1: return "3.1";
+    case spdy::SPDY_VERSION_HTTP2: return "h2";
     default:
       LOG(DFATAL) << "Invalid SpdyVersion value: " << version;
       return "?";
   }
 }
 
+int32 InitialWindowSizeForVersion(spdy::SpdyVersion version) {
+  // RFC 7540 section 6.9.2.
+  return (version == spdy::SPDY_VERSION_HTTP2 ? 65535 :
+          net::kSpdyStreamInitialWindowSize);
+}
+
 const char* GoAwayStatusCodeToString(net::SpdyGoAwayStatus status) {
   switch (status) {
     case net::GOAWAY_OK:             return "OK";
@@ -107,12 +117,15 @@ const char* SettingsIdToString(net::SpdySettingsIds id) {
 bool IsInvalidSpdyResponseHeader(base::StringPiece key) {
   // The following headers are forbidden in SPDY responses (SPDY draft 3
   // section 3.2.2).
-  return (LowerCaseEqualsASCII(key.begin(), key.end(), http::kConnection) ||
-          LowerCaseEqualsASCII(key.begin(), key.end(), http::kKeepAlive) ||
-          LowerCaseEqualsASCII(key.begin(), key.end(),
-                               http::kProxyConnection) ||
-          LowerCaseEqualsASCII(key.begin(), key.end(),
-                               http::kTransferEncoding));
+  switch (ClassifyHeaderName(key)) {
+    case HEADER_CONNECTION:
+    case HEADER_KEEP_ALIVE:
+    case HEADER_PROXY_CONNECTION:
+    case HEADER_TRANSFER_ENCODING:
+      return true;
+    default:
+      return false;
+  }
 }
 
 net::SpdyPriority LowestSpdyPriorityForVersion(
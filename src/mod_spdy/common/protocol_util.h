@@ -15,6 +15,7 @@
 #ifndef MOD_SPDY_COMMON_PROTOCOL_UTIL_H_
 #define MOD_SPDY_COMMON_PROTOCOL_UTIL_H_
 
+#include "base/basictypes.h"
 #include "base/strings/string_piece.h"
 #include "net/spdy/spdy_framer.h"
 #include "net/spdy/spdy_protocol.h"
@@ -47,12 +48,16 @@ namespace spdy {
 
 // Represents a specific SPDY version, including experimental versions such as
 // SPDY/3.1 (which uses version 3 frames, but has extra semantics borrowed from
-// SPDY/4).
+// SPDY/4).  HTTP/2 is treated as the next version after SPDY/3.1: its framing
+// is entirely different, but once the Http2Framer has translated its frames,
+// the rest of mod_spdy sees SPDY/3.1 semantics (colon headers, stream and
+// session flow control).
 enum SpdyVersion {
   SPDY_VERSION_NONE,  // not using SPDY
   SPDY_VERSION_2,     // SPDY/2
   SPDY_VERSION_3,     // SPDY/3
-  SPDY_VERSION_3_1    // SPDY/3.1 (SPDY/3 framing, but with new flow control)
+  SPDY_VERSION_3_1,   // SPDY/3.1 (SPDY/3 framing, but with new flow control)
+  SPDY_VERSION_HTTP2  // HTTP/2 (RFC 7540), with HPACK header compression
 };
 
 // Magic header names for SPDY v2.
@@ -77,9 +82,14 @@ extern const char* const kSpdy3Version;
 net::SpdyMajorVersion SpdyVersionToFramerVersion(spdy::SpdyVersion version);
 
 // Given a SpdyVersion enum value (other than SPDY_VERSION_NONE), return a
-// string for the version number (e.g. "3" or "3.1").
+// string for the version number (e.g. "3" or "3.1", or "h2" for HTTP/2).
 const char* SpdyVersionNumberString(spdy::SpdyVersion version);
 
+// Return the initial flow control window size (for both streams and the
+// session) that the client's side starts with, for the given SpdyVersion;
+// this is 64 KB for SPDY, but one byte less for HTTP/2.
+int32 InitialWindowSizeForVersion(spdy::SpdyVersion version);
+
 // Convert various SPDY enum types to strings.
 const char* GoAwayStatusCodeToString(net::SpdyGoAwayStatus status);
 inline const char* RstStreamStatusCodeToString(
@@ -39,6 +39,16 @@ TEST(ProtocolUtilTest, ValidSpdyResponseHeaders) {
       "X-HEADER-WE-HAVE-NEVER-HEARD-OF"));
 }
 
+TEST(ProtocolUtilTest, Http2Version) {
+  const mod_spdy::spdy::SpdyVersion http2 = mod_spdy::spdy::SPDY_VERSION_HTTP2;
+  EXPECT_STREQ("h2", mod_spdy::SpdyVersionNumberString(http2));
+  EXPECT_EQ(65535, mod_spdy::InitialWindowSizeForVersion(http2));
+  EXPECT_EQ(65536, mod_spdy::InitialWindowSizeForVersion(
+      mod_spdy::spdy::SPDY_VERSION_3_1));
+  // HTTP/2 gets SPDY/3-style (0 to 7) priorities from the Http2Framer.
+  EXPECT_EQ(7u, mod_spdy::LowestSpdyPriorityForVersion(http2));
+}
+
 TEST(ProtocolUtilTest, MergeIntoEmpty) {
   net::SpdyHeaderBlock headers;
   ASSERT_EQ(0u, headers.size());
@@ -0,0 +1,55 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mod_spdy/common/session_framer.h"
+
+#include "net/spdy/buffered_spdy_framer.h"
+#include "net/spdy/spdy_protocol.h"
+
+namespace mod_spdy {
+
+SessionFramer::SessionFramer() {}
+
+SessionFramer::~SessionFramer() {}
+
+BufferedSessionFramer::BufferedSessionFramer(net::SpdyMajorVersion version)
+    : framer_(version, true) {}
+
+BufferedSessionFramer::~BufferedSessionFramer() {}
+
+void BufferedSessionFramer::set_visitor(
+    net::BufferedSpdyFramerVisitorInterface* visitor) {
+  framer_.set_visitor(visitor);
+}
+
+size_t BufferedSessionFramer::ProcessInput(const char* data, size_t length) {
+  return framer_.ProcessInput(data, length);
+}
+
+bool BufferedSessionFramer::HasError() {
+  return framer_.HasError();
+}
+
+net::SpdySerializedFrame* BufferedSessionFramer::SerializeFrame(
+    const net::SpdyFrameIR& frame) {
+  return framer_.SerializeFrame(frame);
+}
+
+net::SpdySerializedFrame* BufferedSessionFramer::ReleasePendingOutput() {
+  // The SPDY framer never generates output of its own.
+  return NULL;
+}
+
+}  // namespace mod_spdy
@@ -0,0 +1,89 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOD_SPDY_COMMON_SESSION_FRAMER_H_
+#define MOD_SPDY_COMMON_SESSION_FRAMER_H_
+
+#include "base/basictypes.h"
+#include "net/spdy/buffered_spdy_framer.h"
+#include "net/spdy/spdy_protocol.h"
+
+namespace mod_spdy {
+
+// The wire protocol for one session: parses input from the client into calls
+// on a BufferedSpdyFramerVisitorInterface, and serializes the frames that the
+// session and its streams send.  SPDY sessions use net::BufferedSpdyFramer
+// (see BufferedSessionFramer below); HTTP/2 sessions use Http2Framer, which
+// speaks HTTP/2 on the wire but presents the same SPDY-style frames to the
+// SpdySession, so that the session, streams and converters are shared.  Like
+// the SpdySession that owns it, a SessionFramer is only used by the main
+// connection thread.
+class SessionFramer {
+ public:
+  SessionFramer();
+  virtual ~SessionFramer();
+
+  // Set the visitor to which input frames are reported.  The framer does not
+  // take ownership.
+  virtual void set_visitor(
+      net::BufferedSpdyFramerVisitorInterface* visitor) = 0;
+
+  // Parse some input from the client, calling visitor methods as frames are
+  // completed, and return the number of bytes consumed.  Unless HasError()
+  // becomes true, all the data is consumed.
+  virtual size_t ProcessInput(const char* data, size_t length) = 0;
+
+  // Return true if the input was malformed; the session can't continue.
+  virtual bool HasError() = 0;
+
+  // Serialize (and compress) a frame for sending to the client, and return a
+  // new object that the caller owns, or NULL on failure.
+  virtual net::SpdySerializedFrame* SerializeFrame(
+      const net::SpdyFrameIR& frame) = 0;
+
+  // Some protocols require the framer itself to answer certain input frames
+  // (e.g. acknowledging an HTTP/2 SETTINGS frame).  If the framer has such
+  // output waiting to be sent, return it as a new frame that the caller owns;
+  // otherwise return NULL.  The session calls this after processing input.
+  virtual net::SpdySerializedFrame* ReleasePendingOutput() = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SessionFramer);
+};
+
+// A SessionFramer for SPDY/2, SPDY/3 and SPDY/3.1, which simply forwards to a
+// net::BufferedSpdyFramer.
+class BufferedSessionFramer : public SessionFramer {
+ public:
+  explicit BufferedSessionFramer(net::SpdyMajorVersion version);
+  virtual ~BufferedSessionFramer();
+
+  // SessionFramer methods:
+  virtual void set_visitor(net::BufferedSpdyFramerVisitorInterface* visitor);
+  virtual size_t ProcessInput(const char* data, size_t length);
+  virtual bool HasError();
+  virtual net::SpdySerializedFrame* SerializeFrame(
+      const net::SpdyFrameIR& frame);
+  virtual net::SpdySerializedFrame* ReleasePendingOutput();
+
+ private:
+  net::BufferedSpdyFramer framer_;
+
+  DISALLOW_COPY_AND_ASSIGN(BufferedSessionFramer);
+};
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_SESSION_FRAMER_H_
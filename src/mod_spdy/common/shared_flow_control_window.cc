@@ -14,9 +14,13 @@
 
 #include "mod_spdy/common/shared_flow_control_window.h"
 
+#include <algorithm>
+
+#include "base/atomicops.h"
 #include "base/logging.h"
 #include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
+#include "mod_spdy/common/spdy_frame_pool.h"
 #include "mod_spdy/common/spdy_frame_priority_queue.h"
 #include "net/spdy/spdy_protocol.h"
 
@@ -24,85 +28,102 @@ namespace mod_spdy {
 
 SharedFlowControlWindow::SharedFlowControlWindow(
     int32 initial_input_window_size, int32 initial_output_window_size)
-    : condvar_(&lock_),
-      aborted_(false),
+    : aborted_(0),
       init_input_window_size_(initial_input_window_size),
       input_window_size_(initial_input_window_size),
       input_bytes_consumed_(0),
-      output_window_size_(initial_output_window_size) {}
+      input_bytes_outstanding_(0),
+      output_window_size_(initial_output_window_size),
+      num_output_waiters_(0),
+      condvar_(&lock_) {}
 
 SharedFlowControlWindow::~SharedFlowControlWindow() {}
 
 void SharedFlowControlWindow::Abort() {
+  base::subtle::Release_Store(&aborted_, 1);
   base::AutoLock autolock(lock_);
-  aborted_ = true;
   condvar_.Broadcast();
 }
 
 bool SharedFlowControlWindow::is_aborted() const {
-  base::AutoLock autolock(lock_);
-  return aborted_;
+  return base::subtle::Acquire_Load(&aborted_) != 0;
 }
 
 int32 SharedFlowControlWindow::current_input_window_size() const {
-  base::AutoLock autolock(lock_);
-  return input_window_size_;
+  return base::subtle::Acquire_Load(&input_window_size_);
 }
 
 int32 SharedFlowControlWindow::current_output_window_size() const {
-  base::AutoLock autolock(lock_);
-  return output_window_size_;
+  return base::subtle::Acquire_Load(&output_window_size_);
 }
 
 int32 SharedFlowControlWindow::input_bytes_consumed() const {
-  base::AutoLock autolock(lock_);
-  return input_bytes_consumed_;
+  return base::subtle::Acquire_Load(&input_bytes_consumed_);
 }
 
 bool SharedFlowControlWindow::OnReceiveInputData(size_t length) {
-  base::AutoLock autolock(lock_);
-  if (aborted_) {
+  if (is_aborted()) {
     return true;
   }
-  DCHECK_GE(input_window_size_, 0);
-  if (static_cast<size_t>(input_window_size_) < length) {
-    return false;
+  // Stream threads may be increasing the window at the same time (in
+  // OnInputDataConsumed), but nothing else decreases it, so this loop only
+  // repeats if the window has just grown.
+  base::subtle::Atomic32 old_size =
+      base::subtle::NoBarrier_Load(&input_window_size_);
+  while (true) {
+    DCHECK_GE(old_size, 0);
+    if (static_cast<size_t>(old_size) < length) {
+      return false;
+    }
+    const base::subtle::Atomic32 new_size =
+        old_size - static_cast<base::subtle::Atomic32>(length);
+    const base::subtle::Atomic32 prev = base::subtle::Acquire_CompareAndSwap(
+        &input_window_size_, old_size, new_size);
+    if (prev == old_size) {
+      break;
+    }
+    old_size = prev;
   }
-  input_window_size_ -= length;
+  base::subtle::NoBarrier_AtomicIncrement(
+      &input_bytes_outstanding_, static_cast<base::subtle::Atomic32>(length));
   return true;
 }
 
 int32 SharedFlowControlWindow::OnInputDataConsumed(size_t length) {
-  base::AutoLock autolock(lock_);
-  if (aborted_) {
+  if (is_aborted()) {
     return 0;
   }
 
-  DCHECK_GE(input_bytes_consumed_, 0);
-
-  // Check for overflow; this should never happen unless there is a bug in
-  // mod_spdy, since we should never say we've consumed more data than we've
-  // actually received.
-  {
-    const int64 new_input_bytes_consumed =
-        static_cast<int64>(input_bytes_consumed_) + static_cast<int64>(length);
-    CHECK_LE(new_input_bytes_consumed,
-             static_cast<int64>(init_input_window_size_));
-    CHECK_LE(new_input_bytes_consumed + static_cast<int64>(input_window_size_),
-             static_cast<int64>(init_input_window_size_));
-    input_bytes_consumed_ = new_input_bytes_consumed;
-  }
+  // Check that we haven't consumed more data than we've received; this should
+  // never happen unless there is a bug in mod_spdy.
+  CHECK_LE(static_cast<int64>(length),
+           static_cast<int64>(init_input_window_size_));
+  const base::subtle::Atomic32 length32 =
+      static_cast<base::subtle::Atomic32>(length);
+  CHECK_GE(base::subtle::NoBarrier_AtomicIncrement(
+               &input_bytes_outstanding_, -length32), 0);
+  base::subtle::Atomic32 consumed =
+      base::subtle::NoBarrier_AtomicIncrement(&input_bytes_consumed_,
+                                              length32);
+  CHECK_LE(consumed, init_input_window_size_);
 
   // Only send a WINDOW_UPDATE when we've consumed 1/16 of the maximum shared
   // window size, so that we don't send lots of small WINDOW_UDPATE frames.
-  if (input_bytes_consumed_ < init_input_window_size_ / 16) {
-    return 0;
-  } else {
-    input_window_size_ += input_bytes_consumed_;
-    const int32 consumed = input_bytes_consumed_;
-    input_bytes_consumed_ = 0;
-    return consumed;
+  // If several threads cross that line at once, whichever one manages to
+  // reset the count to zero sends the update.
+  while (true) {
+    if (consumed < init_input_window_size_ / 16) {
+      return 0;
+    }
+    const base::subtle::Atomic32 prev = base::subtle::Acquire_CompareAndSwap(
+        &input_bytes_consumed_, consumed, 0);
+    if (prev == consumed) {
+      break;
+    }
+    consumed = prev;
   }
+  base::subtle::Barrier_AtomicIncrement(&input_window_size_, consumed);
+  return consumed;
 }
 
 void SharedFlowControlWindow::OnInputDataConsumedSendUpdateIfNeeded(
@@ -110,49 +131,82 @@ void SharedFlowControlWindow::OnInputDataConsumedSendUpdateIfNeeded(
   const int32 update = OnInputDataConsumed(length);
   if (update > 0) {
     output_queue->Insert(SpdyFramePriorityQueue::kTopPriority,
-                         new net::SpdyWindowUpdateIR(0, update));
+                         new PooledSpdyWindowUpdateIR(0, update));
   }
 }
 
 int32 SharedFlowControlWindow::RequestOutputQuota(int32 amount_requested) {
-  base::AutoLock autolock(lock_);
   DCHECK_GT(amount_requested, 0);
 
-  while (!aborted_ && output_window_size_ <= 0) {
-    condvar_.Wait();
+  base::subtle::Atomic32 old_size =
+      base::subtle::Acquire_Load(&output_window_size_);
+  while (true) {
+    if (is_aborted()) {
+      return 0;
+    }
+
+    if (old_size <= 0) {
+      // The window is empty, so we'll have to wait for a WINDOW_UPDATE.
+      // Registering as a waiter before checking the window again (with a full
+      // barrier in between) pairs with IncreaseOutputWindowSize, which updates
+      // the window before checking for waiters: either we see the new window
+      // size, or it sees us and wakes us up.
+      base::subtle::Barrier_AtomicIncrement(&num_output_waiters_, 1);
+      {
+        base::AutoLock autolock(lock_);
+        while (!is_aborted() &&
+               base::subtle::Acquire_Load(&output_window_size_) <= 0) {
+          condvar_.Wait();
+        }
+      }
+      base::subtle::NoBarrier_AtomicIncrement(&num_output_waiters_, -1);
+      old_size = base::subtle::Acquire_Load(&output_window_size_);
+      continue;
+    }
+
+    // Give as much output quota as we can, but not more than is asked for.
+    const int32 amount_to_give = std::min(amount_requested, old_size);
+    const base::subtle::Atomic32 prev = base::subtle::Acquire_CompareAndSwap(
+        &output_window_size_, old_size, old_size - amount_to_give);
+    if (prev == old_size) {
+      DCHECK_GE(old_size - amount_to_give, 0);
+      return amount_to_give;
+    }
+    old_size = prev;
   }
-
-  if (aborted_) {
-    return 0;
-  }
-
-  // Give as much output quota as we can, but not more than is asked for.
-  DCHECK_GT(output_window_size_, 0);
-  const int32 amount_to_give = std::min(amount_requested, output_window_size_);
-  output_window_size_ -= amount_to_give;
-  DCHECK_GE(output_window_size_, 0);
-  return amount_to_give;
 }
 
 bool SharedFlowControlWindow::IncreaseOutputWindowSize(int32 delta) {
-  base::AutoLock autolock(lock_);
   DCHECK_GE(delta, 0);
-  if (aborted_) {
+  if (is_aborted()) {
     return true;
   }
 
-  // Check for overflow; this can happen if the client is misbehaving.
-  const int64 new_size =
-      static_cast<int64>(output_window_size_) + static_cast<int64>(delta);
-  if (new_size > static_cast<int64>(net::kSpdyMaximumWindowSize)) {
-    return false;
+  base::subtle::Atomic32 old_size =
+      base::subtle::NoBarrier_Load(&output_window_size_);
+  base::subtle::Atomic32 new_size;
+  while (true) {
+    // Check for overflow; this can happen if the client is misbehaving.
+    const int64 new_size64 =
+        static_cast<int64>(old_size) + static_cast<int64>(delta);
+    if (new_size64 > static_cast<int64>(net::kSpdyMaximumWindowSize)) {
+      return false;
+    }
+    new_size = static_cast<base::subtle::Atomic32>(new_size64);
+    const base::subtle::Atomic32 prev = base::subtle::Release_CompareAndSwap(
+        &output_window_size_, old_size, new_size);
+    if (prev == old_size) {
+      break;
+    }
+    old_size = prev;
   }
+  DCHECK_LE(new_size, net::kSpdyMaximumWindowSize);
 
-  // Increase the shared output window size, and wake up any stream threads
-  // that are waiting for output quota.
-  output_window_size_ += delta;
-  DCHECK_LE(output_window_size_, net::kSpdyMaximumWindowSize);
-  if (output_window_size_ > 0) {
+  // Wake up any stream threads that are waiting for output quota.
+  base::subtle::MemoryBarrier();
+  if (new_size > 0 &&
+      base::subtle::NoBarrier_Load(&num_output_waiters_) > 0) {
+    base::AutoLock autolock(lock_);
     condvar_.Broadcast();
   }
   return true;
@@ -15,6 +15,7 @@
 #ifndef MOD_SPDY_COMMON_SHARED_FLOW_CONTROL_WINDOW_H_
 #define MOD_SPDY_COMMON_SHARED_FLOW_CONTROL_WINDOW_H_
 
+#include "base/atomicops.h"
 #include "base/basictypes.h"
 #include "base/compiler_specific.h"
 #include "base/synchronization/condition_variable.h"
@@ -29,6 +30,12 @@ class SpdyFramePriorityQueue;
 // SharedFlowControlWindow class is a thread-safe object for tracking the size
 // of this shared flow control window and enforcing flow-control rules, in both
 // the input and output directions.
+//
+// Every DATA frame sent or received by any stream in the session goes through
+// this object, so the window sizes are kept in atomic variables and adjusted
+// with compare-and-swap, rather than under a session-wide lock.  The lock and
+// condition variable are only used by stream threads that find the output
+// window empty and must block until the client sends a WINDOW_UPDATE.
 class SharedFlowControlWindow {
  public:
   SharedFlowControlWindow(int32 initial_input_window_size,
@@ -91,13 +98,20 @@ class SharedFlowControlWindow {
   bool IncreaseOutputWindowSize(int32 delta) WARN_UNUSED_RESULT;
 
  private:
-  mutable base::Lock lock_;  // protects the below fields
-  base::ConditionVariable condvar_;
-  bool aborted_;
+  base::subtle::Atomic32 aborted_;
   const int32 init_input_window_size_;
-  int32 input_window_size_;
-  int32 input_bytes_consumed_;
-  int32 output_window_size_;
+  base::subtle::Atomic32 input_window_size_;
+  base::subtle::Atomic32 input_bytes_consumed_;
+  // Bytes received but not yet consumed; this only exists so that we can
+  // check (without having to read two counters at once) that we never
+  // consume more than we've received.
+  base::subtle::Atomic32 input_bytes_outstanding_;
+  base::subtle::Atomic32 output_window_size_;
+  // The number of threads blocked (or about to block) in RequestOutputQuota.
+  base::subtle::Atomic32 num_output_waiters_;
+
+  base::Lock lock_;
+  base::ConditionVariable condvar_;
 
   DISALLOW_COPY_AND_ASSIGN(SharedFlowControlWindow);
 };
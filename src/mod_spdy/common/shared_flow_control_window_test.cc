@@ -14,7 +14,13 @@
 
 #include "mod_spdy/common/shared_flow_control_window.h"
 
+#include <algorithm>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/stl_util.h"
 #include "base/threading/platform_thread.h"
+#include "base/time/time.h"
 #include "mod_spdy/common/spdy_frame_priority_queue.h"
 #include "mod_spdy/common/testing/async_task_runner.h"
 #include "mod_spdy/common/testing/notification.h"
@@ -213,4 +219,83 @@ TEST(SharedFlowControlWindowTest, OutputAborting) {
   EXPECT_EQ(0, shared_window.RequestOutputQuota(800));
 }
 
+// When run, a ConsumeOutputQuotaTask requests quota from the given
+// SharedFlowControlWindow, a little at a time, until it has received the
+// given total amount (or the window is aborted).
+class ConsumeOutputQuotaTask : public mod_spdy::testing::AsyncTaskRunner::Task {
+ public:
+  ConsumeOutputQuotaTask(mod_spdy::SharedFlowControlWindow* window,
+                         int32 request, int64 total)
+      : window_(window), request_(request), total_(total), received_(0) {}
+  virtual void Run() {
+    while (received_ < total_) {
+      const int32 quota = window_->RequestOutputQuota(request_);
+      if (quota == 0) {
+        break;
+      }
+      EXPECT_LE(quota, request_);
+      received_ += quota;
+    }
+  }
+  int64 received() const { return received_; }
+ private:
+  mod_spdy::SharedFlowControlWindow* const window_;
+  const int32 request_;
+  const int64 total_;
+  int64 received_;
+  DISALLOW_COPY_AND_ASSIGN(ConsumeOutputQuotaTask);
+};
+
+// Run several threads that consume output quota while this thread keeps
+// refilling the window, and check that exactly the quota we handed out is
+// received, no matter how often the window runs dry along the way.
+void RunOutputContention(int num_threads, int32 request, int64 per_thread,
+                         int32 refill) {
+  mod_spdy::SharedFlowControlWindow shared_window(1000, 0);
+  std::vector<ConsumeOutputQuotaTask*> tasks;
+  std::vector<mod_spdy::testing::AsyncTaskRunner*> runners;
+  for (int i = 0; i < num_threads; ++i) {
+    tasks.push_back(
+        new ConsumeOutputQuotaTask(&shared_window, request, per_thread));
+    runners.push_back(new mod_spdy::testing::AsyncTaskRunner(tasks.back()));
+    ASSERT_TRUE(runners.back()->Start());
+  }
+
+  const int64 total = per_thread * num_threads;
+  int64 given = 0;
+  while (given < total) {
+    if (shared_window.current_output_window_size() < refill) {
+      const int32 delta =
+          static_cast<int32>(std::min(static_cast<int64>(refill),
+                                      total - given));
+      ASSERT_TRUE(shared_window.IncreaseOutputWindowSize(delta));
+      given += delta;
+    } else {
+      base::PlatformThread::YieldCurrentThread();
+    }
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    runners[i]->notification()->ExpectSetWithin(
+        base::TimeDelta::FromSeconds(60));
+    EXPECT_EQ(per_thread, tasks[i]->received());
+  }
+  EXPECT_EQ(0, shared_window.current_output_window_size());
+  STLDeleteElements(&runners);
+}
+
+TEST(SharedFlowControlWindowTest, OutputContention) {
+  RunOutputContention(4, 100, 100000, 1000);
+}
+
+// Not a real test; this measures how long it takes many stream threads to
+// send data through the shared window at once.  Run it with
+// --gtest_also_run_disabled_tests.
+TEST(SharedFlowControlWindowTest, DISABLED_OutputContentionBenchmark) {
+  const base::TimeTicks start = base::TimeTicks::Now();
+  RunOutputContention(8, 1024, 1024 * 1024 * 64,
+                      net::kSpdyStreamInitialWindowSize);
+  LOG(INFO) << "8 threads sent 512MB in 1kB pieces in "
+            << (base::TimeTicks::Now() - start).InMilliseconds() << "ms";
+}
+
 }  // namespace
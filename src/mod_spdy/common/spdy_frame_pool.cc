@@ -0,0 +1,258 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/spdy_frame_pool.h"
+
+#include <new>
+
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+#include "base/logging.h"
+#include "build/build_config.h"
+
+#if !defined(ARCH_CPU_64_BITS)
+#include "base/lazy_instance.h"
+#include "base/synchronization/lock.h"
+#endif
+
+namespace {
+
+// Every block starts with a header saying where it came from, so that Free can
+// put it back, followed by the frame object itself.
+struct BlockHeader {
+  // While the block is on a free list: the link to the next free block (see
+  // below).  Unused otherwise.
+  base::subtle::Atomic32 next;
+  // Which size class the block belongs to, or kUnpooled.
+  uint16 size_class;
+  // The block's index within its size class.
+  uint16 index;
+};
+
+COMPILE_ASSERT(sizeof(BlockHeader) == 8, block_header_keeps_frames_aligned);
+
+// Frames are small: a data frame is a few pointers, and a SYN_STREAM frame is
+// mostly its (empty, until filled in) std::map of headers.
+const size_t kBlockSizes[] = { 64, 128 };
+const int kNumSizeClasses = arraysize(kBlockSizes);
+const uint16 kUnpooled = 0xFFFF;
+
+// Blocks are numbered within each size class, and a link to a block on a free
+// list is its index plus one (so that zero, the value that our statically
+// zero-initialized globals start with, means an empty list).  Indices are 16
+// bits, so a size class can hold at most 255 * 256 = 65280 blocks.
+const int kBlocksPerSlab = 256;
+const int kMaxSlabs = 255;
+
+struct SizeClass {
+#if defined(ARCH_CPU_64_BITS)
+  // The free list head.  The low 32 bits are a link to the first free block;
+  // the high 32 bits are a counter that is bumped on every change, so that a
+  // compare-and-swap based on a stale read of the head (say, one made before
+  // another thread popped the first block and pushed it back again) fails
+  // rather than corrupting the list.  A 16-bit counter could wrap around
+  // while a thread was descheduled between its read and its compare-and-swap;
+  // a 32-bit one cannot, in practice.
+  base::subtle::Atomic64 free_head;
+#else
+  // A link to the first free block.  Without a 64-bit compare-and-swap there
+  // is no room for a wide enough counter beside the link, so on 32-bit builds
+  // the free list is guarded by a lock (see g_free_list_locks) instead.
+  uint32 free_head;
+#endif
+  // The slabs allocated so far (as char*), each holding kBlocksPerSlab blocks.
+  // Once set, an entry never changes.
+  base::subtle::AtomicWord slabs[kMaxSlabs];
+};
+
+SizeClass g_size_classes[kNumSizeClasses];
+base::subtle::Atomic32 g_num_system_allocations = 0;
+
+#if !defined(ARCH_CPU_64_BITS)
+struct FreeListLocks {
+  base::Lock locks[kNumSizeClasses];
+};
+
+base::LazyInstance<FreeListLocks>::Leaky g_free_list_locks =
+    LAZY_INSTANCE_INITIALIZER;
+#endif
+
+size_t BlockStride(int size_class) {
+  return sizeof(BlockHeader) + kBlockSizes[size_class];
+}
+
+BlockHeader* GetBlock(int size_class, uint32 index) {
+  const char* slab = reinterpret_cast<const char*>(base::subtle::Acquire_Load(
+      &g_size_classes[size_class].slabs[index / kBlocksPerSlab]));
+  DCHECK(slab != NULL);
+  return reinterpret_cast<BlockHeader*>(const_cast<char*>(
+      slab + (index % kBlocksPerSlab) * BlockStride(size_class)));
+}
+
+#if defined(ARCH_CPU_64_BITS)
+
+// Return the new value for a free list head whose old value was old_head, now
+// to start with the given link.
+base::subtle::Atomic64 NewHead(base::subtle::Atomic64 old_head, uint32 link) {
+  const uint64 counter = (static_cast<uint64>(old_head) >> 32) + 1;
+  return static_cast<base::subtle::Atomic64>((counter << 32) | link);
+}
+
+// Push a chain of blocks (already linked together from first to last) onto
+// the free list for their size class.
+void PushBlocks(BlockHeader* first, BlockHeader* last) {
+  SizeClass* const size_class = &g_size_classes[first->size_class];
+  while (true) {
+    const base::subtle::Atomic64 head =
+        base::subtle::NoBarrier_Load(&size_class->free_head);
+    base::subtle::NoBarrier_Store(
+        &last->next, static_cast<base::subtle::Atomic32>(head & 0xFFFFFFFF));
+    if (base::subtle::Release_CompareAndSwap(
+            &size_class->free_head, head,
+            NewHead(head, first->index + 1)) == head) {
+      return;
+    }
+  }
+}
+
+// Pop a block from the free list for the given size class, or return NULL if
+// the list is empty.
+BlockHeader* PopBlock(int size_class) {
+  base::subtle::Atomic64* const free_head =
+      &g_size_classes[size_class].free_head;
+  while (true) {
+    const base::subtle::Atomic64 head = base::subtle::Acquire_Load(free_head);
+    const uint32 link = static_cast<uint32>(head & 0xFFFFFFFF);
+    if (link == 0) {
+      return NULL;
+    }
+    BlockHeader* const block = GetBlock(size_class, link - 1);
+    // If another thread has popped this block since we read the head, this
+    // may be garbage, but then the head's counter will have changed and the
+    // compare-and-swap will fail.
+    const uint32 next = base::subtle::NoBarrier_Load(&block->next);
+    if (base::subtle::Acquire_CompareAndSwap(free_head, head,
+                                             NewHead(head, next)) == head) {
+      return block;
+    }
+  }
+}
+
+#else  // !defined(ARCH_CPU_64_BITS)
+
+void PushBlocks(BlockHeader* first, BlockHeader* last) {
+  const int size_class = first->size_class;
+  base::AutoLock autolock(g_free_list_locks.Get().locks[size_class]);
+  base::subtle::NoBarrier_Store(&last->next,
+                                g_size_classes[size_class].free_head);
+  g_size_classes[size_class].free_head = first->index + 1;
+}
+
+BlockHeader* PopBlock(int size_class) {
+  base::AutoLock autolock(g_free_list_locks.Get().locks[size_class]);
+  const uint32 link = g_size_classes[size_class].free_head;
+  if (link == 0) {
+    return NULL;
+  }
+  BlockHeader* const block = GetBlock(size_class, link - 1);
+  g_size_classes[size_class].free_head =
+      base::subtle::NoBarrier_Load(&block->next);
+  return block;
+}
+
+#endif  // defined(ARCH_CPU_64_BITS)
+
+// Allocate a new slab for the given size class, put all but one of its blocks
+// on the free list, and return the other one.  Returns NULL if the size class
+// already has as many slabs as it can.
+BlockHeader* AddSlab(int size_class) {
+  const size_t stride = BlockStride(size_class);
+  for (int slab_index = 0; slab_index < kMaxSlabs; ++slab_index) {
+    base::subtle::AtomicWord* const slot =
+        &g_size_classes[size_class].slabs[slab_index];
+    if (base::subtle::Acquire_Load(slot) != 0) {
+      continue;
+    }
+    char* const slab = new char[stride * kBlocksPerSlab];
+    for (int i = 0; i < kBlocksPerSlab; ++i) {
+      BlockHeader* const block =
+          reinterpret_cast<BlockHeader*>(slab + i * stride);
+      block->size_class = static_cast<uint16>(size_class);
+      block->index = static_cast<uint16>(slab_index * kBlocksPerSlab + i);
+      // Link each block to the one after it.  PushBlocks will set the link
+      // for the last one.
+      block->next = block->index + 2;
+    }
+    // If two threads try to add a slab at once, the loser moves on to the
+    // next slot; an extra slab does no harm.
+    if (base::subtle::Release_CompareAndSwap(
+            slot, 0, reinterpret_cast<base::subtle::AtomicWord>(slab)) != 0) {
+      delete[] slab;
+      continue;
+    }
+    base::subtle::NoBarrier_AtomicIncrement(&g_num_system_allocations, 1);
+    PushBlocks(reinterpret_cast<BlockHeader*>(slab + stride),
+               reinterpret_cast<BlockHeader*>(
+                   slab + (kBlocksPerSlab - 1) * stride));
+    return reinterpret_cast<BlockHeader*>(slab);
+  }
+  return NULL;
+}
+
+}  // namespace
+
+namespace mod_spdy {
+
+// static
+void* SpdyFramePool::Allocate(size_t size) {
+  for (int size_class = 0; size_class < kNumSizeClasses; ++size_class) {
+    if (size <= kBlockSizes[size_class]) {
+      BlockHeader* block = PopBlock(size_class);
+      if (block == NULL) {
+        block = AddSlab(size_class);
+      }
+      if (block != NULL) {
+        return block + 1;
+      }
+      // The size class is full, so fall back to the system allocator.
+      break;
+    }
+  }
+  base::subtle::NoBarrier_AtomicIncrement(&g_num_system_allocations, 1);
+  BlockHeader* const block = static_cast<BlockHeader*>(
+      ::operator new(sizeof(BlockHeader) + size));
+  block->size_class = kUnpooled;
+  return block + 1;
+}
+
+// static
+void SpdyFramePool::Free(void* pointer) {
+  if (pointer == NULL) {
+    return;
+  }
+  BlockHeader* const block = static_cast<BlockHeader*>(pointer) - 1;
+  if (block->size_class == kUnpooled) {
+    ::operator delete(block);
+    return;
+  }
+  DCHECK_LT(block->size_class, kNumSizeClasses);
+  PushBlocks(block, block);
+}
+
+// static
+int SpdyFramePool::num_system_allocations() {
+  return base::subtle::NoBarrier_Load(&g_num_system_allocations);
+}
+
+}  // namespace mod_spdy
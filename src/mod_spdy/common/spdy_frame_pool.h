@@ -0,0 +1,92 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_COMMON_SPDY_FRAME_POOL_H_
+#define MOD_SPDY_COMMON_SPDY_FRAME_POOL_H_
+
+#include <cstddef>
+
+#include "base/basictypes.h"
+#include "net/spdy/spdy_protocol.h"
+
+namespace mod_spdy {
+
+// A process-wide pool of memory for SPDY frame objects.  Nearly every frame we
+// handle is created on one thread and deleted on another (a DATA frame is
+// created by a stream thread and deleted by the connection thread once it has
+// been sent, and vice versa for input frames), which is about the worst case
+// for malloc.  The pool instead keeps one free list per size class, and on
+// 64-bit builds both allocating and freeing a block are a single
+// compare-and-swap, from any thread (32-bit builds, lacking a wide enough
+// compare-and-swap, take a short per-size-class lock instead).  Memory is
+// taken from the system a slab at a time and is never given back, so the
+// pool's size is that of the most frames ever alive at once.
+class SpdyFramePool {
+ public:
+  // Allocate a block of at least the given size.  Blocks too big for any size
+  // class (or allocated when the pool has reached its maximum size) come from
+  // the system allocator instead, but must still be freed with Free.
+  static void* Allocate(size_t size);
+
+  // Return a block obtained from Allocate to the pool.  This may be called on
+  // any thread.  Does nothing if pointer is NULL.
+  static void Free(void* pointer);
+
+  // Return the number of times the pool has gone to the system allocator
+  // since the process started, for a new slab or for an unpooled block.  In
+  // the steady state this should stop increasing.
+  static int num_system_allocations();
+
+ private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(SpdyFramePool);
+};
+
+// A frame class whose objects are allocated from the SpdyFramePool.  Since
+// frames are always deleted through a net::SpdyFrameIR pointer, whose
+// destructor is virtual, the memory goes back to the pool no matter who
+// deletes the frame (SpdyFrameQueue, SpdyFramePriorityQueue,
+// SpdySession::SendFrame, or anyone else) without them having to know about
+// the pool.  The same goes for subclasses, such as BackedSpdyDataIR.
+template <class FrameIR>
+class PooledFrame : public FrameIR {
+ public:
+  template <typename A>
+  explicit PooledFrame(const A& a) : FrameIR(a) {}
+  template <typename A, typename B>
+  PooledFrame(const A& a, const B& b) : FrameIR(a, b) {}
+  virtual ~PooledFrame() {}
+
+  static void* operator new(size_t size) {
+    return SpdyFramePool::Allocate(size);
+  }
+  static void operator delete(void* pointer) {
+    SpdyFramePool::Free(pointer);
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PooledFrame);
+};
+
+// The frame types that we create for every stream.  (SETTINGS, PING, and
+// GOAWAY frames are rare enough that they aren't worth pooling.)
+typedef PooledFrame<net::SpdyDataIR> PooledSpdyDataIR;
+typedef PooledFrame<net::SpdyHeadersIR> PooledSpdyHeadersIR;
+typedef PooledFrame<net::SpdyRstStreamIR> PooledSpdyRstStreamIR;
+typedef PooledFrame<net::SpdySynReplyIR> PooledSpdySynReplyIR;
+typedef PooledFrame<net::SpdySynStreamIR> PooledSpdySynStreamIR;
+typedef PooledFrame<net::SpdyWindowUpdateIR> PooledSpdyWindowUpdateIR;
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_SPDY_FRAME_POOL_H_
@@ -0,0 +1,198 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/spdy_frame_pool.h"
+
+#include <cstring>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
+#include "mod_spdy/common/testing/async_task_runner.h"
+#include "net/spdy/spdy_protocol.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+using mod_spdy::PooledSpdyDataIR;
+using mod_spdy::SpdyFramePool;
+
+// Create and delete the frames for one simple request: a SYN_STREAM in, then
+// a SYN_REPLY and some DATA frames out, with a WINDOW_UPDATE along the way.
+void SimulateRequest() {
+  std::vector<net::SpdyFrameIR*> frames;
+  frames.push_back(new mod_spdy::PooledSpdySynStreamIR(1));
+  frames.push_back(new mod_spdy::PooledSpdySynReplyIR(1));
+  for (int i = 0; i < 4; ++i) {
+    frames.push_back(new PooledSpdyDataIR(1, base::StringPiece("foobar")));
+  }
+  frames.push_back(new mod_spdy::PooledSpdyWindowUpdateIR(1, 6));
+  frames.push_back(new PooledSpdyDataIR(1, base::StringPiece()));
+  for (size_t i = 0; i < frames.size(); ++i) {
+    delete frames[i];
+  }
+}
+
+TEST(SpdyFramePoolTest, ReusesFreedFrames) {
+  scoped_ptr<net::SpdyFrameIR> frame(
+      new PooledSpdyDataIR(1, base::StringPiece("foo")));
+  const void* const address = frame.get();
+  // Delete the frame through a pointer to the base class, as the frame queues
+  // do; its memory should go back to the pool, and be the next handed out.
+  frame.reset();
+  frame.reset(new mod_spdy::PooledSpdyWindowUpdateIR(3, 100));
+  EXPECT_EQ(address, frame.get());
+}
+
+TEST(SpdyFramePoolTest, NoSystemAllocationsInSteadyState) {
+  SimulateRequest();
+  const int before = SpdyFramePool::num_system_allocations();
+  for (int i = 0; i < 1000; ++i) {
+    SimulateRequest();
+  }
+  EXPECT_EQ(before, SpdyFramePool::num_system_allocations());
+}
+
+TEST(SpdyFramePoolTest, LargeBlocks) {
+  const int before = SpdyFramePool::num_system_allocations();
+  char* block = static_cast<char*>(SpdyFramePool::Allocate(1000));
+  memset(block, 'x', 1000);
+  EXPECT_EQ(before + 1, SpdyFramePool::num_system_allocations());
+  SpdyFramePool::Free(block);
+  SpdyFramePool::Free(NULL);
+}
+
+// Repeatedly allocates a batch of blocks, stamps each one with an ID, checks
+// that none of them has been stamped by anyone else in the meantime, and
+// frees them.  If the pool ever handed out the same block twice, the stamps
+// would clash.
+class AllocateAndFreeTask : public mod_spdy::testing::AsyncTaskRunner::Task {
+ public:
+  explicit AllocateAndFreeTask(int id) : id_(id), clashes_(0) {}
+  virtual void Run() {
+    std::vector<int*> blocks;
+    for (int round = 0; round < 2000; ++round) {
+      for (int i = 0; i < 50; ++i) {
+        int* block = static_cast<int*>(SpdyFramePool::Allocate(sizeof(int)));
+        *block = id_;
+        blocks.push_back(block);
+      }
+      for (size_t i = 0; i < blocks.size(); ++i) {
+        if (*blocks[i] != id_) {
+          ++clashes_;
+        }
+        SpdyFramePool::Free(blocks[i]);
+      }
+      blocks.clear();
+    }
+  }
+  int clashes() const { return clashes_; }
+
+ private:
+  const int id_;
+  int clashes_;
+
+  DISALLOW_COPY_AND_ASSIGN(AllocateAndFreeTask);
+};
+
+TEST(SpdyFramePoolTest, ConcurrentAllocateAndFree) {
+  AllocateAndFreeTask* task1 = new AllocateAndFreeTask(1);
+  AllocateAndFreeTask* task2 = new AllocateAndFreeTask(2);
+  mod_spdy::testing::AsyncTaskRunner runner1(task1);
+  mod_spdy::testing::AsyncTaskRunner runner2(task2);
+  ASSERT_TRUE(runner1.Start());
+  ASSERT_TRUE(runner2.Start());
+  runner1.notification()->ExpectSetWithin(base::TimeDelta::FromSeconds(10));
+  runner2.notification()->ExpectSetWithin(base::TimeDelta::FromSeconds(10));
+  EXPECT_EQ(0, task1->clashes());
+  EXPECT_EQ(0, task2->clashes());
+}
+
+// Frees frames on a different thread from the one that allocated them, as
+// happens for every frame we send or receive.
+class DeleteFramesTask : public mod_spdy::testing::AsyncTaskRunner::Task {
+ public:
+  explicit DeleteFramesTask(std::vector<net::SpdyFrameIR*>* frames)
+      : frames_(frames) {}
+  virtual void Run() {
+    for (size_t i = 0; i < frames_->size(); ++i) {
+      delete (*frames_)[i];
+    }
+  }
+
+ private:
+  std::vector<net::SpdyFrameIR*>* const frames_;
+
+  DISALLOW_COPY_AND_ASSIGN(DeleteFramesTask);
+};
+
+TEST(SpdyFramePoolTest, FreeOnAnotherThread) {
+  std::vector<net::SpdyFrameIR*> frames;
+  for (int i = 0; i < 1000; ++i) {
+    frames.push_back(new PooledSpdyDataIR(i * 2 + 1, base::StringPiece("x")));
+  }
+  {
+    mod_spdy::testing::AsyncTaskRunner runner(new DeleteFramesTask(&frames));
+    ASSERT_TRUE(runner.Start());
+    runner.notification()->ExpectSetWithin(base::TimeDelta::FromSeconds(10));
+  }
+  // All those blocks are now free, so we can have them back without going to
+  // the system allocator.
+  const int before = SpdyFramePool::num_system_allocations();
+  for (size_t i = 0; i < frames.size(); ++i) {
+    frames[i] = new PooledSpdyDataIR(1, base::StringPiece());
+  }
+  EXPECT_EQ(before, SpdyFramePool::num_system_allocations());
+  for (size_t i = 0; i < frames.size(); ++i) {
+    delete frames[i];
+  }
+}
+
+// Time creating frames on one thread and deleting them on another, with and
+// without the pool.  This is disabled by default; run it with
+// --gtest_also_run_disabled_tests.
+TEST(SpdyFramePoolBenchmark, DISABLED_CrossThreadFrames) {
+  const int kBatches = 2000;
+  const int kFramesPerBatch = 1000;
+  const base::StringPiece kData("x");
+
+  for (int pooled = 0; pooled < 2; ++pooled) {
+    const int before = SpdyFramePool::num_system_allocations();
+    base::TimeDelta time;
+    for (int batch = 0; batch < kBatches; ++batch) {
+      std::vector<net::SpdyFrameIR*> frames;
+      frames.reserve(kFramesPerBatch);
+      const base::TimeTicks start = base::TimeTicks::Now();
+      for (int i = 0; i < kFramesPerBatch; ++i) {
+        if (pooled) {
+          frames.push_back(new PooledSpdyDataIR(1, kData));
+        } else {
+          frames.push_back(new net::SpdyDataIR(1, kData));
+        }
+      }
+      mod_spdy::testing::AsyncTaskRunner runner(new DeleteFramesTask(&frames));
+      ASSERT_TRUE(runner.Start());
+      runner.notification()->ExpectSetWithin(base::TimeDelta::FromSeconds(10));
+      time += base::TimeTicks::Now() - start;
+    }
+    LOG(INFO) << (pooled ? "pooled: " : "new/delete: ")
+              << time.InMillisecondsF() << " ms, "
+              << (SpdyFramePool::num_system_allocations() - before)
+              << " pool system allocations";
+  }
+}
+
+}  // namespace
@@ -14,71 +14,204 @@
 
 #include "mod_spdy/common/spdy_frame_queue.h"
 
+#include <iterator>
 #include <list>
+#include <vector>
 
+#include "base/atomicops.h"
 #include "base/logging.h"
 #include "base/stl_util.h"
 #include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
+#include "base/threading/platform_thread.h"
 #include "net/spdy/spdy_protocol.h"
 
+namespace {
+
+// How many times a blocking Pop checks for frames (yielding in between)
+// before parking.  Input frames for a stream tend to arrive in bursts, so a
+// short spin saves a futex round trip for the frames after the first, without
+// burning much CPU on streams that are waiting for a slow client.
+const int kSpinCount = 20;
+
+}  // namespace
+
 namespace mod_spdy {
 
-SpdyFrameQueue::SpdyFrameQueue()
-    : condvar_(&lock_), is_aborted_(false) {}
+// static
+const uint32 SpdyFrameQueue::kRingSize;
+
+SpdyFrameQueue::SpdyFrameQueue(base::Lock* lock,
+                               base::ConditionVariable* condvar)
+    : lock_(lock),
+      condvar_(condvar),
+      head_(0),
+      tail_(0),
+      overflowing_(0),
+      aborted_(0),
+      consumer_waiting_(false) {
+  DCHECK(lock_);
+  DCHECK(condvar_);
+  COMPILE_ASSERT((kRingSize & (kRingSize - 1)) == 0,
+                 ring_size_must_be_a_power_of_two);
+}
 
 SpdyFrameQueue::~SpdyFrameQueue() {
-  STLDeleteContainerPointers(queue_.begin(), queue_.end());
+  // No other thread can be using the queue now, and our owner's lock may
+  // already be gone, so don't go through TakeFrames.
+  const uint32 tail = base::subtle::NoBarrier_Load(&tail_);
+  for (uint32 head = base::subtle::NoBarrier_Load(&head_); head != tail;
+       ++head) {
+    delete ring_[head & (kRingSize - 1)];
+  }
+  STLDeleteContainerPointers(overflow_.begin(), overflow_.end());
 }
 
 bool SpdyFrameQueue::is_aborted() const {
-  base::AutoLock autolock(lock_);
-  return is_aborted_;
+  return base::subtle::Acquire_Load(&aborted_) != 0;
 }
 
 void SpdyFrameQueue::Abort() {
-  base::AutoLock autolock(lock_);
-  is_aborted_ = true;
-  STLDeleteContainerPointers(queue_.begin(), queue_.end());
-  queue_.clear();
-  condvar_.Broadcast();
+  lock_->AssertAcquired();
+  // We leave deleting the frames to the consumer, since it may be in the
+  // middle of taking them out of the ring.
+  base::subtle::Release_Store(&aborted_, 1);
+  condvar_->Broadcast();
 }
 
 void SpdyFrameQueue::Insert(net::SpdyFrameIR* frame) {
-  base::AutoLock autolock(lock_);
+  lock_->AssertAcquired();
   DCHECK(frame);
-
-  if (is_aborted_) {
-    DCHECK(queue_.empty());
+  if (is_aborted()) {
     delete frame;
+    return;
+  }
+
+  const uint32 tail = base::subtle::NoBarrier_Load(&tail_);
+  const uint32 head = base::subtle::Acquire_Load(&head_);
+  if (base::subtle::NoBarrier_Load(&overflowing_) == 0 &&
+      tail - head < kRingSize) {
+    ring_[tail & (kRingSize - 1)] = frame;
+    base::subtle::Release_Store(&tail_, tail + 1);
   } else {
-    if (queue_.empty()) {
-      condvar_.Signal();
-    }
-    queue_.push_front(frame);
+    // Either the ring is full, or we've already started overflowing.  Every
+    // frame from now until the consumer empties overflow_ must go there too,
+    // to keep the frames in order.
+    overflow_.push_back(frame);
+    base::subtle::Release_Store(&overflowing_, 1);
+  }
+
+  // Wake the consumer only if it's parked.  The condition variable is shared
+  // with other waiters (e.g. a stream thread waiting for flow control window),
+  // so we must wake everyone when we do wake it, but we don't want to do that
+  // for every frame.  Since the consumer parks with the lock held, we can't
+  // miss it.
+  if (consumer_waiting_) {
+    condvar_->Broadcast();
   }
 }
 
 bool SpdyFrameQueue::Pop(bool block, net::SpdyFrameIR** frame) {
-  base::AutoLock autolock(lock_);
   DCHECK(frame);
+  while (true) {
+    if (is_aborted()) {
+      DeleteAllFrames();
+      return false;
+    }
+    if (TakeFrames(1, frame) != 0) {
+      return true;
+    }
+    if (!block) {
+      return false;
+    }
+    WaitForFrames();
+  }
+}
 
-  if (block) {
-    // Block until the queue is nonempty or we abort.
-    while (queue_.empty() && !is_aborted_) {
-      condvar_.Wait();
+bool SpdyFrameQueue::PopAll(bool block,
+                            std::vector<net::SpdyFrameIR*>* frames) {
+  DCHECK(frames);
+  while (true) {
+    if (is_aborted()) {
+      DeleteAllFrames();
+      return false;
+    }
+    if (TakeFrames(static_cast<size_t>(-1), std::back_inserter(*frames)) != 0) {
+      return true;
     }
+    if (!block) {
+      return false;
+    }
+    WaitForFrames();
   }
+}
 
-  // If we've aborted, the queue should now be empty.
-  DCHECK(!is_aborted_ || queue_.empty());
-  if (queue_.empty()) {
-    return false;
+template <typename OutputIterator>
+size_t SpdyFrameQueue::TakeFrames(size_t max_frames, OutputIterator output) {
+  size_t num_taken = 0;
+  while (num_taken < max_frames) {
+    uint32 head = base::subtle::NoBarrier_Load(&head_);
+    const uint32 tail = base::subtle::Acquire_Load(&tail_);
+    if (head != tail) {
+      while (head != tail && num_taken < max_frames) {
+        *output++ = ring_[head & (kRingSize - 1)];
+        ++head;
+        ++num_taken;
+      }
+      base::subtle::Release_Store(&head_, head);
+      continue;
+    }
+
+    if (base::subtle::Acquire_Load(&overflowing_) == 0) {
+      break;
+    }
+    base::AutoLock autolock(*lock_);
+    // Frames that went into the ring before the producer started overflowing
+    // come first.  Once overflowing_ is set the producer stops adding to the
+    // ring, so this check can't go stale.
+    if (static_cast<uint32>(base::subtle::Acquire_Load(&tail_)) != head) {
+      continue;
+    }
+    while (!overflow_.empty() && num_taken < max_frames) {
+      *output++ = overflow_.front();
+      overflow_.pop_front();
+      ++num_taken;
+    }
+    if (overflow_.empty()) {
+      base::subtle::NoBarrier_Store(&overflowing_, 0);
+    }
+    break;
   }
+  return num_taken;
+}
+
+bool SpdyFrameQueue::HasFrames() const {
+  return (base::subtle::Acquire_Load(&tail_) !=
+          base::subtle::NoBarrier_Load(&head_) ||
+          base::subtle::Acquire_Load(&overflowing_) != 0);
+}
+
+void SpdyFrameQueue::WaitForFrames() {
+  for (int i = 0; i < kSpinCount; ++i) {
+    if (HasFrames() || is_aborted()) {
+      return;
+    }
+    base::PlatformThread::YieldCurrentThread();
+  }
+
+  // The producer inserts with the lock held, so we can't miss its wakeup.
+  base::AutoLock autolock(*lock_);
+  consumer_waiting_ = true;
+  while (!HasFrames() && !is_aborted()) {
+    condvar_->Wait();
+  }
+  consumer_waiting_ = false;
+}
 
-  *frame = queue_.back();
-  queue_.pop_back();
-  return true;
+void SpdyFrameQueue::DeleteAllFrames() {
+  std::vector<net::SpdyFrameIR*> frames;
+  TakeFrames(static_cast<size_t>(-1), std::back_inserter(frames));
+  STLDeleteElements(&frames);
 }
 
 }  // namespace mod_spdy
@@ -16,7 +16,9 @@
 #define MOD_SPDY_COMMON_SPDY_FRAME_QUEUE_H_
 
 #include <list>
+#include <vector>
 
+#include "base/atomicops.h"
 #include "base/basictypes.h"
 #include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
@@ -25,27 +27,45 @@ namespace net { class SpdyFrameIR; }
 
 namespace mod_spdy {
 
-// A simple FIFO queue of SPDY frames, intended for sending input frames from
-// the SPDY connection thread to a SPDY stream thread.  This class is
-// thread-safe -- all methods may be called concurrently by multiple threads.
+// A FIFO queue of SPDY frames, intended for sending input frames from the SPDY
+// connection thread to a SPDY stream thread.  The queue has a single producer
+// and a single consumer: only one thread at a time may call Insert, and only
+// one thread at a time may call Pop or PopAll.  Abort and is_aborted may be
+// called by any thread.
+//
+// The queue has no lock of its own; instead it uses one belonging to its
+// owner (for SpdyStream, the stream's lock), so that each stream needs only
+// one lock and condition variable.  Insert and Abort must be called with that
+// lock held; Pop and PopAll must be called without it.
+//
+// Frames normally pass through a small ring buffer, which the consumer reads
+// without taking the lock.  A consumer that has to block spins briefly before
+// parking on the condition variable, and the producer only wakes it if it's
+// parked.  If the ring fills up (which flow control makes unlikely, at least
+// for SPDY/3), further frames go on an overflow list (protected by the lock)
+// until the consumer has caught up, so that Insert never blocks.
 class SpdyFrameQueue {
  public:
-  // Create an initially-empty queue.
-  SpdyFrameQueue();
+  // Create an initially-empty queue.  The queue does not take ownership of
+  // the lock or condition variable, which the owner may also use for other
+  // purposes; the condition variable must be associated with the lock.
+  SpdyFrameQueue(base::Lock* lock, base::ConditionVariable* condvar);
   ~SpdyFrameQueue();
 
   // Return true if this queue has been aborted.
   bool is_aborted() const;
 
-  // Abort the queue.  All frames held by the queue will be deleted; future
-  // frames passed to Insert() will be immediately deleted; future calls to
-  // Pop() will fail immediately; and current blocking calls to Pop will
-  // immediately unblock and fail.
+  // Abort the queue.  All frames held by the queue will be deleted (by the
+  // consumer's next call to Pop or PopAll, or else when the queue is
+  // destroyed); future frames passed to Insert() will be immediately deleted;
+  // future calls to Pop() will fail immediately; and current blocking calls to
+  // Pop will immediately unblock and fail.  Must be called with the lock held.
   void Abort();
 
   // Insert a frame into the queue.  The queue takes ownership of the frame,
   // and will delete it if the queue is deleted or aborted before the frame is
-  // removed from the queue by the Pop method.
+  // removed from the queue by the Pop method.  Must be called with the lock
+  // held.
   void Insert(net::SpdyFrameIR* frame);
 
   // Remove and provide a frame from the queue and return true, or return false
@@ -54,14 +74,49 @@ class SpdyFrameQueue {
   // caller gains ownership of the provided frame object.
   bool Pop(bool block, net::SpdyFrameIR** frame);
 
+  // Like Pop, but remove all the frames currently in the queue at once,
+  // appending them (in order) to *frames.
+  bool PopAll(bool block, std::vector<net::SpdyFrameIR*>* frames);
+
  private:
-  // This is a pretty naive implementation of a thread-safe queue, but it's
-  // good enough for our purposes.  We could use an apr_queue_t instead of
-  // rolling our own class, but it lacks the ownership semantics that we want.
-  mutable base::Lock lock_;
-  base::ConditionVariable condvar_;
-  std::list<net::SpdyFrameIR*> queue_;
-  bool is_aborted_;
+  // The ring size must be a power of two.  Most streams never have more than
+  // a few input frames waiting at once, so we keep this small.
+  static const uint32 kRingSize = 8;
+
+  // Move up to max_frames frames from the queue to the output iterator, and
+  // return how many were moved.  Only the consumer may call this.
+  template <typename OutputIterator>
+  size_t TakeFrames(size_t max_frames, OutputIterator output);
+
+  // Return true if there are any frames waiting.  Only the consumer may call
+  // this.
+  bool HasFrames() const;
+
+  // Block until there are frames waiting or the queue is aborted.  Only the
+  // consumer may call this.
+  void WaitForFrames();
+
+  // Delete all frames in the queue.  Only the consumer may call this.
+  void DeleteAllFrames();
+
+  base::Lock* const lock_;
+  base::ConditionVariable* const condvar_;
+
+  // The ring buffer.  Frames from index head_ up to tail_ (modulo kRingSize)
+  // are waiting; only the consumer changes head_, and only the producer
+  // changes tail_.
+  net::SpdyFrameIR* ring_[kRingSize];
+  base::subtle::Atomic32 head_;
+  base::subtle::Atomic32 tail_;
+  // Nonzero while frames are going to overflow_ rather than the ring.  Only
+  // the producer sets this, and only the consumer clears it (once overflow_
+  // is empty), both with the lock held.
+  base::subtle::Atomic32 overflowing_;
+  base::subtle::Atomic32 aborted_;
+  // True while the consumer is parked on the condition variable.  Protected
+  // by the lock.
+  bool consumer_waiting_;
+  std::list<net::SpdyFrameIR*> overflow_;  // protected by the lock
 
   DISALLOW_COPY_AND_ASSIGN(SpdyFrameQueue);
 };
@@ -14,8 +14,16 @@
 
 #include "mod_spdy/common/spdy_frame_queue.h"
 
+#include <vector>
+
 #include "base/basictypes.h"
+#include "base/logging.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/stl_util.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
 #include "base/threading/platform_thread.h"
+#include "base/time/time.h"
 #include "mod_spdy/common/testing/async_task_runner.h"
 #include "mod_spdy/common/testing/notification.h"
 #include "mod_spdy/common/testing/spdy_frame_matchers.h"
@@ -27,8 +35,38 @@ namespace {
 
 const int kSpdyVersion = 2;
 
+// A SpdyFrameQueue along with the lock it uses, which Insert and Abort must be
+// called with, as SpdyStream would.
+class TestQueue {
+ public:
+  TestQueue() : condvar_(&lock_), queue_(&lock_, &condvar_) {}
+
+  bool is_aborted() const { return queue_.is_aborted(); }
+  void Abort() {
+    base::AutoLock autolock(lock_);
+    queue_.Abort();
+  }
+  void Insert(net::SpdyFrameIR* frame) {
+    base::AutoLock autolock(lock_);
+    queue_.Insert(frame);
+  }
+  bool Pop(bool block, net::SpdyFrameIR** frame) {
+    return queue_.Pop(block, frame);
+  }
+  bool PopAll(bool block, std::vector<net::SpdyFrameIR*>* frames) {
+    return queue_.PopAll(block, frames);
+  }
+
+ private:
+  base::Lock lock_;
+  base::ConditionVariable condvar_;
+  mod_spdy::SpdyFrameQueue queue_;
+
+  DISALLOW_COPY_AND_ASSIGN(TestQueue);
+};
+
 void ExpectPop(bool block, net::SpdyStreamId expected,
-               mod_spdy::SpdyFrameQueue* queue) {
+               TestQueue* queue) {
   net::SpdyFrameIR* raw_frame = NULL;
   const bool success = queue->Pop(block, &raw_frame);
   scoped_ptr<net::SpdyFrameIR> scoped_frame(raw_frame);
@@ -37,14 +75,14 @@ void ExpectPop(bool block, net::SpdyStreamId expected,
   EXPECT_THAT(*scoped_frame, mod_spdy::testing::IsPing(expected));
 }
 
-void ExpectEmpty(mod_spdy::SpdyFrameQueue* queue) {
+void ExpectEmpty(TestQueue* queue) {
   net::SpdyFrameIR* frame = NULL;
   EXPECT_FALSE(queue->Pop(false, &frame));
   EXPECT_TRUE(frame == NULL);
 }
 
 TEST(SpdyFrameQueueTest, Simple) {
-  mod_spdy::SpdyFrameQueue queue;
+  TestQueue queue;
   ExpectEmpty(&queue);
 
   queue.Insert(new net::SpdyPingIR(4));
@@ -64,7 +102,7 @@ TEST(SpdyFrameQueueTest, Simple) {
 }
 
 TEST(SpdyFrameQueueTest, AbortEmptiesQueue) {
-  mod_spdy::SpdyFrameQueue queue;
+  TestQueue queue;
   ASSERT_FALSE(queue.is_aborted());
   ExpectEmpty(&queue);
 
@@ -82,15 +120,15 @@ TEST(SpdyFrameQueueTest, AbortEmptiesQueue) {
 
 class BlockingPopTask : public mod_spdy::testing::AsyncTaskRunner::Task {
  public:
-  explicit BlockingPopTask(mod_spdy::SpdyFrameQueue* queue) : queue_(queue) {}
+  explicit BlockingPopTask(TestQueue* queue) : queue_(queue) {}
   virtual void Run() { ExpectPop(true, 7, queue_); }
  private:
-  mod_spdy::SpdyFrameQueue* const queue_;
+  TestQueue* const queue_;
   DISALLOW_COPY_AND_ASSIGN(BlockingPopTask);
 };
 
 TEST(SpdyFrameQueueTest, BlockingPop) {
-  mod_spdy::SpdyFrameQueue queue;
+  TestQueue queue;
 
   // Start a task that will do a blocking pop from the queue.
   mod_spdy::testing::AsyncTaskRunner runner(new BlockingPopTask(&queue));
@@ -109,4 +147,155 @@ TEST(SpdyFrameQueueTest, BlockingPop) {
   ExpectEmpty(&queue);
 }
 
+TEST(SpdyFrameQueueTest, PopAll) {
+  TestQueue queue;
+  std::vector<net::SpdyFrameIR*> frames;
+  EXPECT_FALSE(queue.PopAll(false, &frames));
+  EXPECT_TRUE(frames.empty());
+
+  queue.Insert(new net::SpdyPingIR(4));
+  queue.Insert(new net::SpdyPingIR(1));
+  queue.Insert(new net::SpdyPingIR(3));
+  ExpectPop(false, 4, &queue);
+
+  ASSERT_TRUE(queue.PopAll(false, &frames));
+  ASSERT_EQ(2u, frames.size());
+  EXPECT_THAT(*frames[0], mod_spdy::testing::IsPing(1));
+  EXPECT_THAT(*frames[1], mod_spdy::testing::IsPing(3));
+  STLDeleteElements(&frames);
+  ExpectEmpty(&queue);
+  EXPECT_FALSE(queue.PopAll(false, &frames));
+}
+
+// If the consumer falls behind by more frames than fit in the ring, the rest
+// should still come out, in order.
+TEST(SpdyFrameQueueTest, Overflow) {
+  TestQueue queue;
+  for (net::SpdyPingId id = 1; id <= 200; ++id) {
+    queue.Insert(new net::SpdyPingIR(id));
+  }
+  for (net::SpdyPingId id = 1; id <= 10; ++id) {
+    ExpectPop(false, id, &queue);
+  }
+  // Frames inserted now must still come out after the overflowed ones.
+  queue.Insert(new net::SpdyPingIR(201));
+  std::vector<net::SpdyFrameIR*> frames;
+  ASSERT_TRUE(queue.PopAll(false, &frames));
+  ASSERT_EQ(191u, frames.size());
+  for (size_t i = 0; i < frames.size(); ++i) {
+    EXPECT_THAT(*frames[i], mod_spdy::testing::IsPing(11 + i));
+  }
+  STLDeleteElements(&frames);
+  ExpectEmpty(&queue);
+
+  // Once the consumer has caught up, the ring gets used again.
+  queue.Insert(new net::SpdyPingIR(202));
+  ExpectPop(false, 202, &queue);
+  ExpectEmpty(&queue);
+}
+
+TEST(SpdyFrameQueueTest, AbortDeletesOverflow) {
+  TestQueue queue;
+  for (net::SpdyPingId id = 1; id <= 100; ++id) {
+    queue.Insert(new net::SpdyPingIR(id));
+  }
+  queue.Abort();
+  queue.Insert(new net::SpdyPingIR(101));
+  ExpectEmpty(&queue);
+  std::vector<net::SpdyFrameIR*> frames;
+  EXPECT_FALSE(queue.PopAll(false, &frames));
+  EXPECT_TRUE(frames.empty());
+}
+
+class BlockingPopAllTask : public mod_spdy::testing::AsyncTaskRunner::Task {
+ public:
+  explicit BlockingPopAllTask(TestQueue* queue)
+      : queue_(queue) {}
+  virtual void Run() {
+    std::vector<net::SpdyFrameIR*> frames;
+    EXPECT_FALSE(queue_->PopAll(true, &frames));
+    EXPECT_TRUE(frames.empty());
+  }
+ private:
+  TestQueue* const queue_;
+  DISALLOW_COPY_AND_ASSIGN(BlockingPopAllTask);
+};
+
+TEST(SpdyFrameQueueTest, AbortUnblocksPopAll) {
+  TestQueue queue;
+  mod_spdy::testing::AsyncTaskRunner runner(new BlockingPopAllTask(&queue));
+  ASSERT_TRUE(runner.Start());
+  base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(50));
+  runner.notification()->ExpectNotSet();
+
+  queue.Abort();
+  runner.notification()->ExpectSetWithinMillis(100);
+}
+
+// Pops frames in batches until it has seen num_frames of them, checking that
+// they arrive in order.
+class ConsumerTask : public mod_spdy::testing::AsyncTaskRunner::Task {
+ public:
+  ConsumerTask(TestQueue* queue, int num_frames)
+      : queue_(queue), num_frames_(num_frames) {}
+  virtual void Run() {
+    std::vector<net::SpdyFrameIR*> frames;
+    int num_popped = 0;
+    while (num_popped < num_frames_) {
+      ASSERT_TRUE(queue_->PopAll(true, &frames));
+      for (size_t i = 0; i < frames.size(); ++i) {
+        ++num_popped;
+        ASSERT_EQ(num_popped, static_cast<int>(
+            static_cast<net::SpdyPingIR*>(frames[i])->id()));
+      }
+      STLDeleteElements(&frames);
+    }
+  }
+ private:
+  TestQueue* const queue_;
+  const int num_frames_;
+  DISALLOW_COPY_AND_ASSIGN(ConsumerTask);
+};
+
+TEST(SpdyFrameQueueTest, ProducerAndConsumer) {
+  const int kNumFrames = 100000;
+  TestQueue queue;
+  mod_spdy::testing::AsyncTaskRunner runner(
+      new ConsumerTask(&queue, kNumFrames));
+  ASSERT_TRUE(runner.Start());
+  for (int i = 1; i <= kNumFrames; ++i) {
+    queue.Insert(new net::SpdyPingIR(i));
+    if (i % 1000 == 0) {
+      // Let the consumer catch up now and then, so that it has to block.
+      base::PlatformThread::YieldCurrentThread();
+    }
+  }
+  runner.notification()->ExpectSetWithin(base::TimeDelta::FromSeconds(10));
+  ExpectEmpty(&queue);
+}
+
+// Not a real test; this measures how long it takes to pass frames from one
+// thread to another through the queue, in bursts of the sort a client
+// uploading a request body would send.  Run it with
+// --gtest_also_run_disabled_tests.
+TEST(SpdyFrameQueueTest, DISABLED_Benchmark) {
+  const int kNumBursts = 20000;
+  const int kBurstSize = 16;
+  TestQueue queue;
+  mod_spdy::testing::AsyncTaskRunner runner(
+      new ConsumerTask(&queue, kNumBursts * kBurstSize));
+  const base::TimeTicks start = base::TimeTicks::Now();
+  ASSERT_TRUE(runner.Start());
+  int id = 0;
+  for (int burst = 0; burst < kNumBursts; ++burst) {
+    for (int i = 0; i < kBurstSize; ++i) {
+      queue.Insert(new net::SpdyPingIR(++id));
+    }
+    base::PlatformThread::YieldCurrentThread();
+  }
+  runner.notification()->ExpectSetWithin(base::TimeDelta::FromSeconds(60));
+  LOG(INFO) << kNumBursts * kBurstSize << " frames in "
+            << (base::TimeTicks::Now() - start).InMilliseconds() << "ms";
+}
+
 }  // namespace
@@ -22,8 +22,14 @@ const bool kDefaultSpdyEnabled = false;
 const int kDefaultMaxStreamsPerConnection = 100;
 const int kDefaultMinThreadsPerProcess = 2;
 const int kDefaultMaxThreadsPerProcess = 10;
+const int kDefaultMinThreadsPerVirtualHost = 1;
+const int kDefaultMaxThreadsPerVirtualHost = 0;  // use the shared pool
+const int kDefaultMaxStreamsPerProcess = 0;  // no limit
 const int kDefaultMaxServerPushDepth = 1;
 const bool kDefaultSendVersionHeader = true;
+const bool kDefaultBuildRequestsDirectly = false;
+const bool kDefaultBuildResponsesDirectly = false;
+const bool kDefaultHttp2Enabled = false;
 const bool kDefaultServerPushDiscoveryEnabled = false;
 const bool kDefaultServerPushDiscoverySendDebugHeaders = false;
 const mod_spdy::spdy::SpdyVersion kDefaultUseSpdyVersionWithoutSsl =
@@ -39,8 +45,14 @@ SpdyServerConfig::SpdyServerConfig()
       max_streams_per_connection_(kDefaultMaxStreamsPerConnection),
       min_threads_per_process_(kDefaultMinThreadsPerProcess),
       max_threads_per_process_(kDefaultMaxThreadsPerProcess),
+      min_threads_per_virtual_host_(kDefaultMinThreadsPerVirtualHost),
+      max_threads_per_virtual_host_(kDefaultMaxThreadsPerVirtualHost),
+      max_streams_per_process_(kDefaultMaxStreamsPerProcess),
       max_server_push_depth_(kDefaultMaxServerPushDepth),
       send_version_header_(kDefaultSendVersionHeader),
+      build_requests_directly_(kDefaultBuildRequestsDirectly),
+      build_responses_directly_(kDefaultBuildResponsesDirectly),
+      http2_enabled_(kDefaultHttp2Enabled),
       server_push_discovery_enabled_(kDefaultServerPushDiscoveryEnabled),
       server_push_discovery_send_debug_headers_(
           kDefaultServerPushDiscoverySendDebugHeaders),
@@ -58,10 +70,21 @@ void SpdyServerConfig::MergeFrom(const SpdyServerConfig& a,
                                      b.min_threads_per_process_);
   max_threads_per_process_.MergeFrom(a.max_threads_per_process_,
                                      b.max_threads_per_process_);
+  min_threads_per_virtual_host_.MergeFrom(a.min_threads_per_virtual_host_,
+                                          b.min_threads_per_virtual_host_);
+  max_threads_per_virtual_host_.MergeFrom(a.max_threads_per_virtual_host_,
+                                          b.max_threads_per_virtual_host_);
+  max_streams_per_process_.MergeFrom(a.max_streams_per_process_,
+                                     b.max_streams_per_process_);
   max_server_push_depth_.MergeFrom(a.max_server_push_depth_,
                                    b.max_server_push_depth_);
   send_version_header_.MergeFrom(
       a.send_version_header_, b.send_version_header_);
+  build_requests_directly_.MergeFrom(a.build_requests_directly_,
+                                     b.build_requests_directly_);
+  build_responses_directly_.MergeFrom(a.build_responses_directly_,
+                                      b.build_responses_directly_);
+  http2_enabled_.MergeFrom(a.http2_enabled_, b.http2_enabled_);
   server_push_discovery_enabled_.MergeFrom(a.server_push_discovery_enabled_,
                                            b.server_push_discovery_enabled_);
   server_push_discovery_send_debug_headers_.MergeFrom(
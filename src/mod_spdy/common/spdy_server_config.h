@@ -45,6 +45,26 @@ class SpdyServerConfig {
     return max_threads_per_process_.get();
   }
 
+  // Return the minimum number of worker threads to spawn per child process
+  // for this server's own thread pool (if it has one; see below).
+  int min_threads_per_virtual_host() const {
+    return min_threads_per_virtual_host_.get();
+  }
+
+  // Return the maximum number of worker threads to spawn per child process
+  // for this server's own thread pool, or zero if this server's SPDY streams
+  // should use the shared per-process thread pool.
+  int max_threads_per_virtual_host() const {
+    return max_threads_per_virtual_host_.get();
+  }
+
+  // Return the maximum number of simultaneous SPDY streams that should be
+  // permitted across all connections in a single child process, or zero for
+  // no process-wide limit.
+  int max_streams_per_process() const {
+    return max_streams_per_process_.get();
+  }
+
   // Return the maximum number of recursive levels to follow
   // X-Associated-Content headers
   int max_server_push_depth() const {
@@ -55,6 +75,23 @@ class SpdyServerConfig {
   // version number.
   bool send_version_header() const { return send_version_header_.get(); }
 
+  // Return true if requests should be filled into Apache's request_rec
+  // directly from the SPDY header block, rather than serialized to HTTP/1.1
+  // text for Apache to parse.
+  bool build_requests_directly() const {
+    return build_requests_directly_.get();
+  }
+
+  // Return true if response status and headers should be taken directly from
+  // Apache's request_rec, rather than serialized to HTTP/1.1 text by Apache's
+  // HTTP_HEADER filter and then parsed again.
+  bool build_responses_directly() const {
+    return build_responses_directly_.get();
+  }
+
+  // Return true if we should offer HTTP/2 (as well as SPDY) to clients.
+  bool http2_enabled() const { return http2_enabled_.get(); }
+
   // Return if SPDY server push discovery is enabled.
   bool server_push_discovery_enabled() const {
     return server_push_discovery_enabled_.get();
@@ -82,8 +119,22 @@ class SpdyServerConfig {
   }
   void set_min_threads_per_process(int n) { min_threads_per_process_.set(n); }
   void set_max_threads_per_process(int n) { max_threads_per_process_.set(n); }
+  void set_min_threads_per_virtual_host(int n) {
+    min_threads_per_virtual_host_.set(n);
+  }
+  void set_max_threads_per_virtual_host(int n) {
+    max_threads_per_virtual_host_.set(n);
+  }
+  void set_max_streams_per_process(int n) { max_streams_per_process_.set(n); }
   void set_max_server_push_depth(int n) { max_server_push_depth_.set(n); }
   void set_send_version_header(bool b) { send_version_header_.set(b); }
+  void set_build_requests_directly(bool b) {
+    build_requests_directly_.set(b);
+  }
+  void set_build_responses_directly(bool b) {
+    build_responses_directly_.set(b);
+  }
+  void set_http2_enabled(bool b) { http2_enabled_.set(b); }
   void set_server_push_discovery_enabled(bool b) {
     return server_push_discovery_enabled_.set(b);
   }
@@ -122,8 +173,14 @@ class SpdyServerConfig {
   Option<int> max_streams_per_connection_;
   Option<int> min_threads_per_process_;
   Option<int> max_threads_per_process_;
+  Option<int> min_threads_per_virtual_host_;
+  Option<int> max_threads_per_virtual_host_;
+  Option<int> max_streams_per_process_;
   Option<int> max_server_push_depth_;
   Option<bool> send_version_header_;
+  Option<bool> build_requests_directly_;
+  Option<bool> build_responses_directly_;
+  Option<bool> http2_enabled_;
   Option<bool> server_push_discovery_enabled_;
   Option<bool> server_push_discovery_send_debug_headers_;
   Option<spdy::SpdyVersion> use_spdy_version_without_ssl_;
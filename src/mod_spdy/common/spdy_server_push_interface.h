@@ -42,6 +42,9 @@ class SpdyServerPushInterface {
     // TOO_MANY_CONCURRENT_PUSHES: The push could not be started right now
     // because there are too many currently active push streams.
     TOO_MANY_CONCURRENT_PUSHES,
+    // SERVER_OVERLOADED: The push was not started because the server is
+    // currently too busy to be doing speculative work.
+    SERVER_OVERLOADED,
     // PUSH_INTERNAL_ERROR: There was an internal error in the SpdySession
     // (typically something that caused a LOG(DFATAL).
     PUSH_INTERNAL_ERROR,
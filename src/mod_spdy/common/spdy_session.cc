@@ -14,16 +14,25 @@
 
 #include "mod_spdy/common/spdy_session.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "base/basictypes.h"
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/synchronization/lock.h"
 #include "base/time/time.h"
+#include "mod_spdy/common/header_block.h"
+#include "mod_spdy/common/http2_framer.h"
 #include "mod_spdy/common/protocol_util.h"
+#include "mod_spdy/common/session_framer.h"
+#include "mod_spdy/common/spdy_frame_pool.h"
 #include "mod_spdy/common/spdy_server_config.h"
 #include "mod_spdy/common/spdy_session_io.h"
 #include "mod_spdy/common/spdy_stream.h"
+#include "mod_spdy/common/spdy_stream_table.h"
 #include "mod_spdy/common/spdy_stream_task_factory.h"
+#include "mod_spdy/common/stream_admission_controller.h"
 #include "net/spdy/spdy_protocol.h"
 
 namespace {
@@ -37,6 +46,43 @@ const net::SpdyStreamId kMaxServerPushStreamId = 0x7FFFFFFEu;
 // push streams at a time.
 const uint32 kInitMaxConcurrentPushes = 100u;
 
+// We only ask the client to persist our congestion window once we've written
+// at least this much since the last time, so that the window has had a chance
+// to open up, and so that we don't send a SETTINGS frame after every small
+// response.
+const uint64 kMinBytesBetweenPersistedSettings = 64 * 1024;
+
+// SETTINGS_CURRENT_CWND is measured in packets.  We size them by the
+// connection's MSS if the transport will tell us, or else assume full-size
+// Ethernet ones.
+const uint32 kDefaultPacketSize = 1460;
+// Bounds for the DATA frame size we choose for a returning client.  The lower
+// bound is the HttpToSpdyConverter's default; the upper bound is the largest
+// payload that, with the 8-byte DATA frame header, still fits in a single TLS
+// record (which carries at most 16384 bytes of plaintext).
+const size_t kMinWarmDataFrameSize = 4096;
+const size_t kMaxWarmDataFrameSize = 16384 - 8;
+
+// Choose a DATA frame size for a client whose congestion window was cwnd
+// packets of mss bytes at the end of its last session: big enough to cut
+// per-frame overhead on a fast connection, but small enough that a window's
+// worth of data still spans several frames, so that higher-priority streams
+// can be interleaved.
+size_t DataFrameSizeForCwnd(uint32 cwnd, uint32 mss) {
+  const uint64 size = static_cast<uint64>(cwnd) * mss / 4;
+  return static_cast<size_t>(std::max<uint64>(
+      kMinWarmDataFrameSize, std::min<uint64>(kMaxWarmDataFrameSize, size)));
+}
+
+mod_spdy::SessionFramer* NewSessionFramer(
+    mod_spdy::spdy::SpdyVersion spdy_version) {
+  if (spdy_version == mod_spdy::spdy::SPDY_VERSION_HTTP2) {
+    return new mod_spdy::Http2Framer;
+  }
+  return new mod_spdy::BufferedSessionFramer(
+      mod_spdy::SpdyVersionToFramerVersion(spdy_version));
+}
+
 }  // namespace
 
 namespace mod_spdy {
@@ -45,24 +91,30 @@ SpdySession::SpdySession(spdy::SpdyVersion spdy_version,
                          const SpdyServerConfig* config,
                          SpdySessionIO* session_io,
                          SpdyStreamTaskFactory* task_factory,
-                         Executor* executor)
+                         Executor* executor,
+                         StreamAdmissionController* admission_controller)
     : spdy_version_(spdy_version),
       config_(config),
       session_io_(session_io),
       task_factory_(task_factory),
       executor_(executor),
-      framer_(SpdyVersionToFramerVersion(spdy_version), true),
+      admission_controller_(admission_controller),
+      framer_(NewSessionFramer(spdy_version)),
       session_stopped_(false),
+      stop_executor_asynchronously_(false),
       already_sent_goaway_(false),
       last_client_stream_id_(0u),
-      initial_window_size_(net::kSpdyStreamInitialWindowSize),
+      initial_window_size_(InitialWindowSizeForVersion(spdy_version)),
+      target_data_frame_size_(0u),
+      bytes_written_since_persist_(0u),
+      max_concurrent_client_streams_(config->max_streams_per_connection()),
       max_concurrent_pushes_(kInitMaxConcurrentPushes),
       last_server_push_stream_id_(0u),
       received_goaway_(false),
       shared_window_(net::kSpdyStreamInitialWindowSize,
-                     net::kSpdyStreamInitialWindowSize) {
+                     InitialWindowSizeForVersion(spdy_version)) {
   DCHECK_NE(spdy::SPDY_VERSION_NONE, spdy_version);
-  framer_.set_visitor(this);
+  framer_->set_visitor(this);
 }
 
 SpdySession::~SpdySession() {}
@@ -78,6 +130,10 @@ int32 SpdySession::current_shared_output_window_size() const {
 }
 
 void SpdySession::Run() {
+  if (admission_controller_ != NULL) {
+    admission_controller_->AddSession();
+  }
+
   // Send a SETTINGS frame when the connection first opens, to inform the
   // client of our MAX_CONCURRENT_STREAMS limit.
   SendSettingsFrame();
@@ -108,13 +164,21 @@ void SpdySession::Run() {
       break;
     }
 
+    // If the process has become overloaded (or has recovered), let the client
+    // know how many streams it may now open.
+    UpdateMaxConcurrentStreams();
+
+    // Set below if we would block on input, but mustn't because we're still
+    // holding this client below its usual stream limit.
+    bool poll_for_new_limit = false;
+
     // Step 1: Read input from the client.
     {
       // Determine whether we should block until more input data is available.
       // For now, our policy is to block only if there is no pending output and
       // there are no currently-active streams (which might produce new
       // output).
-      const bool should_block = StreamMapIsEmpty() && output_queue_.IsEmpty();
+      bool should_block = StreamMapIsEmpty() && output_queue_.IsEmpty();
 
       // If there's no current output, and we can't create new streams (so
       // there will be no future output), then we should just shut down the
@@ -124,14 +188,37 @@ void SpdySession::Run() {
         break;
       }
 
+      // Blocking on input could take arbitrarily long, during which we
+      // couldn't raise the limit again if the process recovers -- and a client
+      // that is waiting for more streams may well have nothing to send until
+      // we do.  So while this client is being held to a reduced limit, poll
+      // instead: step 2 waits on the output queue (with backoff) in place of
+      // the input, and UpdateMaxConcurrentStreams above runs each time round.
+      if (should_block && IsReducingMaxConcurrentStreams()) {
+        should_block = false;
+        poll_for_new_limit = true;
+      }
+
       // Read available input data.  The SpdySessionIO will grab any
-      // available data and push it into the SpdyFramer that we pass to it
-      // here; the SpdyFramer, in turn, will call our OnControl and/or
-      // OnStreamFrameData methods to report decoded frames.  If no input data
-      // is currently available and should_block is true, this will block until
-      // input becomes available (or the connection is closed).
+      // available data and push it into the SessionFramer that we pass to it
+      // here; the framer, in turn, will call our OnSynStream and/or
+      // OnStreamFrameData (etc.) methods to report decoded frames.  If no
+      // input data is currently available and should_block is true, this will
+      // block until input becomes available (or the connection is closed).
       const SpdySessionIO::ReadStatus status =
-          session_io_->ProcessAvailableInput(should_block, &framer_);
+          session_io_->ProcessAvailableInput(should_block, framer_.get());
+      // Send anything the framer must answer by itself (e.g. HTTP/2 SETTINGS
+      // and PING acknowledgements) before any of our own output.
+      {
+        scoped_ptr<const net::SpdySerializedFrame> framer_output(
+            framer_->ReleasePendingOutput());
+        if (framer_output != NULL) {
+          SendFrameRaw(*framer_output);
+        }
+      }
+      // Start up any new streams that the client opened in the input we just
+      // processed, all in one go.
+      AddPendingStreamTasks();
       if (status == SpdySessionIO::READ_SUCCESS) {
         // We successfully did some I/O, so reset the output block timeout.
         output_block_time = kInitOutputBlockTime;
@@ -176,7 +263,8 @@ void SpdySession::Run() {
       // send, if only to prevent this loop from busy-waiting too heavily --
       // not a great solution, but better than nothing for now.
       net::SpdyFrameIR* frame = NULL;
-      if (no_active_streams ? output_queue_.Pop(&frame) :
+      if (no_active_streams && !poll_for_new_limit ?
+          output_queue_.Pop(&frame) :
           output_queue_.BlockingPop(output_block_time, &frame)) {
         do {
           SendFrame(frame);
@@ -190,6 +278,11 @@ void SpdySession::Run() {
         if (already_sent_goaway_ && no_active_streams) {
           StopSession();
         } else {
+          // If the connection has gone idle, now is a good time to tell the
+          // client what we've learned about it.
+          if (no_active_streams) {
+            MaybeSendPersistedSettings();
+          }
           // There were no output frames within the timeout; so do an
           // exponential backoff by doubling output_block_time.
           output_block_time = std::min(kMaxOutputBlockTime,
@@ -206,6 +299,25 @@ void SpdySession::Run() {
     // nonempty (obviously we would abstract that away in SpdySessionIO),
     // but there's not even a nice way to do that (that I know of).
   }
+
+  if (admission_controller_ != NULL) {
+    admission_controller_->RemoveSession();
+  }
+}
+
+void SpdySession::RunAsync(net_instaweb::Function* on_stream_tasks_done) {
+  stop_executor_asynchronously_ = true;
+  Run();
+  DCHECK(session_stopped_);
+  // The caller may destroy the SpdySessionIO as soon as we return, while our
+  // stream tasks are still winding down, so make sure nothing can use it.
+  session_io_ = NULL;
+  // Run() has stopped the session, but hasn't stopped the executor; have the
+  // executor tell us when the stream tasks are all done.  Cancelled tasks will
+  // remove themselves from the stream map, and the callback may delete this
+  // object at any time after that, so we mustn't touch any members after
+  // this call.
+  executor_->StopAsync(on_stream_tasks_done);
 }
 
 SpdyServerPushInterface::PushStatus SpdySession::StartServerPush(
@@ -216,6 +328,12 @@ SpdyServerPushInterface::PushStatus SpdySession::StartServerPush(
   // Server push is pretty ill-defined in SPDY v2, so we require v3 or higher.
   DCHECK_GE(spdy_version(), spdy::SPDY_VERSION_3);
 
+  // HTTP/2 pushes need PUSH_PROMISE frames, which the Http2Framer doesn't
+  // send (yet), so don't push at all on HTTP/2 sessions.
+  if (spdy_version() == spdy::SPDY_VERSION_HTTP2) {
+    return SpdyServerPushInterface::CANNOT_PUSH_EVER_AGAIN;
+  }
+
   // Grab the headers that we are required to send with the initial SYN_STREAM.
   const net::SpdyHeaderBlock::const_iterator host_iter =
       request_headers.find(spdy::kSpdy3Host);
@@ -265,8 +383,7 @@ SpdyServerPushInterface::PushStatus SpdySession::StartServerPush(
     // Server push stream IDs must be even (SPDY draft 3 section 2.3.2).  So
     // each time we do a push, we increment last_server_push_stream_id_ by two.
     DCHECK_EQ(last_server_push_stream_id_ % 2u, 0u);
-    last_server_push_stream_id_ += 2u;
-    const net::SpdyStreamId stream_id = last_server_push_stream_id_;
+    const net::SpdyStreamId stream_id = last_server_push_stream_id_ + 2u;
     // Only the server can create even stream IDs, and we never use the same
     // one twice, so our chosen stream_id should definitely not be in use.
     if (stream_map_.IsStreamActive(stream_id)) {
@@ -275,11 +392,26 @@ SpdyServerPushInterface::PushStatus SpdySession::StartServerPush(
       return SpdyServerPushInterface::PUSH_INTERNAL_ERROR;
     }
 
+    // Server pushes are speculative, so if tasks at this priority are already
+    // waiting too long to run, don't make things worse.
+    if (executor_->ShouldShed(Executor::SERVER_PUSH, priority)) {
+      VLOG(2) << "Server is overloaded; declining to push";
+      return SpdyServerPushInterface::SERVER_OVERLOADED;
+    }
+
+    // Pushed streams count against the process-wide stream budget just like
+    // client streams do; if the process is out of room, don't push.
+    if (admission_controller_ != NULL &&
+        !admission_controller_->TryAdmitStream()) {
+      return SpdyServerPushInterface::TOO_MANY_CONCURRENT_PUSHES;
+    }
+    last_server_push_stream_id_ = stream_id;
+
     // Create task and add it to the stream map.
     task_wrapper = new StreamTaskWrapper(
         this, stream_id, associated_stream_id, server_push_depth, priority);
     stream_map_.AddStreamTask(task_wrapper);
-    net::SpdySynStreamIR* frame = new net::SpdySynStreamIR(stream_id);
+    net::SpdySynStreamIR* frame = new PooledSpdySynStreamIR(stream_id);
     frame->set_associated_to_stream_id(associated_stream_id);
     frame->set_priority(priority);
     frame->set_fin(true);
@@ -290,10 +422,10 @@ SpdyServerPushInterface::PushStatus SpdySession::StartServerPush(
     // Send initial SYN_STREAM to the client.  It only needs to contain the
     // ":host", ":path", and ":scheme" headers; the rest can follow in a later
     // HEADERS frame (SPDY draft 3 section 3.3.1).
-    net::SpdyHeaderBlock initial_response_headers;
-    initial_response_headers[spdy::kSpdy3Host] = host_header;
-    initial_response_headers[spdy::kSpdy3Path] = path_header;
-    initial_response_headers[spdy::kSpdy3Scheme] = scheme_header;
+    HeaderBlock initial_response_headers;
+    initial_response_headers.Set(spdy::kSpdy3Host, host_header);
+    initial_response_headers.Set(spdy::kSpdy3Path, path_header);
+    initial_response_headers.Set(spdy::kSpdy3Scheme, scheme_header);
     task_wrapper->stream()->SendOutputSynStream(
         initial_response_headers, false);
 
@@ -332,23 +464,24 @@ void SpdySession::OnStreamFrameData(
     }
   }
 
-  // Look up the stream to post the data to.  We need to lock when reading the
-  // stream map, because one of the stream threads could call
-  // RemoveStreamTask() at any time.
+  // Look up the stream to post the data to.  One of the stream threads could
+  // call RemoveStreamTask() at any time, but rather than locking the stream
+  // map (and perhaps waiting for a stream thread), we use a ScopedLookup,
+  // which keeps the stream from being deleted until we're done with it.
   {
-    base::AutoLock autolock(stream_map_lock_);
-    SpdyStream* stream = stream_map_.GetStream(stream_id);
+    SpdyStreamTable::ScopedLookup lookup(stream_map_.table(), stream_id);
+    SpdyStream* stream = lookup.stream();
     if (stream != NULL) {
       VLOG(4) << "[stream " << stream_id << "] Received DATA (length="
               << length << ")";
       // Copy the data into an _uncompressed_ SPDY data frame and post it to
       // the stream's input queue.
-      // Note that we must still be holding stream_map_lock_ when we call this
-      // method -- otherwise the stream may be deleted out from under us by the
+      // Note that the lookup must still be in scope when we call this method
+      // -- otherwise the stream may be deleted out from under us by the
       // StreamTaskWrapper destructor.  That's okay -- PostInputFrame is a
       // quick operation and won't block (for any appreciable length of time).
       net::SpdyDataIR* frame =
-          new net::SpdyDataIR(stream_id, base::StringPiece(data, length));
+          new PooledSpdyDataIR(stream_id, base::StringPiece(data, length));
       frame->set_fin(fin);
       stream->PostInputFrame(frame);
       return;
@@ -441,9 +574,31 @@ void SpdySession::OnSynStream(
 
     // Limit the number of simultaneous open streams the client can create;
     // refuse the stream if there are too many currently active (non-push)
-    // streams.
+    // streams.  Note that the limit we've advertised may have been lowered
+    // since the client sent this SYN_STREAM, in which case it's correct to
+    // refuse it (the client can safely retry a refused stream).
     if (static_cast<int>(stream_map_.NumActiveClientStreams()) >=
-        config_->max_streams_per_connection()) {
+        max_concurrent_client_streams_) {
+      SendRstStreamFrame(stream_id, net::RST_STREAM_REFUSED_STREAM);
+      return;
+    }
+
+    // If tasks are waiting too long to run, refuse new lowest-priority
+    // streams until things calm down, rather than queueing them behind
+    // everything else.  The client can retry a refused stream later.
+    if (priority == LowestSpdyPriorityForVersion(spdy_version_) &&
+        executor_->ShouldShed(Executor::LOW_PRIORITY_STREAM, priority)) {
+      VLOG(2) << "Server is overloaded; refusing low-priority stream "
+              << stream_id;
+      SendRstStreamFrame(stream_id, net::RST_STREAM_REFUSED_STREAM);
+      return;
+    }
+
+    // Also refuse the stream if the process as a whole is at its hard limit
+    // for active streams.
+    if (admission_controller_ != NULL &&
+        !admission_controller_->TryAdmitStream()) {
+      VLOG(2) << "Process is overloaded; refusing stream " << stream_id;
       SendRstStreamFrame(stream_id, net::RST_STREAM_REFUSED_STREAM);
       return;
     }
@@ -455,7 +610,7 @@ void SpdySession::OnSynStream(
         0, // server_push_depth = 0
         priority);
     stream_map_.AddStreamTask(task_wrapper);
-    net::SpdySynStreamIR* frame = new net::SpdySynStreamIR(stream_id);
+    net::SpdySynStreamIR* frame = new PooledSpdySynStreamIR(stream_id);
     frame->set_associated_to_stream_id(associated_stream_id);
     frame->set_priority(priority);
     frame->set_slot(credential_slot);
@@ -465,14 +620,15 @@ void SpdySession::OnSynStream(
     task_wrapper->stream()->PostInputFrame(frame);
   }
   DCHECK(task_wrapper);
-  // Release the lock before adding the task to the executor.  This is mostly
-  // for the benefit of unit tests, for which calling AddTask will execute the
-  // task immediately (and we don't want to be holding the lock when that
-  // happens).  Note that it's safe for us to pass task_wrapper here without
+  // Rather than adding the task to the executor right away, save it up so
+  // that all the streams opened by this chunk of input can be added in one
+  // batch once ProcessAvailableInput returns (see AddPendingStreamTasks).
+  // Note that it's safe for us to hold on to task_wrapper here without
   // holding the lock, because the task won't get deleted before it's been
   // added to the executor.
   VLOG(2) << "Received SYN_STREAM; opening stream " << stream_id;
-  executor_->AddTask(task_wrapper, priority);
+  pending_stream_tasks_.push_back(std::make_pair(
+      static_cast<net_instaweb::Function*>(task_wrapper), priority));
 }
 
 void SpdySession::OnSynReply(net::SpdyStreamId stream_id,
@@ -504,14 +660,37 @@ void SpdySession::OnRstStream(net::SpdyStreamId stream_id,
 }
 
 void SpdySession::OnSettings(bool clear_persisted) {
-  // Do nothing; we never persist values, so we don't need to pay attention to
-  // this flag.
+  // If the client is discarding the values we asked it to persist, forget what
+  // we learned from them too.
+  if (clear_persisted) {
+    target_data_frame_size_ = 0u;
+  }
 }
 
 void SpdySession::OnSetting(net::SpdySettingsIds id,
                             uint8 flags, uint32 value) {
   VLOG(4) << "Received SETTING (flags=" << flags << "): "
           << SettingsIdToString(id) << "=" << value;
+  // A persisted setting is one that we asked the client to remember in an
+  // earlier session (see MaybeSendPersistedSettings), not a value of the
+  // client's own; in particular, a persisted INITIAL_WINDOW_SIZE describes a
+  // window that the client is _sending_ into, so we mustn't apply it to ours.
+  if (flags & net::SETTINGS_FLAG_PERSISTED) {
+    if (id == net::SETTINGS_CURRENT_CWND) {
+      // The persisted window is from an earlier connection, but the path (and
+      // so the MSS) is most likely the same as this one's.
+      uint32 current_cwnd = 0u;
+      uint32 mss = 0u;
+      if (!session_io_->GetCongestionWindow(&current_cwnd, &mss) ||
+          mss == 0u) {
+        mss = kDefaultPacketSize;
+      }
+      target_data_frame_size_ = DataFrameSizeForCwnd(value, mss);
+      VLOG(2) << "Client remembered CURRENT_CWND=" << value << "; using "
+              << target_data_frame_size_ << "-byte DATA frames";
+    }
+    return;
+  }
   switch (id) {
     case net::SETTINGS_MAX_CONCURRENT_STREAMS:
       max_concurrent_pushes_ = value;
@@ -593,17 +772,16 @@ void SpdySession::OnGoAway(net::SpdyStreamId last_accepted_stream_id,
 void SpdySession::OnHeaders(net::SpdyStreamId stream_id,
                             bool fin,
                             const net::SpdyHeaderBlock& headers) {
-  // Look up the stream to post the data to.  We need to lock when reading the
-  // stream map, because one of the stream threads could call
-  // RemoveStreamTask() at any time.
+  // Look up the stream to post the data to.  As in OnStreamFrameData, we use
+  // a ScopedLookup rather than locking the stream map.
   {
     // TODO(mdsteele): This is pretty similar to the code in OnStreamFrameData.
     //   Maybe we can factor it out?
-    base::AutoLock autolock(stream_map_lock_);
-    SpdyStream* stream = stream_map_.GetStream(stream_id);
+    SpdyStreamTable::ScopedLookup lookup(stream_map_.table(), stream_id);
+    SpdyStream* stream = lookup.stream();
     if (stream != NULL) {
       VLOG(4) << "[stream " << stream_id << "] Received HEADERS frame";
-      net::SpdySynStreamIR* frame = new net::SpdySynStreamIR(stream_id);
+      net::SpdySynStreamIR* frame = new PooledSpdySynStreamIR(stream_id);
       frame->set_fin(true);
       frame->GetMutableNameValueBlock()->insert(
           headers.begin(), headers.end());
@@ -653,8 +831,8 @@ void SpdySession::OnWindowUpdate(net::SpdyStreamId stream_id,
     return;
   }
 
-  base::AutoLock autolock(stream_map_lock_);
-  SpdyStream* stream = stream_map_.GetStream(stream_id);
+  SpdyStreamTable::ScopedLookup lookup(stream_map_.table(), stream_id);
+  SpdyStream* stream = lookup.stream();
   if (stream == NULL) {
     // We must ignore WINDOW_UPDATE frames for closed streams (SPDY draft 3
     // section 2.6.8).
@@ -675,8 +853,10 @@ void SpdySession::SetInitialWindowSize(uint32 new_init_window_size) {
     return;
   }
 
-  // Validate the new window size; it must be positive, but at most int32max.
-  if (new_init_window_size == 0 ||
+  // Validate the new window size; it must be at most int32max, and for SPDY
+  // it must also be positive (HTTP/2 allows zero; RFC 7540 section 6.9.2).
+  if ((new_init_window_size == 0 &&
+       spdy_version() != spdy::SPDY_VERSION_HTTP2) ||
       new_init_window_size >
       static_cast<uint32>(net::kSpdyMaximumWindowSize)) {
     LOG(WARNING) << "Client sent invalid init window size ("
@@ -684,9 +864,9 @@ void SpdySession::SetInitialWindowSize(uint32 new_init_window_size) {
     SendGoAwayFrame(net::GOAWAY_PROTOCOL_ERROR);
     return;
   }
-  // Sanity check that our current init window size is positive.  It's a signed
-  // int32, so we know it's no more than int32max.
-  DCHECK_GT(initial_window_size_, 0);
+  // Sanity check that our current init window size is non-negative.  It's a
+  // signed int32, so we know it's no more than int32max.
+  DCHECK_GE(initial_window_size_, 0);
   // We can now be sure that this subtraction won't overflow/underflow.
   const int32 delta =
       static_cast<int32>(new_init_window_size) - initial_window_size_;
@@ -703,7 +883,7 @@ void SpdySession::SetInitialWindowSize(uint32 new_init_window_size) {
 void SpdySession::SendFrame(const net::SpdyFrameIR* frame_ptr) {
   scoped_ptr<const net::SpdyFrameIR> frame(frame_ptr);
   scoped_ptr<const net::SpdySerializedFrame> serialized_frame(
-      framer_.SerializeFrame(*frame));
+      framer_->SerializeFrame(*frame));
   if (serialized_frame == NULL) {
     LOG(DFATAL) << "frame compression failed";
     StopSession();
@@ -720,6 +900,7 @@ void SpdySession::SendFrameRaw(const net::SpdySerializedFrame& frame) {
     StopSession();
   } else {
     DCHECK_EQ(SpdySessionIO::WRITE_SUCCESS, status);
+    bytes_written_since_persist_ += frame.size();
   }
 }
 
@@ -733,16 +914,77 @@ void SpdySession::SendGoAwayFrame(net::SpdyGoAwayStatus status) {
 void SpdySession::SendRstStreamFrame(net::SpdyStreamId stream_id,
                                      net::SpdyRstStreamStatus status) {
   output_queue_.Insert(SpdyFramePriorityQueue::kTopPriority,
-                       new net::SpdyRstStreamIR(stream_id, status));
+                       new PooledSpdyRstStreamIR(stream_id, status));
 }
 
 void SpdySession::SendSettingsFrame() {
+  if (admission_controller_ != NULL) {
+    max_concurrent_client_streams_ =
+        admission_controller_->GetMaxConcurrentStreams(
+            config_->max_streams_per_connection());
+  }
+  scoped_ptr<net::SpdySettingsIR> settings(new net::SpdySettingsIR);
+  settings->AddSetting(net::SETTINGS_MAX_CONCURRENT_STREAMS,
+                       false, false, max_concurrent_client_streams_);
+  SendFrame(settings.release());
+}
+
+void SpdySession::UpdateMaxConcurrentStreams() {
+  if (admission_controller_ == NULL || already_sent_goaway_) {
+    return;
+  }
+  const int new_limit = admission_controller_->GetMaxConcurrentStreams(
+      config_->max_streams_per_connection());
+  if (new_limit == max_concurrent_client_streams_) {
+    return;
+  }
+  VLOG(2) << "Changing MAX_CONCURRENT_STREAMS from "
+          << max_concurrent_client_streams_ << " to " << new_limit;
+  max_concurrent_client_streams_ = new_limit;
   scoped_ptr<net::SpdySettingsIR> settings(new net::SpdySettingsIR);
   settings->AddSetting(net::SETTINGS_MAX_CONCURRENT_STREAMS,
-                       false, false, config_->max_streams_per_connection());
+                       false, false, max_concurrent_client_streams_);
   SendFrame(settings.release());
 }
 
+bool SpdySession::IsReducingMaxConcurrentStreams() const {
+  return (admission_controller_ != NULL && !already_sent_goaway_ &&
+          max_concurrent_client_streams_ <
+          config_->max_streams_per_connection());
+}
+
+void SpdySession::MaybeSendPersistedSettings() {
+  // Only do this for SPDY/3 and SPDY/3.1: SPDY/2 clients disagree about how
+  // SETTINGS ids are encoded, and HTTP/2 dropped persistence altogether.
+  if (spdy_version_ < spdy::SPDY_VERSION_3 ||
+      spdy_version_ > spdy::SPDY_VERSION_3_1 || already_sent_goaway_ ||
+      bytes_written_since_persist_ < kMinBytesBetweenPersistedSettings) {
+    return;
+  }
+  bytes_written_since_persist_ = 0u;
+  uint32 cwnd = 0u;
+  uint32 mss = 0u;
+  if (!session_io_->GetCongestionWindow(&cwnd, &mss)) {
+    return;
+  }
+  VLOG(2) << "Asking client to persist CURRENT_CWND=" << cwnd;
+  scoped_ptr<net::SpdySettingsIR> settings(new net::SpdySettingsIR);
+  settings->AddSetting(net::SETTINGS_CURRENT_CWND, true, false, cwnd);
+  SendFrame(settings.release());
+}
+
+void SpdySession::AddPendingStreamTasks() {
+  if (pending_stream_tasks_.empty()) {
+    return;
+  }
+  // We must not be holding stream_map_lock_ here.  This is mostly for the
+  // benefit of unit tests, for which adding a task may execute it immediately
+  // (and the task will remove itself from the stream map when it's deleted).
+  Executor::TaskList tasks;
+  tasks.swap(pending_stream_tasks_);
+  executor_->AddTasks(tasks);
+}
+
 void SpdySession::StopSession() {
   session_stopped_ = true;
   // Abort all remaining streams.  We need to lock when reading the stream
@@ -753,6 +995,15 @@ void SpdySession::StopSession() {
     stream_map_.AbortAllSilently();
   }
   shared_window_.Abort();
+  // Any stream tasks we haven't yet handed to the executor are already in the
+  // stream map (and have now been aborted), so pass them along so that the
+  // executor can cancel them properly below.
+  AddPendingStreamTasks();
+  // If we're running asynchronously, RunAsync() will stop the executor
+  // (without blocking) once we've returned from Run().
+  if (stop_executor_asynchronously_) {
+    return;
+  }
   // Stop all stream threads and tasks for this SPDY session.  This will
   // block until all currently running stream tasks have exited, but since we
   // just aborted all streams, that should hopefully happen fairly soon.  Note
@@ -763,10 +1014,10 @@ void SpdySession::StopSession() {
 
 // Abort the stream without sending anything to the client.
 void SpdySession::AbortStreamSilently(net::SpdyStreamId stream_id) {
-  // We need to lock when reading the stream map, because one of the stream
-  // threads could call RemoveStreamTask() at any time.
-  base::AutoLock autolock(stream_map_lock_);
-  SpdyStream* stream = stream_map_.GetStream(stream_id);
+  // One of the stream threads could call RemoveStreamTask() at any time, so
+  // hold on to the stream with a ScopedLookup while we use it.
+  SpdyStreamTable::ScopedLookup lookup(stream_map_.table(), stream_id);
+  SpdyStream* stream = lookup.stream();
   if (stream != NULL) {
     stream->AbortSilently();
   }
@@ -786,10 +1037,19 @@ void SpdySession::AbortStream(net::SpdyStreamId stream_id,
 // lock the stream_map_lock_ whenever we touch the stream map or its contents.
 void SpdySession::RemoveStreamTask(StreamTaskWrapper* task_wrapper) {
   // We need to lock when touching the stream map, in case the main connection
-  // thread is currently in the middle of reading the stream map.
-  base::AutoLock autolock(stream_map_lock_);
-  VLOG(2) << "Closing stream " << task_wrapper->stream()->stream_id();
-  stream_map_.RemoveStreamTask(task_wrapper);
+  // thread is currently in the middle of reading the stream map.  (If instead
+  // it's using this stream through a ScopedLookup, removing the stream from
+  // the table will wait for it to finish.)
+  {
+    base::AutoLock autolock(stream_map_lock_);
+    VLOG(2) << "Closing stream " << task_wrapper->stream()->stream_id();
+    stream_map_.RemoveStreamTask(task_wrapper);
+  }
+  // Every stream in the map was admitted by the admission controller (if we
+  // have one), so give its slot back.
+  if (admission_controller_ != NULL) {
+    admission_controller_->ReleaseStream();
+  }
 }
 
 bool SpdySession::StreamMapIsEmpty() {
@@ -812,7 +1072,10 @@ SpdySession::StreamTaskWrapper::StreamTaskWrapper(
               server_push_depth, priority, spdy_session_->initial_window_size_,
               &spdy_session_->output_queue_, &spdy_session_->shared_window_,
               spdy_session_),
-      subtask_(spdy_session_->task_factory_->NewStreamTask(&stream_)) {
+      subtask_(NULL) {
+  // Finish setting up the stream before the task factory sees it.
+  stream_.set_target_data_frame_size(spdy_session_->target_data_frame_size_);
+  subtask_ = spdy_session_->task_factory_->NewStreamTask(&stream_);
   CHECK(subtask_);
 }
 
@@ -835,22 +1098,22 @@ SpdySession::SpdyStreamMap::SpdyStreamMap()
 SpdySession::SpdyStreamMap::~SpdyStreamMap() {}
 
 bool SpdySession::SpdyStreamMap::IsEmpty() {
-  DCHECK_LE(num_active_push_streams_, tasks_.size());
-  return tasks_.empty();
+  DCHECK_LE(num_active_push_streams_, streams_.size());
+  return streams_.size() == 0u;
 }
 
 size_t SpdySession::SpdyStreamMap::NumActiveClientStreams() {
-  DCHECK_LE(num_active_push_streams_, tasks_.size());
-  return tasks_.size() - num_active_push_streams_;
+  DCHECK_LE(num_active_push_streams_, streams_.size());
+  return streams_.size() - num_active_push_streams_;
 }
 
 size_t SpdySession::SpdyStreamMap::NumActivePushStreams() {
-  DCHECK_LE(num_active_push_streams_, tasks_.size());
+  DCHECK_LE(num_active_push_streams_, streams_.size());
   return num_active_push_streams_;
 }
 
 bool SpdySession::SpdyStreamMap::IsStreamActive(net::SpdyStreamId stream_id) {
-  return tasks_.count(stream_id) > 0u;
+  return streams_.Get(stream_id) != NULL;
 }
 
 void SpdySession::SpdyStreamMap::AddStreamTask(
@@ -858,13 +1121,11 @@ void SpdySession::SpdyStreamMap::AddStreamTask(
   DCHECK(task_wrapper);
   SpdyStream* stream = task_wrapper->stream();
   DCHECK(stream);
-  net::SpdyStreamId stream_id = stream->stream_id();
-  DCHECK_EQ(0u, tasks_.count(stream_id));
-  tasks_[stream_id] = task_wrapper;
+  streams_.Insert(stream);
   if (stream->is_server_push()) {
     ++num_active_push_streams_;
   }
-  DCHECK_LE(num_active_push_streams_, tasks_.size());
+  DCHECK_LE(num_active_push_streams_, streams_.size());
 }
 
 void SpdySession::SpdyStreamMap::RemoveStreamTask(
@@ -872,42 +1133,37 @@ void SpdySession::SpdyStreamMap::RemoveStreamTask(
   DCHECK(task_wrapper);
   SpdyStream* stream = task_wrapper->stream();
   DCHECK(stream);
-  net::SpdyStreamId stream_id = stream->stream_id();
-  DCHECK_EQ(1u, tasks_.count(stream_id));
-  DCHECK_EQ(task_wrapper, tasks_[stream_id]);
+  DCHECK_EQ(stream, streams_.Get(stream->stream_id()));
   if (stream->is_server_push()) {
     DCHECK_GT(num_active_push_streams_, 0u);
     --num_active_push_streams_;
   }
-  tasks_.erase(stream_id);
-  DCHECK_LE(num_active_push_streams_, tasks_.size());
+  streams_.Remove(stream);
+  DCHECK_LE(num_active_push_streams_, streams_.size());
 }
 
 SpdyStream* SpdySession::SpdyStreamMap::GetStream(
     net::SpdyStreamId stream_id) {
-  TaskMap::const_iterator iter = tasks_.find(stream_id);
-  if (iter == tasks_.end()) {
-    return NULL;
-  }
-  StreamTaskWrapper* task_wrapper = iter->second;
-  DCHECK(task_wrapper);
-  SpdyStream* stream = task_wrapper->stream();
-  DCHECK(stream);
-  DCHECK_EQ(stream_id, stream->stream_id());
+  SpdyStream* stream = streams_.Get(stream_id);
+  DCHECK(stream == NULL || stream->stream_id() == stream_id);
   return stream;
 }
 
 void SpdySession::SpdyStreamMap::AdjustAllOutputWindowSizes(int32 delta) {
-  for (TaskMap::const_iterator iter = tasks_.begin();
-       iter != tasks_.end(); ++iter) {
-    iter->second->stream()->AdjustOutputWindowSize(delta);
+  std::vector<SpdyStream*> streams;
+  streams_.GetAllStreams(&streams);
+  for (std::vector<SpdyStream*>::const_iterator iter = streams.begin();
+       iter != streams.end(); ++iter) {
+    (*iter)->AdjustOutputWindowSize(delta);
   }
 }
 
 void SpdySession::SpdyStreamMap::AbortAllSilently() {
-  for (TaskMap::const_iterator iter = tasks_.begin();
-       iter != tasks_.end(); ++iter) {
-    iter->second->stream()->AbortSilently();
+  std::vector<SpdyStream*> streams;
+  streams_.GetAllStreams(&streams);
+  for (std::vector<SpdyStream*>::const_iterator iter = streams.begin();
+       iter != streams.end(); ++iter) {
+    (*iter)->AbortSilently();
   }
 }
 
@@ -15,16 +15,17 @@
 #ifndef MOD_SPDY_COMMON_SPDY_SESSION_H_
 #define MOD_SPDY_COMMON_SPDY_SESSION_H_
 
-#include <map>
-
 #include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/synchronization/lock.h"
 #include "mod_spdy/common/executor.h"
 #include "mod_spdy/common/protocol_util.h"
+#include "mod_spdy/common/session_framer.h"
 #include "mod_spdy/common/shared_flow_control_window.h"
 #include "mod_spdy/common/spdy_frame_priority_queue.h"
 #include "mod_spdy/common/spdy_server_push_interface.h"
 #include "mod_spdy/common/spdy_stream.h"
+#include "mod_spdy/common/spdy_stream_table.h"
 #include "net/instaweb/util/public/function.h"
 #include "net/spdy/buffered_spdy_framer.h"
 #include "net/spdy/spdy_protocol.h"
@@ -35,6 +36,7 @@ class Executor;
 class SpdySessionIO;
 class SpdyServerConfig;
 class SpdyStreamTaskFactory;
+class StreamAdmissionController;
 
 // Represents a SPDY session with a client.  Given an Executor for processing
 // individual SPDY streams, and a SpdySessionIO for communicating with the
@@ -43,12 +45,15 @@ class SpdyStreamTaskFactory;
 class SpdySession : public net::BufferedSpdyFramerVisitorInterface,
                     public SpdyServerPushInterface {
  public:
-  // The SpdySession does _not_ take ownership of any of these arguments.
+  // The SpdySession does _not_ take ownership of any of these arguments.  The
+  // admission_controller, which enforces a process-wide limit on active
+  // streams shared by all sessions, may be NULL if there is no such limit.
   SpdySession(spdy::SpdyVersion spdy_version,
               const SpdyServerConfig* config,
               SpdySessionIO* session_io,
               SpdyStreamTaskFactory* task_factory,
-              Executor* executor);
+              Executor* executor,
+              StreamAdmissionController* admission_controller);
   virtual ~SpdySession();
 
   // What SPDY version is being used for this session?
@@ -60,9 +65,25 @@ class SpdySession : public net::BufferedSpdyFramerVisitorInterface,
   int32 current_shared_input_window_size() const;
   int32 current_shared_output_window_size() const;
 
+  // The size of the object that the session allocates for each open stream,
+  // which holds the SpdyStream (but not the task that the task factory
+  // creates for it).
+  static size_t GetStreamTaskSizeForTest() {
+    return sizeof(StreamTaskWrapper);
+  }
+
   // Process the session; don't return until the session is finished.
   void Run();
 
+  // Like Run(), but rather than blocking at the end of the session until all
+  // stream tasks have exited, return as soon as we're done with the
+  // connection, and run on_stream_tasks_done (taking ownership of it) once
+  // the last stream task has exited -- possibly on another thread.  The
+  // callback is then responsible for deleting this session (along with its
+  // executor and task factory), which must not be deleted before then.  The
+  // SpdySessionIO, on the other hand, need only outlive this call.
+  void RunAsync(net_instaweb::Function* on_stream_tasks_done);
+
   // BufferedSpdyFramerVisitorInterface methods:
   virtual void OnError(net::SpdyFramer::SpdyError error_code);
   virtual void OnStreamError(
@@ -133,7 +154,7 @@ class SpdySession : public net::BufferedSpdyFramerVisitorInterface,
    private:
     SpdySession* const spdy_session_;
     SpdyStream stream_;
-    net_instaweb::Function* const subtask_;
+    net_instaweb::Function* subtask_;
 
     DISALLOW_COPY_AND_ASSIGN(StreamTaskWrapper);
   };
@@ -141,7 +162,8 @@ class SpdySession : public net::BufferedSpdyFramerVisitorInterface,
   // Helper class for keeping track of active stream tasks, and separately
   // tracking the number of active client/server-initiated streams.  This class
   // is not thread-safe without external synchronization, so it is used below
-  // along with a separate mutex.
+  // along with a separate mutex -- except that the connection thread may look
+  // up streams in table() without the mutex (see SpdyStreamTable).
   class SpdyStreamMap {
    public:
     SpdyStreamMap();
@@ -166,10 +188,12 @@ class SpdySession : public net::BufferedSpdyFramerVisitorInterface,
     // Abort all streams in the map.  Note that this won't immediately empty
     // the map (the tasks still have to shut down).
     void AbortAllSilently();
+    // Get the underlying table, for lock-free lookups by the connection
+    // thread.
+    SpdyStreamTable* table() { return &streams_; }
 
    private:
-    typedef std::map<net::SpdyStreamId, StreamTaskWrapper*> TaskMap;
-    TaskMap tasks_;
+    SpdyStreamTable streams_;
     size_t num_active_push_streams_;
 
     DISALLOW_COPY_AND_ASSIGN(SpdyStreamMap);
@@ -201,6 +225,26 @@ class SpdySession : public net::BufferedSpdyFramerVisitorInterface,
   // SpdyServerConfig object.  This should be done exactly once, at session
   // start.
   void SendSettingsFrame();
+  // If the process-wide stream budget has changed how many concurrent streams
+  // we should allow the client, send a new SETTINGS frame advertising the new
+  // SETTINGS_MAX_CONCURRENT_STREAMS value.
+  void UpdateMaxConcurrentStreams();
+  // True if we're currently advertising a lower MAX_CONCURRENT_STREAMS than
+  // the configured per-connection limit, because the process is overloaded.
+  bool IsReducingMaxConcurrentStreams() const;
+  // If we've sent enough data since we last did so for the connection's
+  // measurements to be worth remembering, send a SETTINGS frame asking the
+  // client to persist the connection's current congestion window, so that we
+  // can pick up where we left off when it next connects.  This should only be
+  // called when the session is idle (e.g. a page has finished loading).
+  void MaybeSendPersistedSettings();
+
+  // Hand all stream tasks created since the last call (by OnSynStream) to the
+  // executor in a single batch.  Streams opened by the client tend to arrive
+  // in bursts (e.g. dozens of SYN_STREAMs in one read when a page loads), so
+  // rather than adding each task separately, we collect them up during each
+  // call to ProcessAvailableInput and submit them together afterwards.
+  void AddPendingStreamTasks();
 
   // Close down the whole session immediately.  Abort all active streams, and
   // then block until all stream threads have shut down.
@@ -224,22 +268,43 @@ class SpdySession : public net::BufferedSpdyFramerVisitorInterface,
   // not be protected by a lock:
   const spdy::SpdyVersion spdy_version_;
   const SpdyServerConfig* const config_;
-  SpdySessionIO* const session_io_;
+  SpdySessionIO* session_io_;  // NULL once RunAsync() has returned
   SpdyStreamTaskFactory* const task_factory_;
   Executor* const executor_;
-  net::BufferedSpdyFramer framer_;
+  StreamAdmissionController* const admission_controller_;
+  // A BufferedSessionFramer for SPDY, or an Http2Framer for HTTP/2.
+  scoped_ptr<SessionFramer> framer_;
   bool session_stopped_;  // StopSession() has been called
+  bool stop_executor_asynchronously_;  // RunAsync() was called
   bool already_sent_goaway_;  // GOAWAY frame has been sent
   net::SpdyStreamId last_client_stream_id_;
   int32 initial_window_size_;  // per-stream initial flow-control window size
+  // The DATA frame payload size to use for new streams (zero for the default),
+  // chosen from the congestion window that a returning client echoes back to
+  // us from a previous session.
+  size_t target_data_frame_size_;
+  // Bytes written to the connection since we last asked the client to persist
+  // the congestion window (see MaybeSendPersistedSettings).
+  uint64 bytes_written_since_persist_;
+  // The SETTINGS_MAX_CONCURRENT_STREAMS value we most recently advertised to
+  // the client; this is at most config_->max_streams_per_connection(), but may
+  // be lower if the process is overloaded.
+  int max_concurrent_client_streams_;
   uint32 max_concurrent_pushes_;  // max number of active server pushes at once
+  // Stream tasks created by OnSynStream that have not yet been passed to the
+  // executor (see AddPendingStreamTasks).  These tasks are already in the
+  // stream map.
+  Executor::TaskList pending_stream_tasks_;
 
   // The stream map must be protected by a lock, because each stream thread
   // will remove itself from the map (by calling RemoveStreamTask) when the
   // stream closes.  You MUST hold the lock to use the stream_map_ OR to use
   // any of the StreamTaskWrapper or SpdyStream objects contained therein
   // (e.g. to post a frame to the stream), otherwise the stream object may be
-  // deleted by another thread while you're using it.  You should NOT be
+  // deleted by another thread while you're using it.  The one exception is
+  // that the connection thread may instead use a SpdyStreamTable::ScopedLookup
+  // on stream_map_.table(), which keeps the stream alive without the lock
+  // (but you must not take the lock while holding one).  You should NOT be
   // holding the lock when you e.g. send a frame to the client, as that may
   // block for a long time.
   base::Lock stream_map_lock_;
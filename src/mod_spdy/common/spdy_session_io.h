@@ -18,12 +18,9 @@
 #include "base/basictypes.h"
 #include "net/spdy/spdy_protocol.h"
 
-namespace net {
-class BufferedSpdyFramer;
-}  // namespace net
-
 namespace mod_spdy {
 
+class SessionFramer;
 class SpdyStream;
 
 // SpdySessionIO is a helper interface for the SpdySession class.  The
@@ -38,7 +35,7 @@ class SpdySessionIO {
  public:
   // Status to describe whether reading succeeded.
   enum ReadStatus {
-    READ_SUCCESS,  // we successfully pushed data into the SpdyFramer
+    READ_SUCCESS,  // we successfully pushed data into the SessionFramer
     READ_NO_DATA,  // no data is currently available
     READ_CONNECTION_CLOSED,  // the connection has been closed
     READ_ERROR  // an unrecoverable error (e.g. client sent malformed data)
@@ -58,11 +55,11 @@ class SpdySessionIO {
   virtual bool IsConnectionAborted() = 0;
 
   // Pull any available input data from the connection and feed it into the
-  // ProcessInput() method of the given SpdyFramer.  If no input data is
+  // ProcessInput() method of the given SessionFramer.  If no input data is
   // currently available and the block argument is true, this should block
   // until more data arrives; otherwise, this should not block.
   virtual ReadStatus ProcessAvailableInput(
-      bool block, net::BufferedSpdyFramer* framer) = 0;
+      bool block, SessionFramer* framer) = 0;
 
   // Send a single SPDY frame to the client as-is; block until it has been
   // sent down the wire.  Return true on success.
@@ -73,6 +70,12 @@ class SpdySessionIO {
   //   probably want to adjust this API a bit.
   virtual WriteStatus SendFrameRaw(const net::SpdySerializedFrame& frame) = 0;
 
+  // If the underlying transport can report them, set *cwnd to the
+  // connection's current congestion window (in packets) and *mss to its
+  // maximum segment size for sending (in bytes), and return true; otherwise,
+  // return false.
+  virtual bool GetCongestionWindow(uint32* cwnd, uint32* mss) = 0;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SpdySessionIO);
 };
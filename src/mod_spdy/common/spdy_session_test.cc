@@ -20,10 +20,14 @@
 #include "base/basictypes.h"
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
+#include "mod_spdy/common/header_block.h"
+#include "mod_spdy/common/hpack_decoder.h"
 #include "mod_spdy/common/protocol_util.h"
+#include "mod_spdy/common/session_framer.h"
 #include "mod_spdy/common/spdy_server_config.h"
 #include "mod_spdy/common/spdy_session_io.h"
 #include "mod_spdy/common/spdy_stream_task_factory.h"
+#include "mod_spdy/common/stream_admission_controller.h"
 #include "mod_spdy/common/testing/spdy_frame_matchers.h"
 #include "mod_spdy/common/thread_pool.h"
 #include "net/instaweb/util/public/function.h"
@@ -36,6 +40,7 @@
 using mod_spdy::testing::IsDataFrame;
 using mod_spdy::testing::IsGoAway;
 using mod_spdy::testing::IsHeaders;
+using mod_spdy::testing::IsPersistSettings;
 using mod_spdy::testing::IsPing;
 using mod_spdy::testing::IsRstStream;
 using mod_spdy::testing::IsSettings;
@@ -51,6 +56,7 @@ using testing::InvokeWithoutArgs;
 using testing::NotNull;
 using testing::Property;
 using testing::Return;
+using testing::SetArgPointee;
 using testing::StrictMock;
 using testing::WithArg;
 
@@ -92,8 +98,9 @@ class MockSpdySessionIO : public mod_spdy::SpdySessionIO {
  public:
   MOCK_METHOD0(IsConnectionAborted, bool());
   MOCK_METHOD2(ProcessAvailableInput,
-               ReadStatus(bool, net::BufferedSpdyFramer*));
+               ReadStatus(bool, mod_spdy::SessionFramer*));
   MOCK_METHOD1(SendFrameRaw, WriteStatus(const net::SpdySerializedFrame&));
+  MOCK_METHOD2(GetCongestionWindow, bool(uint32*, uint32*));
 };
 
 class MockSpdyStreamTaskFactory : public mod_spdy::SpdyStreamTaskFactory {
@@ -127,8 +134,13 @@ ACTION_P4(StartServerPush, task, priority, path, expected_status) {
 
 // gMock action to be used with MockStreamTask::Run.
 ACTION_P(SendResponseHeaders, task) {
-  net::SpdyHeaderBlock headers;
-  AddResponseHeaders(task->stream->spdy_version(), &headers);
+  net::SpdyHeaderBlock spdy_headers;
+  AddResponseHeaders(task->stream->spdy_version(), &spdy_headers);
+  mod_spdy::HeaderBlock headers;
+  for (net::SpdyHeaderBlock::const_iterator iter = spdy_headers.begin();
+       iter != spdy_headers.end(); ++iter) {
+    headers.Set(iter->first, iter->second);
+  }
   if (task->stream->is_server_push()) {
     task->stream->SendOutputHeaders(headers, false);
   } else {
@@ -197,6 +209,20 @@ class InlineExecutor : public mod_spdy::Executor {
   DISALLOW_COPY_AND_ASSIGN(InlineExecutor);
 };
 
+// A Function that sets a flag when run (and fails the test if cancelled).
+class SetFlagFunction : public net_instaweb::Function {
+ public:
+  explicit SetFlagFunction(bool* flag) : flag_(flag) {}
+  virtual ~SetFlagFunction() {}
+ protected:
+  // net_instaweb::Function methods:
+  virtual void Run() { *flag_ = true; }
+  virtual void Cancel() { ADD_FAILURE() << "Function was cancelled"; }
+ private:
+  bool* const flag_;
+  DISALLOW_COPY_AND_ASSIGN(SetFlagFunction);
+};
+
 // A BufferedSpdyFramer visitor that constructs IR objects for the frames it
 // parses.
 class ClientVisitor : public net::BufferedSpdyFramerVisitorInterface {
@@ -323,7 +349,7 @@ class SpdySessionTestBase :
   // Use as gMock action for ProcessAvailableInput:
   //   Invoke(this, &SpdySessionTest::ReadNextInputChunk)
   mod_spdy::SpdySessionIO::ReadStatus ReadNextInputChunk(
-      bool block, net::BufferedSpdyFramer* framer) {
+      bool block, mod_spdy::SessionFramer* framer) {
     if (input_queue_.empty()) {
       return mod_spdy::SpdySessionIO::READ_NO_DATA;
     }
@@ -447,7 +473,7 @@ class SpdySessionTest : public SpdySessionTestBase {
  public:
   SpdySessionTest()
       : session_(spdy_version_, &config_, &session_io_, &task_factory_,
-                 &executor_) {}
+                 &executor_, NULL) {}
 
  protected:
   InlineExecutor executor_;
@@ -493,6 +519,27 @@ TEST_P(SpdySessionTest, SinglePing) {
   EXPECT_TRUE(executor_.stopped());
 }
 
+// Test that RunAsync processes the session just like Run, and then stops the
+// executor and runs the callback.
+TEST_P(SpdySessionTest, RunAsync) {
+  ReceivePingFromClient(47);
+
+  testing::InSequence seq;
+  ExpectSendFrame(IsSettings(net::SETTINGS_MAX_CONCURRENT_STREAMS, 100));
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()));
+  ExpectSendFrame(IsPing(47));
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::READ_CONNECTION_CLOSED));
+  ExpectSendGoAway(0, net::GOAWAY_OK);
+
+  bool done = false;
+  session_.RunAsync(new SetFlagFunction(&done));
+  EXPECT_TRUE(executor_.stopped());
+  EXPECT_TRUE(done);
+}
+
 // Test handling a single stream request.
 TEST_P(SpdySessionTest, SingleStream) {
   MockStreamTask* task = new MockStreamTask;
@@ -710,6 +757,155 @@ TEST_P(SpdySessionNoFlowControlTest, SendGoawayForInitialWindowSize) {
 INSTANTIATE_TEST_CASE_P(Spdy2, SpdySessionNoFlowControlTest, testing::Values(
     mod_spdy::spdy::SPDY_VERSION_2));
 
+// Create another type alias, for tests of persisted settings, which we only
+// use with SPDY v3 and up.
+typedef SpdySessionTest SpdySessionPersistedSettingsTest;
+
+// Test that once we've sent enough data, we ask the client to persist the
+// connection's congestion window when the session goes idle.
+TEST_P(SpdySessionPersistedSettingsTest, AskClientToPersistCwnd) {
+  MockStreamTask* task = new MockStreamTask;
+  executor_.set_run_on_add(false);
+  const net::SpdyStreamId stream_id = 1;
+  ReceiveSynStreamFromClient(stream_id, 2, net::CONTROL_FLAG_FIN);
+  // Exactly fill the initial flow control window, so that the stream never
+  // has to wait for a WINDOW_UPDATE.
+  const std::string body(65536, 'x');
+
+  testing::InSequence seq;
+  ExpectSendFrame(IsSettings(net::SETTINGS_MAX_CONCURRENT_STREAMS, 100));
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()));
+  EXPECT_CALL(task_factory_, NewStreamTask(_))
+      .WillOnce(ReturnMockTask(task));
+  EXPECT_CALL(session_io_, IsConnectionAborted())
+      .WillOnce(DoAll(InvokeWithoutArgs(&executor_, &InlineExecutor::RunAll),
+                      Return(false)));
+  EXPECT_CALL(*task, Run()).WillOnce(DoAll(
+      SendResponseHeaders(task), SendDataFrame(task, body, true)));
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(false), NotNull()));
+  ExpectSendSynReply(stream_id, false);
+  ExpectSendFrame(IsDataFrame(stream_id, true, body));
+  // Now the session is idle, so we should ask the client to persist the
+  // congestion window.
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()));
+  EXPECT_CALL(session_io_, GetCongestionWindow(NotNull(), NotNull()))
+      .WillOnce(DoAll(SetArgPointee<0>(40u), SetArgPointee<1>(1460u),
+                      Return(true)));
+  ExpectSendFrame(IsPersistSettings(net::SETTINGS_CURRENT_CWND, 40));
+  // We only do so once, until we've written enough data again.
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::READ_CONNECTION_CLOSED));
+  ExpectSendGoAway(stream_id, net::GOAWAY_OK);
+
+  session_.Run();
+  EXPECT_TRUE(executor_.stopped());
+}
+
+// Test that when a returning client echoes back the congestion window we asked
+// it to persist, new streams use larger DATA frames, and that other persisted
+// settings (which describe our side of the connection, not the client's) are
+// not applied.
+TEST_P(SpdySessionPersistedSettingsTest, UseCwndPersistedByClient) {
+  net::SettingsMap settings;
+  settings[net::SETTINGS_CURRENT_CWND] =
+      std::make_pair(net::SETTINGS_FLAG_PERSISTED, 40);
+  settings[net::SETTINGS_INITIAL_WINDOW_SIZE] =
+      std::make_pair(net::SETTINGS_FLAG_PERSISTED, 1000);
+  scoped_ptr<net::SpdySerializedFrame> frame(
+      client_framer_.CreateSettings(settings));
+  ReceiveFrameFromClient(*frame);
+  MockStreamTask* task = new MockStreamTask;
+  executor_.set_run_on_add(false);
+  const net::SpdyStreamId stream_id = 1;
+  ReceiveSynStreamFromClient(stream_id, 2, net::CONTROL_FLAG_FIN);
+
+  testing::InSequence seq;
+  ExpectSendFrame(IsSettings(net::SETTINGS_MAX_CONCURRENT_STREAMS, 100));
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()));
+  // The packets are sized by this connection's MSS.
+  EXPECT_CALL(session_io_, GetCongestionWindow(NotNull(), NotNull()))
+      .WillOnce(DoAll(SetArgPointee<0>(10u), SetArgPointee<1>(1400u),
+                      Return(true)));
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()));
+  // 40 packets of 1400 bytes, divided into four frames.
+  EXPECT_CALL(task_factory_, NewStreamTask(AllOf(
+      Property(&mod_spdy::SpdyStream::target_data_frame_size, Eq(14000u)),
+      Property(&mod_spdy::SpdyStream::current_output_window_size,
+               Eq(net::kSpdyStreamInitialWindowSize)))))
+      .WillOnce(ReturnMockTask(task));
+  EXPECT_CALL(session_io_, IsConnectionAborted())
+      .WillOnce(DoAll(InvokeWithoutArgs(&executor_, &InlineExecutor::RunAll),
+                      Return(false)));
+  EXPECT_CALL(*task, Run()).WillOnce(DoAll(
+      SendResponseHeaders(task), SendDataFrame(task, "foobar", true)));
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(false), NotNull()));
+  ExpectSendSynReply(stream_id, false);
+  ExpectSendFrame(IsDataFrame(stream_id, true, "foobar"));
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::READ_CONNECTION_CLOSED));
+  ExpectSendGoAway(stream_id, net::GOAWAY_OK);
+
+  session_.Run();
+  EXPECT_TRUE(executor_.stopped());
+}
+
+INSTANTIATE_TEST_CASE_P(Spdy3, SpdySessionPersistedSettingsTest,
+                        testing::Values(mod_spdy::spdy::SPDY_VERSION_3,
+                                        mod_spdy::spdy::SPDY_VERSION_3_1));
+
+// Test class for tests of the process-wide stream limit.  The admission
+// controller here allows only a single active stream across the "process".
+class SpdySessionAdmissionTest : public SpdySessionTestBase {
+ public:
+  SpdySessionAdmissionTest()
+      : admission_controller_(1, 1),
+        session_(spdy_version_, &config_, &session_io_, &task_factory_,
+                 &executor_, &admission_controller_) {}
+
+ protected:
+  InlineExecutor executor_;
+  mod_spdy::StreamAdmissionController admission_controller_;
+  mod_spdy::SpdySession session_;
+};
+
+// Test that when the process is already at its stream limit (because of a
+// stream on some other session), we advertise a lowered
+// MAX_CONCURRENT_STREAMS and refuse new streams from the client.
+TEST_P(SpdySessionAdmissionTest, RefuseStreamsWhenProcessIsFull) {
+  // Pretend that some other session is using up the only stream slot.
+  admission_controller_.AddSession();
+  ASSERT_TRUE(admission_controller_.TryAdmitStream());
+  ReceiveSynStreamFromClient(1, 2, net::CONTROL_FLAG_FIN);
+
+  testing::InSequence seq;
+  ExpectSendFrame(IsSettings(net::SETTINGS_MAX_CONCURRENT_STREAMS, 1));
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()));
+  ExpectSendFrame(IsRstStream(1, net::RST_STREAM_REFUSED_STREAM));
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::READ_CONNECTION_CLOSED));
+  ExpectSendGoAway(0, net::GOAWAY_OK);
+
+  session_.Run();
+  EXPECT_TRUE(executor_.stopped());
+  EXPECT_EQ(1, admission_controller_.num_active_streams());
+  EXPECT_EQ(1, admission_controller_.num_sessions());
+
+  admission_controller_.ReleaseStream();
+  admission_controller_.RemoveSession();
+}
+
+INSTANTIATE_TEST_CASE_P(Spdy2And3, SpdySessionAdmissionTest, testing::Values(
+    mod_spdy::spdy::SPDY_VERSION_2, mod_spdy::spdy::SPDY_VERSION_3,
+    mod_spdy::spdy::SPDY_VERSION_3_1));
+
 // Test class for flow-control tests.  This uses a ThreadPool Executor, so that
 // we can test concurrency behavior.
 class SpdySessionFlowControlTest : public SpdySessionTestBase {
@@ -721,7 +917,7 @@ class SpdySessionFlowControlTest : public SpdySessionTestBase {
     executor_.reset(thread_pool_.NewExecutor());
     session_.reset(new mod_spdy::SpdySession(
         spdy_version_, &config_, &session_io_, &task_factory_,
-        executor_.get()));
+        executor_.get(), NULL));
   }
 
   void ExpectSendDataGetWindowUpdateBack(
@@ -1067,4 +1263,169 @@ TEST_P(SpdySessionServerPushTest, TooManyConcurrentPushes) {
 INSTANTIATE_TEST_CASE_P(Spdy3, SpdySessionServerPushTest, testing::Values(
     mod_spdy::spdy::SPDY_VERSION_3, mod_spdy::spdy::SPDY_VERSION_3_1));
 
+// The client framer above only speaks SPDY, so the HTTP/2 tests below feed
+// the session raw frames, and check the raw frames it sends back.
+const char kHttp2Preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+// A GET request for http://www.example.com/ (RFC 7541 appendix C.4.1).
+const char kHttp2GetRequestBlock[] =
+    "\x82\x86\x84\x41\x8c\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4\xff";
+
+std::string Http2Uint32(uint32 value) {
+  std::string bytes;
+  bytes.push_back(static_cast<char>(value >> 24));
+  bytes.push_back(static_cast<char>(value >> 16));
+  bytes.push_back(static_cast<char>(value >> 8));
+  bytes.push_back(static_cast<char>(value));
+  return bytes;
+}
+
+std::string Http2Setting(uint16 id, uint32 value) {
+  std::string bytes;
+  bytes.push_back(static_cast<char>(id >> 8));
+  bytes.push_back(static_cast<char>(id));
+  return bytes + Http2Uint32(value);
+}
+
+std::string Http2Frame(uint8 type, uint8 flags, net::SpdyStreamId stream_id,
+                       const std::string& payload) {
+  std::string bytes;
+  bytes.push_back(static_cast<char>(payload.size() >> 16));
+  bytes.push_back(static_cast<char>(payload.size() >> 8));
+  bytes.push_back(static_cast<char>(payload.size()));
+  bytes.push_back(static_cast<char>(type));
+  bytes.push_back(static_cast<char>(flags));
+  return bytes + Http2Uint32(stream_id) + payload;
+}
+
+MATCHER_P(IsRawFrame, bytes, "") {
+  return std::string(arg.data(), arg.size()) == bytes;
+}
+
+// Match a single HTTP/2 HEADERS frame carrying the given headers.  This
+// decodes the block with a fresh HPACK decoder, so it only works for the
+// first header block that the session sends.
+MATCHER_P3(IsHttp2Headers, stream_id, flags, headers, "") {
+  const std::string bytes(arg.data(), arg.size());
+  if (bytes.size() < 9 ||
+      bytes.substr(0, 9) != Http2Frame(0x1, flags, stream_id, std::string(
+          bytes.size() - 9, '\0')).substr(0, 9)) {
+    return false;
+  }
+  mod_spdy::HpackDecoder decoder;
+  net::SpdyHeaderBlock decoded;
+  return decoder.DecodeHeaderBlock(bytes.substr(9), &decoded) &&
+      decoded == headers;
+}
+
+// Create a type alias so that we can run an end-to-end HTTP/2 session, with
+// the real Http2Framer, using the SpdySessionTest fixture.
+typedef SpdySessionTest SpdySessionHttp2Test;
+
+// Test a simple request and response over HTTP/2: the framer's own SETTINGS
+// and PING acks must go out before any stream output, streams get the HTTP/2
+// initial window, and server push is refused.
+TEST_P(SpdySessionHttp2Test, SingleStream) {
+  MockStreamTask* task = new MockStreamTask;
+  executor_.set_run_on_add(true);
+  const std::string ping_payload = "abcdefgh";
+  input_queue_.push_back(
+      std::string(kHttp2Preface) + Http2Frame(0x4, 0x0, 0, "") +
+      Http2Frame(0x6, 0x0, 0, ping_payload) +
+      Http2Frame(0x1, 0x5, 1, kHttp2GetRequestBlock));
+
+  net::SpdyHeaderBlock response_headers;
+  response_headers[mod_spdy::spdy::kSpdy3Status] = "200";
+  response_headers[mod_spdy::http::kContentType] = "text/html";
+
+  testing::InSequence seq;
+  EXPECT_CALL(session_io_, SendFrameRaw(IsRawFrame(
+      Http2Frame(0x4, 0x0, 0, Http2Setting(0x3, 100)))))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::WRITE_SUCCESS));
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()));
+  EXPECT_CALL(task_factory_, NewStreamTask(
+      AllOf(Property(&mod_spdy::SpdyStream::stream_id, Eq(1u)),
+            Property(&mod_spdy::SpdyStream::associated_stream_id, Eq(0u)),
+            Property(&mod_spdy::SpdyStream::current_output_window_size,
+                     Eq(65535)))))
+      .WillOnce(ReturnMockTask(task));
+  EXPECT_CALL(session_io_, SendFrameRaw(IsRawFrame(
+      Http2Frame(0x4, 0x1, 0, "") + Http2Frame(0x6, 0x1, 0, ping_payload))))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::WRITE_SUCCESS));
+  EXPECT_CALL(*task, Run()).WillOnce(DoAll(
+      StartServerPush(task, 3u, "/script.js",
+          mod_spdy::SpdyServerPushInterface::CANNOT_PUSH_EVER_AGAIN),
+      SendResponseHeaders(task), SendDataFrame(task, "foobar", true)));
+  EXPECT_CALL(session_io_, SendFrameRaw(IsHttp2Headers(
+      1u, 0x4, response_headers)))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::WRITE_SUCCESS));
+  EXPECT_CALL(session_io_, SendFrameRaw(IsRawFrame(
+      Http2Frame(0x0, 0x1, 1, "foobar"))))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::WRITE_SUCCESS));
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::READ_CONNECTION_CLOSED));
+  EXPECT_CALL(session_io_, SendFrameRaw(IsRawFrame(
+      Http2Frame(0x7, 0x0, 0, Http2Uint32(1) + Http2Uint32(0)))))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::WRITE_SUCCESS));
+
+  session_.Run();
+  EXPECT_TRUE(executor_.stopped());
+  EXPECT_EQ(65535 - 6, session_.current_shared_output_window_size());
+}
+
+// Unlike SPDY, HTTP/2 allows a SETTINGS_INITIAL_WINDOW_SIZE of zero (RFC 7540
+// section 6.9.2); we should apply it rather than treating it as an error.
+TEST_P(SpdySessionHttp2Test, ZeroInitialWindowSize) {
+  MockStreamTask* task = new MockStreamTask;
+  executor_.set_run_on_add(true);
+  input_queue_.push_back(
+      std::string(kHttp2Preface) +
+      Http2Frame(0x4, 0x0, 0, Http2Setting(0x4, 0)) +
+      Http2Frame(0x1, 0x5, 1, kHttp2GetRequestBlock));
+
+  net::SpdyHeaderBlock response_headers;
+  response_headers[mod_spdy::spdy::kSpdy3Status] = "200";
+  response_headers[mod_spdy::http::kContentType] = "text/html";
+
+  testing::InSequence seq;
+  EXPECT_CALL(session_io_, SendFrameRaw(IsRawFrame(
+      Http2Frame(0x4, 0x0, 0, Http2Setting(0x3, 100)))))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::WRITE_SUCCESS));
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()));
+  EXPECT_CALL(task_factory_, NewStreamTask(
+      AllOf(Property(&mod_spdy::SpdyStream::stream_id, Eq(1u)),
+            Property(&mod_spdy::SpdyStream::current_output_window_size,
+                     Eq(0)))))
+      .WillOnce(ReturnMockTask(task));
+  EXPECT_CALL(session_io_, SendFrameRaw(IsRawFrame(
+      Http2Frame(0x4, 0x1, 0, ""))))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::WRITE_SUCCESS));
+  // With a zero window, the stream can still send its headers and an empty
+  // DATA frame to end the stream.
+  EXPECT_CALL(*task, Run()).WillOnce(DoAll(
+      SendResponseHeaders(task), SendDataFrame(task, "", true)));
+  EXPECT_CALL(session_io_, SendFrameRaw(IsHttp2Headers(
+      1u, 0x4, response_headers)))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::WRITE_SUCCESS));
+  EXPECT_CALL(session_io_, SendFrameRaw(IsRawFrame(
+      Http2Frame(0x0, 0x1, 1, ""))))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::WRITE_SUCCESS));
+  EXPECT_CALL(session_io_, IsConnectionAborted());
+  EXPECT_CALL(session_io_, ProcessAvailableInput(Eq(true), NotNull()))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::READ_CONNECTION_CLOSED));
+  // The GOAWAY must say NO_ERROR, not PROTOCOL_ERROR.
+  EXPECT_CALL(session_io_, SendFrameRaw(IsRawFrame(
+      Http2Frame(0x7, 0x0, 0, Http2Uint32(1) + Http2Uint32(0)))))
+      .WillOnce(Return(mod_spdy::SpdySessionIO::WRITE_SUCCESS));
+
+  session_.Run();
+  EXPECT_TRUE(executor_.stopped());
+}
+
+INSTANTIATE_TEST_CASE_P(Http2, SpdySessionHttp2Test, testing::Values(
+    mod_spdy::spdy::SPDY_VERSION_HTTP2));
+
 }  // namespace
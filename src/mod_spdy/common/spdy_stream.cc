@@ -14,15 +14,20 @@
 
 #include "mod_spdy/common/spdy_stream.h"
 
+#include <vector>
 
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
+#include "mod_spdy/common/backed_data_frame.h"
+#include "mod_spdy/common/header_block.h"
 #include "mod_spdy/common/protocol_util.h"
 #include "mod_spdy/common/shared_flow_control_window.h"
+#include "mod_spdy/common/spdy_frame_pool.h"
 #include "mod_spdy/common/spdy_frame_priority_queue.h"
 #include "mod_spdy/common/spdy_frame_queue.h"
+#include "mod_spdy/common/spdy_version_traits.h"
 #include "net/spdy/spdy_protocol.h"
 
 namespace {
@@ -90,7 +95,9 @@ SpdyStream::SpdyStream(spdy::SpdyVersion spdy_version,
       output_queue_(output_queue),
       shared_window_(shared_window),
       pusher_(pusher),
+      target_data_frame_size_(0u),
       condvar_(&lock_),
+      input_queue_(&lock_, &condvar_),
       aborted_(false),
       output_window_size_(initial_output_window_size),
       // TODO(mdsteele): Make our initial input window size configurable (we
@@ -101,7 +108,8 @@ SpdyStream::SpdyStream(spdy::SpdyVersion spdy_version,
   DCHECK(output_queue_);
   DCHECK(shared_window_ || spdy_version < spdy::SPDY_VERSION_3_1);
   DCHECK(pusher_);
-  DCHECK_GT(output_window_size_, 0);
+  // An HTTP/2 client may set the initial window size to zero.
+  DCHECK_GE(output_window_size_, 0);
   // In SPDY v2, priorities are in the range 0-3; in SPDY v3, they are 0-7.
   DCHECK_GE(priority, 0u);
   DCHECK_LE(priority, LowestSpdyPriorityForVersion(spdy_version));
@@ -175,7 +183,7 @@ void SpdyStream::OnInputDataConsumed(size_t size) {
     if (shared_window_update > 0) {
       output_queue_->Insert(
           SpdyFramePriorityQueue::kTopPriority,
-          new net::SpdyWindowUpdateIR(0, shared_window_update));
+          new PooledSpdyWindowUpdateIR(0, shared_window_update));
     }
   }
 
@@ -222,7 +230,7 @@ void SpdyStream::OnInputDataConsumed(size_t size) {
             static_cast<size_t>(net::kSpdyMaximumWindowSize));
 
   // Send a WINDOW_UPDATE frame to the client and update our window size.
-  SendOutputFrame(new net::SpdyWindowUpdateIR(
+  SendOutputFrame(new PooledSpdyWindowUpdateIR(
       stream_id_, input_bytes_consumed_));
   input_window_size_ += input_bytes_consumed_;
   DCHECK_LE(input_window_size_, net::kSpdyStreamInitialWindowSize);
@@ -304,7 +312,12 @@ bool SpdyStream::GetInputFrame(bool block, net::SpdyFrameIR** frame) {
   return input_queue_.Pop(block, frame);
 }
 
-void SpdyStream::SendOutputSynStream(const net::SpdyHeaderBlock& headers,
+bool SpdyStream::GetInputFrames(bool block,
+                                std::vector<net::SpdyFrameIR*>* frames) {
+  return input_queue_.PopAll(block, frames);
+}
+
+void SpdyStream::SendOutputSynStream(const HeaderBlock& headers,
                                      bool flag_fin) {
   DCHECK(is_server_push());
   base::AutoLock autolock(lock_);
@@ -312,16 +325,16 @@ void SpdyStream::SendOutputSynStream(const net::SpdyHeaderBlock& headers,
     return;
   }
 
-  scoped_ptr<net::SpdySynStreamIR> frame(new net::SpdySynStreamIR(stream_id_));
+  scoped_ptr<net::SpdySynStreamIR> frame(new PooledSpdySynStreamIR(stream_id_));
   frame->set_associated_to_stream_id(associated_stream_id_);
   frame->set_priority(priority_);
   frame->set_fin(flag_fin);
   frame->set_unidirectional(true);
-  frame->GetMutableNameValueBlock()->insert(headers.begin(), headers.end());
+  headers.CopyTo(frame->GetMutableNameValueBlock());
   output_queue_->Insert(SpdyFramePriorityQueue::kTopPriority, frame.release());
 }
 
-void SpdyStream::SendOutputSynReply(const net::SpdyHeaderBlock& headers,
+void SpdyStream::SendOutputSynReply(const HeaderBlock& headers,
                                     bool flag_fin) {
   DCHECK(!is_server_push());
   base::AutoLock autolock(lock_);
@@ -329,38 +342,78 @@ void SpdyStream::SendOutputSynReply(const net::SpdyHeaderBlock& headers,
     return;
   }
 
-  scoped_ptr<net::SpdySynReplyIR> frame(new net::SpdySynReplyIR(stream_id_));
+  scoped_ptr<net::SpdySynReplyIR> frame(new PooledSpdySynReplyIR(stream_id_));
   frame->set_fin(flag_fin);
-  frame->GetMutableNameValueBlock()->insert(headers.begin(), headers.end());
+  headers.CopyTo(frame->GetMutableNameValueBlock());
   SendOutputFrame(frame.release());
 }
 
-void SpdyStream::SendOutputHeaders(const net::SpdyHeaderBlock& headers,
+void SpdyStream::SendOutputHeaders(const HeaderBlock& headers,
                                    bool flag_fin) {
   base::AutoLock autolock(lock_);
   if (aborted_) {
     return;
   }
 
-  scoped_ptr<net::SpdyHeadersIR> frame(new net::SpdyHeadersIR(stream_id_));
+  scoped_ptr<net::SpdyHeadersIR> frame(new PooledSpdyHeadersIR(stream_id_));
   frame->set_fin(flag_fin);
-  frame->GetMutableNameValueBlock()->insert(headers.begin(), headers.end());
+  headers.CopyTo(frame->GetMutableNameValueBlock());
   SendOutputFrame(frame.release());
 }
 
 void SpdyStream::SendOutputDataFrame(base::StringPiece data, bool flag_fin) {
+  SendOutputDataFrames(data, flag_fin, NULL);
+}
+
+void SpdyStream::SendOutputBackedDataFrame(base::StringPiece data,
+                                           bool flag_fin,
+                                           DataFrameBacking* backing) {
+  DCHECK(backing != NULL);
+  SendOutputDataFrames(data, flag_fin, backing);
+}
+
+void SpdyStream::SendOutputDataFrames(base::StringPiece data, bool flag_fin,
+                                      DataFrameBacking* backing) {
   base::AutoLock autolock(lock_);
   if (aborted_) {
     return;
   }
+  switch (spdy_version()) {
+    case spdy::SPDY_VERSION_2:
+      SendOutputDataFramesForVersion<SpdyVersionTraits<spdy::SPDY_VERSION_2> >(
+          data, flag_fin, backing);
+      break;
+    case spdy::SPDY_VERSION_3:
+      SendOutputDataFramesForVersion<SpdyVersionTraits<spdy::SPDY_VERSION_3> >(
+          data, flag_fin, backing);
+      break;
+    case spdy::SPDY_VERSION_3_1:
+      SendOutputDataFramesForVersion<
+          SpdyVersionTraits<spdy::SPDY_VERSION_3_1> >(data, flag_fin, backing);
+      break;
+    default:
+      DCHECK_EQ(spdy::SPDY_VERSION_HTTP2, spdy_version());
+      SendOutputDataFramesForVersion<
+          SpdyVersionTraits<spdy::SPDY_VERSION_HTTP2> >(
+              data, flag_fin, backing);
+      break;
+  }
+}
+
+template <typename Traits>
+void SpdyStream::SendOutputDataFramesForVersion(base::StringPiece data,
+                                                bool flag_fin,
+                                                DataFrameBacking* backing) {
+  lock_.AssertAcquired();
+  DCHECK(Traits::kSpdyVersion == spdy_version());
 
   // Flow control only exists for SPDY v3 and up; for SPDY v2, we can just send
   // the data without regard to the window size.  Even with flow control, we
   // can of course send empty DATA frames at will.
-  if (spdy_version() < spdy::SPDY_VERSION_3 || data.empty()) {
+  if (!Traits::kHasStreamFlowControl || data.empty()) {
     // Suppress empty DATA frames (unless we're setting FLAG_FIN).
     if (!data.empty() || flag_fin) {
-      scoped_ptr<net::SpdyDataIR> frame(new net::SpdyDataIR(stream_id_, data));
+      scoped_ptr<net::SpdyDataIR> frame(NewDataFrame(data, backing));
       frame->set_fin(flag_fin);
       SendOutputFrame(frame.release());
     }
@@ -392,7 +445,7 @@ void SpdyStream::SendOutputDataFrame(base::StringPiece data, bool flag_fin) {
     // window.  Since the call to RequestQuota may block, we need to unlock
     // first.
     int32 length_acquired;
-    if (spdy_version() >= spdy::SPDY_VERSION_3_1) {
+    if (Traits::kHasSessionFlowControl) {
       base::AutoUnlock autounlock(lock_);
       DCHECK(shared_window_);
       length_acquired = shared_window_->RequestOutputQuota(length_desired);
@@ -415,7 +468,7 @@ void SpdyStream::SendOutputDataFrame(base::StringPiece data, bool flag_fin) {
     }
     // Actually send the frame.
     scoped_ptr<net::SpdyDataIR> frame(
-        new net::SpdyDataIR(stream_id_, data.substr(0, length_acquired)));
+        NewDataFrame(data.substr(0, length_acquired), backing));
     frame->set_fin(flag_fin && length_acquired == full_length);
     SendOutputFrame(frame.release());
     data = data.substr(length_acquired);
@@ -436,6 +489,14 @@ void SpdyStream::SendOutputFrame(net::SpdyFrameIR* frame) {
   output_queue_->Insert(static_cast<int>(priority_), frame);
 }
 
+net::SpdyDataIR* SpdyStream::NewDataFrame(base::StringPiece data,
+                                          DataFrameBacking* backing) const {
+  if (backing == NULL) {
+    return new PooledSpdyDataIR(stream_id_, data);
+  }
+  return new BackedSpdyDataIR(stream_id_, data, backing);
+}
+
 void SpdyStream::InternalAbortSilently() {
   lock_.AssertAcquired();
   input_queue_.Abort();
@@ -446,7 +507,7 @@ void SpdyStream::InternalAbortSilently() {
 void SpdyStream::InternalAbortWithRstStream(net::SpdyRstStreamStatus status) {
   lock_.AssertAcquired();
   output_queue_->Insert(SpdyFramePriorityQueue::kTopPriority,
-                        new net::SpdyRstStreamIR(stream_id_, status));
+                        new PooledSpdyRstStreamIR(stream_id_, status));
   // InternalAbortSilently will set aborted_ to true, which will prevent the
   // stream thread from sending any more frames on this stream after the
   // RST_STREAM.
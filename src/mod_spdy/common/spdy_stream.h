@@ -15,17 +15,21 @@
 #ifndef MOD_SPDY_COMMON_SPDY_STREAM_H_
 #define MOD_SPDY_COMMON_SPDY_STREAM_H_
 
+#include <vector>
+
 #include "base/basictypes.h"
 #include "base/strings/string_piece.h"
 #include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
 #include "net/spdy/spdy_protocol.h"
+#include "mod_spdy/common/header_block.h"
 #include "mod_spdy/common/protocol_util.h"
 #include "mod_spdy/common/spdy_frame_queue.h"
 #include "mod_spdy/common/spdy_server_push_interface.h"
 
 namespace mod_spdy {
 
+class DataFrameBacking;
 class SharedFlowControlWindow;
 class SpdyFramePriorityQueue;
 
@@ -73,6 +77,15 @@ class SpdyStream {
   // Get the priority of this stream.
   net::SpdyPriority priority() const { return priority_; }
 
+  // The payload size the session would like this stream's DATA frames to have
+  // (based on what it knows of the connection), or zero if it has no
+  // preference.  The setter may only be called by the connection thread,
+  // before the stream is given to its stream task.
+  size_t target_data_frame_size() const { return target_data_frame_size_; }
+  void set_target_data_frame_size(size_t size) {
+    target_data_frame_size_ = size;
+  }
+
   // Return true if this stream has been aborted and should shut down.
   bool is_aborted() const;
 
@@ -120,20 +133,31 @@ class SpdyStream {
   // gains ownership of the provided frame.
   bool GetInputFrame(bool block, net::SpdyFrameIR** frame);
 
+  // Like GetInputFrame, but get all the frames that are currently available
+  // at once, appending them (in order) to *frames.  The caller gains ownership
+  // of the provided frames.
+  bool GetInputFrames(bool block, std::vector<net::SpdyFrameIR*>* frames);
+
   // Send a SYN_STREAM frame to the client for this stream.  This may only be
   // called if is_server_push() is true.
-  void SendOutputSynStream(const net::SpdyHeaderBlock& headers, bool flag_fin);
+  void SendOutputSynStream(const HeaderBlock& headers, bool flag_fin);
 
   // Send a SYN_REPLY frame to the client for this stream.  This may only be
   // called if is_server_push() is false.
-  void SendOutputSynReply(const net::SpdyHeaderBlock& headers, bool flag_fin);
+  void SendOutputSynReply(const HeaderBlock& headers, bool flag_fin);
 
   // Send a HEADERS frame to the client for this stream.
-  void SendOutputHeaders(const net::SpdyHeaderBlock& headers, bool flag_fin);
+  void SendOutputHeaders(const HeaderBlock& headers, bool flag_fin);
 
   // Send a SPDY data frame to the client on this stream.
   void SendOutputDataFrame(base::StringPiece data, bool flag_fin);
 
+  // Like SendOutputDataFrame, but rather than copying the data, the DATA
+  // frame(s) sent will point into it and hold a reference to the given
+  // backing object, which must keep the data valid for as long as it lives.
+  void SendOutputBackedDataFrame(base::StringPiece data, bool flag_fin,
+                                 DataFrameBacking* backing);
+
   // Initiate a SPDY server push associated with this stream, roughly by
   // pretending that the client sent a SYN_STREAM with the given headers.  To
   // repeat: the headers argument is _not_ the headers that the server will
@@ -149,6 +173,21 @@ class SpdyStream {
   // lock_ to call this method.
   void SendOutputFrame(net::SpdyFrameIR* frame);
 
+  // Implements SendOutputDataFrame and SendOutputBackedDataFrame; backing
+  // may be NULL, in which case the data is copied into each frame.
+  void SendOutputDataFrames(base::StringPiece data, bool flag_fin,
+                            DataFrameBacking* backing);
+  // Implements SendOutputDataFrames for a particular SpdyVersionTraits, so
+  // that the flow control checks are resolved at compile time.  Must be
+  // holding lock_ to call this method.
+  template <typename Traits>
+  void SendOutputDataFramesForVersion(base::StringPiece data, bool flag_fin,
+                                      DataFrameBacking* backing);
+
+  // Create a DATA frame for part of the data passed to SendOutputDataFrames.
+  net::SpdyDataIR* NewDataFrame(base::StringPiece data,
+                                DataFrameBacking* backing) const;
+
   // Aborts the input queue, sets aborted_, and wakes up threads waiting on
   // condvar_.  Must be holding lock_ to call this method.
   void InternalAbortSilently();
@@ -164,20 +203,23 @@ class SpdyStream {
   const net::SpdyStreamId associated_stream_id_;
   const int32 server_push_depth_;
   const net::SpdyPriority priority_;
-  SpdyFrameQueue input_queue_;
   SpdyFramePriorityQueue* const output_queue_;
   SharedFlowControlWindow* const shared_window_;
   SpdyServerPushInterface* const pusher_;
+  // Set only before the stream task is created, so effectively constant.
+  size_t target_data_frame_size_;
 
   // The lock protects the fields below.  The above fields do not require
-  // additional synchronization.
+  // additional synchronization.  The input queue shares the lock and
+  // condition variable (see SpdyFrameQueue), so that a stream needs only one
+  // of each.
   mutable base::Lock lock_;
   base::ConditionVariable condvar_;
+  SpdyFrameQueue input_queue_;
   bool aborted_;
   int32 output_window_size_;
   int32 input_window_size_;
   size_t input_bytes_consumed_;  // consumed since we last sent a WINDOW_UPDATE
-  size_t input_bytes_unconsumed_;  // received but not yet consumed
 
   DISALLOW_COPY_AND_ASSIGN(SpdyStream);
 };
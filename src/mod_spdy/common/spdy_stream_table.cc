@@ -0,0 +1,259 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/spdy_stream_table.h"
+
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/logging.h"
+#include "base/stl_util.h"
+#include "base/threading/platform_thread.h"
+#include "mod_spdy/common/spdy_stream.h"
+#include "net/spdy/spdy_protocol.h"
+
+namespace {
+
+const size_t kMinCapacity = 16;
+
+}  // namespace
+
+namespace mod_spdy {
+
+SpdyStreamTable::ScopedLookup::ScopedLookup(SpdyStreamTable* table,
+                                            net::SpdyStreamId stream_id)
+    : table_(table), stream_(table->AcquireStream(stream_id)) {}
+
+SpdyStreamTable::ScopedLookup::~ScopedLookup() {
+  if (stream_ != NULL) {
+    table_->ReleaseStream();
+  }
+}
+
+SpdyStreamTable::Table::Table(size_t capacity)
+    : mask(capacity - 1), slots(new Slot[capacity]()) {
+  DCHECK_EQ(0u, capacity & mask);
+}
+
+SpdyStreamTable::Table::~Table() {
+  delete[] slots;
+}
+
+SpdyStreamTable::SpdyStreamTable()
+    : table_(reinterpret_cast<base::subtle::AtomicWord>(
+          new Table(kMinCapacity))),
+      table_hazard_(0),
+      stream_hazard_(0),
+      size_(0),
+      num_used_slots_(0) {}
+
+SpdyStreamTable::~SpdyStreamTable() {
+  DCHECK_EQ(0, base::subtle::NoBarrier_Load(&stream_hazard_));
+  delete reinterpret_cast<Table*>(base::subtle::NoBarrier_Load(&table_));
+  STLDeleteElements(&retired_tables_);
+}
+
+SpdyStream* SpdyStreamTable::Get(net::SpdyStreamId stream_id) const {
+  const Slot* slot = FindSlot(
+      reinterpret_cast<const Table*>(base::subtle::NoBarrier_Load(&table_)),
+      stream_id);
+  return slot == NULL ? NULL : reinterpret_cast<SpdyStream*>(slot->stream);
+}
+
+void SpdyStreamTable::Insert(SpdyStream* stream) {
+  DCHECK(stream);
+  const net::SpdyStreamId stream_id = stream->stream_id();
+  DCHECK_NE(0u, stream_id);
+  DCHECK(Get(stream_id) == NULL);
+
+  // Take the first free slot (never used, or a tombstone) that a lookup for
+  // this ID would come to.  Any slot after that holding the same ID must be a
+  // tombstone, so the lookup will never get that far.
+  Table* table = reinterpret_cast<Table*>(
+      base::subtle::NoBarrier_Load(&table_));
+  size_t index = stream_id & table->mask;
+  while (table->slots[index].stream != 0) {
+    index = (index + 1) & table->mask;
+  }
+  if (table->slots[index].stream_id == 0) {
+    // We're about to use up a new slot.  If that would fill more than half of
+    // the table, move to a bigger one instead.
+    if ((num_used_slots_ + 1) * 2 > table->mask + 1) {
+      Grow();
+      Insert(stream);
+      return;
+    }
+    ++num_used_slots_;
+  }
+
+  // If the reader sees the new ID before the new stream, it'll find a
+  // tombstone or an empty slot, which is fine, since the stream isn't in the
+  // table yet.  If it sees the new stream with an old ID, it'll notice that
+  // the stream has the wrong ID.
+  Slot* slot = &table->slots[index];
+  base::subtle::NoBarrier_Store(&slot->stream_id, stream_id);
+  base::subtle::Release_Store(
+      &slot->stream, reinterpret_cast<base::subtle::AtomicWord>(stream));
+  ++size_;
+}
+
+void SpdyStreamTable::Remove(SpdyStream* stream) {
+  DCHECK(stream);
+  Slot* slot = FindSlot(
+      reinterpret_cast<const Table*>(base::subtle::NoBarrier_Load(&table_)),
+      stream->stream_id());
+  const base::subtle::AtomicWord stream_value =
+      reinterpret_cast<base::subtle::AtomicWord>(stream);
+  DCHECK(slot != NULL);
+  DCHECK_EQ(stream_value, slot->stream);
+  base::subtle::Release_Store(&slot->stream, 0);
+  DCHECK_GT(size_, 0u);
+  --size_;
+
+  // The reader will now never find the stream.  If it already has, wait until
+  // it's done with it.  Lookups are quick, so spinning is fine.
+  base::subtle::MemoryBarrier();
+  while (base::subtle::Acquire_Load(&stream_hazard_) == stream_value) {
+    base::PlatformThread::YieldCurrentThread();
+  }
+}
+
+void SpdyStreamTable::GetAllStreams(std::vector<SpdyStream*>* streams) const {
+  DCHECK(streams);
+  const Table* table = reinterpret_cast<const Table*>(
+      base::subtle::NoBarrier_Load(&table_));
+  for (size_t index = 0; index <= table->mask; ++index) {
+    if (table->slots[index].stream != 0) {
+      streams->push_back(
+          reinterpret_cast<SpdyStream*>(table->slots[index].stream));
+    }
+  }
+}
+
+// static
+SpdyStreamTable::Slot* SpdyStreamTable::FindSlot(
+    const Table* table, net::SpdyStreamId stream_id) {
+  // The table is never more than half full, so this will always terminate.
+  size_t index = stream_id & table->mask;
+  while (true) {
+    Slot* slot = &table->slots[index];
+    const base::subtle::Atomic32 slot_stream_id =
+        base::subtle::Acquire_Load(&slot->stream_id);
+    if (slot_stream_id == 0) {
+      return NULL;
+    }
+    if (static_cast<net::SpdyStreamId>(slot_stream_id) == stream_id) {
+      return slot;
+    }
+    index = (index + 1) & table->mask;
+  }
+}
+
+SpdyStream* SpdyStreamTable::AcquireStream(net::SpdyStreamId stream_id) {
+  DCHECK_EQ(0, base::subtle::NoBarrier_Load(&stream_hazard_))
+      << "Only one ScopedLookup may exist at a time";
+  while (true) {
+    // Protect the table we're about to search, and make sure it's still the
+    // current one (so that Grow can't have missed our hazard pointer).
+    const base::subtle::AtomicWord table_value =
+        base::subtle::Acquire_Load(&table_);
+    base::subtle::NoBarrier_Store(&table_hazard_, table_value);
+    base::subtle::MemoryBarrier();
+    if (base::subtle::Acquire_Load(&table_) != table_value) {
+      continue;
+    }
+
+    const Slot* slot = FindSlot(reinterpret_cast<const Table*>(table_value),
+                                stream_id);
+    const base::subtle::AtomicWord stream_value =
+        (slot == NULL ? 0 : base::subtle::Acquire_Load(&slot->stream));
+    if (stream_value == 0) {
+      base::subtle::Release_Store(&table_hazard_, 0);
+      return NULL;
+    }
+
+    // Protect the stream, then make sure it hasn't been removed in the
+    // meantime, either from this table or (if the table has since been
+    // replaced) from the new one.  If not, Remove will see our hazard pointer
+    // and wait for us.
+    base::subtle::NoBarrier_Store(&stream_hazard_, stream_value);
+    base::subtle::MemoryBarrier();
+    const bool still_there =
+        base::subtle::Acquire_Load(&table_) == table_value &&
+        base::subtle::Acquire_Load(&slot->stream) == stream_value;
+    base::subtle::Release_Store(&table_hazard_, 0);
+    if (still_there) {
+      // If the slot was a tombstone for our stream ID that has just been
+      // reused, we've found some other stream, so ours is gone.
+      SpdyStream* stream = reinterpret_cast<SpdyStream*>(stream_value);
+      if (stream->stream_id() == stream_id) {
+        return stream;
+      }
+      base::subtle::Release_Store(&stream_hazard_, 0);
+      return NULL;
+    }
+    base::subtle::Release_Store(&stream_hazard_, 0);
+  }
+}
+
+void SpdyStreamTable::ReleaseStream() {
+  DCHECK_NE(0, base::subtle::NoBarrier_Load(&stream_hazard_));
+  base::subtle::Release_Store(&stream_hazard_, 0);
+}
+
+void SpdyStreamTable::Grow() {
+  Table* old_table = reinterpret_cast<Table*>(
+      base::subtle::NoBarrier_Load(&table_));
+  // Leave room for the table to fill up to four times the current number of
+  // streams before we have to do this again.  (If most of the used slots are
+  // tombstones, the new table may be no bigger than the old one.)
+  size_t capacity = kMinCapacity;
+  while (capacity < (size_ + 1) * 4) {
+    capacity *= 2;
+  }
+  Table* new_table = new Table(capacity);
+  for (size_t index = 0; index <= old_table->mask; ++index) {
+    const Slot& old_slot = old_table->slots[index];
+    if (old_slot.stream == 0) {
+      continue;
+    }
+    size_t new_index = old_slot.stream_id & new_table->mask;
+    while (new_table->slots[new_index].stream_id != 0) {
+      new_index = (new_index + 1) & new_table->mask;
+    }
+    new_table->slots[new_index] = old_slot;
+  }
+  num_used_slots_ = size_;
+  base::subtle::Release_Store(
+      &table_, reinterpret_cast<base::subtle::AtomicWord>(new_table));
+  retired_tables_.push_back(old_table);
+
+  // The reader can't start searching a retired table now, so free every one
+  // except the one it may be searching at this moment.
+  base::subtle::MemoryBarrier();
+  const base::subtle::AtomicWord in_use =
+      base::subtle::Acquire_Load(&table_hazard_);
+  std::vector<Table*> keep;
+  for (size_t i = 0; i < retired_tables_.size(); ++i) {
+    if (reinterpret_cast<base::subtle::AtomicWord>(retired_tables_[i]) ==
+        in_use) {
+      keep.push_back(retired_tables_[i]);
+    } else {
+      delete retired_tables_[i];
+    }
+  }
+  retired_tables_.swap(keep);
+}
+
+}  // namespace mod_spdy
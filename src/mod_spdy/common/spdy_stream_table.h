@@ -0,0 +1,135 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_COMMON_SPDY_STREAM_TABLE_H_
+#define MOD_SPDY_COMMON_SPDY_STREAM_TABLE_H_
+
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+#include "net/spdy/spdy_protocol.h"
+
+namespace mod_spdy {
+
+class SpdyStream;
+
+// A hash table of the active streams of a session, keyed by stream ID, which
+// one thread (the session's connection thread) can read without taking a
+// lock.  Since that thread looks up a stream for every DATA, HEADERS and
+// WINDOW_UPDATE frame it receives, this means that it never has to wait for a
+// stream thread that happens to be adding or removing a stream.
+//
+// Changes to the table (Insert and Remove), and lookups with Get, must be
+// serialized by the caller, for example with a lock.  Lookups with a
+// ScopedLookup need no synchronization, but only one thread may use them.
+//
+// The table uses open addressing with linear probing.  A removed stream leaves
+// a tombstone, which may be reused by a later insertion; when live entries
+// plus tombstones would fill more than half the table, the live entries are
+// copied into a new table.  Memory is reclaimed with hazard pointers: the
+// reading thread publishes the table it is searching and the stream it has
+// found, a replaced table is freed only once the reader isn't searching it,
+// and Remove waits until the reader is no longer using the stream being
+// removed.
+class SpdyStreamTable {
+ public:
+  // Looks up a stream without locking, and keeps the stream from being
+  // removed from the table (and so deleted) until the ScopedLookup goes out of
+  // scope.  While a ScopedLookup exists, its thread must not block on anything
+  // that a thread calling Remove might hold.
+  class ScopedLookup {
+   public:
+    ScopedLookup(SpdyStreamTable* table, net::SpdyStreamId stream_id);
+    ~ScopedLookup();
+
+    // Return the stream, or NULL if no stream with that ID was in the table.
+    SpdyStream* stream() const { return stream_; }
+
+   private:
+    SpdyStreamTable* const table_;
+    SpdyStream* const stream_;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedLookup);
+  };
+
+  SpdyStreamTable();
+  ~SpdyStreamTable();
+
+  // Return the number of streams in the table.
+  size_t size() const { return size_; }
+
+  // Get the stream with the given ID, or NULL if there isn't one.
+  SpdyStream* Get(net::SpdyStreamId stream_id) const;
+
+  // Add a stream to the table.  There must not already be a stream with the
+  // same ID.
+  void Insert(SpdyStream* stream);
+
+  // Remove a stream from the table, blocking until the reading thread (if it
+  // is in the middle of using the stream) is done with it.  The stream must
+  // be in the table.
+  void Remove(SpdyStream* stream);
+
+  // Append all streams in the table to *streams, in no particular order.
+  void GetAllStreams(std::vector<SpdyStream*>* streams) const;
+
+ private:
+  struct Slot {
+    // Zero if the slot has never been used.
+    base::subtle::Atomic32 stream_id;
+    // The SpdyStream*, or zero if the stream has been removed (a tombstone).
+    base::subtle::AtomicWord stream;
+  };
+
+  struct Table {
+    explicit Table(size_t capacity);
+    ~Table();
+
+    // The number of slots, minus one; the number of slots is a power of two.
+    const size_t mask;
+    Slot* const slots;
+  };
+
+  // Return the slot holding the given stream ID (live or tombstone), or NULL.
+  static Slot* FindSlot(const Table* table, net::SpdyStreamId stream_id);
+
+  // Called by ScopedLookup.
+  SpdyStream* AcquireStream(net::SpdyStreamId stream_id);
+  void ReleaseStream();
+
+  // Copy the live entries into a new table with room for plenty more, make
+  // it the current one, and free whichever old tables the reader isn't using.
+  void Grow();
+
+  // The current table, as a Table*.  This is only changed by writers, but is
+  // read by the reading thread without a lock.
+  base::subtle::AtomicWord table_;
+  // Hazard pointers: the table the reading thread is searching (as a Table*)
+  // and the stream it is using (as a SpdyStream*), or zero.
+  base::subtle::AtomicWord table_hazard_;
+  base::subtle::AtomicWord stream_hazard_;
+  // These fields are only used by writers.
+  size_t size_;  // number of live entries in table_
+  size_t num_used_slots_;  // live entries plus tombstones in table_
+  // Old tables that the reading thread may still have been searching when
+  // they were replaced.
+  std::vector<Table*> retired_tables_;
+
+  DISALLOW_COPY_AND_ASSIGN(SpdyStreamTable);
+};
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_SPDY_STREAM_TABLE_H_
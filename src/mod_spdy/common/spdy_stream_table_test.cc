@@ -0,0 +1,238 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/spdy_stream_table.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/stl_util.h"
+#include "base/threading/platform_thread.h"
+#include "base/time/time.h"
+#include "mod_spdy/common/protocol_util.h"
+#include "mod_spdy/common/spdy_frame_priority_queue.h"
+#include "mod_spdy/common/spdy_server_push_interface.h"
+#include "mod_spdy/common/spdy_stream.h"
+#include "mod_spdy/common/testing/async_task_runner.h"
+#include "mod_spdy/common/testing/notification.h"
+#include "net/spdy/spdy_protocol.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using mod_spdy::SpdyStream;
+using mod_spdy::SpdyStreamTable;
+using mod_spdy::testing::AsyncTaskRunner;
+
+namespace {
+
+class NoPushes : public mod_spdy::SpdyServerPushInterface {
+ public:
+  NoPushes() {}
+  virtual PushStatus StartServerPush(
+      net::SpdyStreamId associated_stream_id,
+      int32 server_push_depth,
+      net::SpdyPriority priority,
+      const net::SpdyHeaderBlock& request_headers) {
+    return CANNOT_PUSH_EVER_AGAIN;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(NoPushes);
+};
+
+class SpdyStreamTableTest : public testing::Test {
+ public:
+  SpdyStreamTableTest() {}
+  virtual ~SpdyStreamTableTest() { STLDeleteElements(&streams_); }
+
+ protected:
+  SpdyStream* NewStream(net::SpdyStreamId stream_id) {
+    SpdyStream* stream = new SpdyStream(
+        mod_spdy::spdy::SPDY_VERSION_3, stream_id, 0, 0, 2,
+        net::kSpdyStreamInitialWindowSize, &output_queue_, NULL, &pusher_);
+    streams_.push_back(stream);
+    return stream;
+  }
+
+  mod_spdy::SpdyFramePriorityQueue output_queue_;
+  NoPushes pusher_;
+  std::vector<SpdyStream*> streams_;
+  SpdyStreamTable table_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SpdyStreamTableTest);
+};
+
+TEST_F(SpdyStreamTableTest, InsertAndRemove) {
+  EXPECT_EQ(0u, table_.size());
+  SpdyStream* stream1 = NewStream(1);
+  SpdyStream* stream3 = NewStream(3);
+  SpdyStream* stream2 = NewStream(2);
+  table_.Insert(stream1);
+  table_.Insert(stream3);
+  table_.Insert(stream2);
+  EXPECT_EQ(3u, table_.size());
+  EXPECT_EQ(stream1, table_.Get(1));
+  EXPECT_EQ(stream2, table_.Get(2));
+  EXPECT_EQ(stream3, table_.Get(3));
+  EXPECT_TRUE(table_.Get(5) == NULL);
+
+  table_.Remove(stream3);
+  EXPECT_EQ(2u, table_.size());
+  EXPECT_TRUE(table_.Get(3) == NULL);
+  EXPECT_EQ(stream1, table_.Get(1));
+
+  {
+    SpdyStreamTable::ScopedLookup lookup(&table_, 2);
+    EXPECT_EQ(stream2, lookup.stream());
+  }
+  {
+    SpdyStreamTable::ScopedLookup lookup(&table_, 3);
+    EXPECT_TRUE(lookup.stream() == NULL);
+  }
+
+  std::vector<SpdyStream*> all;
+  table_.GetAllStreams(&all);
+  std::sort(all.begin(), all.end());
+  std::vector<SpdyStream*> expected;
+  expected.push_back(stream1);
+  expected.push_back(stream2);
+  std::sort(expected.begin(), expected.end());
+  EXPECT_EQ(expected, all);
+
+  table_.Remove(stream1);
+  table_.Remove(stream2);
+  EXPECT_EQ(0u, table_.size());
+}
+
+// Go through many more streams than the table starts out with room for, both
+// all at once (so that the table has to grow) and a few at a time (so that
+// tombstones are reused).
+TEST_F(SpdyStreamTableTest, ManyStreams) {
+  std::vector<SpdyStream*> streams;
+  for (net::SpdyStreamId id = 1; id < 2000; id += 2) {
+    streams.push_back(NewStream(id));
+    table_.Insert(streams.back());
+  }
+  EXPECT_EQ(streams.size(), table_.size());
+  for (size_t i = 0; i < streams.size(); ++i) {
+    SpdyStreamTable::ScopedLookup lookup(&table_, streams[i]->stream_id());
+    EXPECT_EQ(streams[i], lookup.stream());
+  }
+  for (size_t i = 0; i < streams.size(); ++i) {
+    table_.Remove(streams[i]);
+  }
+  EXPECT_EQ(0u, table_.size());
+
+  for (net::SpdyStreamId id = 2001; id < 6000; id += 2) {
+    SpdyStream* stream = NewStream(id);
+    table_.Insert(stream);
+    EXPECT_EQ(stream, table_.Get(id));
+    EXPECT_TRUE(table_.Get(id - 2) == NULL);
+    table_.Remove(stream);
+  }
+  EXPECT_EQ(0u, table_.size());
+}
+
+class RemoveTask : public AsyncTaskRunner::Task {
+ public:
+  RemoveTask(SpdyStreamTable* table, SpdyStream* stream)
+      : table_(table), stream_(stream) {}
+  virtual void Run() { table_->Remove(stream_); }
+
+ private:
+  SpdyStreamTable* const table_;
+  SpdyStream* const stream_;
+
+  DISALLOW_COPY_AND_ASSIGN(RemoveTask);
+};
+
+// Removing a stream must wait until the reading thread is done with it.
+TEST_F(SpdyStreamTableTest, RemoveWaitsForLookup) {
+  SpdyStream* stream = NewStream(1);
+  table_.Insert(stream);
+  scoped_ptr<SpdyStreamTable::ScopedLookup> lookup(
+      new SpdyStreamTable::ScopedLookup(&table_, 1));
+  ASSERT_EQ(stream, lookup->stream());
+
+  AsyncTaskRunner runner(new RemoveTask(&table_, stream));
+  ASSERT_TRUE(runner.Start());
+  runner.notification()->ExpectNotSet();
+  base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(50));
+  runner.notification()->ExpectNotSet();
+
+  lookup.reset();
+  runner.notification()->ExpectSetWithin(base::TimeDelta::FromSeconds(1));
+  EXPECT_TRUE(table_.Get(1) == NULL);
+}
+
+// Repeatedly adds and removes a set of streams, as stream threads would.
+class ChurnTask : public AsyncTaskRunner::Task {
+ public:
+  ChurnTask(SpdyStreamTable* table, const std::vector<SpdyStream*>& streams)
+      : table_(table), streams_(streams), done_(0) {}
+  virtual void Run() {
+    for (int round = 0; round < 200; ++round) {
+      for (size_t i = 0; i < streams_.size(); ++i) {
+        table_->Insert(streams_[i]);
+      }
+      for (size_t i = 0; i < streams_.size(); ++i) {
+        table_->Remove(streams_[i]);
+      }
+    }
+    base::subtle::Release_Store(&done_, 1);
+  }
+  bool done() const { return base::subtle::Acquire_Load(&done_) != 0; }
+
+ private:
+  SpdyStreamTable* const table_;
+  const std::vector<SpdyStream*> streams_;
+  base::subtle::Atomic32 done_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChurnTask);
+};
+
+// Look streams up without a lock while another thread adds and removes
+// streams (forcing the table to grow and reuse tombstones as it goes).  We
+// must always find the stream that stays put, and never find the wrong one.
+TEST_F(SpdyStreamTableTest, LookupsDuringChurn) {
+  SpdyStream* fixed_stream = NewStream(1);
+  table_.Insert(fixed_stream);
+  std::vector<SpdyStream*> churning;
+  for (net::SpdyStreamId id = 3; id < 400; id += 2) {
+    churning.push_back(NewStream(id));
+  }
+
+  ChurnTask* task = new ChurnTask(&table_, churning);
+  AsyncTaskRunner runner(task);
+  ASSERT_TRUE(runner.Start());
+  while (!task->done()) {
+    {
+      SpdyStreamTable::ScopedLookup lookup(&table_, 1);
+      ASSERT_EQ(fixed_stream, lookup.stream());
+    }
+    for (net::SpdyStreamId id = 3; id < 400; id += 22) {
+      SpdyStreamTable::ScopedLookup lookup(&table_, id);
+      if (lookup.stream() != NULL) {
+        ASSERT_EQ(id, lookup.stream()->stream_id());
+      }
+    }
+  }
+  runner.notification()->ExpectSetWithin(base::TimeDelta::FromSeconds(1));
+  EXPECT_EQ(1u, table_.size());
+}
+
+}  // namespace
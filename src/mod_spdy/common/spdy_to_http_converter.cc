@@ -14,11 +14,15 @@
 
 #include "mod_spdy/common/spdy_to_http_converter.h"
 
+#include <string>
+
 #include "base/logging.h"
 #include "base/strings/string_number_conversions.h"  // for Int64ToString
 #include "base/strings/string_piece.h"
+#include "mod_spdy/common/header_name.h"
 #include "mod_spdy/common/http_request_visitor_interface.h"
 #include "mod_spdy/common/protocol_util.h"
+#include "mod_spdy/common/spdy_version_traits.h"
 #include "net/spdy/spdy_frame_builder.h"
 #include "net/spdy/spdy_framer.h"
 #include "net/spdy/spdy_protocol.h"
@@ -27,36 +31,68 @@ namespace mod_spdy {
 
 namespace {
 
+// Identify the given request header name.  ClassifyHeaderName ignores case,
+// but header names in a request must already be lowercase (and the request's
+// magic headers must not be confused by, say, both ":method" and ":METHOD"),
+// so a name that isn't exactly the lowercase form of a known name is treated
+// as just another header, as if we had looked it up in the header block.
+HeaderName ClassifyRequestHeaderName(base::StringPiece name) {
+  const HeaderName header = ClassifyHeaderName(name);
+  if (header != HEADER_OTHER && name != HeaderNameToString(header)) {
+    return HEADER_OTHER;
+  }
+  return header;
+}
+
 // Generate an HTTP request line from the given SPDY header block by calling
 // the OnStatusLine() method of the given visitor, and return true.  If there's
 // an error, this will return false without calling any methods on the visitor.
-bool GenerateRequestLine(spdy::SpdyVersion spdy_version,
-                         const net::SpdyHeaderBlock& block,
-                         HttpRequestVisitorInterface* visitor) {
-  const bool spdy2 = spdy_version < spdy::SPDY_VERSION_3;
-  net::SpdyHeaderBlock::const_iterator method = block.find(
-      spdy2 ? spdy::kSpdy2Method : spdy::kSpdy3Method);
-  net::SpdyHeaderBlock::const_iterator scheme = block.find(
-      spdy2 ? spdy::kSpdy2Scheme : spdy::kSpdy3Scheme);
-  net::SpdyHeaderBlock::const_iterator host = block.find(
-      spdy2 ? http::kHost : spdy::kSpdy3Host);
-  net::SpdyHeaderBlock::const_iterator path = block.find(
-      spdy2 ? spdy::kSpdy2Url : spdy::kSpdy3Path);
-  net::SpdyHeaderBlock::const_iterator version = block.find(
-      spdy2 ? spdy::kSpdy2Version : spdy::kSpdy3Version);
-
-  if (method == block.end() ||
-      scheme == block.end() ||
-      host == block.end() ||
-      path == block.end() ||
-      version == block.end()) {
+template <typename Traits>
+bool GenerateRequestLineForVersion(const net::SpdyHeaderBlock& block,
+                                   HttpRequestVisitorInterface* visitor) {
+  // Pick out the headers we need in a single pass over the block.
+  const std::string* method = NULL;
+  const std::string* path = NULL;
+  const std::string* version = NULL;
+  bool has_scheme = false;
+  bool has_host = false;
+  for (net::SpdyHeaderBlock::const_iterator it = block.begin();
+       it != block.end(); ++it) {
+    const HeaderName header = ClassifyRequestHeaderName(it->first);
+    if (header == Traits::kMethodHeader) {
+      method = &it->second;
+    } else if (header == Traits::kSchemeHeader) {
+      has_scheme = true;
+    } else if (header == Traits::kHostHeader) {
+      has_host = true;
+    } else if (header == Traits::kPathHeader) {
+      path = &it->second;
+    } else if (header == Traits::kVersionHeader) {
+      version = &it->second;
+    }
+  }
+
+  if (method == NULL || !has_scheme || !has_host || path == NULL ||
+      version == NULL) {
     return false;
   }
 
-  visitor->OnRequestLine(method->second, path->second, version->second);
+  visitor->OnRequestLine(*method, *path, *version);
   return true;
 }
 
+bool GenerateRequestLine(spdy::SpdyVersion spdy_version,
+                         const net::SpdyHeaderBlock& block,
+                         HttpRequestVisitorInterface* visitor) {
+  // SPDY/3.1 uses the same headers as SPDY/3.
+  if (spdy_version < spdy::SPDY_VERSION_3) {
+    return GenerateRequestLineForVersion<
+        SpdyVersionTraits<spdy::SPDY_VERSION_2> >(block, visitor);
+  }
+  return GenerateRequestLineForVersion<
+      SpdyVersionTraits<spdy::SPDY_VERSION_3> >(block, visitor);
+}
+
 // Convert the given SPDY header into HTTP header(s) by splitting on NUL bytes
 // calling the specified method (either OnLeadingHeader or OnTrailingHeader) of
 // the given visitor.
@@ -219,59 +255,83 @@ SpdyToHttpConverter::Status SpdyToHttpConverter::ConvertDataFrame(
 // frame) into HTTP headers by calling OnLeadingHeader on the given visitor.
 void SpdyToHttpConverter::GenerateLeadingHeaders(
     const net::SpdyHeaderBlock& block) {
+  // SPDY/3.1 uses the same headers as SPDY/3.
+  if (spdy_version() < spdy::SPDY_VERSION_3) {
+    GenerateLeadingHeadersForVersion<
+        SpdyVersionTraits<spdy::SPDY_VERSION_2> >(block);
+  } else {
+    GenerateLeadingHeadersForVersion<
+        SpdyVersionTraits<spdy::SPDY_VERSION_3> >(block);
+  }
+}
+
+template <typename Traits>
+void SpdyToHttpConverter::GenerateLeadingHeadersForVersion(
+    const net::SpdyHeaderBlock& block) {
   for (net::SpdyHeaderBlock::const_iterator it = block.begin();
        it != block.end(); ++it) {
     base::StringPiece key = it->first;
     const base::StringPiece value = it->second;
 
-    // Skip SPDY-specific (i.e. non-HTTP) headers.
-    if (spdy_version() < spdy::SPDY_VERSION_3) {
-      if (key == spdy::kSpdy2Method || key == spdy::kSpdy2Scheme ||
-          key == spdy::kSpdy2Url || key == spdy::kSpdy2Version) {
-        continue;
-      }
-    } else {
-      if (key == spdy::kSpdy3Method || key == spdy::kSpdy3Scheme ||
-          key == spdy::kSpdy3Path || key == spdy::kSpdy3Version) {
-        continue;
-      }
-    }
-
-    // Skip headers that are ignored by SPDY.
-    if (key == http::kConnection || key == http::kKeepAlive) {
-      continue;
-    }
-
-    // If the client sent a Content-Length header, take note, so that we'll
-    // know not to used chunked encoding.
-    if (key == http::kContentLength) {
-      use_chunking_ = false;
-    }
+    switch (ClassifyRequestHeaderName(key)) {
+      // Skip SPDY-specific (i.e. non-HTTP) headers.
+      case HEADER_SPDY2_METHOD:
+      case HEADER_SPDY2_SCHEME:
+      case HEADER_SPDY2_URL:
+      case HEADER_SPDY2_VERSION:
+        if (!Traits::kUsesColonHeaders) {
+          continue;
+        }
+        break;
+      case HEADER_SPDY3_METHOD:
+      case HEADER_SPDY3_SCHEME:
+      case HEADER_SPDY3_PATH:
+      case HEADER_SPDY3_VERSION:
+        if (Traits::kUsesColonHeaders) {
+          continue;
+        }
+        break;
 
-    // The client shouldn't be sending us a Transfer-Encoding header; it's
-    // pretty pointless over SPDY.  If they do send one, just ignore it; we may
-    // be overriding it later anyway.
-    if (key == http::kTransferEncoding) {
-      LOG(WARNING) << "Client sent \"transfer-encoding: " << value
-                   << "\" header over SPDY.  Why would they do that?";
-      continue;
-    }
+      // Skip headers that are ignored by SPDY.
+      case HEADER_CONNECTION:
+      case HEADER_KEEP_ALIVE:
+        continue;
 
-    // For SPDY v3 and later, we need to convert the SPDY ":host" header to an
-    // HTTP "host" header.
-    if (spdy_version() >= spdy::SPDY_VERSION_3 && key == spdy::kSpdy3Host) {
-      key = http::kHost;
-    }
+      // If the client sent a Content-Length header, take note, so that we'll
+      // know not to used chunked encoding.
+      case HEADER_CONTENT_LENGTH:
+        use_chunking_ = false;
+        break;
+
+      // The client shouldn't be sending us a Transfer-Encoding header; it's
+      // pretty pointless over SPDY.  If they do send one, just ignore it; we
+      // may be overriding it later anyway.
+      case HEADER_TRANSFER_ENCODING:
+        LOG(WARNING) << "Client sent \"transfer-encoding: " << value
+                     << "\" header over SPDY.  Why would they do that?";
+        continue;
 
-    // Take note of whether the client has sent an explicit Accept-Encoding
-    // header; if they never do, we'll insert on for them later on.
-    if (key == http::kAcceptEncoding) {
-      // TODO(mdsteele): Ideally, if the client sends something like
-      //   "Accept-Encoding: lzma", we should change it to "Accept-Encoding:
-      //   lzma, gzip".  However, that's more work (we might need to parse the
-      //   syntax, to make sure we don't naively break it), and isn't
-      //   (currently) likely to come up in practice.
-      seen_accept_encoding_ = true;
+      // For SPDY v3 and later, we need to convert the SPDY ":host" header to
+      // an HTTP "host" header.
+      case HEADER_SPDY3_HOST:
+        if (Traits::kUsesColonHeaders) {
+          key = http::kHost;
+        }
+        break;
+
+      // Take note of whether the client has sent an explicit Accept-Encoding
+      // header; if they never do, we'll insert on for them later on.
+      case HEADER_ACCEPT_ENCODING:
+        // TODO(mdsteele): Ideally, if the client sends something like
+        //   "Accept-Encoding: lzma", we should change it to "Accept-Encoding:
+        //   lzma, gzip".  However, that's more work (we might need to parse
+        //   the syntax, to make sure we don't naively break it), and isn't
+        //   (currently) likely to come up in practice.
+        seen_accept_encoding_ = true;
+        break;
+
+      default:
+        break;
     }
 
     InsertHeader<&HttpRequestVisitorInterface::OnLeadingHeader>(
@@ -55,6 +55,9 @@ class SpdyToHttpConverter {
 private:
   // Called to generate leading headers from a SYN_STREAM or HEADERS frame.
   void GenerateLeadingHeaders(const net::SpdyHeaderBlock& block);
+  // Implements GenerateLeadingHeaders for a particular SpdyVersionTraits.
+  template <typename Traits>
+  void GenerateLeadingHeadersForVersion(const net::SpdyHeaderBlock& block);
   // Called when there are no more leading headers, because we've received
   // either data or a FLAG_FIN.  This adds any last-minute needed headers
   // before closing the leading headers section.
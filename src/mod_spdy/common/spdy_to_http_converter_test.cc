@@ -14,8 +14,10 @@
 
 #include "mod_spdy/common/spdy_to_http_converter.h"
 
+#include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/string_piece.h"
+#include "base/time/time.h"
 #include "mod_spdy/common/http_request_visitor_interface.h"
 #include "mod_spdy/common/protocol_util.h"
 #include "net/spdy/spdy_protocol.h"
@@ -25,6 +27,7 @@
 namespace {
 
 using mod_spdy::SpdyToHttpConverter;
+using testing::_;
 using testing::Eq;
 using testing::InSequence;
 using testing::Sequence;
@@ -316,6 +319,27 @@ TEST_P(SpdyToHttpConverterTest, DoubleSynStreamFrame) {
             converter_.ConvertSynStreamFrame(*syn_frame));
 }
 
+// Header names in a request must be lowercase, so magic headers in any other
+// case don't count (here, leaving the request without a method).
+TEST_P(SpdyToHttpConverterTest, MagicHeadersAreCaseSensitive) {
+  AddRequiredHeaders();
+  if (converter_.spdy_version() < mod_spdy::spdy::SPDY_VERSION_3) {
+    headers_.erase(mod_spdy::spdy::kSpdy2Method);
+    headers_["METHOD"] = kMethod;
+  } else {
+    headers_.erase(mod_spdy::spdy::kSpdy3Method);
+    headers_[":METHOD"] = kMethod;
+  }
+  scoped_ptr<net::SpdySynStreamIR> syn_frame(new net::SpdySynStreamIR(1));
+  syn_frame->set_fin(true);
+  syn_frame->GetMutableNameValueBlock()->insert(
+      headers_.begin(), headers_.end());
+
+  EXPECT_CALL(visitor_, OnRequestLine(_, _, _)).Times(0);
+  EXPECT_EQ(SpdyToHttpConverter::BAD_REQUEST,
+            converter_.ConvertSynStreamFrame(*syn_frame));
+}
+
 TEST_P(SpdyToHttpConverterTest, HeadersFrameBeforeSynStreamFrame) {
   headers_["x-foo"] = "bar";
   scoped_ptr<net::SpdyHeadersIR> headers_frame(new net::SpdyHeadersIR(1));
@@ -337,4 +361,74 @@ INSTANTIATE_TEST_CASE_P(Spdy2And3, SpdyToHttpConverterTest, testing::Values(
     mod_spdy::spdy::SPDY_VERSION_2, mod_spdy::spdy::SPDY_VERSION_3,
     mod_spdy::spdy::SPDY_VERSION_3_1));
 
+// A visitor that ignores everything, for benchmarking the converter itself.
+class NullHttpRequestVisitor : public mod_spdy::HttpRequestVisitorInterface {
+ public:
+  NullHttpRequestVisitor() {}
+  virtual void OnRequestLine(const base::StringPiece& method,
+                             const base::StringPiece& path,
+                             const base::StringPiece& version) {}
+  virtual void OnLeadingHeader(const base::StringPiece& key,
+                               const base::StringPiece& value) {}
+  virtual void OnLeadingHeadersComplete() {}
+  virtual void OnRawData(const base::StringPiece& data) {}
+  virtual void OnDataChunk(const base::StringPiece& data) {}
+  virtual void OnDataChunksComplete() {}
+  virtual void OnTrailingHeader(const base::StringPiece& key,
+                                const base::StringPiece& value) {}
+  virtual void OnTrailingHeadersComplete() {}
+  virtual void OnComplete() {}
+ private:
+  DISALLOW_COPY_AND_ASSIGN(NullHttpRequestVisitor);
+};
+
+// Not a real test; this measures how many typical browser SYN_STREAM frames
+// per second we can convert, for each SPDY version.  Run it with
+// --gtest_also_run_disabled_tests.
+TEST(SpdyToHttpConverterBenchmark, DISABLED_SynStreamsPerSecond) {
+  const int kNumFrames = 200000;
+  const mod_spdy::spdy::SpdyVersion versions[] = {
+    mod_spdy::spdy::SPDY_VERSION_2, mod_spdy::spdy::SPDY_VERSION_3,
+    mod_spdy::spdy::SPDY_VERSION_3_1
+  };
+  for (size_t v = 0; v < arraysize(versions); ++v) {
+    const bool spdy2 = versions[v] < mod_spdy::spdy::SPDY_VERSION_3;
+    net::SpdySynStreamIR frame(1);
+    frame.set_fin(true);
+    net::SpdyHeaderBlock* block = frame.GetMutableNameValueBlock();
+    if (spdy2) {
+      (*block)[mod_spdy::spdy::kSpdy2Method] = kMethod;
+      (*block)[mod_spdy::spdy::kSpdy2Scheme] = kScheme;
+      (*block)[mod_spdy::http::kHost] = kHost;
+      (*block)[mod_spdy::spdy::kSpdy2Url] = "/index.html";
+      (*block)[mod_spdy::spdy::kSpdy2Version] = kVersion;
+    } else {
+      (*block)[mod_spdy::spdy::kSpdy3Method] = kMethod;
+      (*block)[mod_spdy::spdy::kSpdy3Scheme] = kScheme;
+      (*block)[mod_spdy::spdy::kSpdy3Host] = kHost;
+      (*block)[mod_spdy::spdy::kSpdy3Path] = "/index.html";
+      (*block)[mod_spdy::spdy::kSpdy3Version] = kVersion;
+    }
+    (*block)["accept"] = "text/html,application/xhtml+xml";
+    (*block)["accept-encoding"] = "gzip,deflate,sdch";
+    (*block)["accept-language"] = "en-US,en;q=0.8";
+    (*block)["cookie"] = "id=1234567890; session=abcdefghijklmnop";
+    (*block)["referer"] = "http://www.example.com/";
+    (*block)["user-agent"] = "Mozilla/5.0 (X11; Linux x86_64)";
+
+    NullHttpRequestVisitor visitor;
+    const base::TimeTicks start = base::TimeTicks::Now();
+    for (int i = 0; i < kNumFrames; ++i) {
+      SpdyToHttpConverter converter(versions[v], &visitor);
+      ASSERT_EQ(SpdyToHttpConverter::SPDY_CONVERTER_SUCCESS,
+                converter.ConvertSynStreamFrame(frame));
+    }
+    const base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+    LOG(INFO) << "SPDY/"
+              << mod_spdy::SpdyVersionNumberString(versions[v]) << ": "
+              << static_cast<int64>(kNumFrames / elapsed.InSecondsF())
+              << " SYN_STREAM frames per second";
+  }
+}
+
 }  // namespace
@@ -0,0 +1,82 @@
+// Copyright 2013 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_COMMON_SPDY_VERSION_TRAITS_H_
+#define MOD_SPDY_COMMON_SPDY_VERSION_TRAITS_H_
+
+#include "mod_spdy/common/header_name.h"
+#include "mod_spdy/common/protocol_util.h"
+
+namespace mod_spdy {
+
+// Compile-time facts about each SPDY version.  Code whose inner loops depend
+// on the version (e.g. per-header or per-DATA-frame work) can be templated on
+// one of these, and then switch on the runtime spdy::SpdyVersion just once,
+// outside the loop, so that the version checks inside the loop are resolved
+// at compile time.
+template <spdy::SpdyVersion kVersion>
+struct SpdyVersionTraits;
+
+template <>
+struct SpdyVersionTraits<spdy::SPDY_VERSION_2> {
+  static const spdy::SpdyVersion kSpdyVersion = spdy::SPDY_VERSION_2;
+  // SPDY/2 has no flow control at all.
+  static const bool kHasStreamFlowControl = false;
+  static const bool kHasSessionFlowControl = false;
+  // SPDY/2 uses un-prefixed magic headers, and a plain HTTP Host header.
+  static const bool kUsesColonHeaders = false;
+  static const HeaderName kMethodHeader = HEADER_SPDY2_METHOD;
+  static const HeaderName kSchemeHeader = HEADER_SPDY2_SCHEME;
+  static const HeaderName kHostHeader = HEADER_HOST;
+  static const HeaderName kPathHeader = HEADER_SPDY2_URL;
+  static const HeaderName kVersionHeader = HEADER_SPDY2_VERSION;
+  static const char* StatusHeaderName() { return spdy::kSpdy2Status; }
+  static const char* VersionHeaderName() { return spdy::kSpdy2Version; }
+};
+
+template <>
+struct SpdyVersionTraits<spdy::SPDY_VERSION_3> {
+  static const spdy::SpdyVersion kSpdyVersion = spdy::SPDY_VERSION_3;
+  // SPDY/3 has per-stream flow control only.
+  static const bool kHasStreamFlowControl = true;
+  static const bool kHasSessionFlowControl = false;
+  static const bool kUsesColonHeaders = true;
+  static const HeaderName kMethodHeader = HEADER_SPDY3_METHOD;
+  static const HeaderName kSchemeHeader = HEADER_SPDY3_SCHEME;
+  static const HeaderName kHostHeader = HEADER_SPDY3_HOST;
+  static const HeaderName kPathHeader = HEADER_SPDY3_PATH;
+  static const HeaderName kVersionHeader = HEADER_SPDY3_VERSION;
+  static const char* StatusHeaderName() { return spdy::kSpdy3Status; }
+  static const char* VersionHeaderName() { return spdy::kSpdy3Version; }
+};
+
+// SPDY/3.1 is the same as SPDY/3, except for the session-wide window.
+template <>
+struct SpdyVersionTraits<spdy::SPDY_VERSION_3_1>
+    : public SpdyVersionTraits<spdy::SPDY_VERSION_3> {
+  static const spdy::SpdyVersion kSpdyVersion = spdy::SPDY_VERSION_3_1;
+  static const bool kHasSessionFlowControl = true;
+};
+
+// By the time anything above the framer sees them, HTTP/2 requests and
+// responses look just like SPDY/3.1 ones (see Http2Framer).
+template <>
+struct SpdyVersionTraits<spdy::SPDY_VERSION_HTTP2>
+    : public SpdyVersionTraits<spdy::SPDY_VERSION_3_1> {
+  static const spdy::SpdyVersion kSpdyVersion = spdy::SPDY_VERSION_HTTP2;
+};
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_SPDY_VERSION_TRAITS_H_
@@ -0,0 +1,106 @@
+// Copyright 2014 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/stream_admission_controller.h"
+
+#include <algorithm>  // for std::max
+
+#include "base/logging.h"
+#include "base/synchronization/lock.h"
+
+namespace mod_spdy {
+
+StreamAdmissionController::StreamAdmissionController(int soft_limit,
+                                                     int hard_limit)
+    : soft_limit_(soft_limit),
+      hard_limit_(hard_limit),
+      // Recover once we've dropped to three quarters of the soft limit.
+      recovery_limit_(soft_limit - soft_limit / 4),
+      num_active_streams_(0),
+      num_sessions_(0),
+      saturated_(false) {
+  DCHECK_GE(soft_limit_, 1);
+  DCHECK_LE(soft_limit_, hard_limit_);
+}
+
+StreamAdmissionController::~StreamAdmissionController() {
+  DCHECK_EQ(0, num_active_streams_);
+  DCHECK_EQ(0, num_sessions_);
+}
+
+void StreamAdmissionController::AddSession() {
+  base::AutoLock autolock(lock_);
+  ++num_sessions_;
+}
+
+void StreamAdmissionController::RemoveSession() {
+  base::AutoLock autolock(lock_);
+  DCHECK_GT(num_sessions_, 0);
+  --num_sessions_;
+}
+
+bool StreamAdmissionController::TryAdmitStream() {
+  base::AutoLock autolock(lock_);
+  if (num_active_streams_ >= hard_limit_) {
+    DCHECK(saturated_);
+    return false;
+  }
+  ++num_active_streams_;
+  if (num_active_streams_ >= soft_limit_) {
+    saturated_ = true;
+  }
+  return true;
+}
+
+void StreamAdmissionController::ReleaseStream() {
+  base::AutoLock autolock(lock_);
+  DCHECK_GT(num_active_streams_, 0);
+  --num_active_streams_;
+  if (num_active_streams_ < recovery_limit_) {
+    saturated_ = false;
+  }
+}
+
+int StreamAdmissionController::GetMaxConcurrentStreams(
+    int per_connection_limit) const {
+  DCHECK_GE(per_connection_limit, 1);
+  base::AutoLock autolock(lock_);
+  if (!saturated_) {
+    return per_connection_limit;
+  }
+  const int headroom = std::max(0, hard_limit_ - num_active_streams_);
+  const int share = headroom / std::max(1, num_sessions_);
+  int limit = 1;
+  while (limit * 2 <= share && limit * 2 <= per_connection_limit) {
+    limit *= 2;
+  }
+  return limit;
+}
+
+int StreamAdmissionController::num_active_streams() const {
+  base::AutoLock autolock(lock_);
+  return num_active_streams_;
+}
+
+int StreamAdmissionController::num_sessions() const {
+  base::AutoLock autolock(lock_);
+  return num_sessions_;
+}
+
+bool StreamAdmissionController::is_saturated() const {
+  base::AutoLock autolock(lock_);
+  return saturated_;
+}
+
+}  // namespace mod_spdy
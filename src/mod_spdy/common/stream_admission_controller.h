@@ -0,0 +1,91 @@
+// Copyright 2014 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOD_SPDY_COMMON_STREAM_ADMISSION_CONTROLLER_H_
+#define MOD_SPDY_COMMON_STREAM_ADMISSION_CONTROLLER_H_
+
+#include "base/basictypes.h"
+#include "base/compiler_specific.h"
+#include "base/synchronization/lock.h"
+
+namespace mod_spdy {
+
+// A StreamAdmissionController keeps track of the total number of active SPDY
+// streams across all sessions in a process, so that when the process becomes
+// overloaded we can push back on clients (by lowering the
+// SETTINGS_MAX_CONCURRENT_STREAMS we advertise, and ultimately by refusing new
+// streams) rather than letting ever more streams pile up in the thread pool's
+// task queue.  This class is thread-safe.
+//
+// There are two limits.  Once the number of active streams reaches the soft
+// limit, the process is considered "saturated", and each session should
+// advertise a reduced MAX_CONCURRENT_STREAMS value (see
+// GetMaxConcurrentStreams).  The process remains saturated until load drops
+// well below the soft limit again, so that we don't flap back and forth.  The
+// hard limit is the most streams that may ever be active at once; past that,
+// TryAdmitStream will refuse new streams.
+class StreamAdmissionController {
+ public:
+  // Both limits must be positive, and soft_limit must be no greater than
+  // hard_limit.
+  StreamAdmissionController(int soft_limit, int hard_limit);
+  ~StreamAdmissionController();
+
+  // Called by each session when it starts and stops, respectively.  The number
+  // of active sessions is used to divide up the remaining stream budget when
+  // the process is saturated.
+  void AddSession();
+  void RemoveSession();
+
+  // Try to reserve a slot for a new stream.  Return true on success, or false
+  // if the hard limit has been reached (in which case the stream should be
+  // refused).  Every successful call must eventually be matched by a call to
+  // ReleaseStream.
+  bool TryAdmitStream() WARN_UNUSED_RESULT;
+
+  // Release a slot reserved by a successful call to TryAdmitStream.
+  void ReleaseStream();
+
+  // Return the SETTINGS_MAX_CONCURRENT_STREAMS value that a session (whose
+  // configured limit is per_connection_limit) should currently advertise.  If
+  // the process isn't saturated, this is just per_connection_limit; otherwise,
+  // it is that session's fair share of the remaining headroom below the hard
+  // limit, rounded down to a power of two (so that small fluctuations in load
+  // don't make every session send a flurry of SETTINGS frames), and always at
+  // least one.
+  int GetMaxConcurrentStreams(int per_connection_limit) const;
+
+  // Accessors, primarily for testing/debugging.
+  int num_active_streams() const;
+  int num_sessions() const;
+  bool is_saturated() const;
+
+ private:
+  const int soft_limit_;
+  const int hard_limit_;
+  // Once saturated, we stay saturated until the number of active streams drops
+  // below this level.
+  const int recovery_limit_;
+
+  mutable base::Lock lock_;  // protects the below fields
+  int num_active_streams_;
+  int num_sessions_;
+  bool saturated_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamAdmissionController);
+};
+
+}  // namespace mod_spdy
+
+#endif  // MOD_SPDY_COMMON_STREAM_ADMISSION_CONTROLLER_H_
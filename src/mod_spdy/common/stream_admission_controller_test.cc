@@ -0,0 +1,106 @@
+// Copyright 2014 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mod_spdy/common/stream_admission_controller.h"
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+// Test that streams are admitted up to the hard limit and refused after that,
+// until some are released.
+TEST(StreamAdmissionControllerTest, HardLimit) {
+  mod_spdy::StreamAdmissionController controller(2, 3);
+  EXPECT_TRUE(controller.TryAdmitStream());
+  EXPECT_TRUE(controller.TryAdmitStream());
+  EXPECT_TRUE(controller.TryAdmitStream());
+  EXPECT_EQ(3, controller.num_active_streams());
+  EXPECT_FALSE(controller.TryAdmitStream());
+  EXPECT_EQ(3, controller.num_active_streams());
+
+  controller.ReleaseStream();
+  EXPECT_TRUE(controller.TryAdmitStream());
+  EXPECT_FALSE(controller.TryAdmitStream());
+
+  controller.ReleaseStream();
+  controller.ReleaseStream();
+  controller.ReleaseStream();
+  EXPECT_EQ(0, controller.num_active_streams());
+}
+
+// Test that we become saturated at the soft limit, and don't recover until the
+// load has dropped well below it.
+TEST(StreamAdmissionControllerTest, SaturationHysteresis) {
+  mod_spdy::StreamAdmissionController controller(8, 16);
+  for (int i = 0; i < 7; ++i) {
+    ASSERT_TRUE(controller.TryAdmitStream());
+  }
+  EXPECT_FALSE(controller.is_saturated());
+  ASSERT_TRUE(controller.TryAdmitStream());
+  EXPECT_TRUE(controller.is_saturated());
+
+  // Dropping just below the soft limit isn't enough to recover.
+  controller.ReleaseStream();
+  controller.ReleaseStream();
+  EXPECT_EQ(6, controller.num_active_streams());
+  EXPECT_TRUE(controller.is_saturated());
+
+  // But dropping below three quarters of it is.
+  controller.ReleaseStream();
+  EXPECT_EQ(5, controller.num_active_streams());
+  EXPECT_FALSE(controller.is_saturated());
+
+  for (int i = 0; i < 5; ++i) {
+    controller.ReleaseStream();
+  }
+}
+
+// Test the MAX_CONCURRENT_STREAMS values we recommend to sessions.
+TEST(StreamAdmissionControllerTest, GetMaxConcurrentStreams) {
+  mod_spdy::StreamAdmissionController controller(10, 50);
+  controller.AddSession();
+  controller.AddSession();
+
+  // While not saturated, sessions use their configured limit.
+  EXPECT_EQ(100, controller.GetMaxConcurrentStreams(100));
+  EXPECT_EQ(7, controller.GetMaxConcurrentStreams(7));
+
+  // Once saturated, the remaining headroom (40 streams) is split between the
+  // two sessions, and rounded down to a power of two.
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(controller.TryAdmitStream());
+  }
+  ASSERT_TRUE(controller.is_saturated());
+  EXPECT_EQ(16, controller.GetMaxConcurrentStreams(100));
+  // The configured limit still applies.
+  EXPECT_EQ(4, controller.GetMaxConcurrentStreams(7));
+
+  // At the hard limit, sessions are still allowed one stream at a time.
+  for (int i = 0; i < 40; ++i) {
+    ASSERT_TRUE(controller.TryAdmitStream());
+  }
+  EXPECT_EQ(1, controller.GetMaxConcurrentStreams(100));
+
+  // Once load drops, the configured limit is restored.
+  for (int i = 0; i < 50; ++i) {
+    controller.ReleaseStream();
+  }
+  EXPECT_FALSE(controller.is_saturated());
+  EXPECT_EQ(100, controller.GetMaxConcurrentStreams(100));
+
+  controller.RemoveSession();
+  controller.RemoveSession();
+}
+
+}  // namespace
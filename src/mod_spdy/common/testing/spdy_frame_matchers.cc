@@ -233,6 +233,13 @@ namespace testing {
   return ::testing::MakeMatcher(new IsEquivalentFrameMatcher(frame));
 }
 
+::testing::Matcher<const net::SpdyFrameIR&> IsPersistSettings(
+     net::SpdySettingsIds id, int32 value) {
+  net::SpdySettingsIR frame;
+  frame.AddSetting(id, true, false, value);
+  return ::testing::MakeMatcher(new IsEquivalentFrameMatcher(frame));
+}
+
 ::testing::Matcher<const net::SpdyFrameIR&> IsPing(net::SpdyPingId ping_id) {
   net::SpdyPingIR frame(ping_id);
   return ::testing::MakeMatcher(new IsEquivalentFrameMatcher(frame));
@@ -48,6 +48,11 @@ namespace testing {
 ::testing::Matcher<const net::SpdyFrameIR&> IsSettings(
      net::SpdySettingsIds id, int32 value);
 
+// Make a matcher that requires the argument to be a SETTINGS frame asking the
+// client to persist the given setting.
+::testing::Matcher<const net::SpdyFrameIR&> IsPersistSettings(
+     net::SpdySettingsIds id, int32 value);
+
 // Make a matcher that requires the argument to be a PING frame with the
 // given ID.
 ::testing::Matcher<const net::SpdyFrameIR&> IsPing(net::SpdyPingId ping_id);
@@ -14,10 +14,12 @@
 
 #include "mod_spdy/common/thread_pool.h"
 
+#include <algorithm>  // for std::min
 #include <map>
 #include <set>
 #include <vector>
 
+#include "base/atomicops.h"
 #include "base/basictypes.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/synchronization/condition_variable.h"
@@ -33,6 +35,12 @@ namespace {
 // Shut down a worker thread after it has been idle for this many seconds:
 const int64 kDefaultMaxWorkerIdleSeconds = 60;
 
+// Consider a priority overloaded if its tasks have waited in the queue for at
+// least this many milliseconds...
+const int64 kDefaultTargetQueueDelayMillis = 100;
+// ...continuously for at least this many milliseconds.
+const int64 kDefaultQueueDelayIntervalMillis = 1000;
+
 }  // namespace
 
 namespace mod_spdy {
@@ -44,19 +52,38 @@ class ThreadPool::ThreadPoolExecutor : public Executor {
   explicit ThreadPoolExecutor(ThreadPool* master)
       : master_(master),
         stopping_condvar_(&master_->lock_),
-        stopped_(false) {}
-  virtual ~ThreadPoolExecutor() { Stop(); }
+        stopped_(false),
+        stop_callback_(NULL) {}
+  virtual ~ThreadPoolExecutor() {
+    Stop();
+    DCHECK(stop_callback_ == NULL);
+  }
 
   // Executor methods:
   virtual void AddTask(net_instaweb::Function* task,
                        net::SpdyPriority priority);
+  virtual void AddTasks(const TaskList& tasks);
+  virtual bool ShouldShed(SheddableWork work, net::SpdyPriority priority);
   virtual void Stop();
+  virtual void StopAsync(net_instaweb::Function* callback);
 
  private:
   friend class ThreadPool;
+
+  // Mark the executor as stopped, and remove all of its pending tasks from
+  // the queue and cancel them.  Return false (and do nothing) if the executor
+  // was already stopped.  Must not be holding master_->lock_ when calling
+  // this.
+  bool StopAndCancelPendingTasks();
+
   ThreadPool* const master_;
   base::ConditionVariable stopping_condvar_;
   bool stopped_;  // protected by master_->lock_
+  // This executor's tasks that are still in the master's task queue.
+  PendingTaskMap pending_tasks_;  // protected by master_->lock_
+  // The callback passed to StopAsync, if we're still waiting for running
+  // tasks to complete before we can run it.
+  net_instaweb::Function* stop_callback_;  // protected by master_->lock_
 
   DISALLOW_COPY_AND_ASSIGN(ThreadPoolExecutor);
 };
@@ -72,14 +99,7 @@ void ThreadPool::ThreadPoolExecutor::AddTask(net_instaweb::Function* task,
     // reaping.  If the OS process we're in accumulates too many unjoined
     // zombie threads over time, the OS might not be able to spawn a new thread
     // below.  So right now is a good time to clean them up.
-    if (!master_->zombies_.empty()) {
-      std::set<WorkerThread*> zombies;
-      zombies.swap(master_->zombies_);
-      // Joining these threads should be basically instant, since they've
-      // already terminated.  But to be safe, let's unlock while we join them.
-      base::AutoUnlock autounlock(master_->lock_);
-      ThreadPool::JoinThreads(zombies);
-    }
+    master_->ReapZombies();
 
     // The thread pool shouldn't be shutting down until all executors are
     // destroyed.  Since this executor clearly still exists, the thread pool
@@ -89,7 +109,10 @@ void ThreadPool::ThreadPoolExecutor::AddTask(net_instaweb::Function* task,
     // If the executor hasn't been stopped, add the task to the queue and
     // notify a worker that there's a new task ready to be taken.
     if (!stopped_) {
-      master_->task_queue_.insert(std::make_pair(priority, Task(task, this)));
+      const base::TimeTicks now = base::TimeTicks::Now();
+      master_->ObserveOldestQueuedTask(priority, now);
+      pending_tasks_[task] = master_->task_queue_.insert(std::make_pair(
+          priority, Task(task, this, now)));
       master_->worker_condvar_.Signal();
       master_->StartNewWorkerIfNeeded();
       return;
@@ -101,30 +124,114 @@ void ThreadPool::ThreadPoolExecutor::AddTask(net_instaweb::Function* task,
   task->CallCancel();
 }
 
+// Add a batch of tasks to the executor, taking the master lock only once.
+// Rather than signalling the worker condvar once per task as AddTask would, we
+// wake up only as many idle workers as there are new tasks for them to take,
+// and then spawn as many new workers as are needed for the rest.
+void ThreadPool::ThreadPoolExecutor::AddTasks(const TaskList& tasks) {
+  if (tasks.empty()) {
+    return;
+  }
+
+  {
+    base::AutoLock autolock(master_->lock_);
+    master_->ReapZombies();
+    DCHECK(!master_->shutting_down_);
+
+    if (!stopped_) {
+      const base::TimeTicks now = base::TimeTicks::Now();
+      for (TaskList::const_iterator iter = tasks.begin();
+           iter != tasks.end(); ++iter) {
+        master_->ObserveOldestQueuedTask(iter->second, now);
+        pending_tasks_[iter->first] = master_->task_queue_.insert(
+            std::make_pair(iter->second, Task(iter->first, this, now)));
+      }
+      const size_t num_idle_workers =
+          master_->workers_.size() - master_->num_busy_workers_;
+      const size_t num_to_wake = std::min(tasks.size(), num_idle_workers);
+      for (size_t i = 0; i < num_to_wake; ++i) {
+        master_->worker_condvar_.Signal();
+      }
+      while (master_->StartNewWorkerIfNeeded()) {}
+      return;
+    }
+  }
+
+  // If this executor has already been stopped, just cancel the tasks (after
+  // releasing the lock).
+  for (TaskList::const_iterator iter = tasks.begin();
+       iter != tasks.end(); ++iter) {
+    iter->first->CallCancel();
+  }
+}
+
+bool ThreadPool::ThreadPoolExecutor::ShouldShed(SheddableWork work,
+                                                net::SpdyPriority priority) {
+  return master_->ShouldShed(work, priority);
+}
+
 // Stop the executor.  Cancel all pending tasks in the thread pool owned by
 // this executor, and then block until all active tasks owned by this executor
 // complete.  Stopping the executor more than once has no effect.
 void ThreadPool::ThreadPoolExecutor::Stop() {
+  if (!StopAndCancelPendingTasks()) {
+    return;
+  }
+
+  // Block until all our active tasks are completed.
+  base::AutoLock autolock(master_->lock_);
+  while (master_->active_task_counts_.count(this) > 0) {
+    stopping_condvar_.Wait();
+  }
+}
+
+// Stop the executor without waiting.  Cancel all pending tasks owned by this
+// executor; then, if any of our tasks are still running, leave the callback
+// for the worker thread that finishes the last of them to run.
+void ThreadPool::ThreadPoolExecutor::StopAsync(
+    net_instaweb::Function* callback) {
+  // Note that we must cancel our pending tasks _before_ we hand off the
+  // callback, since the callback may delete things that cancelling the tasks
+  // would touch.
+  StopAndCancelPendingTasks();
+  {
+    base::AutoLock autolock(master_->lock_);
+    if (master_->active_task_counts_.count(this) > 0) {
+      DCHECK(stop_callback_ == NULL);
+      stop_callback_ = callback;
+      ++master_->num_pending_stop_callbacks_;
+      // The callback may delete this executor as soon as we release the lock,
+      // so we must not touch any members after this point.
+      return;
+    }
+  }
+  // No tasks are running, so we can run the callback right away.
+  callback->CallRun();
+}
+
+bool ThreadPool::ThreadPoolExecutor::StopAndCancelPendingTasks() {
   std::vector<net_instaweb::Function*> functions_to_cancel;
   {
     base::AutoLock autolock(master_->lock_);
     if (stopped_) {
-      return;
+      return false;
     }
     stopped_ = true;
 
     // Remove all tasks owned by this executor from the queue, and collect up
-    // the function objects to be cancelled.
-    TaskQueue::iterator next_iter = master_->task_queue_.begin();
-    while (next_iter != master_->task_queue_.end()) {
-      TaskQueue::iterator iter = next_iter;
-      const Task& task = iter->second;
-      ++next_iter;  // Increment next_iter _before_ we might erase iter.
-      if (task.owner == this) {
-        functions_to_cancel.push_back(task.function);
-        master_->task_queue_.erase(iter);
-      }
+    // the function objects to be cancelled.  Thanks to our index of pending
+    // tasks, this takes time proportional to the number of tasks we own, not
+    // to the length of the whole queue.
+    functions_to_cancel.reserve(pending_tasks_.size());
+    for (PendingTaskMap::const_iterator iter = pending_tasks_.begin();
+         iter != pending_tasks_.end(); ++iter) {
+      DCHECK(iter->second->second.owner == this);
+      functions_to_cancel.push_back(iter->second->second.function);
+      const net::SpdyPriority priority = iter->second->first;
+      master_->task_queue_.erase(iter->second);
+      master_->ForgetQueueDelayStateIfEmpty(priority);
     }
+    pending_tasks_.clear();
   }
 
   // Unlock while we cancel the functions, so we're not hogging the lock for
@@ -135,18 +242,7 @@ void ThreadPool::ThreadPoolExecutor::Stop() {
        iter != functions_to_cancel.end(); ++iter) {
     (*iter)->CallCancel();
   }
-  // CallCancel deletes the Function objects, invalidating the pointers in this
-  // list, so let's go ahead and clear it (which also saves a little memory
-  // while we're blocked below).
-  functions_to_cancel.clear();
-
-  // Block until all our active tasks are completed.
-  {
-    base::AutoLock autolock(master_->lock_);
-    while (master_->active_task_counts_.count(this) > 0) {
-      stopping_condvar_.Wait();
-    }
-  }
+  return true;
 }
 
 // A WorkerThread object wraps a platform-specific thread handle, and provides
@@ -265,7 +361,18 @@ void ThreadPool::WorkerThread::ThreadMain() {
       task.function->CallRun();
     }
     // Inform the master we have completed the task and are no longer busy.
-    master_->OnTaskComplete(task);
+    // If that was the last running task for an executor that was stopped
+    // asynchronously, run the executor's stop callback (without the lock,
+    // since the callback will likely delete the executor).
+    net_instaweb::Function* stop_callback = master_->OnTaskComplete(task);
+    if (stop_callback != NULL) {
+      {
+        base::AutoUnlock autounlock(master_->lock_);
+        stop_callback->CallRun();
+      }
+      DCHECK_GT(master_->num_pending_stop_callbacks_, 0u);
+      --master_->num_pending_stop_callbacks_;
+    }
   }
 }
 
@@ -274,9 +381,17 @@ ThreadPool::ThreadPool(int min_threads, int max_threads)
       max_threads_(max_threads),
       max_thread_idle_time_(
           base::TimeDelta::FromSeconds(kDefaultMaxWorkerIdleSeconds)),
+      target_queue_delay_(
+          base::TimeDelta::FromMilliseconds(kDefaultTargetQueueDelayMillis)),
+      queue_delay_interval_(
+          base::TimeDelta::FromMilliseconds(kDefaultQueueDelayIntervalMillis)),
       worker_condvar_(&lock_),
       num_busy_workers_(0),
-      shutting_down_(false) {
+      shutting_down_(false),
+      num_pending_stop_callbacks_(0),
+      overloaded_priorities_(0),
+      num_shed_server_pushes_(0),
+      num_shed_low_priority_streams_(0) {
   DCHECK_GE(max_thread_idle_time_.InSecondsF(), 0.0);
   // Note that we check e.g. min_threads rather than min_threads_ (which is
   // unsigned), in order to catch negative numbers.
@@ -290,9 +405,17 @@ ThreadPool::ThreadPool(int min_threads, int max_threads,
     : min_threads_(min_threads),
       max_threads_(max_threads),
       max_thread_idle_time_(max_thread_idle_time),
+      target_queue_delay_(
+          base::TimeDelta::FromMilliseconds(kDefaultTargetQueueDelayMillis)),
+      queue_delay_interval_(
+          base::TimeDelta::FromMilliseconds(kDefaultQueueDelayIntervalMillis)),
       worker_condvar_(&lock_),
       num_busy_workers_(0),
-      shutting_down_(false) {
+      shutting_down_(false),
+      num_pending_stop_callbacks_(0),
+      overloaded_priorities_(0),
+      num_shed_server_pushes_(0),
+      num_shed_low_priority_streams_(0) {
   DCHECK_GE(max_thread_idle_time_.InSecondsF(), 0.0);
   DCHECK_GE(min_threads, 1);
   DCHECK_GE(max_threads, 1);
@@ -303,10 +426,20 @@ ThreadPool::~ThreadPool() {
   base::AutoLock autolock(lock_);
 
   // If we're doing things right, all the Executors should have been
-  // destroyed before the ThreadPool is destroyed, so there should be no
-  // pending or active tasks.
+  // destroyed (or stopped with StopAsync) before the ThreadPool is destroyed,
+  // so there should be no pending tasks.  There may still be active tasks for
+  // asynchronously-stopped executors; a worker only exits once it has
+  // finished its current task and run any stop callback that it handed back,
+  // so joining the workers below will wait for both.
   DCHECK(task_queue_.empty());
-  DCHECK(active_task_counts_.empty());
+
+  const int64 shed_server_pushes = GetNumShedServerPushes();
+  const int64 shed_low_priority_streams = GetNumShedLowPriorityStreams();
+  if (shed_server_pushes > 0 || shed_low_priority_streams > 0) {
+    LOG(INFO) << "Thread pool shed " << shed_server_pushes
+              << " server pushes and " << shed_low_priority_streams
+              << " low-priority streams due to overload";
+  }
 
   // Wake up all the worker threads and tell them to shut down.
   shutting_down_ = true;
@@ -329,6 +462,9 @@ ThreadPool::~ThreadPool() {
   DCHECK(zombies_.empty());
   DCHECK(task_queue_.empty());
   DCHECK(active_task_counts_.empty());
+  // Every asynchronously-stopped executor's callback (e.g. the one that deletes
+  // a finished SpdySession) must have run by now; otherwise it never will.
+  DCHECK_EQ(0u, num_pending_stop_callbacks_);
 }
 
 bool ThreadPool::Start() {
@@ -348,6 +484,16 @@ bool ThreadPool::Start() {
   return true;
 }
 
+void ThreadPool::SetQueueDelayThresholds(base::TimeDelta target,
+                                         base::TimeDelta interval) {
+  base::AutoLock autolock(lock_);
+  DCHECK(workers_.empty());
+  DCHECK_GE(target.InSecondsF(), 0.0);
+  DCHECK_GE(interval.InSecondsF(), 0.0);
+  target_queue_delay_ = target;
+  queue_delay_interval_ = interval;
+}
+
 Executor* ThreadPool::NewExecutor() {
   return new ThreadPoolExecutor(this);
 }
@@ -369,8 +515,16 @@ int ThreadPool::GetNumZombiesForTest() {
   return zombies_.size();
 }
 
+int64 ThreadPool::GetNumShedServerPushes() {
+  return base::subtle::NoBarrier_Load(&num_shed_server_pushes_);
+}
+
+int64 ThreadPool::GetNumShedLowPriorityStreams() {
+  return base::subtle::NoBarrier_Load(&num_shed_low_priority_streams_);
+}
+
 // This method is called each time we add a new task to the thread pool.
-void ThreadPool::StartNewWorkerIfNeeded() {
+bool ThreadPool::StartNewWorkerIfNeeded() {
   lock_.AssertAcquired();
   DCHECK_GE(num_busy_workers_, 0u);
   DCHECK_LE(num_busy_workers_, workers_.size());
@@ -383,17 +537,32 @@ void ThreadPool::StartNewWorkerIfNeeded() {
   // that the idle workers haven't yet had a chance to pick up).
   if (workers_.size() >= max_threads_ ||
       task_queue_.size() <= workers_.size() - num_busy_workers_) {
-    return;
+    return false;
   }
 
   scoped_ptr<WorkerThread> worker(new WorkerThread(this));
   if (worker->Start()) {
     workers_.insert(worker.release());
+    return true;
   } else {
     LOG(ERROR) << "Failed to start new worker thread.";
+    return false;
   }
 }
 
+void ThreadPool::ReapZombies() {
+  lock_.AssertAcquired();
+  if (zombies_.empty()) {
+    return;
+  }
+  std::set<WorkerThread*> zombies;
+  zombies.swap(zombies_);
+  // Joining these threads should be basically instant, since they've already
+  // terminated.  But to be safe, let's unlock while we join them.
+  base::AutoUnlock autounlock(lock_);
+  JoinThreads(zombies);
+}
+
 // static
 void ThreadPool::JoinThreads(const std::set<WorkerThread*>& threads) {
   for (std::set<WorkerThread*>::const_iterator iter = threads.begin();
@@ -448,8 +617,16 @@ ThreadPool::Task ThreadPool::GetNextTask() {
   // task_queue_.begin() gets us the highest-priority pending task.
   DCHECK(!task_queue_.empty());
   TaskQueue::iterator task_iter = task_queue_.begin();
+  const net::SpdyPriority priority = task_iter->first;
   const Task task = task_iter->second;
   task_queue_.erase(task_iter);
+  DCHECK_EQ(1u, task.owner->pending_tasks_.count(task.function));
+  task.owner->pending_tasks_.erase(task.function);
+
+  // Record how long this task spent waiting in the queue.
+  const base::TimeTicks now = base::TimeTicks::Now();
+  UpdateQueueDelayState(priority, now - task.enqueue_time, now);
+  ForgetQueueDelayStateIfEmpty(priority);
 
   // Increment the count of active tasks for the executor that owns this
   // task; we'll decrement it again when the task completes.
@@ -465,7 +642,7 @@ ThreadPool::Task ThreadPool::GetNextTask() {
 // Call to indicate that the task has been completed; update our various
 // counters to indicate that the calling worker is no longer busy executing
 // this task.
-void ThreadPool::OnTaskComplete(Task task) {
+net_instaweb::Function* ThreadPool::OnTaskComplete(Task task) {
   lock_.AssertAcquired();
 
   // The worker that just finished this task is no longer busy.
@@ -480,11 +657,111 @@ void ThreadPool::OnTaskComplete(Task task) {
   --(count_iter->second);
 
   // If this was the last active task for the owner, notify anyone who might be
-  // waiting for the owner to stop.
+  // waiting for the owner to stop, and hand back the owner's stop callback (if
+  // it has one) for the caller to run.
+  net_instaweb::Function* stop_callback = NULL;
   if (count_iter->second == 0) {
     active_task_counts_.erase(count_iter);
     task.owner->stopping_condvar_.Broadcast();
+    stop_callback = task.owner->stop_callback_;
+    task.owner->stop_callback_ = NULL;
   }
+  return stop_callback;
+}
+
+void ThreadPool::UpdateQueueDelayState(net::SpdyPriority priority,
+                                       base::TimeDelta queue_delay,
+                                       base::TimeTicks now) {
+  lock_.AssertAcquired();
+  QueueDelayState* state = &queue_delay_states_[priority];
+
+  // As soon as we see a task that didn't have to wait too long, the priority
+  // is no longer overloaded.
+  if (queue_delay < target_queue_delay_) {
+    if (state->overloaded) {
+      LOG(INFO) << "Priority " << static_cast<int>(priority)
+                << " tasks are no longer overloaded";
+      state->overloaded = false;
+      SetOverloaded(priority, false);
+    }
+    state->first_above_time = base::TimeTicks();
+    return;
+  }
+
+  // Otherwise, the delay is above the target.  If it just now went above the
+  // target, give it an interval to recover; if it has stayed above the target
+  // for a whole interval, start shedding load.
+  if (state->first_above_time.is_null()) {
+    state->first_above_time = now + queue_delay_interval_;
+  } else if (!state->overloaded && now >= state->first_above_time) {
+    LOG(WARNING) << "Priority " << static_cast<int>(priority)
+                 << " tasks are waiting " << queue_delay.InMilliseconds()
+                 << "ms to start; shedding load";
+    state->overloaded = true;
+    SetOverloaded(priority, true);
+  }
+}
+
+void ThreadPool::ObserveOldestQueuedTask(net::SpdyPriority priority,
+                                         base::TimeTicks now) {
+  lock_.AssertAcquired();
+  // Since std::multimap keeps equal keys in insertion order, the oldest task
+  // waiting at this priority is the first one.
+  TaskQueue::const_iterator oldest = task_queue_.lower_bound(priority);
+  if (oldest == task_queue_.end() || oldest->first != priority) {
+    ForgetQueueDelayStateIfEmpty(priority);
+    return;
+  }
+  UpdateQueueDelayState(priority, now - oldest->second.enqueue_time, now);
+}
+
+void ThreadPool::ForgetQueueDelayStateIfEmpty(net::SpdyPriority priority) {
+  lock_.AssertAcquired();
+  TaskQueue::const_iterator oldest = task_queue_.lower_bound(priority);
+  if (oldest == task_queue_.end() || oldest->first != priority) {
+    queue_delay_states_.erase(priority);
+    SetOverloaded(priority, false);
+  }
+}
+
+void ThreadPool::SetOverloaded(net::SpdyPriority priority, bool overloaded) {
+  lock_.AssertAcquired();
+  // Priorities are at most 7, even for HTTP/2 (whose weights we map onto
+  // SPDY/3 priorities), so they all fit in the mask.
+  if (priority >= 32) {
+    return;
+  }
+  const base::subtle::Atomic32 bit = 1 << priority;
+  const base::subtle::Atomic32 old_mask =
+      base::subtle::NoBarrier_Load(&overloaded_priorities_);
+  base::subtle::NoBarrier_Store(&overloaded_priorities_, overloaded ?
+                                (old_mask | bit) : (old_mask & ~bit));
+}
+
+bool ThreadPool::ShouldShed(Executor::SheddableWork work,
+                            net::SpdyPriority priority) {
+  // The queueing delay is measured (with lock_ held) as tasks are added to
+  // and taken from the queue, so all we need to do here is read the result.
+  // A slightly stale answer is fine; it will catch up with the next task.
+  if (priority >= 32 ||
+      (base::subtle::NoBarrier_Load(&overloaded_priorities_) &
+       (1 << priority)) == 0) {
+    return false;
+  }
+
+  switch (work) {
+    case Executor::SERVER_PUSH:
+      base::subtle::NoBarrier_AtomicIncrement(&num_shed_server_pushes_, 1);
+      break;
+    case Executor::LOW_PRIORITY_STREAM:
+      base::subtle::NoBarrier_AtomicIncrement(
+          &num_shed_low_priority_streams_, 1);
+      break;
+    default:
+      LOG(DFATAL) << "Invalid SheddableWork value: " << work;
+      break;
+  }
+  return true;
 }
 
 }  // namespace mod_spdy
@@ -18,23 +18,31 @@
 #include <map>
 #include <set>
 
+#include "base/atomicops.h"
 #include "base/basictypes.h"
 #include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
 #include "base/time/time.h"
+#include "mod_spdy/common/executor.h"
 #include "net/spdy/spdy_protocol.h"  // for net::SpdyPriority
 
 namespace net_instaweb { class Function; }
 
 namespace mod_spdy {
 
-class Executor;
-
 // A ThreadPool keeps a pool of threads waiting to perform tasks.  One can
 // create any number of Executor objects, using the NewExecutor method, which
 // will all share the threads for executing tasks.  If more tasks are queued
 // than there are threads in the pool, these executors will respect task
 // priorities when deciding which tasks to execute first.
+//
+// The thread pool also keeps track of how long tasks at each priority wait in
+// the queue before starting, in the manner of the CoDel queue management
+// algorithm: if the queueing delay for a priority stays above a target delay
+// for at least a full interval, that priority is considered overloaded, and
+// the executors will tell callers to shed speculative or low-priority work at
+// that priority (see Executor::ShouldShed) until the delay drops back below
+// the target.
 class ThreadPool {
  public:
   // Create a new thread pool that uses at least min_threads threads, and at
@@ -50,7 +58,9 @@ class ThreadPool {
 
   // The destructor will block until all threads in the pool have shut down.
   // The ThreadPool must not be destroyed until all Executor objects returned
-  // from the NewExecutor method have first been deleted.
+  // from the NewExecutor method have first been deleted (or stopped with
+  // StopAsync, in which case the destructor will wait for their running tasks
+  // and stop callbacks to finish).
   ~ThreadPool();
 
   // Start up the thread pool.  Must be called exactly one before using the
@@ -58,6 +68,13 @@ class ThreadPool {
   // fails, the ThreadPool must be immediately deleted.
   bool Start();
 
+  // Set the queueing delay that tasks may experience before a priority is
+  // considered overloaded, and how long the delay must stay above that target
+  // before we start shedding load, rather than using the default values (this
+  // is primarily for testing).  Must be called before Start().
+  void SetQueueDelayThresholds(base::TimeDelta target,
+                               base::TimeDelta interval);
+
   // Return a new Executor object that uses this thread pool to perform tasks.
   // The caller gains ownership of the returned Executor, and the ThreadPool
   // must outlive the returned Executor.
@@ -73,26 +90,55 @@ class ThreadPool {
   // reaped.  This is provided for testing purposes only.
   int GetNumZombiesForTest();
 
+  // Return the number of times that an executor has told its caller to shed a
+  // server push or a low-priority stream, respectively, since the thread pool
+  // was created.  These are reported on mod_status's server-status page.
+  int64 GetNumShedServerPushes();
+  int64 GetNumShedLowPriorityStreams();
+
  private:
   class ThreadPoolExecutor;
   class WorkerThread;
 
-  // A Task is a simple pair of the Function to run, and the executor to which
-  // the task was added.
+  // A Task is the Function to run, the executor to which the task was added,
+  // and the time at which it was added (so that we can measure how long it
+  // waited in the queue).
   struct Task {
-    Task(net_instaweb::Function* fun, ThreadPoolExecutor* own)
-        : function(fun), owner(own) {}
+    Task(net_instaweb::Function* fun, ThreadPoolExecutor* own,
+         base::TimeTicks added)
+        : function(fun), owner(own), enqueue_time(added) {}
     net_instaweb::Function* function;
     ThreadPoolExecutor* owner;
+    base::TimeTicks enqueue_time;
+  };
+
+  // The CoDel state for tasks of one priority.  first_above_time is null if
+  // the last observed queueing delay was below the target; otherwise, it is
+  // the time at which we will declare the priority overloaded if the delay
+  // hasn't dropped below the target by then.
+  struct QueueDelayState {
+    QueueDelayState() : overloaded(false) {}
+    base::TimeTicks first_above_time;
+    bool overloaded;
   };
 
   typedef std::multimap<net::SpdyPriority, Task> TaskQueue;
   typedef std::map<const ThreadPoolExecutor*, int> OwnerMap;
+  // Each executor keeps an index of its own tasks in the task queue, so that
+  // it can cancel them without having to scan the whole (shared) queue.
+  typedef std::map<const net_instaweb::Function*, TaskQueue::iterator>
+      PendingTaskMap;
+  typedef std::map<net::SpdyPriority, QueueDelayState> QueueDelayMap;
 
   // Start a new worker thread if 1) the task queue is larger than the number
   // of currently idle workers, and 2) we have fewer than the maximum number of
-  // workers.  Otherwise, do nothing.  Must be holding lock_ when calling this.
-  void StartNewWorkerIfNeeded();
+  // workers.  Otherwise, do nothing.  Return true if a new worker was started.
+  // Must be holding lock_ when calling this.
+  bool StartNewWorkerIfNeeded();
+
+  // Join and delete any zombie threads awaiting cleanup.  Must be holding
+  // lock_ when calling this; the lock is released while joining the threads.
+  void ReapZombies();
 
   // Join and delete all worker threads in the given set.  This will block
   // until all the threads have terminated and been cleaned up, so don't call
@@ -103,7 +149,38 @@ class ThreadPool {
   // be holding lock_ when calling any of these.
   bool TryZombifyIdleThread(WorkerThread* thread);
   Task GetNextTask();
-  void OnTaskComplete(Task task);
+  // Returns the executor's stop callback if this was the last running task
+  // for an executor that was stopped with StopAsync, or NULL otherwise; the
+  // caller must run the callback after releasing the lock.
+  net_instaweb::Function* OnTaskComplete(Task task);
+
+  // Update the CoDel state for the given priority with an observation of a
+  // task that has been waiting in the queue for queue_delay.  Must be holding
+  // lock_ when calling this.
+  void UpdateQueueDelayState(net::SpdyPriority priority,
+                             base::TimeDelta queue_delay,
+                             base::TimeTicks now);
+
+  // Update the CoDel state for the given priority with an observation of the
+  // oldest task still waiting in the queue at that priority, or forget the
+  // state if there is no such task.  Tasks are otherwise only measured when
+  // they leave the queue, so without this we'd never notice tasks being
+  // starved by higher-priority ones.  Must be holding lock_ when calling this.
+  void ObserveOldestQueuedTask(net::SpdyPriority priority,
+                               base::TimeTicks now);
+
+  // Forget the CoDel state for the given priority if no tasks are waiting in
+  // the queue at that priority; as in CoDel, an empty queue can't be
+  // overloaded.  Must be holding lock_ when calling this.
+  void ForgetQueueDelayStateIfEmpty(net::SpdyPriority priority);
+
+  // Publish whether the given priority is overloaded, for ShouldShed to read.
+  // Must be holding lock_ when calling this.
+  void SetOverloaded(net::SpdyPriority priority, bool overloaded);
+
+  // Implementation of ThreadPoolExecutor::ShouldShed.  This is called for
+  // every new low-priority stream and server push, so it does not take lock_.
+  bool ShouldShed(Executor::SheddableWork work, net::SpdyPriority priority);
 
   // The min and max number of threads passed to the constructor.  Although the
   // constructor takes signed ints (for convenience), we store these unsigned
@@ -111,6 +188,8 @@ class ThreadPool {
   const unsigned int min_threads_;
   const unsigned int max_threads_;
   const base::TimeDelta max_thread_idle_time_;
+  base::TimeDelta target_queue_delay_;
+  base::TimeDelta queue_delay_interval_;
   // This single master lock protects all of the below fields, as well as any
   // mutable data and condition variables in the worker threads and executors.
   // Having just one lock makes everything much easier to understand.
@@ -128,6 +207,9 @@ class ThreadPool {
   unsigned int num_busy_workers_;
   // We set this to true to tell the worker threads to terminate.
   bool shutting_down_;
+  // How many asynchronously-stopped executors have stop callbacks that have
+  // not yet finished running.
+  unsigned int num_pending_stop_callbacks_;
   // The priority queue of pending tasks.  Invariant: all Function objects in
   // the queue have neither been started nor cancelled yet.
   TaskQueue task_queue_;
@@ -136,6 +218,17 @@ class ThreadPool {
   // it.  If the number is zero, we remove the entry from the map; thus, as an
   // invariant the map only contains entries for executors with active tasks.
   OwnerMap active_task_counts_;
+  // The CoDel state for each priority that has had tasks in the queue.
+  QueueDelayMap queue_delay_states_;
+
+  // The fields below are not protected by lock_.
+  // A bitmask with bit N set if priority N is currently overloaded.  It is
+  // only written with lock_ held (by SetOverloaded), but ShouldShed reads it
+  // without the lock.
+  base::subtle::Atomic32 overloaded_priorities_;
+  // How many times we've told callers to shed each kind of work.
+  base::subtle::Atomic32 num_shed_server_pushes_;
+  base::subtle::Atomic32 num_shed_low_priority_streams_;
 
   DISALLOW_COPY_AND_ASSIGN(ThreadPool);
 };
@@ -169,6 +169,29 @@ class WaitFunction : public net_instaweb::Function {
   DISALLOW_COPY_AND_ASSIGN(WaitFunction);
 };
 
+// When run, a StopCallback deletes the given executor (as the callback passed
+// to Executor::StopAsync is allowed to do), and then sets the notification.
+class StopCallback : public net_instaweb::Function {
+ public:
+  StopCallback(mod_spdy::Executor* executor,
+               mod_spdy::testing::Notification* notification)
+      : executor_(executor), notification_(notification) {}
+  virtual ~StopCallback() {}
+ protected:
+  // net_instaweb::Function methods:
+  virtual void Run() {
+    delete executor_;
+    notification_->Set();
+  }
+  virtual void Cancel() {
+    ADD_FAILURE() << "StopCallback should never be cancelled";
+  }
+ private:
+  mod_spdy::Executor* const executor_;
+  mod_spdy::testing::Notification* const notification_;
+  DISALLOW_COPY_AND_ASSIGN(StopCallback);
+};
+
 // When run, an IdFunction pushes its ID onto the vector.
 class IdFunction : public net_instaweb::Function {
  public:
@@ -336,4 +359,213 @@ TEST(ThreadPoolTest, CreateAndRetireWorkers) {
   // memory is leaked.
 }
 
+// Test that adding a batch of tasks with AddTasks spawns enough workers to run
+// the tasks concurrently.
+TEST(ThreadPoolTest, AddTasksBatch) {
+  // Create a thread pool with one thread to start with, and room for three.
+  mod_spdy::ThreadPool thread_pool(1, 3);
+  ASSERT_TRUE(thread_pool.Start());
+  scoped_ptr<mod_spdy::Executor> executor(thread_pool.NewExecutor());
+
+  // Add three blocking tasks in one batch.  That should push us up to three
+  // workers immediately, all of which should soon be busy.
+  mod_spdy::testing::Notification done;
+  mod_spdy::Executor::TaskList blocking_tasks;
+  blocking_tasks.push_back(std::make_pair(
+      static_cast<net_instaweb::Function*>(new WaitFunction(&done)), 0));
+  blocking_tasks.push_back(std::make_pair(
+      static_cast<net_instaweb::Function*>(new WaitFunction(&done)), 1));
+  blocking_tasks.push_back(std::make_pair(
+      static_cast<net_instaweb::Function*>(new WaitFunction(&done)), 2));
+  executor->AddTasks(blocking_tasks);
+  EXPECT_EQ(3, thread_pool.GetNumWorkersForTest());
+  ExpectWorkersWithinTimeout(3, 0, &thread_pool, 100);
+
+  // Let the blocking tasks finish; all three workers should go idle.
+  done.Set();
+  ExpectWorkersWithinTimeout(3, 3, &thread_pool, 100);
+}
+
+// Test that a batch of tasks at mixed priorities, added while the only worker
+// is busy, runs in priority order (and FIFO within a priority) once the worker
+// frees up.
+TEST(ThreadPoolTest, AddTasksBatchPriorityOrder) {
+  // Create a thread pool with exactly one thread, so that the order in which
+  // tasks start is the order in which they are pulled from the queue.
+  mod_spdy::ThreadPool thread_pool(1, 1);
+  ASSERT_TRUE(thread_pool.Start());
+  scoped_ptr<mod_spdy::Executor> executor(thread_pool.NewExecutor());
+
+  // Keep the worker busy while we add the batch.
+  mod_spdy::testing::Notification done;
+  executor->AddTask(new WaitFunction(&done), 0);
+  ExpectWorkersWithinTimeout(1, 0, &thread_pool, 100);
+
+  base::Lock lock;
+  base::ConditionVariable condvar(&lock);
+  std::vector<int> ids;  // protected by lock
+  mod_spdy::Executor::TaskList tasks;
+  tasks.push_back(std::make_pair(static_cast<net_instaweb::Function*>(
+      new IdFunction(2, &lock, &condvar, &ids)), 3));
+  tasks.push_back(std::make_pair(static_cast<net_instaweb::Function*>(
+      new IdFunction(0, &lock, &condvar, &ids)), 1));
+  tasks.push_back(std::make_pair(static_cast<net_instaweb::Function*>(
+      new IdFunction(1, &lock, &condvar, &ids)), 1));
+  executor->AddTasks(tasks);
+  {
+    base::AutoLock autolock(lock);
+    EXPECT_TRUE(ids.empty());
+  }
+
+  // Let the blocking task finish, then wait for the batched tasks to run.
+  done.Set();
+  base::AutoLock autolock(lock);
+  while (ids.size() < 3u) {
+    condvar.Wait();
+  }
+  ASSERT_EQ(3u, ids.size());
+  EXPECT_EQ(0, ids[0]);
+  EXPECT_EQ(1, ids[1]);
+  EXPECT_EQ(2, ids[2]);
+}
+
+// Test that tasks added in a batch to a stopped executor are cancelled.
+TEST(ThreadPoolTest, AddTasksAfterStop) {
+  mod_spdy::ThreadPool thread_pool(1, 1);
+  ASSERT_TRUE(thread_pool.Start());
+  scoped_ptr<mod_spdy::Executor> executor(thread_pool.NewExecutor());
+  executor->Stop();
+
+  base::Lock lock;
+  TestFunction::Result result0 = TestFunction::NOTHING;
+  TestFunction::Result result1 = TestFunction::NOTHING;
+  mod_spdy::Executor::TaskList tasks;
+  tasks.push_back(std::make_pair(static_cast<net_instaweb::Function*>(
+      new TestFunction(0, &lock, &result0)), 0));
+  tasks.push_back(std::make_pair(static_cast<net_instaweb::Function*>(
+      new TestFunction(0, &lock, &result1)), 1));
+  executor->AddTasks(tasks);
+
+  base::AutoLock autolock(lock);
+  EXPECT_EQ(TestFunction::CANCELLED, result0);
+  EXPECT_EQ(TestFunction::CANCELLED, result1);
+}
+
+// Test that StopAsync cancels pending tasks right away, but doesn't block
+// waiting for running tasks; instead, the callback runs once they're done.
+TEST(ThreadPoolTest, StopAsync) {
+  mod_spdy::ThreadPool thread_pool(1, 1);
+  ASSERT_TRUE(thread_pool.Start());
+  // The executor will be deleted by the StopCallback.
+  mod_spdy::Executor* executor = thread_pool.NewExecutor();
+
+  // Tie up the only worker, then queue up another task behind it.
+  mod_spdy::testing::Notification done;
+  executor->AddTask(new WaitFunction(&done), 0);
+  ExpectWorkersWithinTimeout(1, 0, &thread_pool, 100);
+  base::Lock lock;
+  TestFunction::Result result = TestFunction::NOTHING;
+  executor->AddTask(new TestFunction(0, &lock, &result), 1);
+
+  // Stopping the executor should immediately cancel the queued task, but the
+  // callback must wait for the running task to finish.
+  mod_spdy::testing::Notification stopped;
+  executor->StopAsync(new StopCallback(executor, &stopped));
+  {
+    base::AutoLock autolock(lock);
+    EXPECT_EQ(TestFunction::CANCELLED, result);
+  }
+  stopped.ExpectNotSet();
+
+  // Once the running task finishes, the callback should run.
+  done.Set();
+  stopped.ExpectSetWithinMillis(100);
+
+  // If no tasks are running, StopAsync should run the callback right away.
+  mod_spdy::testing::Notification stopped_again;
+  executor = thread_pool.NewExecutor();
+  executor->StopAsync(new StopCallback(executor, &stopped_again));
+  stopped_again.ExpectSetWithinMillis(0);
+}
+
+// Test that destroying the thread pool waits for the running tasks of
+// asynchronously-stopped executors, and for their stop callbacks to run.
+TEST(ThreadPoolTest, DestroyPoolAfterStopAsync) {
+  base::Lock lock;
+  TestFunction::Result result = TestFunction::NOTHING;
+  mod_spdy::testing::Notification stopped;
+  {
+    mod_spdy::ThreadPool thread_pool(1, 1);
+    ASSERT_TRUE(thread_pool.Start());
+    // The executor will be deleted by the StopCallback.
+    mod_spdy::Executor* executor = thread_pool.NewExecutor();
+    executor->AddTask(new TestFunction(50, &lock, &result), 0);
+    ExpectWorkersWithinTimeout(1, 0, &thread_pool, 100);
+    executor->StopAsync(new StopCallback(executor, &stopped));
+    stopped.ExpectNotSet();
+  }
+  stopped.ExpectSetWithinMillis(0);
+  base::AutoLock autolock(lock);
+  EXPECT_EQ(TestFunction::RAN, result);
+}
+
+// Test that once tasks at some priority have been waiting in the queue for too
+// long, the executor tells callers to shed work at that priority (and counts
+// it), and stops doing so once the queue drains.
+TEST(ThreadPoolTest, ShedLoadWhenQueueDelayIsHigh) {
+  // Use a thread pool with just one thread, and consider a priority
+  // overloaded after its tasks have waited 20 millis (with no grace interval).
+  mod_spdy::ThreadPool thread_pool(1, 1);
+  thread_pool.SetQueueDelayThresholds(
+      base::TimeDelta::FromMilliseconds(20), base::TimeDelta());
+  ASSERT_TRUE(thread_pool.Start());
+  scoped_ptr<mod_spdy::Executor> executor(thread_pool.NewExecutor());
+
+  // Nothing is queued, so there's no reason to shed anything.
+  EXPECT_FALSE(executor->ShouldShed(mod_spdy::Executor::SERVER_PUSH, 7));
+
+  // Tie up the only worker, then queue up a low-priority task behind it.
+  mod_spdy::testing::Notification done;
+  executor->AddTask(new WaitFunction(&done), 0);
+  ExpectWorkersWithinTimeout(1, 0, &thread_pool, 100);
+  base::Lock lock;
+  TestFunction::Result result0 = TestFunction::NOTHING;
+  TestFunction::Result result1 = TestFunction::NOTHING;
+  TestFunction::Result result2 = TestFunction::NOTHING;
+  executor->AddTask(new TestFunction(0, &lock, &result0), 7);
+
+  // Right away, the queued task hasn't waited long, so don't shed anything.
+  EXPECT_FALSE(executor->ShouldShed(
+      mod_spdy::Executor::LOW_PRIORITY_STREAM, 7));
+
+  // The queueing delay of the oldest waiting task is measured whenever a new
+  // task is added at the same priority.  Once the first task has been waiting
+  // long enough, the first such observation above the target starts the
+  // (zero-length) interval, and the second one puts us into the overloaded
+  // state.  Priorities with no queue are unaffected.
+  base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(50));
+  executor->AddTask(new TestFunction(0, &lock, &result1), 7);
+  EXPECT_FALSE(executor->ShouldShed(
+      mod_spdy::Executor::LOW_PRIORITY_STREAM, 7));
+  executor->AddTask(new TestFunction(0, &lock, &result2), 7);
+  EXPECT_TRUE(executor->ShouldShed(
+      mod_spdy::Executor::LOW_PRIORITY_STREAM, 7));
+  EXPECT_TRUE(executor->ShouldShed(mod_spdy::Executor::SERVER_PUSH, 7));
+  EXPECT_FALSE(executor->ShouldShed(mod_spdy::Executor::SERVER_PUSH, 3));
+  EXPECT_EQ(1, thread_pool.GetNumShedServerPushes());
+  EXPECT_EQ(1, thread_pool.GetNumShedLowPriorityStreams());
+
+  // Let the queue drain; after that, we should stop shedding load.
+  done.Set();
+  ExpectWorkersWithinTimeout(1, 1, &thread_pool, 100);
+  {
+    base::AutoLock autolock(lock);
+    EXPECT_EQ(TestFunction::RAN, result0);
+    EXPECT_EQ(TestFunction::RAN, result1);
+    EXPECT_EQ(TestFunction::RAN, result2);
+  }
+  EXPECT_FALSE(executor->ShouldShed(mod_spdy::Executor::SERVER_PUSH, 7));
+  EXPECT_EQ(1, thread_pool.GetNumShedServerPushes());
+}
+
 }  // namespace
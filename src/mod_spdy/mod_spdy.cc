@@ -17,7 +17,8 @@
 
 #include "mod_spdy/mod_spdy.h"
 
-#include <algorithm>  // for std::min
+#include <algorithm>  // for std::max and std::min
+#include <map>
 
 #include "httpd.h"
 #include "http_connection.h"
@@ -27,6 +28,7 @@
 #include "http_request.h"
 #include "apr_optional.h"
 #include "apr_optional_hooks.h"
+#include "apr_strings.h"
 #include "apr_tables.h"
 
 #include "base/basictypes.h"
@@ -42,6 +44,7 @@
 #include "mod_spdy/apache/log_message_handler.h"
 #include "mod_spdy/apache/master_connection_context.h"
 #include "mod_spdy/apache/pool_util.h"
+#include "mod_spdy/apache/slave_connection.h"
 #include "mod_spdy/apache/slave_connection_context.h"
 #include "mod_spdy/apache/slave_connection_api.h"
 #include "mod_spdy/apache/ssl_util.h"
@@ -52,8 +55,10 @@
 #include "mod_spdy/common/spdy_server_config.h"
 #include "mod_spdy/common/spdy_session.h"
 #include "mod_spdy/common/spdy_stream.h"
+#include "mod_spdy/common/stream_admission_controller.h"
 #include "mod_spdy/common/thread_pool.h"
 #include "mod_spdy/common/version.h"
+#include "net/instaweb/util/public/function.h"
 
 extern "C" {
 
@@ -70,6 +75,11 @@ APR_DECLARE_EXTERNAL_HOOK(modssl, AP, int, npn_proto_negotiated_hook,
                           (conn_rec *connection, const char *proto_name,
                            apr_size_t proto_name_len));
 
+// Declaring mod_status's optional hook here (so that we don't need to
+// #include "mod_status.h").
+APR_DECLARE_EXTERNAL_HOOK(ap, AP, int, status_hook,
+                          (request_rec *r, int flags));
+
 }  // extern "C"
 
 namespace {
@@ -83,11 +93,16 @@ COMPILE_ASSERT(arraysize(kFakeModSpdyProtocolNameNoVersion) <= 255,
                fake_protocol_name_no_version_is_not_too_long_for_npn);
 
 const char* const kHttpProtocolName = "http/1.1";
+const char* const kHttp2ProtocolName = "h2";
 const char* const kSpdy2ProtocolName = "spdy/2";
 const char* const kSpdy3ProtocolName = "spdy/3";
 const char* const kSpdy31ProtocolName = "spdy/3.1";
 const char* const kSpdyVersionEnvironmentVariable = "SPDY_VERSION";
 
+// The flag mod_status passes to its status hook for the machine-readable
+// (?auto) form of the page; this matches AP_STATUS_SHORT in mod_status.h.
+const int kStatusShort = 0x1;
+
 const char* const kPhpModuleNames[] = {
   "php_module",
   "php2_module",
@@ -114,6 +129,21 @@ ap_filter_rec_t* gServerPushDiscoveryFilterHandle = NULL;
 // that they configure SpdyMaxThreadsPerProcess depending on the MPM.
 mod_spdy::ThreadPool* gPerProcessThreadPool = NULL;
 
+// Separate thread pools for those servers that are configured (with
+// SpdyMaxThreadsPerVirtualHost) to have their own, so that slow requests on
+// one virtual host can't tie up the threads needed by another.  This map is
+// initialized by our child-init hook, and is NULL if no server has its own
+// thread pool; SPDY connections to servers not in the map use
+// gPerProcessThreadPool.
+typedef std::map<const server_rec*, mod_spdy::ThreadPool*> ThreadPoolMap;
+ThreadPoolMap* gPerVirtualHostThreadPools = NULL;
+
+// A process-global limit on the number of active SPDY streams, shared by all
+// SPDY connections in this child process.  This is NULL unless
+// SpdyMaxStreamsPerProcess is set.  Like gPerProcessThreadPool, it is
+// initialized by our child-init hook and is thread-safe.
+mod_spdy::StreamAdmissionController* gStreamAdmissionController = NULL;
+
 // Process-global objects used for SPDY server push discovery;
 mod_spdy::ServerPushDiscoveryLearner* gServerPushDiscoveryLearner = NULL;
 mod_spdy::ServerPushDiscoverySessionPool*
@@ -270,10 +300,61 @@ void ChildInit(apr_pool_t* pool, server_rec* server_list) {
     return;
   }
 
-  // Create the per-process thread pool.
+  // Now that all modules' hooks are registered, figure out which
+  // pre-connection hooks our slave connections actually need to run.
+  mod_spdy::SlaveConnection::InitFastPath(pool);
+
+  // Stream tasks use the objects below, and since sessions are stopped
+  // asynchronously (see SpdySession::RunAsync), some may still be running
+  // when the child process exits.  Pool cleanups run in reverse order of
+  // registration, so we create these before any thread pool; that way, the
+  // thread pools are destroyed (joining their workers, and running the
+  // callbacks that delete finished sessions) before these are.
   const int max_threads = top_level_config->max_threads_per_process();
   const int min_threads =
       std::min(max_threads, top_level_config->min_threads_per_process());
+
+  // Create the per-process stream admission controller, if configured.  We
+  // start reducing each connection's MAX_CONCURRENT_STREAMS once there are
+  // more active streams than worker threads (since past that point new
+  // streams just wait in the queue), and refuse streams at the hard limit.
+  // The threads to count are those of every pool that will be created below:
+  // one per server with its own pool, plus the shared one if any server
+  // uses it.
+  const int max_streams = top_level_config->max_streams_per_process();
+  if (max_streams > 0) {
+    int total_threads = 0;
+    bool any_shared = false;
+    for (server_rec* server = server_list; server != NULL;
+         server = server->next) {
+      const mod_spdy::SpdyServerConfig* config =
+          mod_spdy::GetServerConfig(server);
+      if (!config->spdy_enabled()) {
+        continue;
+      }
+      if (config->max_threads_per_virtual_host() > 0) {
+        total_threads += config->max_threads_per_virtual_host();
+      } else {
+        any_shared = true;
+      }
+    }
+    if (any_shared) {
+      total_threads += max_threads;
+    }
+    gStreamAdmissionController = new mod_spdy::StreamAdmissionController(
+        std::max(1, std::min(total_threads, max_streams)), max_streams);
+    mod_spdy::PoolRegisterDelete(pool, gStreamAdmissionController);
+  }
+
+  if (server_push_discovery_enabled) {
+    gServerPushDiscoveryLearner = new mod_spdy::ServerPushDiscoveryLearner;
+    mod_spdy::PoolRegisterDelete(pool, gServerPushDiscoveryLearner);
+    gServerPushDiscoverySessionPool =
+        new mod_spdy::ServerPushDiscoverySessionPool;
+    mod_spdy::PoolRegisterDelete(pool, gServerPushDiscoverySessionPool);
+  }
+
+  // Create the per-process thread pool.
   scoped_ptr<mod_spdy::ThreadPool> thread_pool(
       new mod_spdy::ThreadPool(min_threads, max_threads));
   if (thread_pool->Start()) {
@@ -284,12 +365,30 @@ void ChildInit(apr_pool_t* pool, server_rec* server_list) {
                 << "mod_spdy will not function.";
   }
 
-  if (server_push_discovery_enabled) {
-    gServerPushDiscoveryLearner = new mod_spdy::ServerPushDiscoveryLearner;
-    mod_spdy::PoolRegisterDelete(pool, gServerPushDiscoveryLearner);
-    gServerPushDiscoverySessionPool =
-        new mod_spdy::ServerPushDiscoverySessionPool;
-    mod_spdy::PoolRegisterDelete(pool, gServerPushDiscoverySessionPool);
+  // Create a separate thread pool for each server that wants one.
+  for (server_rec* server = server_list; server != NULL;
+       server = server->next) {
+    const mod_spdy::SpdyServerConfig* config =
+        mod_spdy::GetServerConfig(server);
+    const int max_vhost_threads = config->max_threads_per_virtual_host();
+    if (!config->spdy_enabled() || max_vhost_threads <= 0) {
+      continue;
+    }
+    const int min_vhost_threads =
+        std::min(max_vhost_threads, config->min_threads_per_virtual_host());
+    scoped_ptr<mod_spdy::ThreadPool> vhost_thread_pool(
+        new mod_spdy::ThreadPool(min_vhost_threads, max_vhost_threads));
+    if (!vhost_thread_pool->Start()) {
+      LOG(ERROR) << "Could not create mod_spdy thread pool for "
+                 << server->server_hostname << "; using the shared pool.";
+      continue;
+    }
+    if (gPerVirtualHostThreadPools == NULL) {
+      gPerVirtualHostThreadPools = new ThreadPoolMap;
+      mod_spdy::PoolRegisterDelete(pool, gPerVirtualHostThreadPools);
+    }
+    (*gPerVirtualHostThreadPools)[server] = vhost_thread_pool.get();
+    mod_spdy::PoolRegisterDelete(pool, vhost_thread_pool.release());
   }
 }
 
@@ -401,6 +500,52 @@ int PreConnection(conn_rec* connection, void* csd) {
   }
 }
 
+// Owns the objects that a SPDY session's stream tasks may still be using after
+// the master connection is finished, and deletes them once the last stream
+// task has exited (see SpdySession::RunAsync).
+class SessionDeleter : public net_instaweb::Function {
+ public:
+  // Takes ownership of all three arguments.
+  SessionDeleter(mod_spdy::ApacheSpdyStreamTaskFactory* task_factory,
+                 mod_spdy::Executor* executor,
+                 mod_spdy::SpdySession* session)
+      : task_factory_(task_factory), executor_(executor), session_(session) {}
+  virtual ~SessionDeleter() {}
+
+ protected:
+  // net_instaweb::Function methods:
+  virtual void Run() { DeleteAll(); }
+  virtual void Cancel() { DeleteAll(); }
+
+ private:
+  void DeleteAll() {
+    session_.reset();
+    executor_.reset();
+    task_factory_.reset();
+  }
+
+  scoped_ptr<mod_spdy::ApacheSpdyStreamTaskFactory> task_factory_;
+  scoped_ptr<mod_spdy::Executor> executor_;
+  scoped_ptr<mod_spdy::SpdySession> session_;
+
+  DISALLOW_COPY_AND_ASSIGN(SessionDeleter);
+};
+
+// Return the thread pool that should run the SPDY streams for the given
+// master connection: the connection's virtual host's own thread pool if it has
+// one, or else the shared per-process thread pool (which may be NULL if we
+// failed to create it).
+mod_spdy::ThreadPool* GetThreadPoolForConnection(conn_rec* connection) {
+  if (gPerVirtualHostThreadPools != NULL) {
+    const ThreadPoolMap::const_iterator iter =
+        gPerVirtualHostThreadPools->find(connection->base_server);
+    if (iter != gPerVirtualHostThreadPools->end()) {
+      return iter->second;
+    }
+  }
+  return gPerProcessThreadPool;
+}
+
 // Called to see if we want to take care of processing this connection -- if
 // so, we do so and return OK, otherwise we return DECLINED.  For slave
 // connections, we want to return DECLINED.  For "real" connections, we need to
@@ -439,7 +584,9 @@ int ProcessConnection(conn_rec* connection) {
 
   // In the unlikely event that we failed to create our per-process thread
   // pool, we're not going to be able to operate.
-  if (gPerProcessThreadPool == NULL) {
+  mod_spdy::ThreadPool* const thread_pool =
+      GetThreadPoolForConnection(connection);
+  if (thread_pool == NULL) {
     return DECLINED;
   }
 
@@ -508,14 +655,24 @@ int ProcessConnection(conn_rec* connection) {
   // At this point, we and the client have agreed to use SPDY (either that, or
   // we've been configured to use SPDY regardless of what the client says), so
   // process this as a SPDY master connection.
+  //
+  // The stream tasks don't depend on the master connection (the slave
+  // connection factory copies what it needs), so rather than holding up this
+  // connection thread until the slowest stream task exits, we hand the
+  // session, executor, and task factory off to be deleted when the last stream
+  // task is done.  Only the SpdySessionIO, which the stream tasks never touch,
+  // stays on the stack.
   mod_spdy::ApacheSpdySessionIO session_io(connection);
-  mod_spdy::ApacheSpdyStreamTaskFactory task_factory(connection);
-  scoped_ptr<mod_spdy::Executor> executor(
-      gPerProcessThreadPool->NewExecutor());
-  mod_spdy::SpdySession spdy_session(
-      spdy_version, config, &session_io, &task_factory, executor.get());
-  // This call will block until the session has closed down.
-  spdy_session.Run();
+  mod_spdy::ApacheSpdyStreamTaskFactory* task_factory =
+      new mod_spdy::ApacheSpdyStreamTaskFactory(connection);
+  mod_spdy::Executor* executor = thread_pool->NewExecutor();
+  mod_spdy::SpdySession* spdy_session = new mod_spdy::SpdySession(
+      spdy_version, config, &session_io, task_factory, executor,
+      gStreamAdmissionController);
+  // This call will block until we're done with the connection; the session
+  // may still be cleaning up after its streams when it returns.
+  spdy_session->RunAsync(
+      new SessionDeleter(task_factory, executor, spdy_session));
 
   LOG(INFO) << "Terminating SPDY/" <<
       mod_spdy::SpdyVersionNumberString(spdy_version) << " session";
@@ -529,12 +686,20 @@ int ProcessConnection(conn_rec* connection) {
 int AdvertiseSpdy(conn_rec* connection, apr_array_header_t* protos) {
   // If mod_spdy is disabled on this server, then we shouldn't advertise SPDY
   // to the client.
-  if (!mod_spdy::GetServerConfig(connection)->spdy_enabled()) {
+  const mod_spdy::SpdyServerConfig* config =
+      mod_spdy::GetServerConfig(connection);
+  if (!config->spdy_enabled()) {
     return DECLINED;
   }
 
   // Advertise SPDY to the client.  We push protocol names in descending order
-  // of preference; the one we'd most prefer comes first.
+  // of preference; the one we'd most prefer comes first.  HTTP/2 is only
+  // offered if the server has opted in to it, since we don't enforce its TLS
+  // requirements (RFC 7540 section 9.2), and clients that do will refuse to
+  // talk to servers with weaker cipher suites.
+  if (config->http2_enabled()) {
+    APR_ARRAY_PUSH(protos, const char*) = kHttp2ProtocolName;
+  }
   APR_ARRAY_PUSH(protos, const char*) = kSpdy31ProtocolName;
   APR_ARRAY_PUSH(protos, const char*) = kSpdy3ProtocolName;
   APR_ARRAY_PUSH(protos, const char*) = kSpdy2ProtocolName;
@@ -589,7 +754,9 @@ int OnNextProtocolNegotiated(conn_rec* connection, const char* proto_name,
   mod_spdy::ScopedConnectionLogHandler log_handler(connection);
 
   // If mod_spdy is disabled on this server, then ignore the results of NPN.
-  if (!mod_spdy::GetServerConfig(connection)->spdy_enabled()) {
+  const mod_spdy::SpdyServerConfig* config =
+      mod_spdy::GetServerConfig(connection);
+  if (!config->spdy_enabled()) {
     return DECLINED;
   }
 
@@ -623,7 +790,11 @@ int OnNextProtocolNegotiated(conn_rec* connection, const char* proto_name,
   // If the client chose the SPDY version that we advertised, then mark this
   // connection as using SPDY.
   const base::StringPiece protocol_name(proto_name, proto_name_len);
-  if (protocol_name == kSpdy2ProtocolName) {
+  if (protocol_name == kHttp2ProtocolName && config->http2_enabled()) {
+    master_context->set_npn_state(
+        mod_spdy::MasterConnectionContext::USING_SPDY);
+    master_context->set_spdy_version(mod_spdy::spdy::SPDY_VERSION_HTTP2);
+  } else if (protocol_name == kSpdy2ProtocolName) {
     master_context->set_npn_state(
         mod_spdy::MasterConnectionContext::USING_SPDY);
     master_context->set_spdy_version(mod_spdy::spdy::SPDY_VERSION_2);
@@ -726,6 +897,63 @@ void InsertRequestFilters(request_rec* request) {
         request,                  // request object
         connection);              // connection object
   }
+
+  // If the slave connection wants to capture the response headers straight
+  // from the request_rec, put its filter in place of HTTP_HEADER (which the
+  // HTTP module added when it created the request).  Putting ours at the same
+  // position in the chain means that the filters that should run before
+  // HTTP_HEADER (such as BYTERANGE and CONTENT_LENGTH) still do so.
+  if (slave_context->response_header_filter_handle() != NULL) {
+    for (ap_filter_t* filter = request->output_filters; filter != NULL;
+         filter = filter->next) {
+      if (filter->r == request &&
+          apr_strnatcasecmp(filter->frec->name, "HTTP_HEADER") == 0) {
+        ap_remove_output_filter(filter);
+        ap_add_output_filter_handle(
+            slave_context->response_header_filter_handle(),  // filter handle
+            slave_context->response_header_filter_context(),  // context
+            request,                  // request object
+            connection);              // connection object
+        break;
+      }
+    }
+  }
+}
+
+// Called by mod_status (if it's loaded) as it generates the server-status
+// page, to report how often our thread pools have told sessions to shed load.
+// Like the thread pools themselves, the counts are per child process, so
+// these are the numbers for whichever child serves the status request.
+int StatusHook(request_rec* request, int flags) {
+  if (gPerProcessThreadPool == NULL) {
+    return OK;  // mod_spdy isn't enabled on any server
+  }
+  int64 shed_server_pushes = gPerProcessThreadPool->GetNumShedServerPushes();
+  int64 shed_low_priority_streams =
+      gPerProcessThreadPool->GetNumShedLowPriorityStreams();
+  if (gPerVirtualHostThreadPools != NULL) {
+    for (ThreadPoolMap::const_iterator iter =
+             gPerVirtualHostThreadPools->begin();
+         iter != gPerVirtualHostThreadPools->end(); ++iter) {
+      shed_server_pushes += iter->second->GetNumShedServerPushes();
+      shed_low_priority_streams +=
+          iter->second->GetNumShedLowPriorityStreams();
+    }
+  }
+
+  if (flags & kStatusShort) {
+    ap_rprintf(request, "SpdyShedServerPushes: %" APR_INT64_T_FMT "\n",
+               shed_server_pushes);
+    ap_rprintf(request, "SpdyShedLowPriorityStreams: %" APR_INT64_T_FMT "\n",
+               shed_low_priority_streams);
+  } else {
+    ap_rputs("<hr />\n<h2>mod_spdy (this child process)</h2>\n", request);
+    ap_rprintf(request, "<dl><dt>Server pushes shed: %" APR_INT64_T_FMT
+               "</dt>\n", shed_server_pushes);
+    ap_rprintf(request, "<dt>Low-priority streams shed: %" APR_INT64_T_FMT
+               "</dt></dl>\n", shed_low_priority_streams);
+  }
+  return OK;
 }
 
 apr_status_t InvokeIdPoolDestroyInstance(void*) {
@@ -841,6 +1069,10 @@ void RegisterHooks(apr_pool_t* pool) {
       NULL,                       // successors
       APR_HOOK_MIDDLE);           // position
 
+  // Register a hook with mod_status (if it's loaded) so that the
+  // server-status page shows how much load our thread pools have shed.
+  APR_OPTIONAL_HOOK(ap, status_hook, StatusHook, NULL, NULL, APR_HOOK_MIDDLE);
+
   // Create the various filters that will be used to route bytes to/from us
   // on slave connections.
   mod_spdy::ApacheSpdyStreamTaskFactory::InitFilters();
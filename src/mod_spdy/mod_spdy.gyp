@@ -36,7 +36,17 @@
         '<(DEPTH)/net/net.gyp:spdy',
       ],
       'sources': [
+        'common/backed_data_frame.cc',
         'common/executor.cc',
+        'common/header_block.cc',
+        'common/header_name.cc',
+        'common/hpack_decoder.cc',
+        'common/hpack_encoder.cc',
+        'common/hpack_header_table.cc',
+        'common/hpack_huffman.cc',
+        'common/http2_framer.cc',
+        'common/http_line_scanner.cc',
+        'common/http_request_recorder.cc',
         'common/http_request_visitor_interface.cc',
         'common/http_response_parser.cc',
         'common/http_response_visitor_interface.cc',
@@ -45,7 +55,9 @@
         'common/protocol_util.cc',
         'common/server_push_discovery_learner.cc',
         'common/server_push_discovery_session.cc',
+        'common/session_framer.cc',
         'common/shared_flow_control_window.cc',
+        'common/spdy_frame_pool.cc',
         'common/spdy_frame_priority_queue.cc',
         'common/spdy_frame_queue.cc',
         'common/spdy_server_config.cc',
@@ -53,8 +65,10 @@
         'common/spdy_session.cc',
         'common/spdy_session_io.cc',
         'common/spdy_stream.cc',
+        'common/spdy_stream_table.cc',
         'common/spdy_stream_task_factory.cc',
         'common/spdy_to_http_converter.cc',
+        'common/stream_admission_controller.cc',
         'common/thread_pool.cc',
       ],
     },
@@ -87,6 +101,7 @@
         'apache/filters/spdy_to_http_filter.cc',
         'apache/id_pool.cc',
         'apache/log_message_handler.cc',
+        'apache/mapped_file_region.cc',
         'apache/master_connection_context.cc',
         'apache/pool_util.cc',
         'apache/sockaddr_util.cc',
@@ -159,17 +174,29 @@
         '<(DEPTH)',
       ],
       'sources': [
+        'common/header_block_test.cc',
+        'common/header_name_test.cc',
+        'common/hpack_decoder_test.cc',
+        'common/hpack_encoder_test.cc',
+        'common/hpack_header_table_test.cc',
+        'common/hpack_huffman_test.cc',
+        'common/http2_framer_test.cc',
+        'common/http_line_scanner_test.cc',
+        'common/http_request_recorder_test.cc',
         'common/http_response_parser_test.cc',
         'common/http_to_spdy_converter_test.cc',
         'common/protocol_util_test.cc',
         'common/server_push_discovery_learner_test.cc',
         'common/server_push_discovery_session_test.cc',
         'common/shared_flow_control_window_test.cc',
+        'common/spdy_frame_pool_test.cc',
         'common/spdy_frame_priority_queue_test.cc',
         'common/spdy_frame_queue_test.cc',
         'common/spdy_session_test.cc',
         'common/spdy_stream_test.cc',
+        'common/spdy_stream_table_test.cc',
         'common/spdy_to_http_converter_test.cc',
+        'common/stream_admission_controller_test.cc',
         'common/thread_pool_test.cc',
       ],
     },
@@ -189,13 +216,16 @@
         '<(DEPTH)',
       ],
       'sources': [
+        'apache/apache_spdy_stream_task_factory_test.cc',
         'apache/filters/http_to_spdy_filter_test.cc',
         'apache/filters/server_push_discovery_filter_test.cc',
         'apache/filters/server_push_filter_test.cc',
         'apache/filters/spdy_to_http_filter_test.cc',
         'apache/id_pool_test.cc',
+        'apache/mapped_file_region_test.cc',
         'apache/pool_util_test.cc',
         'apache/sockaddr_util_test.cc',
+        'apache/testing/dummy_httpd.cc',
         'apache/testing/dummy_util_filter.cc',
         'apache/testing/spdy_apache_test_main.cc',
       ],